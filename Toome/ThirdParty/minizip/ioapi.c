@@ -14,6 +14,10 @@
         #define _CRT_SECURE_NO_WARNINGS
 #endif
 
+#if defined(__linux__) && !defined(_GNU_SOURCE) && !defined(IOAPI_NO_COPY_FILE_RANGE)
+        #define _GNU_SOURCE     /* for copy_file_range */
+#endif
+
 #if defined(__APPLE__) || defined(IOAPI_NO_64) || defined(__HAIKU__) || defined(MINIZIP_FOPEN_NO_64)
 // In darwin and perhaps other BSD variants off_t is a 64 bit value, hence no need for specific 64 bit functions
 #define FOPEN_FUNC(filename, mode) fopen(filename, mode)
@@ -28,6 +32,39 @@
 
 #include "ioapi.h"
 
+#if !defined(_WIN32) && !defined(IOAPI_NO_MMAP)
+#include <string.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define IOAPI_HAVE_MMAP
+#endif
+
+#if !defined(_WIN32)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define IOAPI_HAVE_FSTAT
+#define IOAPI_HAVE_FTRUNCATE
+#endif
+
+#if defined(__linux__) && !defined(IOAPI_NO_COPY_FILE_RANGE) && \
+    defined(__GLIBC__) && ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 27)))
+#include <errno.h>
+#include <unistd.h>
+#define IOAPI_HAVE_COPY_FILE_RANGE
+#endif
+
+#if !defined(_WIN32) && !defined(IOAPI_NO_PREAD)
+#include <stdlib.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define IOAPI_HAVE_PREAD
+#endif
+
 voidpf call_zopen64 (const zlib_filefunc64_32_def* pfilefunc, const void*filename, int mode) {
     if (pfilefunc->zfile_func64.zopen64_file != NULL)
         return (*(pfilefunc->zfile_func64.zopen64_file)) (pfilefunc->zfile_func64.opaque,filename,mode);
@@ -63,6 +100,49 @@ ZPOS64_T call_ztell64 (const zlib_filefunc64_32_def* pfilefunc, voidpf filestrea
     }
 }
 
+const void* call_zmap64 (const zlib_filefunc64_32_def* pfilefunc, voidpf filestream, ZPOS64_T offset, ZPOS64_T size) {
+    if (ZEXT64(*pfilefunc,zmap64_file) == NULL)
+        return NULL;
+    return (*(pfilefunc->zfile_func64.zmap64_file)) (pfilefunc->zfile_func64.opaque,filestream,offset,size);
+}
+
+uLong call_zread_at64 (const zlib_filefunc64_32_def* pfilefunc, voidpf filestream, ZPOS64_T offset, void* buf, uLong size) {
+    if (ZEXT64(*pfilefunc,zread_at64_file) != NULL)
+        return (*(pfilefunc->zfile_func64.zread_at64_file)) (pfilefunc->zfile_func64.opaque,filestream,offset,buf,size);
+    if (call_zseek64(pfilefunc,filestream,offset,ZLIB_FILEFUNC_SEEK_SET) != 0)
+        return 0;
+    return (*(pfilefunc->zfile_func64.zread_file)) (pfilefunc->zfile_func64.opaque,filestream,buf,size);
+}
+
+ZPOS64_T call_zmtime64 (const zlib_filefunc64_32_def* pfilefunc, voidpf filestream) {
+    if (ZEXT64(*pfilefunc,zmtime64_file) == NULL)
+        return 0;
+    return (*(pfilefunc->zfile_func64.zmtime64_file)) (pfilefunc->zfile_func64.opaque,filestream);
+}
+
+int call_ztruncate64 (const zlib_filefunc64_32_def* pfilefunc, voidpf filestream, ZPOS64_T size) {
+    if (ZEXT64(*pfilefunc,ztruncate64_file) == NULL)
+        return -1;
+    return (*(pfilefunc->zfile_func64.ztruncate64_file)) (pfilefunc->zfile_func64.opaque,filestream,size);
+}
+
+ZPOS64_T call_zcopy64 (const zlib_filefunc64_32_def* pfilefunc, voidpf filestream_to, ZPOS64_T offset_to,
+                       voidpf filestream_from, ZPOS64_T offset_from, ZPOS64_T size) {
+    if (ZEXT64(*pfilefunc,zcopy64_file) == NULL)
+        return 0;
+    return (*(pfilefunc->zfile_func64.zcopy64_file)) (pfilefunc->zfile_func64.opaque,filestream_to,offset_to,
+                                                      filestream_from,offset_from,size);
+}
+
+void init_filefunc64_ext(zlib_filefunc64_def* pzlib_filefunc_def) {
+    pzlib_filefunc_def->zext_magic = ZLIB_FILEFUNC64_EXT_MAGIC;
+    pzlib_filefunc_def->zmap64_file = NULL;
+    pzlib_filefunc_def->zread_at64_file = NULL;
+    pzlib_filefunc_def->zmtime64_file = NULL;
+    pzlib_filefunc_def->ztruncate64_file = NULL;
+    pzlib_filefunc_def->zcopy64_file = NULL;
+}
+
 void fill_zlib_filefunc64_32_def_from_filefunc32(zlib_filefunc64_32_def* p_filefunc64_32, const zlib_filefunc_def* p_filefunc32) {
     p_filefunc64_32->zfile_func64.zopen64_file = NULL;
     p_filefunc64_32->zopen32_file = p_filefunc32->zopen_file;
@@ -73,6 +153,7 @@ void fill_zlib_filefunc64_32_def_from_filefunc32(zlib_filefunc64_32_def* p_filef
     p_filefunc64_32->zfile_func64.zclose_file = p_filefunc32->zclose_file;
     p_filefunc64_32->zfile_func64.zerror_file = p_filefunc32->zerror_file;
     p_filefunc64_32->zfile_func64.opaque = p_filefunc32->opaque;
+    init_filefunc64_ext(&p_filefunc64_32->zfile_func64);
     p_filefunc64_32->zseek32_file = p_filefunc32->zseek_file;
     p_filefunc64_32->ztell32_file = p_filefunc32->ztell_file;
 }
@@ -208,6 +289,58 @@ static int ZCALLBACK ferror_file_func(voidpf opaque, voidpf stream) {
     return ret;
 }
 
+#ifdef IOAPI_HAVE_FSTAT
+static ZPOS64_T ZCALLBACK fmtime64_file_func(voidpf opaque, voidpf stream) {
+    struct stat st;
+    (void)opaque;
+    if (fstat(fileno((FILE *)stream), &st) != 0)
+        return 0;
+    return (ZPOS64_T)st.st_mtime;
+}
+#endif
+
+#ifdef IOAPI_HAVE_FTRUNCATE
+static int ZCALLBACK ftruncate64_file_func(voidpf opaque, voidpf stream, ZPOS64_T size) {
+    (void)opaque;
+    if ((ZPOS64_T)(off_t)size != size)
+        return -1;
+    if (fflush((FILE *)stream) != 0)
+        return -1;
+    return ftruncate(fileno((FILE *)stream), (off_t)size);
+}
+#endif
+
+#ifdef IOAPI_HAVE_COPY_FILE_RANGE
+/* copy_file_range between two file descriptors, as far as the kernel can */
+static ZPOS64_T copy_file_range_fd(int fd_to, ZPOS64_T offset_to, int fd_from, ZPOS64_T offset_from, ZPOS64_T size) {
+    ZPOS64_T done = 0;
+    if (((ZPOS64_T)(off_t)(offset_to + size) != offset_to + size) ||
+        ((ZPOS64_T)(off_t)(offset_from + size) != offset_from + size))
+        return 0;
+    while (done < size)
+    {
+        loff_t off_from = (loff_t)(offset_from + done);
+        loff_t off_to = (loff_t)(offset_to + done);
+        size_t copy_this = (size - done > 0x40000000) ? 0x40000000 : (size_t)(size - done);
+        ssize_t copied = copy_file_range(fd_from, &off_from, fd_to, &off_to, copy_this, 0);
+        if (copied <= 0)
+            break;
+        done += (ZPOS64_T)copied;
+    }
+    return done;
+}
+
+static ZPOS64_T ZCALLBACK fcopy64_file_func(voidpf opaque, voidpf stream_to, ZPOS64_T offset_to,
+                                            voidpf stream_from, ZPOS64_T offset_from, ZPOS64_T size) {
+    (void)opaque;
+    /* the data written in the stdio buffers must be in the files */
+    if ((fflush((FILE *)stream_to) != 0) || (fflush((FILE *)stream_from) != 0))
+        return 0;
+    return copy_file_range_fd(fileno((FILE *)stream_to), offset_to,
+                              fileno((FILE *)stream_from), offset_from, size);
+}
+#endif
+
 void fill_fopen_filefunc(zlib_filefunc_def* pzlib_filefunc_def) {
     pzlib_filefunc_def->zopen_file = fopen_file_func;
     pzlib_filefunc_def->zread_file = fread_file_func;
@@ -228,4 +361,371 @@ void fill_fopen64_filefunc(zlib_filefunc64_def* pzlib_filefunc_def) {
     pzlib_filefunc_def->zclose_file = fclose_file_func;
     pzlib_filefunc_def->zerror_file = ferror_file_func;
     pzlib_filefunc_def->opaque = NULL;
+    pzlib_filefunc_def->zext_magic = ZLIB_FILEFUNC64_EXT_MAGIC;
+    pzlib_filefunc_def->zmap64_file = NULL;
+    pzlib_filefunc_def->zread_at64_file = NULL;
+#ifdef IOAPI_HAVE_FSTAT
+    pzlib_filefunc_def->zmtime64_file = fmtime64_file_func;
+#else
+    pzlib_filefunc_def->zmtime64_file = NULL;
+#endif
+#ifdef IOAPI_HAVE_FTRUNCATE
+    pzlib_filefunc_def->ztruncate64_file = ftruncate64_file_func;
+#else
+    pzlib_filefunc_def->ztruncate64_file = NULL;
+#endif
+#ifdef IOAPI_HAVE_COPY_FILE_RANGE
+    pzlib_filefunc_def->zcopy64_file = fcopy64_file_func;
+#else
+    pzlib_filefunc_def->zcopy64_file = NULL;
+#endif
 }
+
+
+#ifdef IOAPI_HAVE_MMAP
+
+typedef struct
+{
+    unsigned char* base;        /* mapping of the whole file, NULL if empty */
+    ZPOS64_T size;
+    ZPOS64_T pos;
+    ZPOS64_T mtime;
+} mmap_file_s;
+
+static voidpf ZCALLBACK mmap64_open_file_func(voidpf opaque, const void* filename, int mode) {
+    mmap_file_s* file;
+    struct stat st;
+    int fd;
+    (void)opaque;
+    if ((filename==NULL) || ((mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER)!=ZLIB_FILEFUNC_MODE_READ))
+        return NULL;
+
+    fd = open((const char*)filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    file = (mmap_file_s*)malloc(sizeof(mmap_file_s));
+    if ((file == NULL) || (fstat(fd, &st) != 0) || ((size_t)st.st_size != (ZPOS64_T)st.st_size))
+    {
+        free(file);
+        close(fd);
+        return NULL;
+    }
+    file->base = NULL;
+    file->size = (ZPOS64_T)st.st_size;
+    file->pos = 0;
+    file->mtime = (ZPOS64_T)st.st_mtime;
+    if (file->size > 0)
+    {
+        void* base = mmap(NULL, (size_t)file->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED)
+        {
+            free(file);
+            close(fd);
+            return NULL;
+        }
+        file->base = (unsigned char*)base;
+    }
+    close(fd);
+    return file;
+}
+
+static uLong ZCALLBACK mmap_read_file_func(voidpf opaque, voidpf stream, void* buf, uLong size) {
+    mmap_file_s* file = (mmap_file_s*)stream;
+    (void)opaque;
+    if (file->pos >= file->size)
+        return 0;
+    if (size > file->size - file->pos)
+        size = (uLong)(file->size - file->pos);
+    memcpy(buf, file->base + file->pos, size);
+    file->pos += size;
+    return size;
+}
+
+static uLong ZCALLBACK mmap_write_file_func(voidpf opaque, voidpf stream, const void* buf, uLong size) {
+    (void)opaque;
+    (void)stream;
+    (void)buf;
+    (void)size;
+    return 0;
+}
+
+static ZPOS64_T ZCALLBACK mmap_tell64_file_func(voidpf opaque, voidpf stream) {
+    (void)opaque;
+    return ((mmap_file_s*)stream)->pos;
+}
+
+static long ZCALLBACK mmap_seek64_file_func(voidpf opaque, voidpf stream, ZPOS64_T offset, int origin) {
+    mmap_file_s* file = (mmap_file_s*)stream;
+    (void)opaque;
+    switch (origin)
+    {
+    case ZLIB_FILEFUNC_SEEK_CUR :
+        file->pos += offset;
+        break;
+    case ZLIB_FILEFUNC_SEEK_END :
+        file->pos = file->size + offset;
+        break;
+    case ZLIB_FILEFUNC_SEEK_SET :
+        file->pos = offset;
+        break;
+    default: return -1;
+    }
+    return 0;
+}
+
+static int ZCALLBACK mmap_close_file_func(voidpf opaque, voidpf stream) {
+    mmap_file_s* file = (mmap_file_s*)stream;
+    int ret = 0;
+    (void)opaque;
+    if (file->base != NULL)
+        ret = munmap(file->base, (size_t)file->size);
+    free(file);
+    return ret;
+}
+
+static int ZCALLBACK mmap_error_file_func(voidpf opaque, voidpf stream) {
+    (void)opaque;
+    (void)stream;
+    return 0;
+}
+
+static uLong ZCALLBACK mmap_read_at64_file_func(voidpf opaque, voidpf stream, ZPOS64_T offset, void* buf, uLong size) {
+    mmap_file_s* file = (mmap_file_s*)stream;
+    (void)opaque;
+    if (offset >= file->size)
+        return 0;
+    if (size > file->size - offset)
+        size = (uLong)(file->size - offset);
+    memcpy(buf, file->base + offset, size);
+    return size;
+}
+
+static const void* ZCALLBACK mmap_map64_file_func(voidpf opaque, voidpf stream, ZPOS64_T offset, ZPOS64_T size) {
+    mmap_file_s* file = (mmap_file_s*)stream;
+    (void)opaque;
+    if ((file->base == NULL) || (offset > file->size) || (size > file->size - offset))
+        return NULL;
+    return file->base + offset;
+}
+
+static ZPOS64_T ZCALLBACK mmap_mtime64_file_func(voidpf opaque, voidpf stream) {
+    (void)opaque;
+    return ((mmap_file_s*)stream)->mtime;
+}
+
+void fill_mmap64_filefunc(zlib_filefunc64_def* pzlib_filefunc_def) {
+    pzlib_filefunc_def->zopen64_file = mmap64_open_file_func;
+    pzlib_filefunc_def->zread_file = mmap_read_file_func;
+    pzlib_filefunc_def->zwrite_file = mmap_write_file_func;
+    pzlib_filefunc_def->ztell64_file = mmap_tell64_file_func;
+    pzlib_filefunc_def->zseek64_file = mmap_seek64_file_func;
+    pzlib_filefunc_def->zclose_file = mmap_close_file_func;
+    pzlib_filefunc_def->zerror_file = mmap_error_file_func;
+    pzlib_filefunc_def->opaque = NULL;
+    pzlib_filefunc_def->zext_magic = ZLIB_FILEFUNC64_EXT_MAGIC;
+    pzlib_filefunc_def->zmap64_file = mmap_map64_file_func;
+    pzlib_filefunc_def->zread_at64_file = mmap_read_at64_file_func;
+    pzlib_filefunc_def->zmtime64_file = mmap_mtime64_file_func;
+    pzlib_filefunc_def->ztruncate64_file = NULL;
+    pzlib_filefunc_def->zcopy64_file = NULL;
+}
+
+#else
+
+void fill_mmap64_filefunc(zlib_filefunc64_def* pzlib_filefunc_def) {
+    fill_fopen64_filefunc(pzlib_filefunc_def);
+}
+
+#endif
+
+
+#ifdef IOAPI_HAVE_PREAD
+
+typedef struct
+{
+    int fd;
+    int error;
+} pread_file_s;
+
+static voidpf ZCALLBACK pread64_open_file_func(voidpf opaque, const void* filename, int mode) {
+    pread_file_s* file;
+    int flags;
+    int fd;
+    (void)opaque;
+    if (filename == NULL)
+        return NULL;
+
+    if ((mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER)==ZLIB_FILEFUNC_MODE_READ)
+        flags = O_RDONLY;
+    else if (mode & ZLIB_FILEFUNC_MODE_EXISTING)
+        flags = O_RDWR;
+    else if (mode & ZLIB_FILEFUNC_MODE_CREATE)
+        flags = O_RDWR | O_CREAT | O_TRUNC;
+    else
+        return NULL;
+
+    fd = open((const char*)filename, flags, 0666);
+    if (fd < 0)
+        return NULL;
+    file = (pread_file_s*)malloc(sizeof(pread_file_s));
+    if (file == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+    file->fd = fd;
+    file->error = 0;
+    return file;
+}
+
+static uLong ZCALLBACK pread_read_file_func(voidpf opaque, voidpf stream, void* buf, uLong size) {
+    pread_file_s* file = (pread_file_s*)stream;
+    uLong done = 0;
+    (void)opaque;
+    while (done < size)
+    {
+        ssize_t got = read(file->fd, (char*)buf + done, (size_t)(size - done));
+        if (got <= 0)
+        {
+            if (got < 0)
+                file->error = 1;
+            break;
+        }
+        done += (uLong)got;
+    }
+    return done;
+}
+
+static uLong ZCALLBACK pread_read_at64_file_func(voidpf opaque, voidpf stream, ZPOS64_T offset, void* buf, uLong size) {
+    pread_file_s* file = (pread_file_s*)stream;
+    uLong done = 0;
+    (void)opaque;
+    if ((ZPOS64_T)(off_t)offset != offset)
+        return 0;
+    while (done < size)
+    {
+        ssize_t got = pread(file->fd, (char*)buf + done, (size_t)(size - done), (off_t)(offset + done));
+        if (got <= 0)
+        {
+            if (got < 0)
+                file->error = 1;
+            break;
+        }
+        done += (uLong)got;
+    }
+    return done;
+}
+
+static uLong ZCALLBACK pread_write_file_func(voidpf opaque, voidpf stream, const void* buf, uLong size) {
+    pread_file_s* file = (pread_file_s*)stream;
+    uLong done = 0;
+    (void)opaque;
+    while (done < size)
+    {
+        ssize_t written = write(file->fd, (const char*)buf + done, (size_t)(size - done));
+        if (written <= 0)
+        {
+            file->error = 1;
+            break;
+        }
+        done += (uLong)written;
+    }
+    return done;
+}
+
+static ZPOS64_T ZCALLBACK pread_tell64_file_func(voidpf opaque, voidpf stream) {
+    off_t pos = lseek(((pread_file_s*)stream)->fd, 0, SEEK_CUR);
+    (void)opaque;
+    return (pos < 0) ? (ZPOS64_T)-1 : (ZPOS64_T)pos;
+}
+
+static long ZCALLBACK pread_seek64_file_func(voidpf opaque, voidpf stream, ZPOS64_T offset, int origin) {
+    pread_file_s* file = (pread_file_s*)stream;
+    int whence;
+    (void)opaque;
+    switch (origin)
+    {
+    case ZLIB_FILEFUNC_SEEK_CUR :
+        whence = SEEK_CUR;
+        break;
+    case ZLIB_FILEFUNC_SEEK_END :
+        whence = SEEK_END;
+        break;
+    case ZLIB_FILEFUNC_SEEK_SET :
+        whence = SEEK_SET;
+        break;
+    default: return -1;
+    }
+    if ((ZPOS64_T)(off_t)offset != offset)
+        return -1;
+    if (lseek(file->fd, (off_t)offset, whence) < 0)
+        return -1;
+    return 0;
+}
+
+static int ZCALLBACK pread_close_file_func(voidpf opaque, voidpf stream) {
+    pread_file_s* file = (pread_file_s*)stream;
+    int ret;
+    (void)opaque;
+    ret = close(file->fd);
+    free(file);
+    return ret;
+}
+
+static int ZCALLBACK pread_error_file_func(voidpf opaque, voidpf stream) {
+    (void)opaque;
+    return ((pread_file_s*)stream)->error;
+}
+
+static ZPOS64_T ZCALLBACK pread_mtime64_file_func(voidpf opaque, voidpf stream) {
+    struct stat st;
+    (void)opaque;
+    if (fstat(((pread_file_s*)stream)->fd, &st) != 0)
+        return 0;
+    return (ZPOS64_T)st.st_mtime;
+}
+
+static int ZCALLBACK pread_truncate64_file_func(voidpf opaque, voidpf stream, ZPOS64_T size) {
+    (void)opaque;
+    if ((ZPOS64_T)(off_t)size != size)
+        return -1;
+    return ftruncate(((pread_file_s*)stream)->fd, (off_t)size);
+}
+
+#ifdef IOAPI_HAVE_COPY_FILE_RANGE
+static ZPOS64_T ZCALLBACK pread_copy64_file_func(voidpf opaque, voidpf stream_to, ZPOS64_T offset_to,
+                                                 voidpf stream_from, ZPOS64_T offset_from, ZPOS64_T size) {
+    (void)opaque;
+    return copy_file_range_fd(((pread_file_s*)stream_to)->fd, offset_to,
+                              ((pread_file_s*)stream_from)->fd, offset_from, size);
+}
+#endif
+
+void fill_pread64_filefunc(zlib_filefunc64_def* pzlib_filefunc_def) {
+    pzlib_filefunc_def->zopen64_file = pread64_open_file_func;
+    pzlib_filefunc_def->zread_file = pread_read_file_func;
+    pzlib_filefunc_def->zwrite_file = pread_write_file_func;
+    pzlib_filefunc_def->ztell64_file = pread_tell64_file_func;
+    pzlib_filefunc_def->zseek64_file = pread_seek64_file_func;
+    pzlib_filefunc_def->zclose_file = pread_close_file_func;
+    pzlib_filefunc_def->zerror_file = pread_error_file_func;
+    pzlib_filefunc_def->opaque = NULL;
+    pzlib_filefunc_def->zext_magic = ZLIB_FILEFUNC64_EXT_MAGIC;
+    pzlib_filefunc_def->zmap64_file = NULL;
+    pzlib_filefunc_def->zread_at64_file = pread_read_at64_file_func;
+    pzlib_filefunc_def->zmtime64_file = pread_mtime64_file_func;
+    pzlib_filefunc_def->ztruncate64_file = pread_truncate64_file_func;
+#ifdef IOAPI_HAVE_COPY_FILE_RANGE
+    pzlib_filefunc_def->zcopy64_file = pread_copy64_file_func;
+#else
+    pzlib_filefunc_def->zcopy64_file = NULL;
+#endif
+}
+
+#else
+
+void fill_pread64_filefunc(zlib_filefunc64_def* pzlib_filefunc_def) {
+    fill_fopen64_filefunc(pzlib_filefunc_def);
+}
+
+#endif
@@ -161,6 +161,38 @@ typedef ZPOS64_T (ZCALLBACK *tell64_file_func)    (voidpf opaque, voidpf stream)
 typedef long     (ZCALLBACK *seek64_file_func)    (voidpf opaque, voidpf stream, ZPOS64_T offset, int origin);
 typedef voidpf   (ZCALLBACK *open64_file_func)    (voidpf opaque, const void* filename, int mode);
 
+/* return a pointer to the size bytes at offset in the file, valid until the
+   stream is closed, or NULL if they can't be accessed without a copy */
+typedef const void* (ZCALLBACK *map64_file_func)  (voidpf opaque, voidpf stream, ZPOS64_T offset, ZPOS64_T size);
+
+/* read size bytes at offset without using nor changing the position of the
+   stream (like pread), so it can be called by several threads at once */
+typedef uLong    (ZCALLBACK *read_at64_file_func) (voidpf opaque, voidpf stream, ZPOS64_T offset, void* buf, uLong size);
+
+/* return the modification time of the file, in any unit (it is only compared
+   with a time given before by the same function), or 0 if it is not known */
+typedef ZPOS64_T (ZCALLBACK *mtime64_file_func)   (voidpf opaque, voidpf stream);
+
+/* cut the file at size bytes, return 0 if done */
+typedef int      (ZCALLBACK *truncate64_file_func) (voidpf opaque, voidpf stream, ZPOS64_T size);
+
+/* copy size bytes at offset_from in stream_from to offset_to in stream_to,
+   two streams opened by the same io functions, without a copy in user
+   memory (like copy_file_range) and without using nor changing the
+   positions of the streams. The two ranges don't overlap. Return the number
+   of bytes copied, less than size if the rest must be copied by the caller */
+typedef ZPOS64_T (ZCALLBACK *copy64_file_func)    (voidpf opaque, voidpf stream_to, ZPOS64_T offset_to,
+                                                   voidpf stream_from, ZPOS64_T offset_from, ZPOS64_T size);
+
+/* value of zext_magic when the optional functions after it are set */
+#define ZLIB_FILEFUNC64_EXT_MAGIC (0x7a657831)
+
+/* The functions after zext_magic were added to this structure later. A
+   zlib_filefunc64_def filled by hand must be zeroed first, or given to
+   init_filefunc64_ext once its first functions and opaque are set:
+   the optional functions are only used when zext_magic is
+   ZLIB_FILEFUNC64_EXT_MAGIC, so older code filling the structure field by
+   field keeps working without them. */
 typedef struct zlib_filefunc64_def_s
 {
     open64_file_func    zopen64_file;
@@ -171,11 +203,30 @@ typedef struct zlib_filefunc64_def_s
     close_file_func     zclose_file;
     testerror_file_func zerror_file;
     voidpf              opaque;
+    uLong               zext_magic;     /* ZLIB_FILEFUNC64_EXT_MAGIC, or the functions below are ignored */
+    map64_file_func     zmap64_file;    /* optional, NULL if not supported */
+    read_at64_file_func zread_at64_file; /* optional, NULL to seek then read */
+    mtime64_file_func   zmtime64_file;  /* optional, NULL if not known */
+    truncate64_file_func ztruncate64_file; /* optional, NULL if not supported */
+    copy64_file_func    zcopy64_file;   /* optional, NULL to read then write */
 } zlib_filefunc64_def;
 
 void fill_fopen64_filefunc(zlib_filefunc64_def* pzlib_filefunc_def);
 void fill_fopen_filefunc(zlib_filefunc_def* pzlib_filefunc_def);
 
+/* Set the optional functions of a structure filled by hand to NULL and mark
+   them valid, so that some of them can be set afterwards */
+void init_filefunc64_ext(zlib_filefunc64_def* pzlib_filefunc_def);
+
+/* Read only backend mapping the whole file in memory (mmap), reads are served
+   from the mapping and zmap64_file gives direct access to it.
+   Where mmap is not available this is the same than fill_fopen64_filefunc */
+void fill_mmap64_filefunc(zlib_filefunc64_def* pzlib_filefunc_def);
+
+/* Backend on a POSIX file descriptor, with zread_at64_file done by pread.
+   Where pread is not available this is the same than fill_fopen64_filefunc */
+void fill_pread64_filefunc(zlib_filefunc64_def* pzlib_filefunc_def);
+
 /* now internal definition, only for zip.c and unzip.h */
 typedef struct zlib_filefunc64_32_def_s
 {
@@ -196,12 +247,27 @@ typedef struct zlib_filefunc64_32_def_s
 voidpf call_zopen64(const zlib_filefunc64_32_def* pfilefunc,const void*filename,int mode);
 long call_zseek64(const zlib_filefunc64_32_def* pfilefunc,voidpf filestream, ZPOS64_T offset, int origin);
 ZPOS64_T call_ztell64(const zlib_filefunc64_32_def* pfilefunc,voidpf filestream);
+const void* call_zmap64(const zlib_filefunc64_32_def* pfilefunc,voidpf filestream, ZPOS64_T offset, ZPOS64_T size);
+uLong call_zread_at64(const zlib_filefunc64_32_def* pfilefunc,voidpf filestream, ZPOS64_T offset, void* buf, uLong size);
+ZPOS64_T call_zmtime64(const zlib_filefunc64_32_def* pfilefunc,voidpf filestream);
+int call_ztruncate64(const zlib_filefunc64_32_def* pfilefunc,voidpf filestream, ZPOS64_T size);
+ZPOS64_T call_zcopy64(const zlib_filefunc64_32_def* pfilefunc,voidpf filestream_to, ZPOS64_T offset_to, voidpf filestream_from, ZPOS64_T offset_from, ZPOS64_T size);
 
 void fill_zlib_filefunc64_32_def_from_filefunc32(zlib_filefunc64_32_def* p_filefunc64_32,const zlib_filefunc_def* p_filefunc32);
 
+/* the optional function field of filefunc (a zlib_filefunc64_32_def), or NULL
+   if it is not given or if the structure does not have the optional functions */
+#define ZEXT64(filefunc,field) (((filefunc).zfile_func64.zext_magic == ZLIB_FILEFUNC64_EXT_MAGIC) ? \
+                                (filefunc).zfile_func64.field : NULL)
+
 #define ZOPEN64(filefunc,filename,mode)         (call_zopen64((&(filefunc)),(filename),(mode)))
 #define ZTELL64(filefunc,filestream)            (call_ztell64((&(filefunc)),(filestream)))
 #define ZSEEK64(filefunc,filestream,pos,mode)   (call_zseek64((&(filefunc)),(filestream),(pos),(mode)))
+#define ZMAP64(filefunc,filestream,pos,size)    (call_zmap64((&(filefunc)),(filestream),(pos),(size)))
+#define ZREADAT64(filefunc,filestream,pos,buf,size) (call_zread_at64((&(filefunc)),(filestream),(pos),(buf),(size)))
+#define ZMTIME64(filefunc,filestream)           (call_zmtime64((&(filefunc)),(filestream)))
+#define ZTRUNCATE64(filefunc,filestream,size)   (call_ztruncate64((&(filefunc)),(filestream),(size)))
+#define ZCOPY64(filefunc,to,pos_to,from,pos_from,size) (call_zcopy64((&(filefunc)),(to),(pos_to),(from),(pos_from),(size)))
 
 #ifdef __cplusplus
 }
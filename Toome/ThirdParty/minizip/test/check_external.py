@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+"""check_external.py -- read back with Python's zipfile the zipfiles written
+by minizip_test, listed in external.txt of its work directory.
+
+usage: check_external.py work_directory/external.txt
+"""
+
+import sys
+import zipfile
+import zlib
+
+
+def check_zipfile(path, checks):
+    """Return the list of the failed checks of the zipfile path."""
+    failures = []
+    try:
+        archive = zipfile.ZipFile(path)
+    except Exception as error:  # any failure of zipfile is reported
+        return ["%s: %s" % (path, error)]
+    with archive:
+        for check in checks:
+            try:
+                if check[0] == "count":
+                    if len(archive.infolist()) != int(check[1]):
+                        raise ValueError("%d files instead of %s"
+                                         % (len(archive.infolist()), check[1]))
+                else:
+                    name, password, size, crc = check[1:5]
+                    data = archive.read(name, password.encode() if password else None)
+                    if (len(data) != int(size)) or (zlib.crc32(data) != int(crc, 16)):
+                        raise ValueError("bad content")
+            except Exception as error:  # any failure of zipfile is reported
+                failures.append("%s %s: %s" % (path, check[1], error))
+    return failures
+
+
+def main(list_path):
+    zipfiles = {}
+    with open(list_path, encoding="utf-8") as listing:
+        for line in listing:
+            fields = line.rstrip("\n").split("\t")
+            zipfiles.setdefault(fields[1], []).append([fields[0]] + fields[2:])
+    failures = []
+    checked = 0
+    for path, checks in zipfiles.items():
+        failures += check_zipfile(path, checks)
+        checked += len(checks)
+    for failure in failures:
+        print(failure)
+    print("%d checks of %d zipfiles, %d failed" % (checked, len(zipfiles), len(failures)))
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    sys.exit(main(sys.argv[1]))
@@ -0,0 +1,604 @@
+/* minizip_bench.c -- timings of zip.c and unzip.c
+
+   usage: minizip_bench work_directory [bench...]
+
+   Runs all the benchmarks, or only the ones named, writing their zipfiles
+   in work_directory, which must exist. The large ones, that need several
+   GB of memory or disk, run only when named ("make bench-large"). Each time printed is the best of a
+   few runs, with the zipfile in the page cache: it measures minizip, not
+   the disk. The figures quoted in the change log of minizip come from here.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "zlib.h"
+#include "zip.h"
+#include "unzip.h"
+
+/* zcrc.h only has static functions, included here as in zip.c to time its
+   carry-less multiply and table paths */
+#if defined(__GNUC__)
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+
+#include "zthread.h"
+#include "zcrc.h"
+
+#define RUNS 5
+
+static const char* work_dir = ".";
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* a failed step makes the timings meaningless: stop there */
+static void fail(const char* file, int line, const char* what) {
+    fprintf(stderr, "%s:%d: failed: %s\n", file, line, what);
+    exit(1);
+}
+
+#define CHECK(cond) do { if (!(cond)) fail(__FILE__, __LINE__, #cond); } while (0)
+#define CHECK_OK(expr) CHECK((expr) == 0)
+
+static const char* bench_path(const char* name) {
+    static char paths[4][1024];
+    static int next = 0;
+    char* path = paths[next];
+    next = (next + 1) % 4;
+    snprintf(path, sizeof(paths[0]), "%s/%s", work_dir, name);
+    return path;
+}
+
+/* size bytes of half text, half noise, as the content of the test files */
+static unsigned char* make_content(size_t size) {
+    unsigned char* data = (unsigned char*)malloc(size);
+    unsigned x = 12345;
+    size_t i;
+    CHECK(data != NULL);
+    for (i = 0; i < size; i++)
+    {
+        x = x * 1103515245 + 12345;
+        data[i] = ((i & 0x1000) == 0) ? (unsigned char)("minizip test data "[(i * 7) % 18]) :
+                                        (unsigned char)(x >> 24);
+    }
+    return data;
+}
+
+static void report_rate(const char* bench, const char* what, double seconds, double bytes) {
+    printf("%-8s %-36s %10.2f ms %9.0f MB/s\n", bench, what, seconds * 1e3,
+           bytes / seconds / (1 << 20));
+    fflush(stdout);
+}
+
+/************************************************************/
+/* stored files: extraction against memcpy of the same bytes */
+
+#define STORED_FILES 64
+#define STORED_SIZE (4 << 20)
+
+static double read_stored(const char* path, zlib_filefunc64_def* def, unsigned char* out) {
+    double best = 1e9;
+    int run, i;
+
+    for (run = 0; run < RUNS; run++)
+    {
+        unzFile uf = unzOpen2_64(path, def);
+        double start = now();
+        CHECK(uf != NULL);
+        CHECK_OK(unzGoToFirstFile(uf));
+        for (i = 0; i < STORED_FILES; i++)
+        {
+            CHECK_OK(unzOpenCurrentFile(uf));
+            CHECK(unzReadCurrentFile(uf, out, STORED_SIZE) == STORED_SIZE);
+            CHECK_OK(unzCloseCurrentFile(uf));
+            if (i + 1 < STORED_FILES)
+                CHECK_OK(unzGoToNextFile(uf));
+        }
+        if (now() - start < best)
+            best = now() - start;
+        CHECK_OK(unzClose(uf));
+    }
+    return best;
+}
+
+static void bench_stored(void) {
+    const char* path = bench_path("bench_stored.zip");
+    const double total = (double)STORED_FILES * STORED_SIZE;
+    unsigned char* data = make_content(STORED_SIZE);
+    unsigned char* out = (unsigned char*)malloc(STORED_SIZE);
+    zlib_filefunc64_def defs[3];
+    double best = 1e9;
+    zipFile zf;
+    int run, i;
+
+    CHECK(out != NULL);
+    memset(out, 0, STORED_SIZE);
+    zf = zipOpen64(path, APPEND_STATUS_CREATE);
+    CHECK(zf != NULL);
+    for (i = 0; i < STORED_FILES; i++)
+    {
+        char name[32];
+        sprintf(name, "stored%02d.bin", i);
+        CHECK_OK(zipOpenNewFileInZip64(zf, name, NULL, NULL, 0, NULL, 0, NULL, 0, 0, 0));
+        CHECK_OK(zipWriteInFileInZip(zf, data, STORED_SIZE));
+        CHECK_OK(zipCloseFileInZip(zf));
+    }
+    CHECK_OK(zipClose(zf, NULL));
+
+    for (run = 0; run < RUNS; run++)
+    {
+        double start = now();
+        for (i = 0; i < STORED_FILES; i++)
+        {
+            memcpy(out, data, STORED_SIZE);
+            data[i] ^= out[STORED_SIZE - 1 - i];  /* keep the copies */
+        }
+        if (now() - start < best)
+            best = now() - start;
+    }
+    report_rate("stored", "memcpy", best, total);
+
+    fill_fopen64_filefunc(&defs[0]);
+    fill_pread64_filefunc(&defs[1]);
+    fill_mmap64_filefunc(&defs[2]);
+    report_rate("stored", "unzReadCurrentFile, fopen", read_stored(path, &defs[0], out), total);
+    report_rate("stored", "unzReadCurrentFile, pread", read_stored(path, &defs[1], out), total);
+    report_rate("stored", "unzReadCurrentFile, mmap", read_stored(path, &defs[2], out), total);
+
+    /* the view of a mapped zipfile, with its crc checked */
+    best = 1e9;
+    for (run = 0; run < RUNS; run++)
+    {
+        unzFile uf = unzOpen2_64(path, &defs[2]);
+        double start = now();
+        CHECK(uf != NULL);
+        CHECK_OK(unzGoToFirstFile(uf));
+        for (i = 0; i < STORED_FILES; i++)
+        {
+            const void* view;
+            ZPOS64_T len;
+            CHECK_OK(unzGetCurrentFileView(uf, &view, &len));
+            CHECK_OK(unzCheckCurrentFileView(uf, view, len));
+            if (i + 1 < STORED_FILES)
+                CHECK_OK(unzGoToNextFile(uf));
+        }
+        if (now() - start < best)
+            best = now() - start;
+        CHECK_OK(unzClose(uf));
+    }
+    report_rate("stored", "unzGetCurrentFileView + crc, mmap", best, total);
+
+    free(out);
+    free(data);
+}
+
+/************************************************************/
+/* many small deflated files, read one after the other with the read
+   structure, buffer and inflate state kept from one file to the next */
+
+#define SMALL_FILES 100000
+#define SMALL_SIZE(i) (500 + (size_t)(i) * 7919 % 3000)
+
+static double read_small(const char* path, zlib_filefunc64_def* def, int flags, double* bytes) {
+    static unsigned char out[4096];
+    double best = 1e9;
+    int run;
+
+    for (run = 0; run < RUNS; run++)
+    {
+        unzFile uf = unzOpen3_64(path, def, flags);
+        double start = now();
+        int err;
+        CHECK(uf != NULL);
+        *bytes = 0;
+        for (err = unzGoToFirstFile(uf); err == UNZ_OK; err = unzGoToNextFile(uf))
+        {
+            int read;
+            CHECK_OK(unzOpenCurrentFile(uf));
+            while ((read = unzReadCurrentFile(uf, out, sizeof(out))) > 0)
+                *bytes += read;
+            CHECK(read == 0);
+            CHECK_OK(unzCloseCurrentFile(uf));
+        }
+        CHECK(err == UNZ_END_OF_LIST_OF_FILE);
+        if (now() - start < best)
+            best = now() - start;
+        CHECK_OK(unzClose(uf));
+    }
+    return best;
+}
+
+static void report_files(const char* bench, const char* what, double seconds, double bytes) {
+    printf("%-8s %-36s %10.2f ms %9.2f us/file %6.0f MB/s\n", bench, what, seconds * 1e3,
+           seconds * 1e6 / SMALL_FILES, bytes / seconds / (1 << 20));
+    fflush(stdout);
+}
+
+static void bench_small(void) {
+    const char* path = bench_path("bench_small.zip");
+    unsigned char* data = make_content(1 << 20);
+    zlib_filefunc64_def defs[2];
+    double best, bytes;
+    zipFile zf;
+    int run, i;
+
+    zf = zipOpen64(path, APPEND_STATUS_CREATE);
+    CHECK(zf != NULL);
+    for (i = 0; i < SMALL_FILES; i++)
+    {
+        char name[32];
+        sprintf(name, "small/%06d.txt", i);
+        CHECK_OK(zipOpenNewFileInZip64(zf, name, NULL, NULL, 0, NULL, 0, NULL, Z_DEFLATED, 6, 0));
+        CHECK_OK(zipWriteInFileInZip(zf, data + (size_t)i * 104729 % (1 << 19), (unsigned)SMALL_SIZE(i)));
+        CHECK_OK(zipCloseFileInZip(zf));
+    }
+    CHECK_OK(zipClose(zf, NULL));
+
+    fill_fopen64_filefunc(&defs[0]);
+    fill_mmap64_filefunc(&defs[1]);
+    best = read_small(path, &defs[0], 0, &bytes);
+    report_files("small", "open, read, close, fopen", best, bytes);
+    best = read_small(path, &defs[1], 0, &bytes);
+    report_files("small", "open, read, close, mmap", best, bytes);
+    best = read_small(path, &defs[1], UNZ_OPEN_BUFFERED, &bytes);
+    report_files("small", "open, read, close, mmap, buffered", best, bytes);
+
+    /* what the kept state saves on each file: a new inflate state, against
+       a reset one, to inflate the same 2000 bytes */
+    {
+        static unsigned char packed[4096], out[4096];
+        z_stream stream;
+        uInt size_packed;
+        int fresh;
+
+        memset(&stream, 0, sizeof(stream));
+        CHECK(deflateInit2(&stream, 6, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+        stream.next_in = data;
+        stream.avail_in = 2000;
+        stream.next_out = packed;
+        stream.avail_out = sizeof(packed);
+        CHECK(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+        size_packed = (uInt)stream.total_out;
+        deflateEnd(&stream);
+
+        for (fresh = 1; fresh >= 0; fresh--)
+        {
+            memset(&stream, 0, sizeof(stream));
+            CHECK(inflateInit2(&stream, -MAX_WBITS) == Z_OK);
+            best = 1e9;
+            for (run = 0; run < RUNS; run++)
+            {
+                double start = now();
+                for (i = 0; i < SMALL_FILES; i++)
+                {
+                    if (fresh)
+                    {
+                        inflateEnd(&stream);
+                        CHECK(inflateInit2(&stream, -MAX_WBITS) == Z_OK);
+                    }
+                    else
+                        CHECK(inflateReset(&stream) == Z_OK);
+                    stream.next_in = packed;
+                    stream.avail_in = size_packed;
+                    stream.next_out = out;
+                    stream.avail_out = sizeof(out);
+                    CHECK(inflate(&stream, Z_FINISH) == Z_STREAM_END);
+                }
+                if (now() - start < best)
+                    best = now() - start;
+            }
+            inflateEnd(&stream);
+            report_files("small", fresh ? "inflate 2000 bytes, new state" :
+                                          "inflate 2000 bytes, reset state",
+                         best, 2000.0 * SMALL_FILES);
+        }
+    }
+
+    free(data);
+}
+
+/************************************************************/
+/* zipClose of zipfiles of many entries, writing the central directory */
+
+/* write number files of 10 bytes in path, returning the time of zipClose in
+   *close_seconds and the time of it all */
+static double write_entries(const char* path, unsigned number, double* close_seconds) {
+    double start = now(), start_close;
+    zipFile zf = zipOpen64(path, APPEND_STATUS_CREATE);
+    unsigned i;
+
+    CHECK(zf != NULL);
+    for (i = 0; i < number; i++)
+    {
+        char name[32];
+        sprintf(name, "entries/%07u.txt", i);
+        CHECK_OK(zipOpenNewFileInZip64(zf, name, NULL, NULL, 0, NULL, 0, NULL, 0, 0, 0));
+        CHECK_OK(zipWriteInFileInZip(zf, "0123456789", 10));
+        CHECK_OK(zipCloseFileInZip(zf));
+    }
+    start_close = now();
+    CHECK_OK(zipClose(zf, NULL));
+    *close_seconds = now() - start_close;
+    return now() - start;
+}
+
+static void report_entries(const char* bench, const char* what, double seconds, unsigned number) {
+    printf("%-8s %-36s %10.2f ms %9.3f us/entry\n", bench, what, seconds * 1e3,
+           seconds * 1e6 / number);
+    fflush(stdout);
+}
+
+static void close_entries(unsigned number, const char* label, int runs) {
+    char what[64];
+    double best = 1e9, best_close = 1e9;
+    int run;
+
+    for (run = 0; run < runs; run++)
+    {
+        double close_seconds;
+        double seconds = write_entries(bench_path("bench_entries.zip"), number, &close_seconds);
+        if (seconds < best)
+            best = seconds;
+        if (close_seconds < best_close)
+            best_close = close_seconds;
+    }
+    remove(bench_path("bench_entries.zip"));
+    sprintf(what, "%s entries, zipClose", label);
+    report_entries("close", what, best_close, number);
+    sprintf(what, "%s entries, all", label);
+    report_entries("close", what, best, number);
+}
+
+static void bench_close(void) {
+    close_entries(100000, "100k", RUNS);
+    close_entries(1000000, "1M", RUNS);
+}
+
+/* a zipfile of 1.2 GB with a central directory of 620 MB, held in memory
+   until zipClose: run only when named */
+static void bench_close_10m(void) {
+    close_entries(10000000, "10M", 2);
+}
+
+/************************************************************/
+/* one file appended to a zipfile of a million entries */
+
+static void bench_append(void) {
+    const char* path = bench_path("bench_append.zip");
+    double best = 1e9, best_open = 1e9, close_seconds;
+    int run;
+
+    write_entries(path, 1000000, &close_seconds);
+    for (run = 0; run < RUNS; run++)
+    {
+        char name[32];
+        double start = now(), opened;
+        zipFile zf = zipOpen64(path, APPEND_STATUS_ADDINZIP);
+        CHECK(zf != NULL);
+        opened = now();
+        sprintf(name, "appended%d.txt", run);
+        CHECK_OK(zipOpenNewFileInZip64(zf, name, NULL, NULL, 0, NULL, 0, NULL, Z_DEFLATED, 6, 0));
+        CHECK_OK(zipWriteInFileInZip(zf, "0123456789", 10));
+        CHECK_OK(zipCloseFileInZip(zf));
+        CHECK_OK(zipClose(zf, NULL));
+        if (opened - start < best_open)
+            best_open = opened - start;
+        if (now() - start < best)
+            best = now() - start;
+    }
+    report_entries("append", "1M entries, zipOpen64", best_open, 1000000);
+    report_entries("append", "1M entries, open, add one, zipClose", best, 1000000);
+}
+
+/************************************************************/
+/* the last or the first file deleted from a zipfile of 1 GB */
+
+#define DELETE_FILES 256
+#define DELETE_SIZE (4 << 20)
+#define DELETE_RUNS 3
+
+static void copy_file(const char* from, const char* to) {
+    static unsigned char buf[1 << 20];
+    FILE* in = fopen(from, "rb");
+    FILE* out = fopen(to, "wb");
+    size_t n;
+    CHECK((in != NULL) && (out != NULL));
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+        CHECK(fwrite(buf, 1, n, out) == n);
+    fclose(in);
+    CHECK(fclose(out) == 0);
+}
+
+static void bench_delete(void) {
+    const char* source = bench_path("bench_delete_source.zip");
+    const char* path = bench_path("bench_delete.zip");
+    unsigned char* data = make_content(DELETE_SIZE);
+    zipFile zf;
+    int i, last;
+
+    zf = zipOpen64(source, APPEND_STATUS_CREATE);
+    CHECK(zf != NULL);
+    for (i = 0; i < DELETE_FILES; i++)
+    {
+        char name[32];
+        sprintf(name, "member%03d.bin", i);
+        CHECK_OK(zipOpenNewFileInZip64(zf, name, NULL, NULL, 0, NULL, 0, NULL, 0, 0, 0));
+        CHECK_OK(zipWriteInFileInZip(zf, data, DELETE_SIZE));
+        CHECK_OK(zipCloseFileInZip(zf));
+    }
+    CHECK_OK(zipClose(zf, NULL));
+
+    for (last = 1; last >= 0; last--)
+    {
+        double best = 1e9;
+        int run;
+        for (run = 0; run < DELETE_RUNS; run++)
+        {
+            char name[32];
+            const char* names[1];
+            double start;
+
+            copy_file(source, path);
+            sprintf(name, "member%03d.bin", last ? DELETE_FILES - 1 : 0);
+            names[0] = name;
+            start = now();
+            zf = zipOpen64(path, APPEND_STATUS_ADDINZIP);
+            CHECK(zf != NULL);
+            CHECK_OK(zipDeleteMembers(zf, names, 1));
+            CHECK_OK(zipClose(zf, NULL));
+            if (now() - start < best)
+                best = now() - start;
+        }
+        printf("%-8s %-36s %10.2f ms\n", "delete", last ? "1 GB, last file, open, delete, close" :
+                                                          "1 GB, first file, open, delete, close",
+               best * 1e3);
+        fflush(stdout);
+    }
+    remove(path);
+    remove(source);
+    free(data);
+}
+
+/************************************************************/
+/* crc-32: zcrc32 on both paths against zlib's crc32 */
+
+#define CRC_CHUNK (1 << 20)
+
+enum { CRC_ZLIB, CRC_ZCRC, CRC_ZCRC_COPY, CRC_MEMCPY, CRC_MEMCPY_ZLIB };
+
+/* the crc of size bytes of buf by calls of CRC_CHUNK bytes, going round
+   buf of size_buf bytes, copying to out of the same size for the copies */
+static double time_crc(const unsigned char* buf, unsigned char* out, size_t size_buf,
+                       double size, int how, int runs, uLong* crc) {
+    double best = 1e9;
+    int run;
+
+    for (run = 0; run < runs; run++)
+    {
+        double start = now();
+        double done;
+        size_t at = 0;
+        *crc = 0;
+        for (done = 0; done < size; done += CRC_CHUNK)
+        {
+            if (how == CRC_ZLIB)
+                *crc = crc32(*crc, buf + at, CRC_CHUNK);
+            else if (how == CRC_ZCRC)
+                *crc = zcrc32(*crc, buf + at, CRC_CHUNK);
+            else if (how == CRC_ZCRC_COPY)
+                *crc = zcrc32_copy(*crc, out + at, buf + at, CRC_CHUNK);
+            else
+            {
+                /* the copy and crc in two passes, as before zcrc32_copy */
+                memcpy(out + at, buf + at, CRC_CHUNK);
+                if (how == CRC_MEMCPY_ZLIB)
+                    *crc = crc32(*crc, out + at, CRC_CHUNK);
+                else
+                    *crc ^= out[at + CRC_CHUNK - 1];
+            }
+            at = (at + CRC_CHUNK) % size_buf;
+        }
+        if (now() - start < best)
+            best = now() - start;
+    }
+    return best;
+}
+
+/* every way on size bytes, going round a buffer of size_buf bytes */
+static void crc_all(const char* bench, size_t size_buf, double size, int runs) {
+    unsigned char* buf = make_content(size_buf);
+    unsigned char* out = (unsigned char*)malloc(size_buf);
+    uLong expected, crc;
+#ifdef ZCRC_HAVE_CLMUL
+    int use_clmul;
+#endif
+
+    CHECK(out != NULL);
+    memset(out, 0, size_buf);
+    report_rate(bench, "memcpy", time_crc(buf, out, size_buf, size, CRC_MEMCPY, runs, &crc), size);
+    report_rate(bench, "zlib crc32", time_crc(buf, out, size_buf, size, CRC_ZLIB, runs, &expected), size);
+    report_rate(bench, "memcpy + zlib crc32",
+                time_crc(buf, out, size_buf, size, CRC_MEMCPY_ZLIB, runs, &crc), size);
+    CHECK(crc == expected);
+#ifdef ZCRC_HAVE_CLMUL
+    zcrc32(0, buf, 0);  /* run zcrc_init before the flag is changed */
+    use_clmul = zcrc_use_clmul;
+    if (use_clmul)
+    {
+        report_rate(bench, "zcrc32, clmul", time_crc(buf, out, size_buf, size, CRC_ZCRC, runs, &crc), size);
+        CHECK(crc == expected);
+        report_rate(bench, "zcrc32_copy, clmul",
+                    time_crc(buf, out, size_buf, size, CRC_ZCRC_COPY, runs, &crc), size);
+        CHECK(crc == expected);
+    }
+    zcrc_use_clmul = 0;
+#endif
+    report_rate(bench, "zcrc32, tables", time_crc(buf, out, size_buf, size, CRC_ZCRC, runs, &crc), size);
+    CHECK(crc == expected);
+    report_rate(bench, "zcrc32_copy, tables",
+                time_crc(buf, out, size_buf, size, CRC_ZCRC_COPY, runs, &crc), size);
+    CHECK(crc == expected);
+#ifdef ZCRC_HAVE_CLMUL
+    zcrc_use_clmul = use_clmul;
+#endif
+
+    free(out);
+    free(buf);
+}
+
+/* 256 MB in a buffer that stays in cache */
+static void bench_crc(void) {
+    crc_all("crc", CRC_CHUNK, 256.0 * CRC_CHUNK, RUNS);
+}
+
+/* 4 GB going round two buffers of 1 GB, far larger than the caches, so
+   that the data comes from memory, and the copies go to it */
+static void bench_crc_large(void) {
+    crc_all("crc_4gb", (size_t)1 << 30, 4096.0 * CRC_CHUNK, 2);
+}
+
+static const struct
+{
+    const char* name;
+    void (*func)(void);
+    int large;                  /* 1 to run it only when it is named */
+} benches[] =
+{
+    { "stored", bench_stored, 0 },
+    { "small", bench_small, 0 },
+    { "close", bench_close, 0 },
+    { "close_10m", bench_close_10m, 1 },
+    { "append", bench_append, 0 },
+    { "delete", bench_delete, 0 },
+    { "crc", bench_crc, 0 },
+    { "crc_4gb", bench_crc_large, 1 },
+};
+
+int main(int argc, char** argv) {
+    size_t b;
+    int i;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: minizip_bench work_directory [bench...]\n");
+        return 2;
+    }
+    work_dir = argv[1];
+
+    for (b = 0; b < sizeof(benches) / sizeof(benches[0]); b++)
+    {
+        int run = (argc == 2) && !benches[b].large;
+        for (i = 2; i < argc; i++)
+            if (strcmp(argv[i], benches[b].name) == 0)
+                run = 1;
+        if (run)
+            benches[b].func();
+    }
+    return 0;
+}
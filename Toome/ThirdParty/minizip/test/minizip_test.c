@@ -0,0 +1,275 @@
+/* minizip_test.c -- round trip tests of zip.c and unzip.c
+
+   usage: minizip_test work_directory [test...]
+
+   Runs all the tests, or only the ones named, writing their zipfiles in
+   work_directory, which must exist. Returns 0 if all the checks passed.
+*/
+
+#include "mztest.h"
+
+#include <sys/stat.h>
+
+int mz_failures = 0;
+
+static const char* work_dir = ".";
+static FILE* external_list = NULL;
+
+#define POOL_SIZE (16 << 20)
+#define CONTENT_MAX (8 << 20)  /* largest content */
+static unsigned char* pool = NULL;
+
+void mz_fail(const char* file, int line, const char* what) {
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+    mz_failures++;
+}
+
+const char* mz_path(const char* name) {
+    static char paths[8][1024];
+    static int next = 0;
+    char* path = paths[next];
+    next = (next + 1) % 8;
+    snprintf(path, sizeof(paths[0]), "%s/%s", work_dir, name);
+    return path;
+}
+
+static void make_pool(void) {
+    unsigned x = 12345;
+    size_t i;
+    pool = (unsigned char*)malloc(POOL_SIZE);
+    for (i = 0; i < POOL_SIZE; i++)
+    {
+        x = x * 1103515245 + 12345;
+        /* 4K of text, then 4K of noise */
+        pool[i] = ((i & 0x1000) == 0) ? (unsigned char)("minizip test data "[(i * 7) % 18]) :
+                                        (unsigned char)(x >> 24);
+    }
+}
+
+const unsigned char* mz_content_size(unsigned i, size_t size) {
+    if (size > CONTENT_MAX)
+        size = CONTENT_MAX;
+    return pool + ((size_t)i * 104729) % (POOL_SIZE - CONTENT_MAX);
+}
+
+const unsigned char* mz_content(unsigned i, size_t* size) {
+    *size = ((size_t)i * 7919) % 20000;
+    if (i % 97 == 1)
+        *size += 200000;
+    return mz_content_size(i, *size);
+}
+
+unsigned char* mz_read_current(unzFile uf, ZPOS64_T* size) {
+    unz_file_info64 info;
+    unsigned char* data;
+    ZPOS64_T done = 0;
+    unsigned block = 1;
+
+    if (unzGetCurrentFileInfo64(uf, &info, NULL, 0, NULL, 0, NULL, 0) != UNZ_OK)
+        return NULL;
+    data = (unsigned char*)malloc((size_t)info.uncompressed_size + 1);
+    for (;;)
+    {
+        int read = unzReadCurrentFile(uf, data + done,
+                                      (unsigned)((info.uncompressed_size + 1 - done < block) ?
+                                                 info.uncompressed_size + 1 - done : block));
+        if (read < 0)
+        {
+            free(data);
+            return NULL;
+        }
+        if (read == 0)
+            break;
+        done += (ZPOS64_T)read;
+        if (done > info.uncompressed_size)
+            break;
+        block = (block * 3 + 7) % 70000 + 1;
+    }
+    *size = done;
+    return data;
+}
+
+void mz_check_file(unzFile uf, const char* name, const char* password,
+                   const void* expected, size_t size) {
+    unsigned char* data;
+    ZPOS64_T read_size = 0;
+    int err;
+
+    err = unzLocateFile(uf, name, 1);
+    if (err != UNZ_OK)
+    {
+        fprintf(stderr, "file %s: not found (%d)\n", name, err);
+        mz_failures++;
+        return;
+    }
+    err = unzOpenCurrentFilePassword(uf, password);
+    if (err != UNZ_OK)
+    {
+        fprintf(stderr, "file %s: open failed (%d)\n", name, err);
+        mz_failures++;
+        return;
+    }
+    data = mz_read_current(uf, &read_size);
+    if ((data == NULL) || (read_size != size) || (memcmp(data, expected, size) != 0))
+    {
+        fprintf(stderr, "file %s: bad content\n", name);
+        mz_failures++;
+    }
+    free(data);
+    err = unzCloseCurrentFile(uf);
+    if (err != UNZ_OK)
+    {
+        fprintf(stderr, "file %s: close failed (%d)\n", name, err);
+        mz_failures++;
+    }
+}
+
+void mz_external(const char* path, const char* name, const char* password,
+                 const void* data, size_t size) {
+    if (external_list == NULL)
+        return;
+    fprintf(external_list, "file\t%s\t%s\t%s\t%lu\t%08lx\n", path, name,
+            (password != NULL) ? password : "", (unsigned long)size,
+            crc32(0, (const Bytef*)data, (uInt)size));
+}
+
+void mz_external_count(const char* path, unsigned long number) {
+    if (external_list == NULL)
+        return;
+    fprintf(external_list, "count\t%s\t%lu\n", path, number);
+}
+
+void mz_name(unsigned i, char* name) {
+    sprintf(name, "dir%u/File%05u.dat", i % 7, i);
+}
+
+void mz_write_set(const char* path, unsigned first, unsigned number, int append, int first_listed) {
+    zipFile zf = zipOpen64(path, append);
+    unsigned i;
+
+    CHECK(zf != NULL);
+    if (zf == NULL)
+        return;
+    for (i = first; i < first + number; i++)
+    {
+        char name[64];
+        zip_fileinfo zfi;
+        size_t size;
+        const unsigned char* data = mz_content(i, &size);
+        int method = (i % 3 == 0) ? 0 : Z_DEFLATED;
+
+        mz_name(i, name);
+        memset(&zfi, 0, sizeof(zfi));
+        zfi.dosDate = 0x5a4b3c21 + i;
+        zfi.external_fa = 0x81a40000;
+        CHECK_OK(zipOpenNewFileInZip64(zf, name, &zfi, NULL, 0, NULL, 0, NULL,
+                                       method, (int)(i % 9) + 1, i % 11 == 5));
+        CHECK_OK(zipWriteInFileInZip(zf, data, (unsigned)size));
+        CHECK_OK(zipCloseFileInZip(zf));
+        if (first_listed >= 0)
+            mz_external(path, name, NULL, data, size);
+    }
+    CHECK_OK(zipClose(zf, "test set"));
+    if (first_listed >= 0)
+        mz_external_count(path, first + number - (unsigned)first_listed);
+}
+
+void mz_check_set(unzFile uf, unsigned first, unsigned number) {
+    unsigned i;
+    for (i = first; i < first + number; i++)
+    {
+        char name[64];
+        size_t size;
+        const unsigned char* data = mz_content(i, &size);
+        mz_name(i, name);
+        mz_check_file(uf, name, NULL, data, size);
+    }
+}
+
+long long mz_file_size(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return -1;
+    return (long long)st.st_size;
+}
+
+void mz_copy_file(const char* from, const char* to) {
+    FILE* in = fopen(from, "rb");
+    FILE* out = fopen(to, "wb");
+    char buf[65536];
+    size_t n;
+    CHECK((in != NULL) && (out != NULL));
+    if ((in != NULL) && (out != NULL))
+        while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+            CHECK(fwrite(buf, 1, n, out) == n);
+    if (in != NULL)
+        fclose(in);
+    if (out != NULL)
+        fclose(out);
+}
+
+static const struct
+{
+    const char* name;
+    void (*func)(void);
+} tests[] =
+{
+    { "crc", test_crc },
+    { "locate", test_locate },
+    { "backends", test_backends },
+    { "view", test_view },
+    { "many_entries", test_many_entries },
+    { "parallel_extract", test_parallel_extract },
+    { "parallel_deflate", test_parallel_deflate },
+    { "members", test_members },
+    { "stream_writer", test_stream_writer },
+    { "stream_reader", test_stream_reader },
+    { "aes", test_aes },
+    { "codecs", test_codecs },
+    { "seek", test_seek },
+    { "index_file", test_index_file },
+    { "append", test_append },
+    { "delete", test_delete },
+    { "copy", test_copy },
+    { "hostile", test_hostile },
+    { "hostile_index", test_hostile_index },
+};
+
+int main(int argc, char** argv) {
+    size_t t;
+    int i;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: minizip_test work_directory [test...]\n");
+        return 2;
+    }
+    work_dir = argv[1];
+    make_pool();
+    external_list = fopen(mz_path("external.txt"), "w");
+    if (external_list == NULL)
+    {
+        fprintf(stderr, "can't write in %s\n", work_dir);
+        return 2;
+    }
+
+    for (t = 0; t < sizeof(tests) / sizeof(tests[0]); t++)
+    {
+        int run = (argc == 2);
+        int failures = mz_failures;
+        for (i = 2; i < argc; i++)
+            if (strcmp(argv[i], tests[t].name) == 0)
+                run = 1;
+        if (!run)
+            continue;
+        tests[t].func();
+        printf("%-18s %s\n", tests[t].name, (mz_failures == failures) ? "ok" : "FAILED");
+        fflush(stdout);
+    }
+
+    fclose(external_list);
+    free(pool);
+    if (mz_failures > 0)
+        printf("%d checks failed\n", mz_failures);
+    return (mz_failures == 0) ? 0 : 1;
+}
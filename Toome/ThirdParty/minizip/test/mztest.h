@@ -0,0 +1,91 @@
+/* mztest.h -- helpers of the minizip tests
+
+   The tests write their zipfiles in a work directory, given on the command
+   line of minizip_test. Every zipfile whose files can be read by another
+   implementation is listed in external.txt there, with the name, size and
+   crc of its files, and check_external.py reads them back with Python's
+   zipfile module.
+*/
+
+#ifndef _MZTEST_H
+#define _MZTEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zlib.h"
+#include "zip.h"
+#include "unzip.h"
+
+extern int mz_failures;
+
+void mz_fail(const char* file, int line, const char* what);
+
+#define CHECK(cond) do { if (!(cond)) mz_fail(__FILE__, __LINE__, #cond); } while (0)
+#define CHECK_OK(expr) do { int err_ = (expr); if (err_ != 0) { \
+    char what_[256]; snprintf(what_, sizeof(what_), "%.200s returned %d", #expr, err_); \
+    mz_fail(__FILE__, __LINE__, what_); } } while (0)
+
+/* the path of name in the work directory, in one of 8 rotating buffers */
+const char* mz_path(const char* name);
+
+/* content of the test file number i: its size, and a pointer on it valid
+   until the end of the tests. Files alternate compressible and random
+   parts so that both stored and deflated blocks get written. */
+const unsigned char* mz_content(unsigned i, size_t* size);
+/* the same content of a given size */
+const unsigned char* mz_content_size(unsigned i, size_t size);
+
+/* read all the current file of uf (opened by the caller), by blocks of
+   varying sizes; return the data (to free) and its size in *size, or NULL */
+unsigned char* mz_read_current(unzFile uf, ZPOS64_T* size);
+
+/* open, read and close the file named name of uf, and compare it with
+   expected; password can be NULL */
+void mz_check_file(unzFile uf, const char* name, const char* password,
+                   const void* expected, size_t size);
+
+/* list the file name of the zipfile path with its content, for
+   check_external.py; password can be NULL */
+void mz_external(const char* path, const char* name, const char* password,
+                 const void* data, size_t size);
+/* tell check_external.py the zipfile has number files in all */
+void mz_external_count(const char* path, unsigned long number);
+
+/* the name of the test file number i */
+void mz_name(unsigned i, char* name);
+
+/* write the test files first to first+number-1 in the zipfile path, stored
+   or deflated at various levels, with append as for zipOpen64; the zipfile
+   is listed for check_external.py with first_listed the first file of it,
+   or not listed if first_listed is -1 */
+void mz_write_set(const char* path, unsigned first, unsigned number, int append, int first_listed);
+/* check that the test files first to first+number-1 are in uf */
+void mz_check_set(unzFile uf, unsigned first, unsigned number);
+
+long long mz_file_size(const char* path);
+void mz_copy_file(const char* from, const char* to);
+
+/* the tests, one by request of the change log of minizip */
+void test_crc(void);
+void test_locate(void);
+void test_backends(void);
+void test_view(void);
+void test_many_entries(void);
+void test_parallel_extract(void);
+void test_parallel_deflate(void);
+void test_members(void);
+void test_stream_writer(void);
+void test_stream_reader(void);
+void test_aes(void);
+void test_codecs(void);
+void test_seek(void);
+void test_index_file(void);
+void test_append(void);
+void test_delete(void);
+void test_copy(void);
+void test_hostile(void);
+void test_hostile_index(void);
+
+#endif
@@ -0,0 +1,75 @@
+/* test_crc.c -- zcrc32 and zcrc32_copy against zlib's crc32
+
+   zcrc.h only has static functions, it is included here as in zip.c, so
+   that both its carry-less multiply and table paths can be checked.
+*/
+
+#include "mztest.h"
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+
+#include "zthread.h"
+#include "zcrc.h"
+
+/* several threads compute their first crc at once, for zthread_once */
+static void crc_thread(void* arg) {
+    size_t size;
+    const unsigned char* data = mz_content(1, &size);
+    if (zcrc32(0, data, size) != crc32(0, data, (uInt)size))
+        (*(int*)arg)++;
+}
+
+static void check_lengths(const char* path) {
+    static const size_t lengths[] = { 0, 1, 15, 16, 17, 63, 64, 65, 127, 128, 1000,
+                                      4095, 4096, 65536 + 3, 1000003, 4 << 20 };
+    unsigned char* copy = (unsigned char*)malloc((4 << 20) + 64);
+    size_t l;
+    unsigned align;
+
+    for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+        for (align = 0; align < 16; align += 5)
+        {
+            const unsigned char* data = mz_content_size(align, lengths[l] + 16) + align;
+            uLong expected = crc32(0, data, (uInt)lengths[l]);
+            uLong split = lengths[l] / 3;
+            if (zcrc32(0, data, lengths[l]) != expected)
+            {
+                fprintf(stderr, "%s: zcrc32 of %lu bytes at +%u\n", path, (unsigned long)lengths[l], align);
+                mz_failures++;
+            }
+            /* the running crc goes on from any split */
+            if (zcrc32(zcrc32(0, data, split), data + split, lengths[l] - split) != expected)
+            {
+                fprintf(stderr, "%s: split zcrc32 of %lu bytes\n", path, (unsigned long)lengths[l]);
+                mz_failures++;
+            }
+            memset(copy, 0, lengths[l] + 64);
+            if ((zcrc32_copy(0, copy + align + 1, data, lengths[l]) != expected) ||
+                (memcmp(copy + align + 1, data, lengths[l]) != 0) ||
+                (copy[align] != 0) || (copy[align + 1 + lengths[l]] != 0))
+            {
+                fprintf(stderr, "%s: zcrc32_copy of %lu bytes\n", path, (unsigned long)lengths[l]);
+                mz_failures++;
+            }
+        }
+    free(copy);
+}
+
+void test_crc(void) {
+    int errors = 0;
+
+    zthread_run(4, crc_thread, &errors);
+    CHECK(errors == 0);
+
+#ifdef ZCRC_HAVE_CLMUL
+    if (zcrc_use_clmul)
+        check_lengths("clmul");
+    zcrc_use_clmul = 0;
+    check_lengths("tables");
+    zcrc_use_clmul = 1;
+#else
+    check_lengths("tables");
+#endif
+}
@@ -0,0 +1,228 @@
+/* test_hostile.c -- damaged zipfiles: every reader must fail cleanly
+   (under the sanitizers of "make asan"), whatever the bytes changed
+*/
+
+#include "mztest.h"
+
+#include <unistd.h>
+
+/* read all of uf with every reader, ignoring the errors */
+static void read_all(unzFile uf) {
+    static unsigned char buf[1 << 18];
+    int err;
+
+    for (err = unzGoToFirstFile(uf); err == UNZ_OK; err = unzGoToNextFile(uf))
+    {
+        unz_file_info64 info;
+        char name[256], extra[256], comment[256];
+        const void* view;
+        ZPOS64_T len;
+
+        if (unzGetCurrentFileInfo64(uf, &info, name, sizeof(name), extra, sizeof(extra),
+                                    comment, sizeof(comment)) != UNZ_OK)
+            continue;
+        if (unzGetCurrentFileView(uf, &view, &len) == UNZ_OK)
+            unzCheckCurrentFileView(uf, view, len);
+        if (unzOpenCurrentFilePassword(uf, "secret") == UNZ_OK)
+        {
+            unzGetLocalExtrafield(uf, extra, sizeof(extra));
+            while (unzReadCurrentFile(uf, buf, sizeof(buf)) > 0)
+                ;
+            unzCloseCurrentFile(uf);
+        }
+        if (unzOpenCurrentFile(uf) == UNZ_OK)
+        {
+            if (unzSeek64(uf, 100000, ZLIB_FILEFUNC_SEEK_SET) == UNZ_OK)
+                unzReadCurrentFile(uf, buf, 1000);
+            unzCloseCurrentFile(uf);
+        }
+        if (unzOpenCurrentFile(uf) == UNZ_OK)
+        {
+            unzReadCurrentFileFully(uf, buf, sizeof(buf));
+            unzCloseCurrentFile(uf);
+        }
+    }
+}
+
+static int ignore_data(voidpf opaque, const unz64_file_pos* file_pos, ZPOS64_T offset,
+                       const void* buf, uLong len) {
+    (void)opaque; (void)file_pos; (void)offset; (void)buf; (void)len;
+    return UNZ_OK;
+}
+
+static void read_stream(const char* path) {
+    static unsigned char buf[65536];
+    unzStream us = unzStreamOpen64(path, NULL);
+    unz_file_info64 info;
+    char name[256];
+
+    if (us == NULL)
+        return;
+    while (unzStreamNextFile(us, &info, name, sizeof(name)) == UNZ_OK)
+        while (unzStreamReadFile(us, buf, sizeof(buf)) > 0)
+            ;
+    unzStreamClose(us);
+}
+
+/* open path every way and read it all */
+static void read_damaged(const char* path, const char* index_path, zlib_filefunc64_def* defs) {
+    static const int flags[] = { 0, UNZ_OPEN_INDEXED, UNZ_OPEN_BUFFERED };
+    size_t f;
+    int b;
+
+    for (b = 0; b < 3; b++)
+        for (f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            unzFile uf = unzOpen3_64(path, &defs[b], flags[f]);
+            if (uf == NULL)
+                continue;
+            read_all(uf);
+            unzExtractParallel(uf, NULL, 0, 2, ignore_data, NULL);
+            unzClose(uf);
+        }
+    {
+        unzFile uf = unzOpen4_64(path, &defs[1], 0, index_path);
+        if (uf != NULL)
+        {
+            read_all(uf);
+            unzClose(uf);
+        }
+    }
+    read_stream(path);
+}
+
+/* a small zipfile with a bit of everything */
+static void write_base(const char* path) {
+    zipFile zf = zipOpen64(path, APPEND_STATUS_CREATE);
+    static const char extra[] = "\x55\x54\x05\x00\x01\x11\x22\x33\x44";
+    zip_fileinfo zfi;
+
+    memset(&zfi, 0, sizeof(zfi));
+    CHECK_OK(zipOpenNewFileInZip64(zf, "stored", &zfi, extra, 9, extra, 9, "a comment", 0, 0, 0));
+    CHECK_OK(zipWriteInFileInZip(zf, mz_content_size(1, 3000), 3000));
+    CHECK_OK(zipCloseFileInZip(zf));
+    CHECK_OK(zipOpenNewFileInZip64(zf, "deflated64", &zfi, NULL, 0, NULL, 0, NULL, Z_DEFLATED, 6, 1));
+    CHECK_OK(zipWriteInFileInZip(zf, mz_content_size(2, 150000), 150000));
+    CHECK_OK(zipCloseFileInZip(zf));
+    CHECK_OK(zipSetAESEncryption(zf, 1));
+    CHECK_OK(zipOpenNewFileInZip3_64(zf, "aes", &zfi, NULL, 0, NULL, 0, NULL, Z_DEFLATED, 6, 0,
+                                     -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY, "secret", 0, 0));
+    CHECK_OK(zipWriteInFileInZip(zf, mz_content_size(3, 2000), 2000));
+    CHECK_OK(zipCloseFileInZip(zf));
+    CHECK_OK(zipSetAESEncryption(zf, 0));
+    CHECK_OK(zipOpenNewFileInZip64(zf, "empty", &zfi, NULL, 0, NULL, 0, NULL, Z_DEFLATED, 6, 0));
+    CHECK_OK(zipCloseFileInZip(zf));
+    CHECK_OK(zipClose(zf, "zipfile comment"));
+}
+
+static unsigned char* load(const char* path, long* size) {
+    FILE* file = fopen(path, "rb");
+    unsigned char* data;
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data = (unsigned char*)malloc((size_t)*size);
+    CHECK(fread(data, 1, (size_t)*size, file) == (size_t)*size);
+    fclose(file);
+    return data;
+}
+
+static void save(const char* path, const unsigned char* data, long size) {
+    FILE* file = fopen(path, "wb");
+    CHECK(fwrite(data, 1, (size_t)size, file) == (size_t)size);
+    fclose(file);
+}
+
+#define FLIPS 300
+
+void test_hostile(void) {
+    const char* base_path = mz_path("hostile_base.zip");
+    const char* path = mz_path("hostile.zip");
+    const char* index_path = mz_path("hostile.zip.idx");
+    zlib_filefunc64_def defs[3];
+    unsigned char* base;
+    unsigned char* data;
+    unsigned x = 99;
+    long size, i;
+    int n;
+
+    fill_fopen64_filefunc(&defs[0]);
+    fill_mmap64_filefunc(&defs[1]);
+    fill_pread64_filefunc(&defs[2]);
+    write_base(base_path);
+    base = load(base_path, &size);
+    data = (unsigned char*)malloc((size_t)size);
+
+    /* bytes changed at random, more often in the headers */
+    for (n = 0; n < FLIPS; n++)
+    {
+        int k, changes = 1 + n % 4;
+        memcpy(data, base, (size_t)size);
+        for (k = 0; k < changes; k++)
+        {
+            long at;
+            x = x * 1103515245 + 12345;
+            at = (n % 2) ? size - 1 - (long)((x >> 8) % 400) : (long)((x >> 8) % (unsigned long)size);
+            if (at < 0)
+                at = 0;
+            x = x * 1103515245 + 12345;
+            data[at] = (k % 2) ? (unsigned char)(x >> 24) : (unsigned char)(data[at] ^ (1 << (x >> 29)));
+        }
+        save(path, data, size);
+        unlink(index_path);
+        read_damaged(path, index_path, defs);
+    }
+
+    /* cut at every position near the end, and some others */
+    for (i = 0; i < size; i += (size - i > 600) ? 997 : 1)
+    {
+        save(path, base, i);
+        read_damaged(path, index_path, defs);
+    }
+
+    free(data);
+    free(base);
+}
+
+/* the index file of a valid zipfile with changed bytes */
+void test_hostile_index(void) {
+    const char* path = mz_path("hostile_index.zip");
+    const char* index_path = mz_path("hostile_index.zip.idx");
+    zlib_filefunc64_def defs[3];
+    unsigned char* index;
+    unsigned char* changed;
+    unsigned x = 99;
+    long index_size;
+    int n;
+
+    fill_fopen64_filefunc(&defs[0]);
+    fill_mmap64_filefunc(&defs[1]);
+    fill_pread64_filefunc(&defs[2]);
+    write_base(path);
+    unlink(index_path);
+    {
+        unzFile uf = unzOpen4_64(path, &defs[1], 0, index_path);
+        CHECK(uf != NULL);
+        if (uf != NULL)
+            unzClose(uf);
+    }
+    index = load(index_path, &index_size);
+    changed = (unsigned char*)malloc((size_t)index_size);
+    for (n = 0; n < 200; n++)
+    {
+        unzFile uf;
+        x = x * 1103515245 + 12345;
+        memcpy(changed, index, (size_t)index_size);
+        changed[(x >> 8) % (unsigned long)index_size] ^= (unsigned char)(1 + (x >> 24) % 255);
+        save(index_path, changed, index_size);
+        uf = unzOpen4_64(path, &defs[n % 3], 0, index_path);
+        CHECK(uf != NULL);
+        if (uf != NULL)
+        {
+            read_all(uf);
+            unzClose(uf);
+        }
+    }
+    free(changed);
+    free(index);
+}
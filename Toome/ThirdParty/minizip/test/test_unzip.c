@@ -0,0 +1,756 @@
+/* test_unzip.c -- reading tests: index, io backends, views, parallel
+   extraction, forward-only reader, seeking and index file
+*/
+
+#include "mztest.h"
+
+#include <unistd.h>
+
+#define SET_SIZE 1500
+
+static void check_iteration(unzFile uf, unsigned first, unsigned number) {
+    unsigned i = first;
+    int err;
+
+    for (err = unzGoToFirstFile(uf); err == UNZ_OK; err = unzGoToNextFile(uf))
+    {
+        char name[64], expected[64];
+        unz_file_info64 info;
+        size_t size;
+
+        mz_content(i, &size);
+        mz_name(i, expected);
+        CHECK_OK(unzGetCurrentFileInfo64(uf, &info, name, sizeof(name), NULL, 0, NULL, 0));
+        if ((strcmp(name, expected) != 0) || (info.uncompressed_size != size))
+        {
+            fprintf(stderr, "entry %u: %s instead of %s\n", i - first, name, expected);
+            mz_failures++;
+            return;
+        }
+        i++;
+    }
+    CHECK(err == UNZ_END_OF_LIST_OF_FILE);
+    CHECK(i == first + number);
+}
+
+void test_locate(void) {
+    const char* path = mz_path("locate.zip");
+    static const int flags[] = { -1, 0, UNZ_OPEN_INDEXED, UNZ_OPEN_BUFFERED,
+                                 UNZ_OPEN_INDEXED | UNZ_OPEN_BUFFERED };
+    size_t f;
+
+    mz_write_set(path, 0, SET_SIZE, APPEND_STATUS_CREATE, 0);
+    for (f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+    {
+        unzFile uf = (flags[f] < 0) ? unzOpen64(path) : unzOpen3_64(path, NULL, flags[f]);
+        unz_global_info64 gi;
+        unz64_file_pos pos;
+        char name[64];
+        unsigned i;
+
+        CHECK(uf != NULL);
+        if (uf == NULL)
+            continue;
+        CHECK_OK(unzGetGlobalInfo64(uf, &gi));
+        CHECK(gi.number_entry == SET_SIZE);
+        check_iteration(uf, 0, SET_SIZE);
+
+        /* all the files in a scattered order, the content of some */
+        for (i = 0; i < SET_SIZE; i++)
+        {
+            unsigned n = (i * 977) % SET_SIZE;
+            char got[64];
+            mz_name(n, name);
+            if (n % 13 == 0)
+            {
+                size_t size;
+                const unsigned char* data = mz_content(n, &size);
+                mz_check_file(uf, name, NULL, data, size);
+                continue;
+            }
+            CHECK_OK(unzLocateFile(uf, name, 1));
+            CHECK_OK(unzGetCurrentFileInfo64(uf, NULL, got, sizeof(got), NULL, 0, NULL, 0));
+            CHECK(strcmp(got, name) == 0);
+        }
+
+        /* case insensitive, and missing names leave the current file */
+        mz_name(777, name);
+        name[0] = 'D';
+        name[5] = 'f';
+        CHECK(unzLocateFile(uf, name, 1) == UNZ_END_OF_LIST_OF_FILE);
+        CHECK_OK(unzLocateFile(uf, name, 2));
+        CHECK_OK(unzGetFilePos64(uf, &pos));
+        CHECK(unzLocateFile(uf, "dir0/missing", 0) == UNZ_END_OF_LIST_OF_FILE);
+        CHECK(unzLocateFile(uf, "", 0) == UNZ_END_OF_LIST_OF_FILE);
+        {
+            char got[64];
+            CHECK_OK(unzGetCurrentFileInfo64(uf, NULL, got, sizeof(got), NULL, 0, NULL, 0));
+            mz_name(777, name);
+            CHECK(strcmp(got, name) == 0);
+        }
+
+        /* back to a saved position */
+        CHECK_OK(unzGoToFirstFile(uf));
+        CHECK_OK(unzGoToFilePos64(uf, &pos));
+        {
+            size_t size;
+            const unsigned char* data = mz_content(777, &size);
+            ZPOS64_T read_size;
+            unsigned char* read;
+            CHECK_OK(unzOpenCurrentFile(uf));
+            read = mz_read_current(uf, &read_size);
+            CHECK((read != NULL) && (read_size == size) && (memcmp(read, data, size) == 0));
+            free(read);
+            CHECK_OK(unzCloseCurrentFile(uf));
+        }
+        CHECK_OK(unzClose(uf));
+    }
+}
+
+/* fopen64 functions copied in a structure filled field by field, with
+   garbage in the optional functions and no ZLIB_FILEFUNC64_EXT_MAGIC */
+static void fill_garbage_filefunc(zlib_filefunc64_def* def) {
+    zlib_filefunc64_def base;
+    fill_fopen64_filefunc(&base);
+    memset(def, 0x5a, sizeof(*def));
+    def->zopen64_file = base.zopen64_file;
+    def->zread_file = base.zread_file;
+    def->zwrite_file = base.zwrite_file;
+    def->ztell64_file = base.ztell64_file;
+    def->zseek64_file = base.zseek64_file;
+    def->zclose_file = base.zclose_file;
+    def->zerror_file = base.zerror_file;
+    def->opaque = base.opaque;
+}
+
+void test_backends(void) {
+    const char* path = mz_path("backends.zip");
+    zlib_filefunc64_def defs[5];
+    zlib_filefunc_def def32;
+    int b;
+
+    mz_write_set(path, 2000, 300, APPEND_STATUS_CREATE, -1);
+    fill_fopen64_filefunc(&defs[0]);
+    fill_mmap64_filefunc(&defs[1]);
+    fill_pread64_filefunc(&defs[2]);
+    fill_garbage_filefunc(&defs[3]);
+    /* the pread functions with only their positional read */
+    {
+        zlib_filefunc64_def pread_def;
+        fill_pread64_filefunc(&pread_def);
+        memcpy(&defs[4], &pread_def, sizeof(defs[4]));
+        init_filefunc64_ext(&defs[4]);
+        defs[4].zread_at64_file = pread_def.zread_at64_file;
+    }
+
+    for (b = 0; b < 5; b++)
+    {
+        int indexed;
+        for (indexed = 0; indexed < 2; indexed++)
+        {
+            unzFile uf = unzOpen3_64(path, &defs[b], indexed ? UNZ_OPEN_INDEXED : 0);
+            CHECK(uf != NULL);
+            if (uf == NULL)
+                continue;
+            mz_check_set(uf, 2000, 300);
+            check_iteration(uf, 2000, 300);
+            CHECK_OK(unzClose(uf));
+        }
+    }
+
+    fill_fopen_filefunc(&def32);
+    {
+        unzFile uf = unzOpen2(path, &def32);
+        CHECK(uf != NULL);
+        if (uf != NULL)
+        {
+            mz_check_set(uf, 2000, 300);
+            CHECK_OK(unzClose(uf));
+        }
+    }
+
+    /* the garbage optional functions are not called for writing either */
+    {
+        zipFile zf = zipOpen2_64(path, APPEND_STATUS_ADDINZIP, NULL, &defs[3]);
+        char name[64];
+        const char* names[1];
+        mz_name(2000, name);
+        names[0] = name;
+        CHECK(zf != NULL);
+        if (zf != NULL)
+        {
+            CHECK(zipDeleteMembers(zf, names, 1) == ZIP_PARAMERROR);
+            CHECK_OK(zipClose(zf, NULL));
+        }
+    }
+}
+
+void test_view(void) {
+    const char* path = mz_path("view.zip");
+    const char* bad_path = mz_path("view_bad.zip");
+    zlib_filefunc64_def mmap_def;
+    unzFile uf;
+    unsigned views = 0;
+    int err;
+
+    mz_write_set(path, 0, 200, APPEND_STATUS_CREATE, -1);
+    fill_mmap64_filefunc(&mmap_def);
+
+    uf = unzOpen2_64(path, &mmap_def);
+    CHECK(uf != NULL);
+    if (uf == NULL)
+        return;
+    for (err = unzGoToFirstFile(uf); err == UNZ_OK; err = unzGoToNextFile(uf))
+    {
+        unz_file_info64 info;
+        const void* view = NULL;
+        ZPOS64_T len = 0;
+        int r;
+
+        CHECK_OK(unzGetCurrentFileInfo64(uf, &info, NULL, 0, NULL, 0, NULL, 0));
+        r = unzGetCurrentFileView(uf, &view, &len);
+        if (info.compression_method == 0)
+        {
+            size_t size;
+            unsigned i = views * 3;
+            const unsigned char* data = mz_content(i, &size);
+            CHECK(r == UNZ_OK);
+            CHECK((len == size) && (memcmp(view, data, size) == 0));
+            CHECK_OK(unzCheckCurrentFileView(uf, view, len));
+            if (len > 0)
+                CHECK(unzCheckCurrentFileView(uf, view, len - 1) == UNZ_CRCERROR);
+            views++;
+        }
+        else
+            CHECK((r == UNZ_PARAMERROR) && (view == NULL));
+    }
+    CHECK(views == 67);
+    CHECK_OK(unzClose(uf));
+
+    /* no view without mapping */
+    uf = unzOpen64(path);
+    if (uf != NULL)
+    {
+        const void* view;
+        ZPOS64_T len;
+        char name[64];
+        mz_name(3, name);
+        CHECK_OK(unzLocateFile(uf, name, 1));
+        CHECK(unzGetCurrentFileView(uf, &view, &len) == UNZ_PARAMERROR);
+        CHECK_OK(unzClose(uf));
+    }
+
+    /* a changed byte in the data of a stored file */
+    mz_copy_file(path, bad_path);
+    uf = unzOpen64(bad_path);
+    if (uf != NULL)
+    {
+        char name[64];
+        ZPOS64_T pos;
+        FILE* file;
+        mz_name(3, name);
+        CHECK_OK(unzLocateFile(uf, name, 1));
+        CHECK_OK(unzOpenCurrentFile(uf));
+        pos = unzGetCurrentFileZStreamPos64(uf);
+        CHECK_OK(unzCloseCurrentFile(uf));
+        CHECK_OK(unzClose(uf));
+        file = fopen(bad_path, "r+b");
+        fseek(file, (long)pos + 10, SEEK_SET);
+        fputc(mz_content_size(3, 11)[10] ^ 0x40, file);
+        fclose(file);
+
+        uf = unzOpen2_64(bad_path, &mmap_def);
+        if (uf != NULL)
+        {
+            const void* view;
+            ZPOS64_T len;
+            CHECK_OK(unzLocateFile(uf, name, 1));
+            CHECK_OK(unzGetCurrentFileView(uf, &view, &len));
+            CHECK(unzCheckCurrentFileView(uf, view, len) == UNZ_CRCERROR);
+            CHECK_OK(unzClose(uf));
+        }
+    }
+}
+
+#define MANY_ENTRIES 70000
+
+void test_many_entries(void) {
+    const char* path = mz_path("many.zip");
+    zipFile zf = zipOpen64(path, APPEND_STATUS_CREATE);
+    unzFile uf;
+    unsigned i;
+    int err;
+
+    CHECK(zf != NULL);
+    if (zf == NULL)
+        return;
+    for (i = 0; i < MANY_ENTRIES; i++)
+    {
+        char name[32];
+        sprintf(name, "e%u", i);
+        CHECK_OK(zipOpenNewFileInZip64(zf, name, NULL, NULL, 0, NULL, 0, NULL, 0, 0, 0));
+        CHECK_OK(zipWriteInFileInZip(zf, name, (unsigned)(i % 5)));
+        CHECK_OK(zipCloseFileInZip(zf));
+    }
+    CHECK_OK(zipClose(zf, NULL));
+    mz_external(path, "e69999", NULL, "e699", 4);
+    mz_external_count(path, MANY_ENTRIES);
+
+    for (i = 0; i < 2; i++)
+    {
+        unz_global_info64 gi;
+        ZPOS64_T n = 0;
+        uf = unzOpen3_64(path, NULL, (i == 0) ? 0 : UNZ_OPEN_INDEXED | UNZ_OPEN_BUFFERED);
+        CHECK(uf != NULL);
+        if (uf == NULL)
+            continue;
+        CHECK_OK(unzGetGlobalInfo64(uf, &gi));
+        CHECK(gi.number_entry == MANY_ENTRIES);
+        for (err = unzGoToFirstFile(uf); err == UNZ_OK; err = unzGoToNextFile(uf))
+            n++;
+        CHECK(n == MANY_ENTRIES);
+        mz_check_file(uf, "e69999", NULL, "e699", 4);
+        mz_check_file(uf, "e0", NULL, "", 0);
+        CHECK_OK(unzClose(uf));
+    }
+}
+
+typedef struct
+{
+    uLong crc;
+    ZPOS64_T size;
+    int done;
+    int bad;
+} extract_result;
+
+typedef struct
+{
+    extract_result* results;
+    long stop_at;
+} extract_state;
+
+static int extract_func(voidpf opaque, const unz64_file_pos* file_pos, ZPOS64_T offset,
+                        const void* buf, uLong len) {
+    extract_state* state = (extract_state*)opaque;
+    extract_result* r = &state->results[file_pos->num_of_file];
+    if (offset != r->size)
+        r->bad = 1;
+    if (buf == NULL)
+    {
+        r->done++;
+        return ((long)file_pos->num_of_file == state->stop_at) ? 1234 : UNZ_OK;
+    }
+    r->crc = crc32(r->crc, (const Bytef*)buf, (uInt)len);
+    r->size += len;
+    return UNZ_OK;
+}
+
+static void reset_results(extract_result* results, unsigned number) {
+    unsigned i;
+    memset(results, 0, number * sizeof(extract_result));
+    for (i = 0; i < number; i++)
+        results[i].crc = crc32(0, NULL, 0);
+}
+
+#define EXTRACT_SIZE 400
+
+void test_parallel_extract(void) {
+    const char* path = mz_path("extract.zip");
+    zlib_filefunc64_def defs[3];
+    extract_result results[EXTRACT_SIZE];
+    extract_state state;
+    int b;
+
+    mz_write_set(path, 0, EXTRACT_SIZE, APPEND_STATUS_CREATE, -1);
+    fill_fopen64_filefunc(&defs[0]);
+    fill_mmap64_filefunc(&defs[1]);
+    fill_pread64_filefunc(&defs[2]);
+    state.results = results;
+
+    for (b = 0; b < 3; b++)
+    {
+        static const int threads[] = { 4, 1, 0 };
+        unzFile uf = unzOpen3_64(path, &defs[b], UNZ_OPEN_INDEXED);
+        unz64_file_pos before, after, subset[EXTRACT_SIZE / 3 + 1];
+        unsigned number_subset = 0, i;
+        size_t t;
+
+        CHECK(uf != NULL);
+        if (uf == NULL)
+            continue;
+        for (t = 0; t < sizeof(threads) / sizeof(threads[0]); t++)
+        {
+            int done = 0;
+
+            CHECK_OK(unzGoToFirstFile(uf));
+            CHECK_OK(unzGoToNextFile(uf));
+            CHECK_OK(unzGetFilePos64(uf, &before));
+            reset_results(results, EXTRACT_SIZE);
+            state.stop_at = -1;
+            CHECK_OK(unzExtractParallel(uf, NULL, 0, threads[t], extract_func, &state));
+            CHECK_OK(unzGetFilePos64(uf, &after));
+            CHECK(before.num_of_file == after.num_of_file);
+            for (i = 0; i < EXTRACT_SIZE; i++)
+            {
+                size_t size;
+                const unsigned char* data = mz_content(i, &size);
+                if ((results[i].done != 1) || results[i].bad || (results[i].size != size) ||
+                    (results[i].crc != crc32(0, data, (uInt)size)))
+                {
+                    fprintf(stderr, "parallel extract %d/%d: bad file %u\n", b, threads[t], i);
+                    mz_failures++;
+                    break;
+                }
+            }
+
+            /* a third of the files */
+            number_subset = 0;
+            for (i = 0; i < EXTRACT_SIZE; i += 3)
+            {
+                char name[64];
+                mz_name(i, name);
+                CHECK_OK(unzLocateFile(uf, name, 1));
+                CHECK_OK(unzGetFilePos64(uf, &subset[number_subset++]));
+            }
+            reset_results(results, EXTRACT_SIZE);
+            CHECK_OK(unzExtractParallel(uf, subset, number_subset, threads[t], extract_func, &state));
+            for (i = 0; i < EXTRACT_SIZE; i++)
+                done += results[i].done;
+            CHECK(done == (int)number_subset);
+            CHECK(results[3].done == 1);
+            CHECK(results[4].done == 0);
+
+            /* stopped by extract_func */
+            reset_results(results, EXTRACT_SIZE);
+            state.stop_at = 5;
+            CHECK(unzExtractParallel(uf, NULL, 0, threads[t], extract_func, &state) == 1234);
+        }
+        CHECK_OK(unzClose(uf));
+    }
+}
+
+#define STREAM_BUF 300000
+
+/* read all the files of path in order with unzStreamOpen64, and check them
+   against the files first to first+number-1; return the number of files */
+static unsigned stream_read(const char* path, unsigned first, int expect_error) {
+    unzStream us = unzStreamOpen64(path, NULL);
+    unsigned char* buf = (unsigned char*)malloc(STREAM_BUF);
+    unsigned n = 0;
+    int err = UNZ_OK;
+
+    CHECK(us != NULL);
+    if (us == NULL)
+    {
+        free(buf);
+        return 0;
+    }
+    for (;;)
+    {
+        unz_file_info64 info;
+        char name[64], expected[64];
+        size_t size, done = 0;
+        const unsigned char* data = mz_content(first + n, &size);
+        int read;
+
+        err = unzStreamNextFile(us, &info, name, sizeof(name));
+        if (err != UNZ_OK)
+            break;
+        mz_name(first + n, expected);
+        if (!expect_error)
+            CHECK(strcmp(name, expected) == 0);
+        do
+        {
+            unsigned len = 1 + (unsigned)(done % 65536);
+            if (len > STREAM_BUF - done)
+                len = (unsigned)(STREAM_BUF - done);
+            read = (len > 0) ? unzStreamReadFile(us, buf + done, len) : UNZ_BADZIPFILE;
+            if (read > 0)
+                done += (size_t)read;
+        } while (read > 0);
+        if (read < 0)
+        {
+            err = read;
+            break;
+        }
+        if (!expect_error)
+            CHECK((done == size) && (memcmp(buf, data, size) == 0));
+        n++;
+    }
+    if (expect_error)
+        CHECK(err != UNZ_END_OF_LIST_OF_FILE);
+    else
+        CHECK(err == UNZ_END_OF_LIST_OF_FILE);
+    CHECK_OK(unzStreamClose(us));
+    free(buf);
+    return n;
+}
+
+void test_stream_reader(void) {
+    const char* path = mz_path("stream_read.zip");
+    const char* cut_path = mz_path("stream_cut.zip");
+    long long size;
+
+    mz_write_set(path, 100, 300, APPEND_STATUS_CREATE, -1);
+    CHECK(stream_read(path, 100, 0) == 300);
+
+    /* a truncated zipfile gives an error, not the end of the files */
+    size = mz_file_size(path);
+    mz_copy_file(path, cut_path);
+    CHECK(truncate(cut_path, (off_t)(size / 2)) == 0);
+    CHECK(stream_read(cut_path, 100, 1) < 300);
+    CHECK(truncate(cut_path, 10) == 0);
+    CHECK(stream_read(cut_path, 100, 1) == 0);
+
+    CHECK(unzStreamOpen64(mz_path("missing.zip"), NULL) == NULL);
+}
+
+#define SEEK_FILE_SIZE (5 << 20)
+
+static void random_reads(unzFile uf, const unsigned char* data, ZPOS64_T size, int reads) {
+    unsigned char buf[777];
+    unsigned x = 17;
+    ZPOS64_T cur = 0;
+    int i;
+
+    for (i = 0; i < reads; i++)
+    {
+        ZPOS64_T pos, offset;
+        int origin = i % 3, read, want;
+
+        x = x * 1103515245 + 12345;
+        pos = ((ZPOS64_T)x << 7) % (size + 1);
+        offset = (origin == ZLIB_FILEFUNC_SEEK_SET) ? pos :
+                 (origin == ZLIB_FILEFUNC_SEEK_CUR) ? pos - cur : pos - size;
+        if (unzSeek64(uf, offset, origin) != UNZ_OK)
+        {
+            fprintf(stderr, "seek %d to %lu failed\n", i, (unsigned long)pos);
+            mz_failures++;
+            return;
+        }
+        CHECK(unztell64(uf) == pos);
+        want = (size - pos < sizeof(buf)) ? (int)(size - pos) : (int)sizeof(buf);
+        read = unzReadCurrentFile(uf, buf, sizeof(buf));
+        if ((read != want) || (memcmp(buf, data + pos, (size_t)want) != 0))
+        {
+            fprintf(stderr, "read after seek %d to %lu: bad data\n", i, (unsigned long)pos);
+            mz_failures++;
+            return;
+        }
+        cur = pos + (ZPOS64_T)read;
+    }
+}
+
+void test_seek(void) {
+    const char* path = mz_path("seek.zip");
+    const unsigned char* data = mz_content_size(42, SEEK_FILE_SIZE);
+    zipFile zf = zipOpen64(path, APPEND_STATUS_CREATE);
+    zlib_filefunc64_def mmap_def;
+    unsigned char* index = NULL;
+    ZPOS64_T index_size = 0;
+    int b;
+
+    CHECK(zf != NULL);
+    if (zf == NULL)
+        return;
+    CHECK_OK(zipOpenNewFileInZip64(zf, "big", NULL, NULL, 0, NULL, 0, NULL, Z_DEFLATED, 6, 1));
+    CHECK_OK(zipWriteInFileInZip(zf, data, SEEK_FILE_SIZE));
+    CHECK_OK(zipCloseFileInZip(zf));
+    CHECK_OK(zipOpenNewFileInZip64(zf, "stored", NULL, NULL, 0, NULL, 0, NULL, 0, 0, 0));
+    CHECK_OK(zipWriteInFileInZip(zf, data, 1 << 20));
+    CHECK_OK(zipCloseFileInZip(zf));
+    CHECK_OK(zipClose(zf, NULL));
+    mz_external(path, "big", NULL, data, SEEK_FILE_SIZE);
+    mz_external(path, "stored", NULL, data, 1 << 20);
+    fill_mmap64_filefunc(&mmap_def);
+
+    for (b = 0; b < 2; b++)
+    {
+        unzFile uf = (b == 0) ? unzOpen64(path) : unzOpen2_64(path, &mmap_def);
+        CHECK(uf != NULL);
+        if (uf == NULL)
+            continue;
+
+        CHECK_OK(unzLocateFile(uf, "big", 1));
+        CHECK_OK(unzOpenCurrentFile(uf));
+        if (b == 1)
+            CHECK_OK(unzImportSeekIndex(uf, index, index_size));
+        random_reads(uf, data, SEEK_FILE_SIZE, 300);
+        CHECK(unzSeek64(uf, SEEK_FILE_SIZE + 1, ZLIB_FILEFUNC_SEEK_SET) == UNZ_PARAMERROR);
+        CHECK(unzSeek64(uf, 0, 7) == UNZ_PARAMERROR);
+        if (b == 0)
+        {
+            CHECK_OK(unzExportSeekIndex(uf, NULL, &index_size));
+            index = (unsigned char*)malloc((size_t)index_size);
+            CHECK_OK(unzExportSeekIndex(uf, index, &index_size));
+        }
+        /* read from 0 after seeking: the crc is checked again */
+        CHECK_OK(unzSeek64(uf, 0, ZLIB_FILEFUNC_SEEK_SET));
+        {
+            ZPOS64_T read_size;
+            unsigned char* read = mz_read_current(uf, &read_size);
+            CHECK((read != NULL) && (read_size == SEEK_FILE_SIZE) &&
+                  (memcmp(read, data, SEEK_FILE_SIZE) == 0));
+            free(read);
+        }
+        CHECK_OK(unzCloseCurrentFile(uf));
+
+        CHECK_OK(unzLocateFile(uf, "stored", 1));
+        CHECK_OK(unzOpenCurrentFile(uf));
+        CHECK(unzImportSeekIndex(uf, index, index_size) == UNZ_PARAMERROR);
+        random_reads(uf, data, 1 << 20, 300);
+        CHECK_OK(unzCloseCurrentFile(uf));
+        CHECK_OK(unzClose(uf));
+    }
+
+    /* the index of another file */
+    {
+        const char* other_path = mz_path("seek_other.zip");
+        unzFile uf;
+        zf = zipOpen64(other_path, APPEND_STATUS_CREATE);
+        CHECK_OK(zipOpenNewFileInZip64(zf, "big", NULL, NULL, 0, NULL, 0, NULL, Z_DEFLATED, 1, 0));
+        CHECK_OK(zipWriteInFileInZip(zf, data + 1, SEEK_FILE_SIZE - 1));
+        CHECK_OK(zipCloseFileInZip(zf));
+        CHECK_OK(zipClose(zf, NULL));
+        uf = unzOpen64(other_path);
+        CHECK_OK(unzLocateFile(uf, "big", 1));
+        CHECK_OK(unzOpenCurrentFile(uf));
+        CHECK(unzImportSeekIndex(uf, index, index_size) == UNZ_BADZIPFILE);
+        CHECK(unzImportSeekIndex(uf, index, index_size / 2) == UNZ_BADZIPFILE);
+        random_reads(uf, data + 1, SEEK_FILE_SIZE - 1, 50);
+        CHECK_OK(unzCloseCurrentFile(uf));
+        CHECK_OK(unzClose(uf));
+    }
+    free(index);
+}
+
+static void check_index_open(const char* path, zlib_filefunc64_def* def, const char* index_path,
+                             unsigned first, unsigned number) {
+    unzFile uf = unzOpen4_64(path, def, 0, index_path);
+    CHECK(uf != NULL);
+    if (uf == NULL)
+        return;
+    check_iteration(uf, first, number);
+    mz_check_set(uf, first, number);
+    CHECK_OK(unzClose(uf));
+}
+
+static void write_garbage(const char* path, long size) {
+    FILE* file = fopen(path, "wb");
+    long i;
+    for (i = 0; i < size; i++)
+        fputc((int)((i * 7) ^ (i >> 8)) & 0xff, file);
+    fclose(file);
+}
+
+void test_index_file(void) {
+    const char* path = mz_path("index.zip");
+    const char* index_path = mz_path("index.zip.idx");
+    zlib_filefunc64_def defs[3];
+    long long index_size;
+    int b;
+
+    fill_fopen64_filefunc(&defs[0]);
+    fill_mmap64_filefunc(&defs[1]);
+    fill_pread64_filefunc(&defs[2]);
+    mz_write_set(path, 0, 500, APPEND_STATUS_CREATE, -1);
+    unlink(index_path);
+
+    check_index_open(path, &defs[1], index_path, 0, 500);
+    index_size = mz_file_size(index_path);
+    CHECK(index_size > 0);
+    for (b = 0; b < 3; b++)
+        check_index_open(path, &defs[b], index_path, 0, 500);
+
+    /* the zipfile changed: the stale index is not used */
+    mz_write_set(path, 0, 520, APPEND_STATUS_CREATE, -1);
+    for (b = 0; b < 3; b++)
+        check_index_open(path, &defs[b], index_path, 0, 520);
+    mz_write_set(path, 520, 10, APPEND_STATUS_ADDINZIP, -1);
+    check_index_open(path, &defs[1], index_path, 0, 530);
+
+    /* truncated, damaged or garbage index files */
+    index_size = mz_file_size(index_path);
+    CHECK(truncate(index_path, (off_t)(index_size / 2)) == 0);
+    check_index_open(path, &defs[1], index_path, 0, 530);
+    {
+        FILE* file = fopen(index_path, "r+b");
+        long at;
+        for (at = 16; at < index_size; at += index_size / 7)
+        {
+            fseek(file, at, SEEK_SET);
+            fputc(0x7f, file);
+        }
+        fclose(file);
+    }
+    for (b = 0; b < 3; b++)
+        check_index_open(path, &defs[b], index_path, 0, 530);
+    write_garbage(index_path, (long)index_size);
+    check_index_open(path, &defs[2], index_path, 0, 530);
+    write_garbage(index_path, 3);
+    check_index_open(path, &defs[1], index_path, 0, 530);
+
+    /* the index file written again for another zipfile, then for the first
+       one, while the other handle uses it */
+    {
+        const char* other_path = mz_path("index_other.zip");
+        unzFile uf, other;
+        mz_write_set(other_path, 3000, 200, APPEND_STATUS_CREATE, -1);
+        check_index_open(path, &defs[1], index_path, 0, 530);
+        uf = unzOpen4_64(path, &defs[1], 0, index_path);
+        CHECK(uf != NULL);
+        other = unzOpen4_64(other_path, &defs[1], 0, index_path);
+        CHECK(other != NULL);
+        if ((uf != NULL) && (other != NULL))
+        {
+            check_iteration(uf, 0, 530);
+            mz_check_set(uf, 0, 530);
+            CHECK_OK(unzWriteIndexFile(uf, index_path));
+            check_iteration(other, 3000, 200);
+            mz_check_set(other, 3000, 200);
+        }
+        if (uf != NULL)
+            CHECK_OK(unzClose(uf));
+        if (other != NULL)
+            CHECK_OK(unzClose(other));
+    }
+
+    /* no index file can be written */
+    check_index_open(path, &defs[0], mz_path("missing/index.idx"), 0, 530);
+
+    /* the checkpoints kept in the index file */
+    {
+        const unsigned char* data = mz_content_size(7, 3 << 20);
+        const char* big_path = mz_path("index_big.zip");
+        zipFile zf = zipOpen64(big_path, APPEND_STATUS_CREATE);
+        unzFile uf;
+        ZPOS64_T size;
+        unsigned char buf[100];
+
+        CHECK_OK(zipOpenNewFileInZip64(zf, "big", NULL, NULL, 0, NULL, 0, NULL, Z_DEFLATED, 6, 0));
+        CHECK_OK(zipWriteInFileInZip(zf, data, 3 << 20));
+        CHECK_OK(zipCloseFileInZip(zf));
+        CHECK_OK(zipClose(zf, NULL));
+        uf = unzOpen4_64(big_path, &defs[1], 0, index_path);
+        CHECK_OK(unzLocateFile(uf, "big", 1));
+        CHECK_OK(unzOpenCurrentFile(uf));
+        CHECK_OK(unzExportSeekIndex(uf, NULL, &size));
+        CHECK_OK(unzCloseCurrentFile(uf));
+        CHECK_OK(unzWriteIndexFile(uf, index_path));
+        CHECK_OK(unzClose(uf));
+        for (b = 0; b < 3; b++)
+        {
+            uf = unzOpen4_64(big_path, &defs[b], 0, index_path);
+            CHECK_OK(unzLocateFile(uf, "big", 1));
+            CHECK_OK(unzOpenCurrentFile(uf));
+            CHECK_OK(unzSeek64(uf, (3 << 20) - 50, ZLIB_FILEFUNC_SEEK_SET));
+            CHECK(unzReadCurrentFile(uf, buf, sizeof(buf)) == 50);
+            CHECK(memcmp(buf, data + (3 << 20) - 50, 50) == 0);
+            CHECK_OK(unzCloseCurrentFile(uf));
+            CHECK_OK(unzClose(uf));
+        }
+        uf = unzOpen64(big_path);
+        CHECK(unzWriteIndexFile(uf, index_path) == UNZ_PARAMERROR);
+        CHECK_OK(unzClose(uf));
+    }
+}
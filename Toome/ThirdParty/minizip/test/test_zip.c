@@ -0,0 +1,925 @@
+/* test_zip.c -- writing tests: parallel deflate, members from memory,
+   streaming, encryption, other methods, append, delete and copy
+*/
+
+#include "mztest.h"
+
+#include <unistd.h>
+
+/* add the content size bytes of i as name, written by blocks of block bytes */
+static void add_file(zipFile zf, const char* name, unsigned i, size_t size, int method, int level,
+                     const char* password, unsigned block) {
+    const unsigned char* data = mz_content_size(i, size);
+    size_t done = 0;
+    CHECK_OK(zipOpenNewFileInZip3_64(zf, name, NULL, NULL, 0, NULL, 0, NULL, method, level, 0,
+                                     -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY, password,
+                                     (password != NULL) ? crc32(0, data, (uInt)size) : 0,
+                                     size >= 0xffffffff));
+    while (done < size)
+    {
+        unsigned len = (size - done < block) ? (unsigned)(size - done) : block;
+        CHECK_OK(zipWriteInFileInZip(zf, data + done, len));
+        done += len;
+    }
+    CHECK_OK(zipCloseFileInZip(zf));
+}
+
+/* check the file name of path, content size bytes of i */
+static void check_content(const char* path, const char* name, unsigned i, size_t size,
+                          const char* password) {
+    unzFile uf = unzOpen64(path);
+    CHECK(uf != NULL);
+    if (uf == NULL)
+        return;
+    mz_check_file(uf, name, password, mz_content_size(i, size), size);
+    CHECK_OK(unzClose(uf));
+}
+
+void test_parallel_deflate(void) {
+    const char* path = mz_path("parallel_deflate.zip");
+    static const size_t sizes[] = { 3 << 20, 100000, 1, 0, (1 << 20) + 17 };
+    static const uLong block_sizes[] = { 0, 65536, 1 << 20 };
+    size_t b, s;
+
+    for (b = 0; b < sizeof(block_sizes) / sizeof(block_sizes[0]); b++)
+    {
+        zipFile zf = zipOpen64(path, APPEND_STATUS_CREATE);
+        CHECK(zf != NULL);
+        if (zf == NULL)
+            continue;
+        CHECK_OK(zipSetParallelDeflate(zf, 4, block_sizes[b]));
+        for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            char name[32];
+            sprintf(name, "p%lu", (unsigned long)s);
+            add_file(zf, name, (unsigned)s, sizes[s], Z_DEFLATED, (s % 2) ? 9 : 6, NULL, 100000);
+        }
+        /* back to one thread */
+        CHECK_OK(zipSetParallelDeflate(zf, 1, 0));
+        add_file(zf, "single", 9, 500000, Z_DEFLATED, 6, NULL, 65536);
+        CHECK_OK(zipClose(zf, NULL));
+
+        for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            char name[32];
+            sprintf(name, "p%lu", (unsigned long)s);
+            check_content(path, name, (unsigned)s, sizes[s], NULL);
+        }
+        check_content(path, "single", 9, 500000, NULL);
+    }
+    /* the last one is read back by zipfile */
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        char name[32];
+        sprintf(name, "p%lu", (unsigned long)s);
+        mz_external(path, name, NULL, mz_content_size((unsigned)s, sizes[s]), sizes[s]);
+    }
+    mz_external_count(path, sizeof(sizes) / sizeof(sizes[0]) + 1);
+}
+
+#define MEMBERS 300
+#define CONTENT_OUT 300000
+
+void test_members(void) {
+    const char* path = mz_path("members.zip");
+    static char names[MEMBERS][32];
+    static zip_member members[MEMBERS];
+    static const int threads[] = { 4, 1, 0 };
+    unsigned char* out = (unsigned char*)malloc(CONTENT_OUT);
+    size_t t;
+    unsigned i;
+
+    for (i = 0; i < MEMBERS; i++)
+    {
+        size_t size;
+        sprintf(names[i], "m/%u", i);
+        memset(&members[i], 0, sizeof(members[i]));
+        members[i].filename = names[i];
+        members[i].buf = mz_content(i, &size);
+        members[i].size = size;
+        members[i].method = (i % 4 == 0) ? 0 : Z_DEFLATED;
+        members[i].level = (i % 3 == 0) ? Z_DEFAULT_COMPRESSION : (int)(i % 9) + 1;
+        members[i].comment = (i % 5 == 0) ? "member comment" : NULL;
+    }
+    /* no data at all */
+    members[7].buf = NULL;
+    members[7].size = 0;
+
+    for (t = 0; t < sizeof(threads) / sizeof(threads[0]); t++)
+    {
+        zipFile zf = zipOpen64(path, APPEND_STATUS_CREATE);
+        unzFile uf;
+        int err;
+
+        CHECK(zf != NULL);
+        if (zf == NULL)
+            continue;
+        for (i = 0; i < 20; i++)
+            CHECK_OK(zipAddMemberFromBuffer(zf, &members[i]));
+        /* in two calls: the deflaters of the threads are kept from the first */
+        CHECK_OK(zipAddMembersParallel(zf, members + 20, 50, threads[t]));
+        CHECK_OK(zipAddMembersParallel(zf, members + 70, MEMBERS - 70, threads[t]));
+        CHECK_OK(zipClose(zf, NULL));
+
+        uf = unzOpen64(path);
+        CHECK(uf != NULL);
+        if (uf == NULL)
+            continue;
+        i = 0;
+        for (err = unzGoToFirstFile(uf); err == UNZ_OK; err = unzGoToNextFile(uf), i++)
+        {
+            unz_file_info64 info;
+            char name[32], comment[32];
+            CHECK_OK(unzGetCurrentFileInfo64(uf, &info, name, sizeof(name), NULL, 0, comment, sizeof(comment)));
+            CHECK(strcmp(name, names[i]) == 0);
+            CHECK((members[i].comment == NULL) ? (info.size_file_comment == 0) :
+                  (strcmp(comment, members[i].comment) == 0));
+            CHECK_OK(unzOpenCurrentFile(uf));
+            if (info.uncompressed_size > 0)
+                CHECK(unzReadCurrentFileFully(uf, out, info.uncompressed_size - 1) == UNZ_PARAMERROR);
+            CHECK_OK(unzReadCurrentFileFully(uf, out, CONTENT_OUT));
+            CHECK((info.uncompressed_size == members[i].size) &&
+                  ((members[i].size == 0) || (memcmp(out, members[i].buf, (size_t)members[i].size) == 0)));
+            CHECK(unzReadCurrentFile(uf, out, 10) == 0);
+            CHECK_OK(unzCloseCurrentFile(uf));
+        }
+        CHECK(i == MEMBERS);
+        CHECK_OK(unzClose(uf));
+    }
+    for (i = 0; i < MEMBERS; i += 7)
+        mz_external(path, names[i], NULL, members[i].buf, (size_t)members[i].size);
+    mz_external_count(path, MEMBERS);
+    free(out);
+}
+
+/* io functions which can only write forward, as to a pipe: seeking, telling
+   and reading fail */
+static voidpf ZCALLBACK pipe_open(voidpf opaque, const void* filename, int mode) {
+    (void)opaque;
+    return ((mode & ZLIB_FILEFUNC_MODE_CREATE) != 0) ? fopen((const char*)filename, "wb") : NULL;
+}
+
+static uLong ZCALLBACK pipe_read(voidpf opaque, voidpf stream, void* buf, uLong size) {
+    (void)opaque; (void)stream; (void)buf; (void)size;
+    return 0;
+}
+
+static uLong ZCALLBACK pipe_write(voidpf opaque, voidpf stream, const void* buf, uLong size) {
+    (void)opaque;
+    return (uLong)fwrite(buf, 1, (size_t)size, (FILE*)stream);
+}
+
+static ZPOS64_T ZCALLBACK pipe_tell(voidpf opaque, voidpf stream) {
+    (void)opaque; (void)stream;
+    return (ZPOS64_T)-1;
+}
+
+static long ZCALLBACK pipe_seek(voidpf opaque, voidpf stream, ZPOS64_T offset, int origin) {
+    (void)opaque; (void)stream; (void)offset; (void)origin;
+    return -1;
+}
+
+static int ZCALLBACK pipe_close(voidpf opaque, voidpf stream) {
+    (void)opaque;
+    return fclose((FILE*)stream);
+}
+
+static int ZCALLBACK pipe_error(voidpf opaque, voidpf stream) {
+    (void)opaque;
+    return ferror((FILE*)stream);
+}
+
+static void fill_pipe_filefunc(zlib_filefunc64_def* def) {
+    memset(def, 0, sizeof(*def));
+    def->zopen64_file = pipe_open;
+    def->zread_file = pipe_read;
+    def->zwrite_file = pipe_write;
+    def->ztell64_file = pipe_tell;
+    def->zseek64_file = pipe_seek;
+    def->zclose_file = pipe_close;
+    def->zerror_file = pipe_error;
+}
+
+void test_stream_writer(void) {
+    const char* path = mz_path("stream_write.zip");
+    zlib_filefunc64_def pipe_def;
+    zipFile zf;
+    unzFile uf;
+    unzStream us;
+    int err, n = 0;
+
+    fill_pipe_filefunc(&pipe_def);
+    zf = zipOpen2_64(path, APPEND_STATUS_STREAM, NULL, &pipe_def);
+    CHECK(zf != NULL);
+    if (zf == NULL)
+        return;
+    add_file(zf, "stored", 1, 100000, 0, 0, NULL, 7777);
+    add_file(zf, "deflated", 2, 1 << 20, Z_DEFLATED, 6, NULL, 65536);
+    add_file(zf, "empty", 3, 0, Z_DEFLATED, 6, NULL, 1);
+    CHECK_OK(zipSetParallelDeflate(zf, 2, 65536));
+    add_file(zf, "parallel", 4, 2 << 20, Z_DEFLATED, 6, NULL, 1 << 20);
+    add_file(zf, "pkware", 5, 200000, Z_DEFLATED, 1, "secret", 1000);
+    add_file(zf, "pkware_stored", 6, 3000, 0, 0, "secret", 1000);
+    /* the bit 3 of the flag can't be cleared here */
+    CHECK(zipDeleteMembers(zf, NULL, 0) == ZIP_PARAMERROR);
+    CHECK_OK(zipClose(zf, "streamed"));
+
+    mz_external(path, "stored", NULL, mz_content_size(1, 100000), 100000);
+    mz_external(path, "deflated", NULL, mz_content_size(2, 1 << 20), 1 << 20);
+    mz_external(path, "empty", NULL, "", 0);
+    mz_external(path, "parallel", NULL, mz_content_size(4, 2 << 20), 2 << 20);
+    mz_external(path, "pkware", "secret", mz_content_size(5, 200000), 200000);
+    mz_external(path, "pkware_stored", "secret", mz_content_size(6, 3000), 3000);
+    mz_external_count(path, 6);
+
+    uf = unzOpen64(path);
+    CHECK(uf != NULL);
+    if (uf != NULL)
+    {
+        char comment[16];
+        for (err = unzGoToFirstFile(uf); err == UNZ_OK; err = unzGoToNextFile(uf))
+        {
+            unz_file_info64 info;
+            CHECK_OK(unzGetCurrentFileInfo64(uf, &info, NULL, 0, NULL, 0, NULL, 0));
+            CHECK((info.flag & 8) != 0);
+        }
+        CHECK(unzGetGlobalComment(uf, comment, sizeof(comment)) == 8);
+        CHECK_OK(unzClose(uf));
+    }
+    check_content(path, "stored", 1, 100000, NULL);
+    check_content(path, "deflated", 2, 1 << 20, NULL);
+    check_content(path, "empty", 3, 0, NULL);
+    check_content(path, "parallel", 4, 2 << 20, NULL);
+
+    /* the forward-only reader reads up to the first encrypted file, which
+       it can't skip without knowing its size */
+    us = unzStreamOpen64(path, NULL);
+    CHECK(us != NULL);
+    if (us != NULL)
+    {
+        unz_file_info64 info;
+        char name[32];
+        unsigned char* buf = (unsigned char*)malloc(1 << 20);
+        while ((err = unzStreamNextFile(us, &info, name, sizeof(name))) == UNZ_OK)
+        {
+            size_t done = 0;
+            int read;
+            n++;
+            if (info.flag & 1)
+                continue;
+            while ((read = unzStreamReadFile(us, buf, 1 << 20)) > 0)
+            {
+                CHECK(memcmp(buf, mz_content_size((unsigned)n, done + (size_t)read) + done, (size_t)read) == 0);
+                done += (size_t)read;
+            }
+            CHECK(read == 0);
+        }
+        CHECK(err == UNZ_BADZIPFILE);
+        CHECK(n == 5);
+        CHECK_OK(unzStreamClose(us));
+        free(buf);
+    }
+}
+
+void test_aes(void) {
+    const char* path = mz_path("aes.zip");
+    const char* bad_path = mz_path("aes_bad.zip");
+    int strength, mode;
+
+    for (strength = 1; strength <= 3; strength++)
+        for (mode = 0; mode < 2; mode++)
+        {
+            zipFile zf = zipOpen64(path, (mode == 0) ? APPEND_STATUS_CREATE : APPEND_STATUS_STREAM);
+            unzFile uf;
+            CHECK(zf != NULL);
+            if (zf == NULL)
+                continue;
+            CHECK_OK(zipSetAESEncryption(zf, strength));
+            add_file(zf, "stored", 1, 100000, 0, 0, "secret", 7777);
+            add_file(zf, "deflated", 2, 300000, Z_DEFLATED, 6, "secret", 65536);
+            add_file(zf, "empty", 3, 0, Z_DEFLATED, 6, "secret", 1);
+            add_file(zf, "plain", 4, 1000, Z_DEFLATED, 6, NULL, 1000);
+            CHECK_OK(zipSetAESEncryption(zf, 0));
+            add_file(zf, "pkware", 5, 1000, Z_DEFLATED, 6, "secret", 1000);
+            CHECK_OK(zipClose(zf, NULL));
+
+            check_content(path, "stored", 1, 100000, "secret");
+            check_content(path, "deflated", 2, 300000, "secret");
+            check_content(path, "empty", 3, 0, "secret");
+            check_content(path, "plain", 4, 1000, NULL);
+
+            uf = unzOpen64(path);
+            CHECK(uf != NULL);
+            if (uf == NULL)
+                continue;
+            CHECK_OK(unzLocateFile(uf, "deflated", 1));
+            CHECK(unzOpenCurrentFilePassword(uf, "wrong") == UNZ_BADPASSWORD);
+            CHECK(unzOpenCurrentFilePassword(uf, NULL) == UNZ_BADPASSWORD);
+            {
+                int method;
+                CHECK_OK(unzOpenCurrentFile2(uf, &method, NULL, 1));
+                CHECK(method == Z_AES);
+                CHECK_OK(unzCloseCurrentFile(uf));
+            }
+            CHECK_OK(unzClose(uf));
+        }
+
+    /* a changed byte in the encrypted data fails the authentication */
+    mz_copy_file(path, bad_path);
+    {
+        unzFile uf = unzOpen64(bad_path);
+        ZPOS64_T pos;
+        FILE* file;
+        int c;
+        unsigned char* buf = (unsigned char*)malloc(100000);
+
+        CHECK_OK(unzLocateFile(uf, "stored", 1));
+        CHECK_OK(unzOpenCurrentFile2(uf, NULL, NULL, 1));
+        pos = unzGetCurrentFileZStreamPos64(uf);
+        CHECK_OK(unzCloseCurrentFile(uf));
+        CHECK_OK(unzClose(uf));
+        file = fopen(bad_path, "r+b");
+        fseek(file, (long)pos + 5000, SEEK_SET);
+        c = fgetc(file);
+        fseek(file, (long)pos + 5000, SEEK_SET);
+        fputc(c ^ 1, file);
+        fclose(file);
+
+        uf = unzOpen64(bad_path);
+        CHECK_OK(unzLocateFile(uf, "stored", 1));
+        CHECK_OK(unzOpenCurrentFilePassword(uf, "secret"));
+        while (unzReadCurrentFile(uf, buf, 100000) > 0)
+            ;
+        CHECK(unzCloseCurrentFile(uf) == UNZ_CRCERROR);
+        CHECK_OK(unzClose(uf));
+        free(buf);
+    }
+}
+
+void test_codecs(void) {
+    const char* path = mz_path("codecs.zip");
+    zipFile zf;
+    int mode;
+
+    for (mode = 0; mode < 2; mode++)
+    {
+        zf = zipOpen64(path, (mode == 0) ? APPEND_STATUS_CREATE : APPEND_STATUS_STREAM);
+        CHECK(zf != NULL);
+        if (zf == NULL)
+            return;
+#ifdef HAVE_ZSTD
+        add_file(zf, "zstd", 1, 300000, Z_ZSTD, Z_DEFAULT_COMPRESSION, NULL, 65536);
+        add_file(zf, "zstd_empty", 2, 0, Z_ZSTD, 3, NULL, 1);
+        CHECK_OK(zipSetZstdWorkers(zf, 2));
+        add_file(zf, "zstd_big", 3, 6 << 20, Z_ZSTD, 19, NULL, 1 << 20);
+        CHECK_OK(zipSetZstdWorkers(zf, 1));
+        CHECK_OK(zipSetAESEncryption(zf, 2));
+        add_file(zf, "zstd_aes", 4, 100000, Z_ZSTD, 1, "secret", 5000);
+        CHECK_OK(zipSetAESEncryption(zf, 0));
+#else
+        CHECK(zipSetZstdWorkers(zf, 2) == ZIP_PARAMERROR);
+        CHECK(zipOpenNewFileInZip64(zf, "zstd", NULL, NULL, 0, NULL, 0, NULL, Z_ZSTD, 3, 0) == ZIP_PARAMERROR);
+#endif
+#ifdef HAVE_LZMA
+        add_file(zf, "lzma", 5, 300000, Z_LZMA, Z_DEFAULT_COMPRESSION, NULL, 7777);
+        add_file(zf, "lzma_empty", 6, 0, Z_LZMA, 9, NULL, 1);
+        add_file(zf, "xz", 7, 1 << 20, Z_XZ, 6, NULL, 65536);
+        CHECK(zipOpenNewFileInZip64(zf, "lzma_bad", NULL, NULL, 0, NULL, 0, NULL, Z_LZMA, 12, 0) != ZIP_OK);
+#else
+        CHECK(zipOpenNewFileInZip64(zf, "lzma", NULL, NULL, 0, NULL, 0, NULL, Z_LZMA, 6, 0) == ZIP_PARAMERROR);
+#endif
+        add_file(zf, "deflated", 8, 1000, Z_DEFLATED, 6, NULL, 1000);
+        CHECK_OK(zipClose(zf, NULL));
+
+#ifdef HAVE_ZSTD
+        check_content(path, "zstd", 1, 300000, NULL);
+        check_content(path, "zstd_empty", 2, 0, NULL);
+        check_content(path, "zstd_big", 3, 6 << 20, NULL);
+        check_content(path, "zstd_aes", 4, 100000, "secret");
+#endif
+#ifdef HAVE_LZMA
+        check_content(path, "lzma", 5, 300000, NULL);
+        check_content(path, "lzma_empty", 6, 0, NULL);
+        check_content(path, "xz", 7, 1 << 20, NULL);
+#endif
+        check_content(path, "deflated", 8, 1000, NULL);
+    }
+#ifdef HAVE_LZMA
+    mz_external(path, "lzma", NULL, mz_content_size(5, 300000), 300000);
+    mz_external(path, "lzma_empty", NULL, "", 0);
+#endif
+    mz_external(path, "deflated", NULL, mz_content_size(8, 1000), 1000);
+}
+
+void test_append(void) {
+    const char* path = mz_path("append.zip");
+    const char* sfx_path = mz_path("append_sfx.zip");
+    unzFile uf;
+    int i;
+
+    /* adding files, twice, keeps the files and the comment */
+    mz_write_set(path, 0, 100, APPEND_STATUS_CREATE, -1);
+    mz_write_set(path, 100, 100, APPEND_STATUS_ADDINZIP, -1);
+    mz_write_set(path, 200, 50, APPEND_STATUS_ADDINZIP, 0);
+    uf = unzOpen64(path);
+    CHECK(uf != NULL);
+    if (uf != NULL)
+    {
+        char comment[16];
+        unz_global_info64 gi;
+        CHECK_OK(unzGetGlobalInfo64(uf, &gi));
+        CHECK(gi.number_entry == 250);
+        CHECK(unzGetGlobalComment(uf, comment, sizeof(comment)) == 8);
+        CHECK(strcmp(comment, "test set") == 0);
+        mz_check_set(uf, 0, 250);
+        CHECK_OK(unzClose(uf));
+    }
+
+    /* after a self extractor, with a zipfile comment changed */
+    {
+        FILE* file = fopen(sfx_path, "wb");
+        for (i = 0; i < 5000; i++)
+            fputc('S', file);
+        fclose(file);
+    }
+    mz_write_set(sfx_path, 0, 40, APPEND_STATUS_CREATEAFTER, -1);
+    mz_write_set(sfx_path, 40, 40, APPEND_STATUS_ADDINZIP, -1);
+    {
+        zipFile zf = zipOpen64(sfx_path, APPEND_STATUS_ADDINZIP);
+        CHECK(zf != NULL);
+        if (zf != NULL)
+        {
+            add_file(zf, "last", 3, 5000, Z_DEFLATED, 6, NULL, 5000);
+            CHECK_OK(zipClose(zf, "new comment"));
+        }
+    }
+    uf = unzOpen64(sfx_path);
+    CHECK(uf != NULL);
+    if (uf != NULL)
+    {
+        char comment[16];
+        CHECK(unzGetGlobalComment(uf, comment, sizeof(comment)) == 11);
+        mz_check_set(uf, 0, 80);
+        mz_check_file(uf, "last", NULL, mz_content_size(3, 5000), 5000);
+        CHECK_OK(unzClose(uf));
+    }
+    mz_external(sfx_path, "last", NULL, mz_content_size(3, 5000), 5000);
+    mz_external_count(sfx_path, 81);
+
+    /* a zipfile with a zip64 end of central directory */
+    {
+        const char* path64 = mz_path("append64.zip");
+        zipFile zf = zipOpen64(path64, APPEND_STATUS_CREATE);
+        add_file(zf, "first", 1, 1000, Z_DEFLATED, 6, NULL, 1000);
+        CHECK_OK(zipClose(zf, NULL));
+        for (i = 0; i < 3; i++)
+        {
+            char name[16];
+            zf = zipOpen64(path64, APPEND_STATUS_ADDINZIP);
+            CHECK(zf != NULL);
+            if (zf == NULL)
+                break;
+            sprintf(name, "next%d", i);
+            CHECK_OK(zipOpenNewFileInZip64(zf, name, NULL, NULL, 0, NULL, 0, NULL, Z_DEFLATED, 6, 1));
+            CHECK_OK(zipWriteInFileInZip(zf, mz_content_size(10 + i, 3000), 3000));
+            CHECK_OK(zipCloseFileInZip(zf));
+            CHECK_OK(zipClose(zf, NULL));
+        }
+        check_content(path64, "first", 1, 1000, NULL);
+        for (i = 0; i < 3; i++)
+        {
+            char name[16];
+            sprintf(name, "next%d", i);
+            check_content(path64, name, 10 + i, 3000, NULL);
+            mz_external(path64, name, NULL, mz_content_size(10 + i, 3000), 3000);
+        }
+        mz_external_count(path64, 4);
+    }
+
+    CHECK(zipOpen64(mz_path("missing.zip"), APPEND_STATUS_ADDINZIP) == NULL);
+}
+
+#define DELETE_SIZE 300
+
+/* check the set 0..DELETE_SIZE-1 with present[i]: 0 deleted, 1 there,
+   2 replaced by "new value" */
+static void check_deleted(const char* path, const char* present) {
+    unzFile uf = unzOpen64(path);
+    unz_global_info64 gi;
+    ZPOS64_T number = 0;
+    unsigned i;
+
+    CHECK(uf != NULL);
+    if (uf == NULL)
+        return;
+    for (i = 0; i < DELETE_SIZE; i++)
+    {
+        char name[64];
+        size_t size;
+        const unsigned char* data = mz_content(i, &size);
+        mz_name(i, name);
+        if (present[i] == 0)
+            CHECK(unzLocateFile(uf, name, 1) == UNZ_END_OF_LIST_OF_FILE);
+        else if (present[i] == 1)
+            mz_check_file(uf, name, NULL, data, size);
+        else
+            mz_check_file(uf, name, NULL, "new value", 9);
+        number += (present[i] != 0);
+    }
+    CHECK_OK(unzGetGlobalInfo64(uf, &gi));
+    CHECK(gi.number_entry == number);
+    CHECK_OK(unzClose(uf));
+}
+
+static int delete_names(const char* path, zlib_filefunc64_def* def, const unsigned* numbers,
+                        unsigned number) {
+    zipFile zf = zipOpen2_64(path, APPEND_STATUS_ADDINZIP, NULL, def);
+    char names[DELETE_SIZE][64];
+    const char* pnames[DELETE_SIZE];
+    unsigned i;
+    int err, err_close;
+
+    if (zf == NULL)
+        return ZIP_ERRNO;
+    for (i = 0; i < number; i++)
+    {
+        mz_name(numbers[i], names[i]);
+        pnames[i] = names[i];
+    }
+    err = zipDeleteMembers(zf, pnames, number);
+    err_close = zipClose(zf, NULL);
+    return (err != ZIP_OK) ? err : err_close;
+}
+
+void test_delete(void) {
+    const char* path;
+    zlib_filefunc64_def defs[3];
+    char present[DELETE_SIZE];
+    int b;
+
+    fill_fopen64_filefunc(&defs[0]);
+    fill_pread64_filefunc(&defs[1]);
+    fill_mmap64_filefunc(&defs[2]);
+
+    for (b = 0; b < 2; b++)
+    {
+        static const unsigned first[] = { 0, 17, 18, 19, 35, DELETE_SIZE - 1, DELETE_SIZE + 5 };
+        static const unsigned second[] = { 6, 1 };
+        unsigned all[DELETE_SIZE], i;
+        long long size = 0;
+        zipFile zf;
+        zip_member member;
+        char name[64];
+
+        path = mz_path((b == 0) ? "delete_fopen.zip" : "delete_pread.zip");
+        mz_write_set(path, 0, DELETE_SIZE, APPEND_STATUS_CREATE, -1);
+        memset(present, 1, sizeof(present));
+        size = mz_file_size(path);
+        CHECK_OK(delete_names(path, &defs[b], first, 7));
+        for (i = 0; i < 6; i++)
+            present[first[i]] = 0;
+        check_deleted(path, present);
+        CHECK(mz_file_size(path) < size);
+
+        /* replace and delete in one session */
+        zf = zipOpen2_64(path, APPEND_STATUS_ADDINZIP, NULL, &defs[b]);
+        CHECK(zf != NULL);
+        if (zf == NULL)
+            continue;
+        memset(&member, 0, sizeof(member));
+        mz_name(5, name);
+        member.filename = name;
+        member.buf = "new value";
+        member.size = 9;
+        CHECK_OK(zipReplaceMember(zf, &member));
+        present[5] = 2;
+        {
+            char names[2][64];
+            const char* pnames[2];
+            mz_name(second[0], names[0]);
+            mz_name(second[1], names[1]);
+            pnames[0] = names[0];
+            pnames[1] = names[1];
+            CHECK_OK(zipDeleteMembers(zf, pnames, 2));
+            present[second[0]] = present[second[1]] = 0;
+        }
+        mz_name(7, name);
+        member.method = Z_DEFLATED;
+        member.level = 6;
+        CHECK_OK(zipReplaceMember(zf, &member));
+        present[7] = 2;
+        CHECK_OK(zipClose(zf, NULL));
+        check_deleted(path, present);
+        if (b == 0)
+        {
+            mz_name(5, name);
+            mz_external(path, name, NULL, "new value", 9);
+            size_t size;
+            const unsigned char* data = mz_content(8, &size);
+            mz_name(8, name);
+            mz_external(path, name, NULL, data, size);
+            mz_external_count(path, DELETE_SIZE - 8);
+        }
+
+        /* delete everything */
+        if (b == 1)
+        {
+            for (i = 0; i < DELETE_SIZE; i++)
+                all[i] = i;
+            CHECK_OK(delete_names(path, &defs[b], all, DELETE_SIZE));
+            memset(present, 0, sizeof(present));
+            check_deleted(path, present);
+        }
+    }
+
+    /* not possible */
+    path = mz_path("delete_errors.zip");
+    {
+        static const unsigned one[] = { 3 };
+        zlib_filefunc64_def no_truncate;
+        zipFile zf;
+
+        mz_write_set(path, 0, 10, APPEND_STATUS_CREATE, -1);
+        /* the mmap functions can't write */
+        CHECK(zipOpen2_64(path, APPEND_STATUS_ADDINZIP, NULL, &defs[2]) == NULL);
+        fill_fopen64_filefunc(&no_truncate);
+        no_truncate.ztruncate64_file = NULL;
+        CHECK(delete_names(path, &no_truncate, one, 1) == ZIP_PARAMERROR);
+        zf = zipOpen64(path, APPEND_STATUS_ADDINZIP);
+        CHECK_OK(zipOpenNewFileInZip64(zf, "open", NULL, NULL, 0, NULL, 0, NULL, 0, 0, 0));
+        CHECK(zipDeleteMembers(zf, NULL, 0) == ZIP_PARAMERROR);
+        CHECK_OK(zipCloseFileInZip(zf));
+        CHECK_OK(zipClose(zf, NULL));
+        {
+            unzFile uf = unzOpen64(path);
+            mz_check_set(uf, 0, 10);
+            CHECK_OK(unzClose(uf));
+        }
+    }
+}
+
+/* the kinds of files of the copy sources */
+#define COPY_KINDS 6
+#define COPY_SIZE(i) (((size_t)(i) * 7919) % 200000)
+
+static void add_copy_source(zipFile zf, unsigned i) {
+    static const char extra[] = "\x55\x54\x05\x00\x01\x11\x22\x33\x44";
+    char name[32], comment[32];
+    zip_fileinfo zfi;
+    unsigned kind = i % COPY_KINDS;
+    const unsigned char* data = mz_content_size(i, COPY_SIZE(i));
+    const char* password = ((kind == 3) || (kind == 4)) ? "secret" : NULL;
+
+    sprintf(name, "d/m%u.bin", i);
+    sprintf(comment, "comment %u", i);
+    memset(&zfi, 0, sizeof(zfi));
+    zfi.dosDate = 0x5a4b3c21 + i;
+    zfi.external_fa = 0x81a40000 | i;
+    zfi.internal_fa = i & 1;
+    CHECK_OK(zipSetAESEncryption(zf, (kind == 4) ? 3 : 0));
+    CHECK_OK(zipOpenNewFileInZip4_64(zf, name, &zfi, extra, 9, extra, 9, (i % 2) ? comment : NULL,
+                                     (kind == 0) ? 0 : Z_DEFLATED, (kind == 5) ? 9 : 6, 0,
+                                     -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY, password,
+                                     crc32(0, data, (uInt)COPY_SIZE(i)), 0x31e, 0x800, kind == 2));
+    CHECK_OK(zipWriteInFileInZip(zf, data, (unsigned)COPY_SIZE(i)));
+    CHECK_OK(zipCloseFileInZip(zf));
+}
+
+#define COPY_LIST       1   /* list them for check_external.py */
+#define COPY_NO_PKWARE  2   /* the traditionally encrypted files of the first
+                               source were not copied to a streamed zipfile */
+
+/* check the copies of the files first to last by step in path */
+static void check_copies(const char* path, unsigned first, unsigned last, unsigned step,
+                         int flags) {
+    unzFile uf = unzOpen64(path);
+    unsigned i;
+
+    CHECK(uf != NULL);
+    if (uf == NULL)
+        return;
+    for (i = first; i < last; i += step)
+    {
+        char name[32], comment[32], extra[64];
+        unz_file_info64 info;
+        unsigned kind = i % COPY_KINDS;
+        const unsigned char* data = mz_content_size(i, COPY_SIZE(i));
+
+        sprintf(name, "d/m%u.bin", i);
+        if ((flags & COPY_NO_PKWARE) && (kind == 3) && (i < 60))
+        {
+            CHECK(unzLocateFile(uf, name, 1) == UNZ_END_OF_LIST_OF_FILE);
+            continue;
+        }
+        if (unzLocateFile(uf, name, 1) != UNZ_OK)
+        {
+            fprintf(stderr, "copy of %s: missing\n", name);
+            mz_failures++;
+            continue;
+        }
+        CHECK_OK(unzGetCurrentFileInfo64(uf, &info, NULL, 0, extra, sizeof(extra), comment, sizeof(comment)));
+        CHECK(info.dosDate == 0x5a4b3c21 + i);
+        CHECK(info.external_fa == (0x81a40000 | i));
+        CHECK(info.internal_fa == (uLong)(i & 1));
+        CHECK((info.flag & 0x800) != 0);
+        CHECK(info.uncompressed_size == COPY_SIZE(i));
+        CHECK((info.size_file_extra >= 9) && (memcmp(extra, "\x55\x54\x05\x00", 4) == 0));
+        if (i % 2)
+        {
+            char expected[32];
+            sprintf(expected, "comment %u", i);
+            CHECK(strcmp(comment, expected) == 0);
+        }
+        else
+            CHECK(info.size_file_comment == 0);
+        /* no traditional decryption in unzip.c: zipfile checks them */
+        if (kind != 3)
+            mz_check_file(uf, name, (kind == 4) ? "secret" : NULL, data, COPY_SIZE(i));
+        if ((flags & COPY_LIST) && (kind != 4))
+            mz_external(path, name, (kind == 3) ? "secret" : NULL, data, COPY_SIZE(i));
+    }
+    CHECK_OK(unzClose(uf));
+}
+
+/* copy the files of sources by step to path */
+static void copy_members(const char* path, int append, zlib_filefunc64_def* zip_def,
+                         zlib_filefunc64_def* unz_def, const char* const* sources,
+                         int number_source, unsigned step) {
+    zipFile zf = zipOpen2_64(path, append, NULL, zip_def);
+    int s;
+
+    CHECK(zf != NULL);
+    if (zf == NULL)
+        return;
+    for (s = 0; s < number_source; s++)
+    {
+        unzFile uf = unzOpen2_64(sources[s], unz_def);
+        unsigned k = 0;
+        int err;
+
+        CHECK(uf != NULL);
+        if (uf == NULL)
+            continue;
+        for (err = unzGoToFirstFile(uf); err == UNZ_OK; err = unzGoToNextFile(uf), k++)
+        {
+            unz_file_info64 info;
+            if (k % step != 0)
+                continue;
+            CHECK_OK(unzGetCurrentFileInfo64(uf, &info, NULL, 0, NULL, 0, NULL, 0));
+            /* traditional encryption without data descriptor can't be streamed */
+            if ((append == APPEND_STATUS_STREAM) && ((info.flag & 9) == 1) &&
+                (info.compression_method != Z_AES))
+                CHECK(zipCopyMemberFromUnz(zf, uf) == ZIP_PARAMERROR);
+            else
+                CHECK_OK(zipCopyMemberFromUnz(zf, uf));
+        }
+        CHECK_OK(unzClose(uf));
+    }
+    CHECK_OK(zipClose(zf, "merged"));
+}
+
+/* extra fields that are not whole blocks, as found in other zipfiles: the
+   Zip64 blocks are removed from them, the rest is copied as it is (the block
+   beyond the end is only in a local extra field, that zipfile doesn't read) */
+static const struct {
+    const char* name;
+    const char* local;
+    int size_local;
+    const char* global;
+    int size_global;
+    const char* copied_global;
+    int size_copied_global;
+} padded_extras[] = {
+    { "padded", "\0\0\0", 3, "\0", 1, "\0", 1 },
+    { "padded_zip64", "\x55\x54\x05\x00\x01\x11\x22\x33\x44\x01\x00", 11,
+      "\x01\x00\x08\x00\x10\x00\x00\x00\x00\x00\x00\x00\0\0\0", 15, "\0\0\0", 3 },
+    { "oversized", "\x0a\x00\xff\x7f\x01\x02", 6,
+      "\x01\x00\x08\x00\x10\x00\x00\x00\x00\x00\x00\x00\x99\x99", 14, "\x99\x99", 2 },
+};
+
+static void test_copy_padded_extras(void) {
+    const char* source = mz_path("copy_padded_source.zip");
+    const char* path = mz_path("copy_padded.zip");
+    const size_t number = sizeof(padded_extras) / sizeof(padded_extras[0]);
+    const unsigned char* data = mz_content_size(7, 5000);
+    zip_fileinfo zfi;
+    zipFile zf;
+    unzFile uf;
+    size_t i;
+
+    memset(&zfi, 0, sizeof(zfi));
+    zf = zipOpen64(source, APPEND_STATUS_CREATE);
+    for (i = 0; i < number; i++)
+    {
+        CHECK_OK(zipOpenNewFileInZip64(zf, padded_extras[i].name, &zfi,
+                                       padded_extras[i].local, (uInt)padded_extras[i].size_local,
+                                       padded_extras[i].global, (uInt)padded_extras[i].size_global,
+                                       NULL, Z_DEFLATED, 6, 0));
+        CHECK_OK(zipWriteInFileInZip(zf, data, 5000));
+        CHECK_OK(zipCloseFileInZip(zf));
+    }
+    CHECK_OK(zipClose(zf, NULL));
+
+    zf = zipOpen64(path, APPEND_STATUS_CREATE);
+    uf = unzOpen64(source);
+    CHECK(uf != NULL);
+    for (i = 0; i < number; i++)
+    {
+        CHECK_OK(unzLocateFile(uf, padded_extras[i].name, 1));
+        CHECK_OK(zipCopyMemberFromUnz(zf, uf));
+    }
+    CHECK_OK(unzClose(uf));
+    CHECK_OK(zipClose(zf, NULL));
+
+    uf = unzOpen64(path);
+    CHECK(uf != NULL);
+    if (uf == NULL)
+        return;
+    for (i = 0; i < number; i++)
+    {
+        char extra[64];
+        unz_file_info64 info;
+
+        CHECK_OK(unzLocateFile(uf, padded_extras[i].name, 1));
+        CHECK_OK(unzGetCurrentFileInfo64(uf, &info, NULL, 0, extra, sizeof(extra), NULL, 0));
+        CHECK((info.size_file_extra == (uLong)padded_extras[i].size_copied_global) &&
+              (memcmp(extra, padded_extras[i].copied_global, info.size_file_extra) == 0));
+        CHECK_OK(unzOpenCurrentFile(uf));
+        CHECK((unzGetLocalExtrafield(uf, extra, sizeof(extra)) == padded_extras[i].size_local) &&
+              (memcmp(extra, padded_extras[i].local, (size_t)padded_extras[i].size_local) == 0));
+        CHECK_OK(unzCloseCurrentFile(uf));
+        mz_check_file(uf, padded_extras[i].name, NULL, data, 5000);
+        mz_external(path, padded_extras[i].name, NULL, data, 5000);
+    }
+    CHECK_OK(unzClose(uf));
+}
+
+void test_copy(void) {
+    const char* sources[2];
+    const char* path = mz_path("copy.zip");
+    zlib_filefunc64_def defs[3];
+    zipFile zf;
+    unsigned i;
+    int zb, ub, stream;
+
+    sources[0] = mz_path("copy_source.zip");
+    sources[1] = mz_path("copy_source_streamed.zip");
+    fill_fopen64_filefunc(&defs[0]);
+    fill_pread64_filefunc(&defs[1]);
+    fill_mmap64_filefunc(&defs[2]);
+
+    zf = zipOpen64(sources[0], APPEND_STATUS_CREATE);
+    for (i = 0; i < 60; i++)
+        add_copy_source(zf, i);
+    CHECK_OK(zipClose(zf, NULL));
+    zf = zipOpen64(sources[1], APPEND_STATUS_STREAM);
+    for (i = 60; i < 120; i++)
+        add_copy_source(zf, i);
+    CHECK_OK(zipClose(zf, NULL));
+    check_copies(sources[0], 0, 60, 1, COPY_LIST);
+    mz_external_count(sources[0], 60);
+    check_copies(sources[1], 60, 120, 1, COPY_LIST);
+
+    for (zb = 0; zb < 2; zb++)
+        for (ub = 0; ub < 3; ub++)
+            for (stream = 0; stream < 2; stream++)
+            {
+                copy_members(path, stream ? APPEND_STATUS_STREAM : APPEND_STATUS_CREATE,
+                             &defs[zb], &defs[ub], sources, 2, 1);
+                check_copies(path, 0, 120, 1, stream ? COPY_NO_PKWARE : 0);
+            }
+    copy_members(mz_path("copy_all.zip"), APPEND_STATUS_CREATE, &defs[0], &defs[0], sources, 2, 1);
+    check_copies(mz_path("copy_all.zip"), 0, 120, 1, COPY_LIST);
+    mz_external_count(mz_path("copy_all.zip"), 120);
+
+    /* a third of the files, then one more added to it */
+    copy_members(path, APPEND_STATUS_CREATE, &defs[0], &defs[0], sources, 1, 3);
+    check_copies(path, 0, 60, 3, 0);
+    {
+        unzFile uf = unzOpen64(sources[1]);
+        zf = zipOpen2_64(path, APPEND_STATUS_ADDINZIP, NULL, &defs[1]);
+        CHECK_OK(unzGoToFirstFile(uf));
+        CHECK_OK(zipCopyMemberFromUnz(zf, uf));
+        CHECK_OK(unzClose(uf));
+        CHECK_OK(zipClose(zf, NULL));
+        check_copies(path, 60, 61, 1, 0);
+        check_copies(path, 0, 60, 3, 0);
+    }
+
+    /* no current file */
+    {
+        const char* empty_path = mz_path("copy_empty.zip");
+        unzFile uf;
+        CHECK_OK(zipClose(zipOpen64(empty_path, APPEND_STATUS_CREATE), NULL));
+        zf = zipOpen64(path, APPEND_STATUS_CREATE);
+        uf = unzOpen64(empty_path);
+        CHECK(uf != NULL);
+        CHECK(zipCopyMemberFromUnz(zf, uf) == ZIP_PARAMERROR);
+        CHECK(zipCopyMemberFromUnz(NULL, uf) == ZIP_PARAMERROR);
+        CHECK(zipCopyMemberFromUnz(zf, NULL) == ZIP_PARAMERROR);
+        CHECK_OK(unzClose(uf));
+        CHECK_OK(zipClose(zf, NULL));
+    }
+
+    test_copy_padded_extras();
+}
@@ -67,6 +67,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #ifndef NOUNCRYPT
         #define NOUNCRYPT
@@ -112,11 +113,24 @@
 
 #define SIZECENTRALDIRITEM (0x2e)
 #define SIZEZIPLOCALHEADER (0x1e)
+#define SIZELZMAHEADER (0x09) /* LZMA SDK version, size of the properties, properties */
+
+/* uncompressed data between two checkpoints of a deflated file, for unzSeek64 */
+#ifndef UNZ_SEEKSPAN
+#define UNZ_SEEKSPAN (1048576)
+#endif
+#define UNZ_WINDOWSIZE (32768) /* history needed by inflate */
 
 
 const char unz_copyright[] =
    " unzip 1.01 Copyright 1998-2004 Gilles Vollant - http://www.winimage.com/zLibDll";
 
+#include "zthread.h"
+
+#ifndef NOAES
+#include "zaes.h"
+#endif
+
 /* unz_file_info_interntal contain internal info about a file in zipfile*/
 typedef struct unz_file_info64_internal_s
 {
@@ -124,6 +138,99 @@ typedef struct unz_file_info64_internal_s
 } unz_file_info64_internal;
 
 
+/* unz64_cd_entry contain one file of the central directory index,
+    with the fields of unz_file_info64 packed to their size in the zipfile */
+typedef struct unz64_cd_entry_s
+{
+    ZPOS64_T pos_in_central_dir;   /* pos of the file in the central dir */
+    ZPOS64_T offset_curfile;       /* relative offset of local header */
+    ZPOS64_T compressed_size;
+    ZPOS64_T uncompressed_size;
+    ZPOS64_T name_offset;          /* offset of the filename in names */
+    unsigned int name_hash;        /* hash of the case folded filename */
+    unsigned int crc;
+    unsigned int dosDate;
+    unsigned int external_fa;
+    unsigned int disk_num_start;
+    unsigned short version;
+    unsigned short version_needed;
+    unsigned short flag;
+    unsigned short compression_method;
+    unsigned short size_filename;
+    unsigned short size_file_extra;
+    unsigned short size_file_comment;
+    unsigned short internal_fa;
+} unz64_cd_entry;
+
+/* unz64_cd_index contain the whole central directory, built at open time
+    when UNZ_OPEN_INDEXED is used */
+typedef struct unz64_cd_index_s
+{
+    unz64_cd_entry* entries;
+    ZPOS64_T number_entry;
+    char* names;                   /* zero terminated filenames, one after another */
+    ZPOS64_T size_names;
+    unsigned int* hash_table;      /* entry number + 1, or 0 for a free slot */
+    ZPOS64_T hash_mask;            /* size of hash_table - 1 */
+    int in_index_file;             /* entries, names and hash_table are in the
+                                      index file read in memory, not allocated */
+} unz64_cd_index;
+
+
+/* unz64_seek_point is a place in a deflated file where inflate can start
+    again, at the end of a deflate block */
+typedef struct unz64_seek_point_s
+{
+    ZPOS64_T out;                  /* offset in the uncompressed data */
+    ZPOS64_T in;                   /* offset of the next byte of compressed data */
+    int bits;                      /* bits of the byte before in not inflated yet */
+    unsigned char window[UNZ_WINDOWSIZE]; /* uncompressed data before out */
+} unz64_seek_point;
+
+/* unz64_seek_index contain the checkpoints of a deflated file, in order,
+    one every UNZ_SEEKSPAN bytes of uncompressed data up to where unzSeek64
+    has inflated it */
+typedef struct unz64_seek_index_s
+{
+    ZPOS64_T offset_curfile;       /* relative offset of local header */
+    ZPOS64_T compressed_size;      /* of the file, to check an imported index */
+    ZPOS64_T uncompressed_size;
+    uLong crc;
+    unz64_seek_point* points;
+    uLong number_point;
+    uLong size_points;             /* allocated size of points */
+    int complete;                  /* set when the checkpoints go up to the end */
+    struct unz64_seek_index_s* next;
+} unz64_seek_index;
+
+/* unz64_index_file_header is at the start of an index file (see unzOpen4_64).
+    It is followed by the entries, the hash table and the filenames of the
+    central directory index, as they are in memory so that the file is used
+    as it is once read, then by the checkpoints of some deflated files, each
+    given by unzExportSeekIndex after its size on 8 bytes.
+   The index file is made for one machine: magic and size_entry reject the
+    files of another byte order or structure layout. */
+typedef struct unz64_index_file_header_s
+{
+    unsigned int magic;            /* INDEXFILEMAGIC */
+    unsigned int size_entry;       /* sizeof(unz64_cd_entry) */
+    ZPOS64_T size_zipfile;         /* the zipfile the index file was made for */
+    ZPOS64_T mtime_zipfile;        /* 0 if the io functions don't give it */
+    ZPOS64_T crc_end;              /* crc from central_pos to the end of the zipfile */
+    ZPOS64_T central_pos;
+    ZPOS64_T size_central_dir;
+    ZPOS64_T offset_central_dir;
+    ZPOS64_T number_entry;         /* of unz_global_info64 */
+    ZPOS64_T size_comment;
+    ZPOS64_T isZip64;
+    ZPOS64_T number_index_entry;   /* of the central directory index */
+    ZPOS64_T hash_mask;
+    ZPOS64_T size_names;
+    ZPOS64_T offset_seek;          /* offset of the checkpoints in the index file */
+    ZPOS64_T size_index_file;
+} unz64_index_file_header;
+
+
 /* file_in_zip_read_info_s contain internal information about a file in zipfile,
     when reading and decompress it */
 typedef struct
@@ -134,6 +241,21 @@ typedef struct
 #ifdef HAVE_BZIP2
     bz_stream bstream;          /* bzLib stream structure for bziped */
 #endif
+#ifdef HAVE_ZSTD
+    ZSTD_DCtx* zstream;         /* zstd context, kept from file to file like
+                                   the inflate state */
+#endif
+#ifdef HAVE_LZMA
+    lzma_stream lstream;        /* liblzma stream for LZMA and XZ, kept from
+                                   file to file like the inflate state */
+    unsigned char lzma_header[SIZELZMAHEADER]; /* header before the LZMA data */
+    uInt lzma_header_read;      /* bytes of lzma_header read, the decoder is
+                                   made once it is complete */
+#endif
+#ifdef HAVE_LIBDEFLATE
+    struct libdeflate_decompressor* ldecompressor; /* for unzReadCurrentFileFully,
+                                   kept from file to file */
+#endif
 
     ZPOS64_T pos_in_zipfile;       /* position in byte on the zipfile, for fseek*/
     uLong stream_initialised;   /* flag set if stream structure is initialised*/
@@ -147,11 +269,19 @@ typedef struct
     uLong crc32_wait;           /* crc32 we must obtain after decompress all */
     ZPOS64_T rest_read_compressed; /* number of byte to be decompressed */
     ZPOS64_T rest_read_uncompressed;/*number of byte to be obtained after decomp*/
+    ZPOS64_T pos_data;          /* position of the data in the zipfile */
+    ZPOS64_T size_data;         /* size of the data, rest_read_compressed at the start */
+    int   crc_unknown;          /* set by unzSeek64 when it skipped some data */
     zlib_filefunc64_32_def z_filefunc;
     voidpf filestream;        /* io structure of the zipfile */
     uLong compression_method;   /* compression method (0==store) */
     ZPOS64_T byte_before_the_zipfile;/* byte before the zipfile, (>0 for sfx)*/
     int   raw;
+    int   aes;                  /* WinZip AES version (1 or 2) of the file being
+                                   decrypted, 0 if not */
+#ifndef NOAES
+    zaes_ctx aes_ctx;
+#endif
 } file_in_zip64_read_info_s;
 
 
@@ -177,10 +307,23 @@ typedef struct
     unz_file_info64_internal cur_file_info_internal; /* private info about it*/
     file_in_zip64_read_info_s* pfile_in_zip_read; /* structure about the current
                                         file if we are decompressing it */
+    file_in_zip64_read_info_s* pfile_in_zip_read_free; /* structure of the last
+                                        closed file, with its buffer and inflate
+                                        state, kept for the next one */
     int encrypted;
 
     int isZip64;
 
+    unz64_cd_index* cd_index;      /* index of the central dir, or NULL */
+    unz64_seek_index* seek_index;  /* checkpoints of the files sought in, or NULL */
+    unsigned char* index_alloc;    /* index file read in memory, or NULL */
+    const unsigned char* index_seek; /* checkpoints in the index file */
+    ZPOS64_T size_index_seek;
+    const unsigned char* central_dir_buffer; /* whole central dir in memory, or NULL */
+    unsigned char* central_dir_alloc; /* central_dir_buffer if we allocated it */
+    unsigned char* entry_buffer;   /* central dir entry read from the zipfile */
+    uLong entry_buffer_size;
+
 #    ifndef NOUNCRYPT
     unsigned long keys[3];     /* keys defining the pseudo-random sequence */
     const z_crc_t* pcrc_32_tab;
@@ -192,6 +335,8 @@ typedef struct
 #include "crypt.h"
 #endif
 
+#include "zcrc.h"
+
 
 /* ===========================================================================
    Reads a long in LSB order from the given gz_stream. Sets
@@ -289,6 +434,7 @@ local int strcmpcasenosensitive_internal(const char* fileName1, const char* file
 
 #ifndef STRCMPCASENOSENTIVEFUNCTION
 #define STRCMPCASENOSENTIVEFUNCTION strcmpcasenosensitive_internal
+#define CASENOSENSITIVE_IS_ASCII
 #endif
 
 /*
@@ -358,10 +504,7 @@ local ZPOS64_T unz64local_SearchCentralDir(const zlib_filefunc64_32_def* pzlib_f
 
         uReadSize = ((BUFREADCOMMENT+4) < (uSizeFile-uReadPos)) ?
                      (BUFREADCOMMENT+4) : (uLong)(uSizeFile-uReadPos);
-        if (ZSEEK64(*pzlib_filefunc_def,filestream,uReadPos,ZLIB_FILEFUNC_SEEK_SET)!=0)
-            break;
-
-        if (ZREAD64(*pzlib_filefunc_def,filestream,buf,uReadSize)!=uReadSize)
+        if (ZREADAT64(*pzlib_filefunc_def,filestream,uReadPos,buf,uReadSize)!=uReadSize)
             break;
 
         for (i=(int)uReadSize-3; (i--)>0;)
@@ -421,10 +564,7 @@ local ZPOS64_T unz64local_SearchCentralDir64(const zlib_filefunc64_32_def* pzlib
 
         uReadSize = ((BUFREADCOMMENT+4) < (uSizeFile-uReadPos)) ?
                      (BUFREADCOMMENT+4) : (uLong)(uSizeFile-uReadPos);
-        if (ZSEEK64(*pzlib_filefunc_def,filestream,uReadPos,ZLIB_FILEFUNC_SEEK_SET)!=0)
-            break;
-
-        if (ZREAD64(*pzlib_filefunc_def,filestream,buf,uReadSize)!=uReadSize)
+        if (ZREADAT64(*pzlib_filefunc_def,filestream,uReadPos,buf,uReadSize)!=uReadSize)
             break;
 
         for (i=(int)uReadSize-3; (i--)>0;)
@@ -480,20 +620,19 @@ local ZPOS64_T unz64local_SearchCentralDir64(const zlib_filefunc64_32_def* pzlib
     return relativeOffset;
 }
 
+local int unz64local_LoadCentralDirBuffer(unz64_s* s);
+local unz64_cd_index* unz64local_BuildCentralDirIndex(unz64_s* s);
+local void unz64local_FreeCentralDirIndex(unz64_cd_index* index);
+local void unz64local_FreeReadInfo(file_in_zip64_read_info_s* pfile_in_zip_read_info);
+local void unz64local_FreeSeekIndex(unz64_seek_index* index);
+local int unz64local_LoadIndexFile(unz64_s* s, const void* index_path);
+local int unz64local_WriteIndexFile(unz64_s* s, const void* index_path);
+
 /*
-  Open a Zip file. path contain the full pathname (by example,
-     on a Windows NT computer "c:\\test\\zlib114.zip" or on an Unix computer
-     "zlib/zlib114.zip".
-     If the zipfile cannot be opened (file doesn't exist or in not valid), the
-       return value is NULL.
-     Else, the return value is a unzFile Handle, usable with other function
-       of this unzip package.
+  Read the end of central directory record of the zipfile (and its zip64
+    version), to find the central directory
 */
-local unzFile unzOpenInternal(const void *path,
-                              zlib_filefunc64_32_def* pzlib_filefunc64_32_def,
-                              int is64bitOpenFunction) {
-    unz64_s us;
-    unz64_s *s;
+local int unz64local_ReadEndOfCentralDir(unz64_s* us) {
     ZPOS64_T central_pos;
     uLong   uL;
 
@@ -507,162 +646,214 @@ local unzFile unzOpenInternal(const void *path,
 
     int err=UNZ_OK;
 
-    if (unz_copyright[0]!=' ')
-        return NULL;
-
-    us.z_filefunc.zseek32_file = NULL;
-    us.z_filefunc.ztell32_file = NULL;
-    if (pzlib_filefunc64_32_def==NULL)
-        fill_fopen64_filefunc(&us.z_filefunc.zfile_func64);
-    else
-        us.z_filefunc = *pzlib_filefunc64_32_def;
-    us.is64bitOpenFunction = is64bitOpenFunction;
-
-
-
-    us.filestream = ZOPEN64(us.z_filefunc,
-                                                 path,
-                                                 ZLIB_FILEFUNC_MODE_READ |
-                                                 ZLIB_FILEFUNC_MODE_EXISTING);
-    if (us.filestream==NULL)
-        return NULL;
-
-    central_pos = unz64local_SearchCentralDir64(&us.z_filefunc,us.filestream);
+    central_pos = unz64local_SearchCentralDir64(&us->z_filefunc,us->filestream);
     if (central_pos!=CENTRALDIRINVALID)
     {
         uLong uS;
         ZPOS64_T uL64;
 
-        us.isZip64 = 1;
+        us->isZip64 = 1;
 
-        if (ZSEEK64(us.z_filefunc, us.filestream,
+        if (ZSEEK64(us->z_filefunc, us->filestream,
                                       central_pos,ZLIB_FILEFUNC_SEEK_SET)!=0)
         err=UNZ_ERRNO;
 
         /* the signature, already checked */
-        if (unz64local_getLong(&us.z_filefunc, us.filestream,&uL)!=UNZ_OK)
+        if (unz64local_getLong(&us->z_filefunc, us->filestream,&uL)!=UNZ_OK)
             err=UNZ_ERRNO;
 
         /* size of zip64 end of central directory record */
-        if (unz64local_getLong64(&us.z_filefunc, us.filestream,&uL64)!=UNZ_OK)
+        if (unz64local_getLong64(&us->z_filefunc, us->filestream,&uL64)!=UNZ_OK)
             err=UNZ_ERRNO;
 
         /* version made by */
-        if (unz64local_getShort(&us.z_filefunc, us.filestream,&uS)!=UNZ_OK)
+        if (unz64local_getShort(&us->z_filefunc, us->filestream,&uS)!=UNZ_OK)
             err=UNZ_ERRNO;
 
         /* version needed to extract */
-        if (unz64local_getShort(&us.z_filefunc, us.filestream,&uS)!=UNZ_OK)
+        if (unz64local_getShort(&us->z_filefunc, us->filestream,&uS)!=UNZ_OK)
             err=UNZ_ERRNO;
 
         /* number of this disk */
-        if (unz64local_getLong(&us.z_filefunc, us.filestream,&number_disk)!=UNZ_OK)
+        if (unz64local_getLong(&us->z_filefunc, us->filestream,&number_disk)!=UNZ_OK)
             err=UNZ_ERRNO;
 
         /* number of the disk with the start of the central directory */
-        if (unz64local_getLong(&us.z_filefunc, us.filestream,&number_disk_with_CD)!=UNZ_OK)
+        if (unz64local_getLong(&us->z_filefunc, us->filestream,&number_disk_with_CD)!=UNZ_OK)
             err=UNZ_ERRNO;
 
         /* total number of entries in the central directory on this disk */
-        if (unz64local_getLong64(&us.z_filefunc, us.filestream,&us.gi.number_entry)!=UNZ_OK)
+        if (unz64local_getLong64(&us->z_filefunc, us->filestream,&us->gi.number_entry)!=UNZ_OK)
             err=UNZ_ERRNO;
 
         /* total number of entries in the central directory */
-        if (unz64local_getLong64(&us.z_filefunc, us.filestream,&number_entry_CD)!=UNZ_OK)
+        if (unz64local_getLong64(&us->z_filefunc, us->filestream,&number_entry_CD)!=UNZ_OK)
             err=UNZ_ERRNO;
 
-        if ((number_entry_CD!=us.gi.number_entry) ||
+        if ((number_entry_CD!=us->gi.number_entry) ||
             (number_disk_with_CD!=0) ||
             (number_disk!=0))
             err=UNZ_BADZIPFILE;
 
         /* size of the central directory */
-        if (unz64local_getLong64(&us.z_filefunc, us.filestream,&us.size_central_dir)!=UNZ_OK)
+        if (unz64local_getLong64(&us->z_filefunc, us->filestream,&us->size_central_dir)!=UNZ_OK)
             err=UNZ_ERRNO;
 
         /* offset of start of central directory with respect to the
           starting disk number */
-        if (unz64local_getLong64(&us.z_filefunc, us.filestream,&us.offset_central_dir)!=UNZ_OK)
+        if (unz64local_getLong64(&us->z_filefunc, us->filestream,&us->offset_central_dir)!=UNZ_OK)
             err=UNZ_ERRNO;
 
-        us.gi.size_comment = 0;
+        us->gi.size_comment = 0;
     }
     else
     {
-        central_pos = unz64local_SearchCentralDir(&us.z_filefunc,us.filestream);
+        central_pos = unz64local_SearchCentralDir(&us->z_filefunc,us->filestream);
         if (central_pos==CENTRALDIRINVALID)
             err=UNZ_ERRNO;
 
-        us.isZip64 = 0;
+        us->isZip64 = 0;
 
-        if (ZSEEK64(us.z_filefunc, us.filestream,
+        if (ZSEEK64(us->z_filefunc, us->filestream,
                                         central_pos,ZLIB_FILEFUNC_SEEK_SET)!=0)
             err=UNZ_ERRNO;
 
         /* the signature, already checked */
-        if (unz64local_getLong(&us.z_filefunc, us.filestream,&uL)!=UNZ_OK)
+        if (unz64local_getLong(&us->z_filefunc, us->filestream,&uL)!=UNZ_OK)
             err=UNZ_ERRNO;
 
         /* number of this disk */
-        if (unz64local_getShort(&us.z_filefunc, us.filestream,&number_disk)!=UNZ_OK)
+        if (unz64local_getShort(&us->z_filefunc, us->filestream,&number_disk)!=UNZ_OK)
             err=UNZ_ERRNO;
 
         /* number of the disk with the start of the central directory */
-        if (unz64local_getShort(&us.z_filefunc, us.filestream,&number_disk_with_CD)!=UNZ_OK)
+        if (unz64local_getShort(&us->z_filefunc, us->filestream,&number_disk_with_CD)!=UNZ_OK)
             err=UNZ_ERRNO;
 
         /* total number of entries in the central dir on this disk */
-        if (unz64local_getShort(&us.z_filefunc, us.filestream,&uL)!=UNZ_OK)
+        if (unz64local_getShort(&us->z_filefunc, us->filestream,&uL)!=UNZ_OK)
             err=UNZ_ERRNO;
-        us.gi.number_entry = uL;
+        us->gi.number_entry = uL;
 
         /* total number of entries in the central dir */
-        if (unz64local_getShort(&us.z_filefunc, us.filestream,&uL)!=UNZ_OK)
+        if (unz64local_getShort(&us->z_filefunc, us->filestream,&uL)!=UNZ_OK)
             err=UNZ_ERRNO;
         number_entry_CD = uL;
 
-        if ((number_entry_CD!=us.gi.number_entry) ||
+        if ((number_entry_CD!=us->gi.number_entry) ||
             (number_disk_with_CD!=0) ||
             (number_disk!=0))
             err=UNZ_BADZIPFILE;
 
         /* size of the central directory */
-        if (unz64local_getLong(&us.z_filefunc, us.filestream,&uL)!=UNZ_OK)
+        if (unz64local_getLong(&us->z_filefunc, us->filestream,&uL)!=UNZ_OK)
             err=UNZ_ERRNO;
-        us.size_central_dir = uL;
+        us->size_central_dir = uL;
 
         /* offset of start of central directory with respect to the
             starting disk number */
-        if (unz64local_getLong(&us.z_filefunc, us.filestream,&uL)!=UNZ_OK)
+        if (unz64local_getLong(&us->z_filefunc, us->filestream,&uL)!=UNZ_OK)
             err=UNZ_ERRNO;
-        us.offset_central_dir = uL;
+        us->offset_central_dir = uL;
 
         /* zipfile comment length */
-        if (unz64local_getShort(&us.z_filefunc, us.filestream,&us.gi.size_comment)!=UNZ_OK)
+        if (unz64local_getShort(&us->z_filefunc, us->filestream,&us->gi.size_comment)!=UNZ_OK)
             err=UNZ_ERRNO;
     }
 
-    if ((central_pos<us.offset_central_dir+us.size_central_dir) &&
+    if ((central_pos<us->offset_central_dir+us->size_central_dir) &&
         (err==UNZ_OK))
         err=UNZ_BADZIPFILE;
 
+    us->central_pos = central_pos;
+    return err;
+}
+
+/*
+  Open a Zip file. path contain the full pathname (by example,
+     on a Windows NT computer "c:\\test\\zlib114.zip" or on an Unix computer
+     "zlib/zlib114.zip".
+     If the zipfile cannot be opened (file doesn't exist or in not valid), the
+       return value is NULL.
+     Else, the return value is a unzFile Handle, usable with other function
+       of this unzip package.
+*/
+local unzFile unzOpenInternal(const void *path,
+                              zlib_filefunc64_32_def* pzlib_filefunc64_32_def,
+                              int is64bitOpenFunction,
+                              int open_flags,
+                              const void* index_path) {
+    unz64_s us;
+    unz64_s *s;
+    int err=UNZ_OK;
+
+    if (unz_copyright[0]!=' ')
+        return NULL;
+
+    us.z_filefunc.zseek32_file = NULL;
+    us.z_filefunc.ztell32_file = NULL;
+    if (pzlib_filefunc64_32_def==NULL)
+        fill_fopen64_filefunc(&us.z_filefunc.zfile_func64);
+    else
+        us.z_filefunc = *pzlib_filefunc64_32_def;
+    us.is64bitOpenFunction = is64bitOpenFunction;
+
+
+
+    us.filestream = ZOPEN64(us.z_filefunc,
+                                                 path,
+                                                 ZLIB_FILEFUNC_MODE_READ |
+                                                 ZLIB_FILEFUNC_MODE_EXISTING);
+    if (us.filestream==NULL)
+        return NULL;
+
+    us.pfile_in_zip_read = NULL;
+    us.pfile_in_zip_read_free = NULL;
+    us.encrypted = 0;
+    us.cd_index = NULL;
+    us.seek_index = NULL;
+    us.index_alloc = NULL;
+    us.index_seek = NULL;
+    us.size_index_seek = 0;
+    us.central_dir_buffer = NULL;
+    us.central_dir_alloc = NULL;
+    us.entry_buffer = NULL;
+    us.entry_buffer_size = 0;
+
+    /* an up to date index file gives the central directory without reading it */
+    if ((index_path==NULL) || (unz64local_LoadIndexFile(&us, index_path)!=UNZ_OK))
+        err = unz64local_ReadEndOfCentralDir(&us);
+    else
+        index_path = NULL;
+
     if (err!=UNZ_OK)
     {
         ZCLOSE64(us.z_filefunc, us.filestream);
         return NULL;
     }
 
-    us.byte_before_the_zipfile = central_pos -
+    us.byte_before_the_zipfile = us.central_pos -
                             (us.offset_central_dir+us.size_central_dir);
-    us.central_pos = central_pos;
-    us.pfile_in_zip_read = NULL;
-    us.encrypted = 0;
 
 
     s=(unz64_s*)ALLOC(sizeof(unz64_s));
     if( s != NULL)
     {
         *s=us;
+        if ((open_flags & UNZ_OPEN_BUFFERED) ||
+            ((open_flags & UNZ_OPEN_INDEXED) && (s->cd_index==NULL)))
+            unz64local_LoadCentralDirBuffer(s);
+        if ((open_flags & UNZ_OPEN_INDEXED) && (s->cd_index==NULL))
+            s->cd_index = unz64local_BuildCentralDirIndex(s);
+        if (!(open_flags & UNZ_OPEN_BUFFERED))
+        {
+            free(s->central_dir_alloc);
+            s->central_dir_alloc = NULL;
+            s->central_dir_buffer = NULL;
+        }
+        /* the index file was missing or out of date */
+        if ((index_path!=NULL) && (s->cd_index!=NULL))
+            unz64local_WriteIndexFile(s, index_path);
         unzGoToFirstFile((unzFile)s);
     }
     return (unzFile)s;
@@ -675,32 +866,47 @@ extern unzFile ZEXPORT unzOpen2(const char *path,
     {
         zlib_filefunc64_32_def zlib_filefunc64_32_def_fill;
         fill_zlib_filefunc64_32_def_from_filefunc32(&zlib_filefunc64_32_def_fill,pzlib_filefunc32_def);
-        return unzOpenInternal(path, &zlib_filefunc64_32_def_fill, 0);
+        return unzOpenInternal(path, &zlib_filefunc64_32_def_fill, 0, 0, NULL);
     }
     else
-        return unzOpenInternal(path, NULL, 0);
+        return unzOpenInternal(path, NULL, 0, 0, NULL);
 }
 
-extern unzFile ZEXPORT unzOpen2_64(const void *path,
-                                   zlib_filefunc64_def* pzlib_filefunc_def) {
+extern unzFile ZEXPORT unzOpen3_64(const void *path,
+                                   zlib_filefunc64_def* pzlib_filefunc_def,
+                                   int open_flags) {
+    return unzOpen4_64(path, pzlib_filefunc_def, open_flags, NULL);
+}
+
+extern unzFile ZEXPORT unzOpen4_64(const void *path,
+                                   zlib_filefunc64_def* pzlib_filefunc_def,
+                                   int open_flags,
+                                   const void *index_path) {
+    if (index_path != NULL)
+        open_flags |= UNZ_OPEN_INDEXED;
     if (pzlib_filefunc_def != NULL)
     {
         zlib_filefunc64_32_def zlib_filefunc64_32_def_fill;
         zlib_filefunc64_32_def_fill.zfile_func64 = *pzlib_filefunc_def;
         zlib_filefunc64_32_def_fill.ztell32_file = NULL;
         zlib_filefunc64_32_def_fill.zseek32_file = NULL;
-        return unzOpenInternal(path, &zlib_filefunc64_32_def_fill, 1);
+        return unzOpenInternal(path, &zlib_filefunc64_32_def_fill, 1, open_flags, index_path);
     }
     else
-        return unzOpenInternal(path, NULL, 1);
+        return unzOpenInternal(path, NULL, 1, open_flags, index_path);
+}
+
+extern unzFile ZEXPORT unzOpen2_64(const void *path,
+                                   zlib_filefunc64_def* pzlib_filefunc_def) {
+    return unzOpen3_64(path, pzlib_filefunc_def, 0);
 }
 
 extern unzFile ZEXPORT unzOpen(const char *path) {
-    return unzOpenInternal(path, NULL, 0);
+    return unzOpenInternal(path, NULL, 0, 0, NULL);
 }
 
 extern unzFile ZEXPORT unzOpen64(const void *path) {
-    return unzOpenInternal(path, NULL, 1);
+    return unzOpenInternal(path, NULL, 1, 0, NULL);
 }
 
 /*
@@ -717,6 +923,12 @@ extern int ZEXPORT unzClose(unzFile file) {
     if (s->pfile_in_zip_read!=NULL)
         unzCloseCurrentFile(file);
 
+    unz64local_FreeReadInfo(s->pfile_in_zip_read_free);
+    unz64local_FreeCentralDirIndex(s->cd_index);
+    unz64local_FreeSeekIndex(s->seek_index);
+    free(s->index_alloc);
+    free(s->central_dir_alloc);
+    free(s->entry_buffer);
     ZCLOSE64(s->z_filefunc, s->filestream);
     free(s);
     return UNZ_OK;
@@ -762,97 +974,228 @@ local void unz64local_DosDateToTmuDate(ZPOS64_T ulDosDate, tm_unz* ptm) {
 }
 
 /*
-  Get Info about the current file in the zipfile, with internal only info
+  Central directory index, built by unzOpen3_64 with UNZ_OPEN_INDEXED.
+  The hash of a filename is computed on the name folded to upper case
+    (like strcmpcasenosensitive_internal), so that the same table can be
+    used for case sensitive and case insensitive searches.
 */
-local int unz64local_GetCurrentFileInfoInternal(unzFile file,
-                                                unz_file_info64 *pfile_info,
-                                                unz_file_info64_internal
-                                                *pfile_info_internal,
-                                                char *szFileName,
-                                                uLong fileNameBufferSize,
-                                                void *extraField,
-                                                uLong extraFieldBufferSize,
-                                                char *szComment,
-                                                uLong commentBufferSize) {
-    unz64_s* s;
-    unz_file_info64 file_info;
-    unz_file_info64_internal file_info_internal;
-    int err=UNZ_OK;
-    uLong uMagic;
-    long lSeek=0;
-    uLong uL;
-
-    if (file==NULL)
-        return UNZ_PARAMERROR;
-    s=(unz64_s*)file;
-    if (ZSEEK64(s->z_filefunc, s->filestream,
-              s->pos_in_central_dir+s->byte_before_the_zipfile,
-              ZLIB_FILEFUNC_SEEK_SET)!=0)
-        err=UNZ_ERRNO;
-
+local unsigned int unz64local_HashFileName(const char* fileName) {
+    unsigned int h = 2166136261U;
+    for (; *fileName != '\0'; fileName++)
+    {
+        unsigned char c = (unsigned char)*fileName;
+        if ((c>='a') && (c<='z'))
+            c -= 0x20;
+        h = (h ^ c) * 16777619U;
+    }
+    return h;
+}
 
-    /* we check the magic */
-    if (err==UNZ_OK)
+local void unz64local_FreeCentralDirIndex(unz64_cd_index* index) {
+    if (index==NULL)
+        return;
+    if (!index->in_index_file)
     {
-        if (unz64local_getLong(&s->z_filefunc, s->filestream,&uMagic) != UNZ_OK)
-            err=UNZ_ERRNO;
-        else if (uMagic!=0x02014b50)
-            err=UNZ_BADZIPFILE;
+        free(index->entries);
+        free(index->names);
+        free(index->hash_table);
     }
+    free(index);
+}
 
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.version) != UNZ_OK)
-        err=UNZ_ERRNO;
+local void unz64local_GetIndexEntryInfo(const unz64_cd_entry* entry,
+                                        unz_file_info64* pfile_info,
+                                        unz_file_info64_internal* pfile_info_internal) {
+    pfile_info->version = entry->version;
+    pfile_info->version_needed = entry->version_needed;
+    pfile_info->flag = entry->flag;
+    pfile_info->compression_method = entry->compression_method;
+    pfile_info->dosDate = entry->dosDate;
+    unz64local_DosDateToTmuDate(pfile_info->dosDate,&pfile_info->tmu_date);
+    pfile_info->crc = entry->crc;
+    pfile_info->compressed_size = entry->compressed_size;
+    pfile_info->uncompressed_size = entry->uncompressed_size;
+    pfile_info->size_filename = entry->size_filename;
+    pfile_info->size_file_extra = entry->size_file_extra;
+    pfile_info->size_file_comment = entry->size_file_comment;
+    pfile_info->disk_num_start = entry->disk_num_start;
+    pfile_info->internal_fa = entry->internal_fa;
+    pfile_info->external_fa = entry->external_fa;
+    pfile_info_internal->offset_curfile = entry->offset_curfile;
+}
 
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.version_needed) != UNZ_OK)
-        err=UNZ_ERRNO;
+local void unz64local_SetIndexEntry(unz64_cd_entry* entry,
+                                    const unz_file_info64* pfile_info,
+                                    const unz_file_info64_internal* pfile_info_internal) {
+    entry->version = (unsigned short)pfile_info->version;
+    entry->version_needed = (unsigned short)pfile_info->version_needed;
+    entry->flag = (unsigned short)pfile_info->flag;
+    entry->compression_method = (unsigned short)pfile_info->compression_method;
+    entry->dosDate = (unsigned int)pfile_info->dosDate;
+    entry->crc = (unsigned int)pfile_info->crc;
+    entry->compressed_size = pfile_info->compressed_size;
+    entry->uncompressed_size = pfile_info->uncompressed_size;
+    entry->size_filename = (unsigned short)pfile_info->size_filename;
+    entry->size_file_extra = (unsigned short)pfile_info->size_file_extra;
+    entry->size_file_comment = (unsigned short)pfile_info->size_file_comment;
+    entry->disk_num_start = (unsigned int)pfile_info->disk_num_start;
+    entry->internal_fa = (unsigned short)pfile_info->internal_fa;
+    entry->external_fa = (unsigned int)pfile_info->external_fa;
+    entry->offset_curfile = pfile_info_internal->offset_curfile;
+}
 
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.flag) != UNZ_OK)
-        err=UNZ_ERRNO;
+/*
+  Fill the hash table of the index from its entries.
+  Entries are inserted in central directory order with linear probing, so
+    a search meets the first of several files with the same name first.
+*/
+local int unz64local_HashCentralDirIndex(unz64_cd_index* index) {
+    ZPOS64_T hash_size = 16;
+    ZPOS64_T i;
 
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.compression_method) != UNZ_OK)
-        err=UNZ_ERRNO;
+    while (hash_size < 2*index->number_entry)
+        hash_size *= 2;
+    if ((size_t)hash_size != hash_size)
+        return UNZ_INTERNALERROR;
 
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&file_info.dosDate) != UNZ_OK)
-        err=UNZ_ERRNO;
+    index->hash_table = (unsigned int*)ALLOC((size_t)hash_size*sizeof(unsigned int));
+    if (index->hash_table==NULL)
+        return UNZ_INTERNALERROR;
+    memset(index->hash_table, 0, (size_t)hash_size*sizeof(unsigned int));
+    index->hash_mask = hash_size - 1;
 
-    unz64local_DosDateToTmuDate(file_info.dosDate,&file_info.tmu_date);
+    for (i=0; i<index->number_entry; i++)
+    {
+        ZPOS64_T slot = index->entries[i].name_hash & index->hash_mask;
+        while (index->hash_table[slot] != 0)
+            slot = (slot + 1) & index->hash_mask;
+        index->hash_table[slot] = (unsigned int)(i + 1);
+    }
+    return UNZ_OK;
+}
 
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&file_info.crc) != UNZ_OK)
-        err=UNZ_ERRNO;
+/*
+  Set the current file to the entry number_file of the index, without I/O
+*/
+local int unz64local_GoToIndexEntry(unz64_s* s, ZPOS64_T number_file) {
+    const unz64_cd_entry* entry = &s->cd_index->entries[number_file];
+    s->num_file = number_file;
+    s->pos_in_central_dir = entry->pos_in_central_dir;
+    unz64local_GetIndexEntryInfo(entry, &s->cur_file_info, &s->cur_file_info_internal);
+    s->current_file_ok = 1;
+    return UNZ_OK;
+}
 
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&uL) != UNZ_OK)
-        err=UNZ_ERRNO;
-    file_info.compressed_size = uL;
+/*
+  return 1 if the current file of s is the entry num_file of the index
+*/
+local int unz64local_CurrentFileIsIndexed(const unz64_s* s) {
+    return (s->cd_index!=NULL) &&
+           (s->num_file < s->cd_index->number_entry) &&
+           (s->cd_index->entries[s->num_file].pos_in_central_dir == s->pos_in_central_dir);
+}
 
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&uL) != UNZ_OK)
-        err=UNZ_ERRNO;
-    file_info.uncompressed_size = uL;
+local uLong unz64local_readShort(const unsigned char* p) {
+    return p[0] | ((uLong)p[1] << 8);
+}
 
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.size_filename) != UNZ_OK)
-        err=UNZ_ERRNO;
+local uLong unz64local_readLong(const unsigned char* p) {
+    return p[0] | ((uLong)p[1] << 8) | ((uLong)p[2] << 16) | ((uLong)p[3] << 24);
+}
 
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.size_file_extra) != UNZ_OK)
-        err=UNZ_ERRNO;
+local ZPOS64_T unz64local_readLong64(const unsigned char* p) {
+    return unz64local_readLong(p) | ((ZPOS64_T)unz64local_readLong(p+4) << 32);
+}
 
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.size_file_comment) != UNZ_OK)
-        err=UNZ_ERRNO;
+/*
+  Read the whole central directory with one I/O in s->central_dir_buffer,
+    or use it in place if the io functions can map the zipfile
+*/
+local int unz64local_LoadCentralDirBuffer(unz64_s* s) {
+    unsigned char* buf;
+    ZPOS64_T size_read = 0;
 
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.disk_num_start) != UNZ_OK)
-        err=UNZ_ERRNO;
+    s->central_dir_buffer = (const unsigned char*)ZMAP64(s->z_filefunc, s->filestream,
+                                   s->offset_central_dir+s->byte_before_the_zipfile,
+                                   s->size_central_dir);
+    if (s->central_dir_buffer!=NULL)
+        return UNZ_OK;
 
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&file_info.internal_fa) != UNZ_OK)
-        err=UNZ_ERRNO;
+    if ((size_t)s->size_central_dir != s->size_central_dir)
+        return UNZ_INTERNALERROR;
+    buf = (unsigned char*)ALLOC((size_t)s->size_central_dir + 1);
+    if (buf==NULL)
+        return UNZ_INTERNALERROR;
 
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&file_info.external_fa) != UNZ_OK)
-        err=UNZ_ERRNO;
+    while (size_read < s->size_central_dir)
+    {
+        uLong uReadThis = 0x40000000;
+        if (s->size_central_dir - size_read < uReadThis)
+            uReadThis = (uLong)(s->size_central_dir - size_read);
+        if (ZREADAT64(s->z_filefunc, s->filestream,
+                      s->offset_central_dir + s->byte_before_the_zipfile + size_read,
+                      buf + size_read, uReadThis) != uReadThis)
+        {
+            free(buf);
+            return UNZ_ERRNO;
+        }
+        size_read += uReadThis;
+    }
+    s->central_dir_alloc = buf;
+    s->central_dir_buffer = buf;
+    return UNZ_OK;
+}
 
-                // relative offset of local header
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&uL) != UNZ_OK)
-        err=UNZ_ERRNO;
-    file_info_internal.offset_curfile = uL;
+/*
+  Decode the file info of the central directory entry at p, size being the
+    number of bytes available from p
+*/
+local int unz64local_GetFileInfoFromEntry(const unsigned char* p,
+                                          ZPOS64_T size,
+                                          unz_file_info64 *pfile_info,
+                                          unz_file_info64_internal
+                                          *pfile_info_internal,
+                                          char *szFileName,
+                                          uLong fileNameBufferSize,
+                                          void *extraField,
+                                          uLong extraFieldBufferSize,
+                                          char *szComment,
+                                          uLong commentBufferSize) {
+    unz_file_info64 file_info;
+    unz_file_info64_internal file_info_internal;
+    const unsigned char* extra;
+    uLong acc = 0;
+
+    if (size < SIZECENTRALDIRITEM)
+        return UNZ_BADZIPFILE;
+
+    /* we check the magic */
+    if (unz64local_readLong(p)!=0x02014b50)
+        return UNZ_BADZIPFILE;
+
+    file_info.version = unz64local_readShort(p+4);
+    file_info.version_needed = unz64local_readShort(p+6);
+    file_info.flag = unz64local_readShort(p+8);
+    file_info.compression_method = unz64local_readShort(p+10);
+    file_info.dosDate = unz64local_readLong(p+12);
+    unz64local_DosDateToTmuDate(file_info.dosDate,&file_info.tmu_date);
+    file_info.crc = unz64local_readLong(p+16);
+    file_info.compressed_size = unz64local_readLong(p+20);
+    file_info.uncompressed_size = unz64local_readLong(p+24);
+    file_info.size_filename = unz64local_readShort(p+28);
+    file_info.size_file_extra = unz64local_readShort(p+30);
+    file_info.size_file_comment = unz64local_readShort(p+32);
+    file_info.disk_num_start = unz64local_readShort(p+34);
+    file_info.internal_fa = unz64local_readShort(p+36);
+    file_info.external_fa = unz64local_readLong(p+38);
+    file_info_internal.offset_curfile = unz64local_readLong(p+42);
+
+    if (size - SIZECENTRALDIRITEM <
+        (ZPOS64_T)file_info.size_filename + file_info.size_file_extra + file_info.size_file_comment)
+        return UNZ_BADZIPFILE;
+    p += SIZECENTRALDIRITEM;
 
-    lSeek+=file_info.size_filename;
-    if ((err==UNZ_OK) && (szFileName!=NULL))
+    if (szFileName!=NULL)
     {
         uLong uSizeRead ;
         if (file_info.size_filename<fileNameBufferSize)
@@ -864,105 +1207,68 @@ local int unz64local_GetCurrentFileInfoInternal(unzFile file,
             uSizeRead = fileNameBufferSize;
 
         if ((file_info.size_filename>0) && (fileNameBufferSize>0))
-            if (ZREAD64(s->z_filefunc, s->filestream,szFileName,uSizeRead)!=uSizeRead)
-                err=UNZ_ERRNO;
-        lSeek -= uSizeRead;
+            memcpy(szFileName, p, uSizeRead);
     }
+    p += file_info.size_filename;
 
-    // Read extrafield
-    if ((err==UNZ_OK) && (extraField!=NULL))
+    if (extraField!=NULL)
     {
-        ZPOS64_T uSizeRead ;
+        uLong uSizeRead ;
         if (file_info.size_file_extra<extraFieldBufferSize)
             uSizeRead = file_info.size_file_extra;
         else
             uSizeRead = extraFieldBufferSize;
 
-        if (lSeek!=0)
-        {
-            if (ZSEEK64(s->z_filefunc, s->filestream,(ZPOS64_T)lSeek,ZLIB_FILEFUNC_SEEK_CUR)==0)
-                lSeek=0;
-            else
-                err=UNZ_ERRNO;
-        }
-
         if ((file_info.size_file_extra>0) && (extraFieldBufferSize>0))
-            if (ZREAD64(s->z_filefunc, s->filestream,extraField,(uLong)uSizeRead)!=uSizeRead)
-                err=UNZ_ERRNO;
-
-        lSeek += file_info.size_file_extra - (uLong)uSizeRead;
+            memcpy(extraField, p, uSizeRead);
     }
-    else
-        lSeek += file_info.size_file_extra;
 
-
-    if ((err==UNZ_OK) && (file_info.size_file_extra != 0))
+    extra = p;
+    while (acc + 4 <= file_info.size_file_extra)
     {
-                                uLong acc = 0;
-
-        // since lSeek now points to after the extra field we need to move back
-        lSeek -= file_info.size_file_extra;
+        uLong headerId = unz64local_readShort(extra+acc);
+        uLong dataSize = unz64local_readShort(extra+acc+2);
+        const unsigned char* data = extra+acc+4;
+        const unsigned char* data_end;
 
-        if (lSeek!=0)
-        {
-            if (ZSEEK64(s->z_filefunc, s->filestream,(ZPOS64_T)lSeek,ZLIB_FILEFUNC_SEEK_CUR)==0)
-                lSeek=0;
-            else
-                err=UNZ_ERRNO;
-        }
+        if (acc + 4 + dataSize > file_info.size_file_extra)
+            break;
+        data_end = data + dataSize;
 
-        while(acc < file_info.size_file_extra)
+        /* ZIP64 extra fields */
+        if (headerId == 0x0001)
         {
-            uLong headerId;
-                                                uLong dataSize;
-
-            if (unz64local_getShort(&s->z_filefunc, s->filestream,&headerId) != UNZ_OK)
-                err=UNZ_ERRNO;
-
-            if (unz64local_getShort(&s->z_filefunc, s->filestream,&dataSize) != UNZ_OK)
-                err=UNZ_ERRNO;
-
-            /* ZIP64 extra fields */
-            if (headerId == 0x0001)
+            if ((file_info.uncompressed_size == MAXU32) && (data + 8 <= data_end))
             {
-                if(file_info.uncompressed_size == MAXU32)
-                {
-                    if (unz64local_getLong64(&s->z_filefunc, s->filestream,&file_info.uncompressed_size) != UNZ_OK)
-                        err=UNZ_ERRNO;
-                }
-
-                if(file_info.compressed_size == MAXU32)
-                {
-                    if (unz64local_getLong64(&s->z_filefunc, s->filestream,&file_info.compressed_size) != UNZ_OK)
-                        err=UNZ_ERRNO;
-                }
-
-                if(file_info_internal.offset_curfile == MAXU32)
-                {
-                    /* Relative Header offset */
-                    if (unz64local_getLong64(&s->z_filefunc, s->filestream,&file_info_internal.offset_curfile) != UNZ_OK)
-                        err=UNZ_ERRNO;
-                }
-
-                if(file_info.disk_num_start == 0xffff)
-                {
-                    /* Disk Start Number */
-                    if (unz64local_getLong(&s->z_filefunc, s->filestream,&file_info.disk_num_start) != UNZ_OK)
-                        err=UNZ_ERRNO;
-                }
+                file_info.uncompressed_size = unz64local_readLong64(data);
+                data += 8;
+            }
 
+            if ((file_info.compressed_size == MAXU32) && (data + 8 <= data_end))
+            {
+                file_info.compressed_size = unz64local_readLong64(data);
+                data += 8;
             }
-            else
+
+            if ((file_info_internal.offset_curfile == MAXU32) && (data + 8 <= data_end))
             {
-                if (ZSEEK64(s->z_filefunc, s->filestream,dataSize,ZLIB_FILEFUNC_SEEK_CUR)!=0)
-                    err=UNZ_ERRNO;
+                /* Relative Header offset */
+                file_info_internal.offset_curfile = unz64local_readLong64(data);
+                data += 8;
             }
 
-            acc += 2 + 2 + dataSize;
+            if ((file_info.disk_num_start == 0xffff) && (data + 4 <= data_end))
+            {
+                /* Disk Start Number */
+                file_info.disk_num_start = unz64local_readLong(data);
+            }
         }
+
+        acc += 2 + 2 + dataSize;
     }
+    p += file_info.size_file_extra;
 
-    if ((err==UNZ_OK) && (szComment!=NULL))
+    if (szComment!=NULL)
     {
         uLong uSizeRead ;
         if (file_info.size_file_comment<commentBufferSize)
@@ -973,45 +1279,123 @@ local int unz64local_GetCurrentFileInfoInternal(unzFile file,
         else
             uSizeRead = commentBufferSize;
 
-        if (lSeek!=0)
-        {
-            if (ZSEEK64(s->z_filefunc, s->filestream,(ZPOS64_T)lSeek,ZLIB_FILEFUNC_SEEK_CUR)==0)
-                lSeek=0;
-            else
-                err=UNZ_ERRNO;
-        }
-
         if ((file_info.size_file_comment>0) && (commentBufferSize>0))
-            if (ZREAD64(s->z_filefunc, s->filestream,szComment,uSizeRead)!=uSizeRead)
-                err=UNZ_ERRNO;
-        lSeek+=file_info.size_file_comment - uSizeRead;
+            memcpy(szComment, p, uSizeRead);
     }
-    else
-        lSeek+=file_info.size_file_comment;
-
 
-    if ((err==UNZ_OK) && (pfile_info!=NULL))
+    if (pfile_info!=NULL)
         *pfile_info=file_info;
 
-    if ((err==UNZ_OK) && (pfile_info_internal!=NULL))
+    if (pfile_info_internal!=NULL)
         *pfile_info_internal=file_info_internal;
 
-    return err;
+    return UNZ_OK;
 }
 
-
-
 /*
-  Write info about the ZipFile in the *pglobal_info structure.
-  No preparation of the structure is needed
-  return UNZ_OK if there is no problem.
+  Get Info about the current file in the zipfile, with internal only info
 */
-extern int ZEXPORT unzGetCurrentFileInfo64(unzFile file,
-                                           unz_file_info64 * pfile_info,
-                                           char * szFileName, uLong fileNameBufferSize,
-                                           void *extraField, uLong extraFieldBufferSize,
-                                           char* szComment,  uLong commentBufferSize) {
-    return unz64local_GetCurrentFileInfoInternal(file,pfile_info,NULL,
+local int unz64local_GetCurrentFileInfoInternal(unzFile file,
+                                                unz_file_info64 *pfile_info,
+                                                unz_file_info64_internal
+                                                *pfile_info_internal,
+                                                char *szFileName,
+                                                uLong fileNameBufferSize,
+                                                void *extraField,
+                                                uLong extraFieldBufferSize,
+                                                char *szComment,
+                                                uLong commentBufferSize) {
+    unz64_s* s;
+    unz_file_info64 file_info;
+    unz_file_info64_internal file_info_internal;
+    unsigned char header[SIZECENTRALDIRITEM];
+    uLong size_entry;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+
+    if ((extraField==NULL) && (szComment==NULL) && unz64local_CurrentFileIsIndexed(s))
+    {
+        const unz64_cd_entry* entry = &s->cd_index->entries[s->num_file];
+        unz64local_GetIndexEntryInfo(entry, &file_info, &file_info_internal);
+        if (szFileName!=NULL)
+        {
+            uLong uSizeRead = file_info.size_filename;
+            if (file_info.size_filename<fileNameBufferSize)
+                *(szFileName+file_info.size_filename)='\0';
+            else
+                uSizeRead = fileNameBufferSize;
+            memcpy(szFileName, s->cd_index->names + entry->name_offset, uSizeRead);
+        }
+        if (pfile_info!=NULL)
+            *pfile_info=file_info;
+        if (pfile_info_internal!=NULL)
+            *pfile_info_internal=file_info_internal;
+        return UNZ_OK;
+    }
+
+    if (s->central_dir_buffer!=NULL)
+    {
+        ZPOS64_T offset = s->pos_in_central_dir - s->offset_central_dir;
+        if ((s->pos_in_central_dir < s->offset_central_dir) ||
+            (offset > s->size_central_dir))
+            return UNZ_BADZIPFILE;
+        return unz64local_GetFileInfoFromEntry(s->central_dir_buffer + offset,
+                                               s->size_central_dir - offset,
+                                               pfile_info,pfile_info_internal,
+                                               szFileName,fileNameBufferSize,
+                                               extraField,extraFieldBufferSize,
+                                               szComment,commentBufferSize);
+    }
+
+    /* read the fixed part of the entry, then all its variable part at once */
+    if (ZREADAT64(s->z_filefunc, s->filestream,
+                  s->pos_in_central_dir+s->byte_before_the_zipfile,
+                  header, SIZECENTRALDIRITEM) != SIZECENTRALDIRITEM)
+        return UNZ_ERRNO;
+    size_entry = SIZECENTRALDIRITEM + unz64local_readShort(header+28) +
+                 unz64local_readShort(header+30) + unz64local_readShort(header+32);
+
+    if (size_entry > s->entry_buffer_size)
+    {
+        unsigned char* entry_buffer = (unsigned char*)ALLOC(size_entry);
+        if (entry_buffer==NULL)
+            return UNZ_INTERNALERROR;
+        free(s->entry_buffer);
+        s->entry_buffer = entry_buffer;
+        s->entry_buffer_size = size_entry;
+    }
+    memcpy(s->entry_buffer, header, SIZECENTRALDIRITEM);
+    if (size_entry > SIZECENTRALDIRITEM)
+    {
+        if (ZREADAT64(s->z_filefunc, s->filestream,
+                      s->pos_in_central_dir+s->byte_before_the_zipfile+SIZECENTRALDIRITEM,
+                      s->entry_buffer+SIZECENTRALDIRITEM,
+                      size_entry-SIZECENTRALDIRITEM) != size_entry-SIZECENTRALDIRITEM)
+            return UNZ_ERRNO;
+    }
+
+    return unz64local_GetFileInfoFromEntry(s->entry_buffer, size_entry,
+                                           pfile_info,pfile_info_internal,
+                                           szFileName,fileNameBufferSize,
+                                           extraField,extraFieldBufferSize,
+                                           szComment,commentBufferSize);
+}
+
+
+
+/*
+  Write info about the ZipFile in the *pglobal_info structure.
+  No preparation of the structure is needed
+  return UNZ_OK if there is no problem.
+*/
+extern int ZEXPORT unzGetCurrentFileInfo64(unzFile file,
+                                           unz_file_info64 * pfile_info,
+                                           char * szFileName, uLong fileNameBufferSize,
+                                           void *extraField, uLong extraFieldBufferSize,
+                                           char* szComment,  uLong commentBufferSize) {
+    return unz64local_GetCurrentFileInfoInternal(file,pfile_info,NULL,
                                                  szFileName,fileNameBufferSize,
                                                  extraField,extraFieldBufferSize,
                                                  szComment,commentBufferSize);
@@ -1054,6 +1438,101 @@ extern int ZEXPORT unzGetCurrentFileInfo(unzFile file,
     }
     return err;
 }
+local unz64_cd_index* unz64local_BuildCentralDirIndex(unz64_s* s) {
+    unz64_cd_index* index;
+    ZPOS64_T capacity_entries = 0;
+    ZPOS64_T capacity_names = 0;
+    ZPOS64_T pos_in_central_dir = s->offset_central_dir;
+    char* szFileName;
+    int err = UNZ_OK;
+
+    index = (unz64_cd_index*)ALLOC(sizeof(unz64_cd_index));
+    szFileName = (char*)ALLOC(0xffff+1);
+    if ((index==NULL) || (szFileName==NULL))
+    {
+        free(index);
+        free(szFileName);
+        return NULL;
+    }
+    memset(index, 0, sizeof(unz64_cd_index));
+
+    for (;;)
+    {
+        unz_file_info64 file_info;
+        unz_file_info64_internal file_info_internal;
+        unz64_cd_entry* entry;
+
+        if (s->gi.number_entry != 0xffff)    /* 2^16 files overflow hack */
+        {
+            if (index->number_entry == s->gi.number_entry)
+                break;
+        }
+        else if (pos_in_central_dir >= s->offset_central_dir + s->size_central_dir)
+            break;
+
+        s->pos_in_central_dir = pos_in_central_dir;
+        err = unz64local_GetCurrentFileInfoInternal((unzFile)s, &file_info, &file_info_internal,
+                                                    szFileName, 0xffff+1, NULL, 0, NULL, 0);
+        if (err!=UNZ_OK)
+            break;
+
+        if (index->number_entry == capacity_entries)
+        {
+            unz64_cd_entry* entries;
+            capacity_entries = (capacity_entries==0) ? 256 : capacity_entries*2;
+            if (capacity_entries >= 0xffffffff)
+            {
+                err = UNZ_INTERNALERROR;
+                break;
+            }
+            entries = (unz64_cd_entry*)realloc(index->entries, (size_t)capacity_entries*sizeof(unz64_cd_entry));
+            if (entries==NULL)
+            {
+                err = UNZ_INTERNALERROR;
+                break;
+            }
+            index->entries = entries;
+        }
+        if (index->size_names + file_info.size_filename + 1 > capacity_names)
+        {
+            char* names;
+            capacity_names = (capacity_names==0) ? 0x4000 : capacity_names*2;
+            while (index->size_names + file_info.size_filename + 1 > capacity_names)
+                capacity_names *= 2;
+            names = (char*)realloc(index->names, (size_t)capacity_names);
+            if (names==NULL)
+            {
+                err = UNZ_INTERNALERROR;
+                break;
+            }
+            index->names = names;
+        }
+
+        entry = &index->entries[index->number_entry];
+        unz64local_SetIndexEntry(entry, &file_info, &file_info_internal);
+        entry->pos_in_central_dir = pos_in_central_dir;
+        entry->name_offset = index->size_names;
+        memcpy(index->names + index->size_names, szFileName, file_info.size_filename);
+        index->names[index->size_names + file_info.size_filename] = '\0';
+        entry->name_hash = unz64local_HashFileName(index->names + index->size_names);
+        index->size_names += file_info.size_filename + 1;
+        index->number_entry++;
+
+        pos_in_central_dir += SIZECENTRALDIRITEM + file_info.size_filename +
+                file_info.size_file_extra + file_info.size_file_comment;
+    }
+    free(szFileName);
+
+    if (err==UNZ_OK)
+        err = unz64local_HashCentralDirIndex(index);
+    if (err!=UNZ_OK)
+    {
+        unz64local_FreeCentralDirIndex(index);
+        return NULL;
+    }
+    return index;
+}
+
 /*
   Set the current file of the zipfile to the first file.
   return UNZ_OK if there is no problem
@@ -1064,6 +1543,8 @@ extern int ZEXPORT unzGoToFirstFile(unzFile file) {
     if (file==NULL)
         return UNZ_PARAMERROR;
     s=(unz64_s*)file;
+    if ((s->cd_index!=NULL) && (s->cd_index->number_entry>0))
+        return unz64local_GoToIndexEntry(s, 0);
     s->pos_in_central_dir=s->offset_central_dir;
     s->num_file=0;
     err=unz64local_GetCurrentFileInfoInternal(file,&s->cur_file_info,
@@ -1091,6 +1572,14 @@ extern int ZEXPORT unzGoToNextFile(unzFile file) {
       if (s->num_file+1==s->gi.number_entry)
         return UNZ_END_OF_LIST_OF_FILE;
 
+    if (unz64local_CurrentFileIsIndexed(s))
+    {
+        if (s->num_file+1 < s->cd_index->number_entry)
+            return unz64local_GoToIndexEntry(s, s->num_file+1);
+        s->current_file_ok = 0;
+        return UNZ_END_OF_LIST_OF_FILE;
+    }
+
     s->pos_in_central_dir += SIZECENTRALDIRITEM + s->cur_file_info.size_filename +
             s->cur_file_info.size_file_extra + s->cur_file_info.size_file_comment ;
     s->num_file++;
@@ -1133,6 +1622,33 @@ extern int ZEXPORT unzLocateFile(unzFile file, const char *szFileName, int iCase
     if (!s->current_file_ok)
         return UNZ_END_OF_LIST_OF_FILE;
 
+    if (iCaseSensitivity==0)
+        iCaseSensitivity=CASESENSITIVITYDEFAULTVALUE;
+
+    if ((s->cd_index!=NULL)
+#ifndef CASENOSENSITIVE_IS_ASCII
+        /* a custom compare function may fold more than ASCII, the hash can't be used */
+        && (iCaseSensitivity==1)
+#endif
+       )
+    {
+        const unz64_cd_index* index = s->cd_index;
+        unsigned int hash = unz64local_HashFileName(szFileName);
+        ZPOS64_T slot = hash & index->hash_mask;
+
+        while (index->hash_table[slot] != 0)
+        {
+            ZPOS64_T number_file = index->hash_table[slot] - 1;
+            const unz64_cd_entry* entry = &index->entries[number_file];
+            if ((entry->name_hash == hash) &&
+                (unzStringFileNameCompare(index->names + entry->name_offset,
+                                          szFileName,iCaseSensitivity)==0))
+                return unz64local_GoToIndexEntry(s, number_file);
+            slot = (slot + 1) & index->hash_mask;
+        }
+        return UNZ_END_OF_LIST_OF_FILE;
+    }
+
     /* Save the current state */
     num_fileSaved = s->num_file;
     pos_in_central_dirSaved = s->pos_in_central_dir;
@@ -1257,7 +1773,8 @@ extern int ZEXPORT unzGoToFilePos(unzFile file, unz_file_pos* file_pos) {
 local int unz64local_CheckCurrentFileCoherencyHeader(unz64_s* s, uInt* piSizeVar,
                                                      ZPOS64_T * poffset_local_extrafield,
                                                      uInt  * psize_local_extrafield) {
-    uLong uMagic,uData,uFlags;
+    unsigned char header[SIZEZIPLOCALHEADER];
+    uLong uData,uFlags;
     uLong size_filename;
     uLong size_extra_field;
     int err=UNZ_OK;
@@ -1266,67 +1783,60 @@ local int unz64local_CheckCurrentFileCoherencyHeader(unz64_s* s, uInt* piSizeVar
     *poffset_local_extrafield = 0;
     *psize_local_extrafield = 0;
 
-    if (ZSEEK64(s->z_filefunc, s->filestream,s->cur_file_info_internal.offset_curfile +
-                                s->byte_before_the_zipfile,ZLIB_FILEFUNC_SEEK_SET)!=0)
+    if (ZREADAT64(s->z_filefunc, s->filestream,s->cur_file_info_internal.offset_curfile +
+                  s->byte_before_the_zipfile, header, SIZEZIPLOCALHEADER) != SIZEZIPLOCALHEADER)
         return UNZ_ERRNO;
 
+    /* we check the magic */
+    if (unz64local_readLong(header)!=0x04034b50)
+        err=UNZ_BADZIPFILE;
 
-    if (err==UNZ_OK)
-    {
-        if (unz64local_getLong(&s->z_filefunc, s->filestream,&uMagic) != UNZ_OK)
-            err=UNZ_ERRNO;
-        else if (uMagic!=0x04034b50)
-            err=UNZ_BADZIPFILE;
-    }
-
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&uData) != UNZ_OK)
-        err=UNZ_ERRNO;
 /*
-    else if ((err==UNZ_OK) && (uData!=s->cur_file_info.wVersion))
+    else if ((err==UNZ_OK) && (version_needed!=s->cur_file_info.wVersion))
         err=UNZ_BADZIPFILE;
 */
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&uFlags) != UNZ_OK)
-        err=UNZ_ERRNO;
+    uFlags = unz64local_readShort(header+6);
 
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&uData) != UNZ_OK)
-        err=UNZ_ERRNO;
-    else if ((err==UNZ_OK) && (uData!=s->cur_file_info.compression_method))
+    uData = unz64local_readShort(header+8);
+    if ((err==UNZ_OK) && (uData!=s->cur_file_info.compression_method))
         err=UNZ_BADZIPFILE;
 
     if ((err==UNZ_OK) && (s->cur_file_info.compression_method!=0) &&
 /* #ifdef HAVE_BZIP2 */
                          (s->cur_file_info.compression_method!=Z_BZIP2ED) &&
 /* #endif */
+/* #ifdef HAVE_LZMA */
+                         (s->cur_file_info.compression_method!=Z_LZMA) &&
+                         (s->cur_file_info.compression_method!=Z_XZ) &&
+/* #endif */
+/* #ifdef HAVE_ZSTD */
+                         (s->cur_file_info.compression_method!=Z_ZSTD) &&
+/* #endif */
+                         (s->cur_file_info.compression_method!=Z_AES) &&
                          (s->cur_file_info.compression_method!=Z_DEFLATED))
         err=UNZ_BADZIPFILE;
 
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&uData) != UNZ_OK) /* date/time */
-        err=UNZ_ERRNO;
+    /* date/time at header+10 is not checked */
 
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&uData) != UNZ_OK) /* crc */
-        err=UNZ_ERRNO;
-    else if ((err==UNZ_OK) && (uData!=s->cur_file_info.crc) && ((uFlags & 8)==0))
+    uData = unz64local_readLong(header+14); /* crc */
+    if ((err==UNZ_OK) && (uData!=s->cur_file_info.crc) && ((uFlags & 8)==0))
         err=UNZ_BADZIPFILE;
 
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&uData) != UNZ_OK) /* size compr */
-        err=UNZ_ERRNO;
-    else if (uData != 0xFFFFFFFF && (err==UNZ_OK) && (uData!=s->cur_file_info.compressed_size) && ((uFlags & 8)==0))
+    uData = unz64local_readLong(header+18); /* size compr */
+    if (uData != 0xFFFFFFFF && (err==UNZ_OK) && (uData!=s->cur_file_info.compressed_size) && ((uFlags & 8)==0))
         err=UNZ_BADZIPFILE;
 
-    if (unz64local_getLong(&s->z_filefunc, s->filestream,&uData) != UNZ_OK) /* size uncompr */
-        err=UNZ_ERRNO;
-    else if (uData != 0xFFFFFFFF && (err==UNZ_OK) && (uData!=s->cur_file_info.uncompressed_size) && ((uFlags & 8)==0))
+    uData = unz64local_readLong(header+22); /* size uncompr */
+    if (uData != 0xFFFFFFFF && (err==UNZ_OK) && (uData!=s->cur_file_info.uncompressed_size) && ((uFlags & 8)==0))
         err=UNZ_BADZIPFILE;
 
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&size_filename) != UNZ_OK)
-        err=UNZ_ERRNO;
-    else if ((err==UNZ_OK) && (size_filename!=s->cur_file_info.size_filename))
+    size_filename = unz64local_readShort(header+26);
+    if ((err==UNZ_OK) && (size_filename!=s->cur_file_info.size_filename))
         err=UNZ_BADZIPFILE;
 
     *piSizeVar += (uInt)size_filename;
 
-    if (unz64local_getShort(&s->z_filefunc, s->filestream,&size_extra_field) != UNZ_OK)
-        err=UNZ_ERRNO;
+    size_extra_field = unz64local_readShort(header+28);
     *poffset_local_extrafield= s->cur_file_info_internal.offset_curfile +
                                     SIZEZIPLOCALHEADER + size_filename;
     *psize_local_extrafield = (uInt)size_extra_field;
@@ -1336,6 +1846,54 @@ local int unz64local_CheckCurrentFileCoherencyHeader(unz64_s* s, uInt* piSizeVar
     return err;
 }
 
+#ifndef NOAES
+/*
+  Find the WinZip AES extra field in the local extra field of the current
+    file, and read the AES version, the strength and the real compression
+    method from it
+*/
+local int unz64local_GetAESExtra(unz64_s* s, ZPOS64_T offset_local_extrafield,
+                                 uInt size_local_extrafield, int* version,
+                                 int* strength, uLong* method) {
+    unsigned char* extra;
+    uInt pos = 0;
+    int err = UNZ_BADZIPFILE;
+
+    if (size_local_extrafield == 0)
+        return UNZ_BADZIPFILE;
+    extra = (unsigned char*)ALLOC(size_local_extrafield);
+    if (extra == NULL)
+        return UNZ_INTERNALERROR;
+
+    if (ZREADAT64(s->z_filefunc, s->filestream, offset_local_extrafield + s->byte_before_the_zipfile,
+                  extra, size_local_extrafield) != size_local_extrafield)
+        err = UNZ_ERRNO;
+    else
+        while (pos + 4 <= size_local_extrafield)
+        {
+            uLong header_id = unz64local_readShort(extra + pos);
+            uLong data_size = unz64local_readShort(extra + pos + 2);
+            if (pos + 4 + data_size > size_local_extrafield)
+                break;
+            if ((header_id == ZAES_EXTRA_ID) && (data_size >= ZAES_EXTRA_SIZE) &&
+                (extra[pos + 6] == 'A') && (extra[pos + 7] == 'E'))
+            {
+                *version = (int)unz64local_readShort(extra + pos + 4);
+                *strength = extra[pos + 8];
+                *method = unz64local_readShort(extra + pos + 9);
+                if (((*version == ZAES_VERSION_AE1) || (*version == ZAES_VERSION_AE2)) &&
+                    (*strength >= 1) && (*strength <= 3))
+                    err = UNZ_OK;
+                break;
+            }
+            pos += 4 + (uInt)data_size;
+        }
+
+    free(extra);
+    return err;
+}
+#endif
+
 /*
   Open for reading data the current file in the zipfile.
   If there is no error and the file is opened, the return value is UNZ_OK.
@@ -1348,11 +1906,13 @@ extern int ZEXPORT unzOpenCurrentFile3(unzFile file, int* method,
     file_in_zip64_read_info_s* pfile_in_zip_read_info;
     ZPOS64_T offset_local_extrafield;  /* offset of the local extra field */
     uInt  size_local_extrafield;    /* size of the local extra field */
+    uLong compression_method;       /* real compression method of the data */
+    int aes_version = 0;            /* WinZip AES version if we decrypt it */
+#ifndef NOAES
+    int aes_strength = 0;
+#endif
 #    ifndef NOUNCRYPT
     char source[12];
-#    else
-    if (password != NULL)
-        return UNZ_PARAMERROR;
 #    endif
 
     if (file==NULL)
@@ -1367,26 +1927,73 @@ extern int ZEXPORT unzOpenCurrentFile3(unzFile file, int* method,
     if (unz64local_CheckCurrentFileCoherencyHeader(s,&iSizeVar, &offset_local_extrafield,&size_local_extrafield)!=UNZ_OK)
         return UNZ_BADZIPFILE;
 
-    pfile_in_zip_read_info = (file_in_zip64_read_info_s*)ALLOC(sizeof(file_in_zip64_read_info_s));
+    compression_method = s->cur_file_info.compression_method;
+    if (compression_method==Z_AES)
+    {
+#ifndef NOAES
+        err = unz64local_GetAESExtra(s, offset_local_extrafield, size_local_extrafield,
+                                     &aes_version, &aes_strength, &compression_method);
+        if (err!=UNZ_OK)
+            return err;
+        if (password == NULL)
+        {
+            /* without password, only the raw encrypted data can be read */
+            if (!raw)
+                return UNZ_BADPASSWORD;
+            compression_method = Z_AES;
+            aes_version = 0;
+        }
+#else
+        if (!raw)
+            return UNZ_BADZIPFILE;
+#endif
+    }
+
+#    ifdef NOUNCRYPT
+    if ((password != NULL) && (aes_version == 0))
+        return UNZ_PARAMERROR;
+#    endif
+
+    /* reuse the structure, buffer and inflate state of the last closed file */
+    pfile_in_zip_read_info = s->pfile_in_zip_read_free;
+    s->pfile_in_zip_read_free = NULL;
     if (pfile_in_zip_read_info==NULL)
-        return UNZ_INTERNALERROR;
+    {
+        pfile_in_zip_read_info = (file_in_zip64_read_info_s*)ALLOC(sizeof(file_in_zip64_read_info_s));
+        if (pfile_in_zip_read_info==NULL)
+            return UNZ_INTERNALERROR;
+
+        pfile_in_zip_read_info->read_buffer=(char*)ALLOC(UNZ_BUFSIZE);
+        if (pfile_in_zip_read_info->read_buffer==NULL)
+        {
+            free(pfile_in_zip_read_info);
+            return UNZ_INTERNALERROR;
+        }
+
+        pfile_in_zip_read_info->stream_initialised=0;
+#ifdef HAVE_ZSTD
+        pfile_in_zip_read_info->zstream=NULL;
+#endif
+#ifdef HAVE_LZMA
+        {
+            lzma_stream lstream_init = LZMA_STREAM_INIT;
+            pfile_in_zip_read_info->lstream = lstream_init;
+        }
+#endif
+#ifdef HAVE_LIBDEFLATE
+        pfile_in_zip_read_info->ldecompressor=NULL;
+#endif
+    }
 
-    pfile_in_zip_read_info->read_buffer=(char*)ALLOC(UNZ_BUFSIZE);
     pfile_in_zip_read_info->offset_local_extrafield = offset_local_extrafield;
     pfile_in_zip_read_info->size_local_extrafield = size_local_extrafield;
     pfile_in_zip_read_info->pos_local_extrafield=0;
     pfile_in_zip_read_info->raw=raw;
-
-    if (pfile_in_zip_read_info->read_buffer==NULL)
-    {
-        free(pfile_in_zip_read_info);
-        return UNZ_INTERNALERROR;
-    }
-
-    pfile_in_zip_read_info->stream_initialised=0;
+    pfile_in_zip_read_info->aes=0;
+    pfile_in_zip_read_info->crc_unknown=0;
 
     if (method!=NULL)
-        *method = (int)s->cur_file_info.compression_method;
+        *method = (int)compression_method;
 
     if (level!=NULL)
     {
@@ -1399,27 +2006,38 @@ extern int ZEXPORT unzOpenCurrentFile3(unzFile file, int* method,
         }
     }
 
-    if ((s->cur_file_info.compression_method!=0) &&
+    if ((compression_method!=0) &&
 /* #ifdef HAVE_BZIP2 */
-        (s->cur_file_info.compression_method!=Z_BZIP2ED) &&
+        (compression_method!=Z_BZIP2ED) &&
+/* #endif */
+/* #ifdef HAVE_LZMA */
+        (compression_method!=Z_LZMA) &&
+        (compression_method!=Z_XZ) &&
 /* #endif */
-        (s->cur_file_info.compression_method!=Z_DEFLATED))
+/* #ifdef HAVE_ZSTD */
+        (compression_method!=Z_ZSTD) &&
+/* #endif */
+        (compression_method!=Z_DEFLATED))
 
         err=UNZ_BADZIPFILE;
 
     pfile_in_zip_read_info->crc32_wait=s->cur_file_info.crc;
     pfile_in_zip_read_info->crc32=0;
     pfile_in_zip_read_info->total_out_64=0;
-    pfile_in_zip_read_info->compression_method = s->cur_file_info.compression_method;
+    pfile_in_zip_read_info->compression_method = compression_method;
     pfile_in_zip_read_info->filestream=s->filestream;
     pfile_in_zip_read_info->z_filefunc=s->z_filefunc;
     pfile_in_zip_read_info->byte_before_the_zipfile=s->byte_before_the_zipfile;
 
     pfile_in_zip_read_info->stream.total_out = 0;
 
-    if ((s->cur_file_info.compression_method==Z_BZIP2ED) && (!raw))
+    if ((compression_method==Z_BZIP2ED) && (!raw))
     {
 #ifdef HAVE_BZIP2
+      if (pfile_in_zip_read_info->stream_initialised==Z_DEFLATED)
+        inflateEnd(&pfile_in_zip_read_info->stream);
+      pfile_in_zip_read_info->stream_initialised=0;
+
       pfile_in_zip_read_info->bstream.bzalloc = (void *(*) (void *, int, int))0;
       pfile_in_zip_read_info->bstream.bzfree = (free_func)0;
       pfile_in_zip_read_info->bstream.opaque = (voidpf)0;
@@ -1436,15 +2054,62 @@ extern int ZEXPORT unzOpenCurrentFile3(unzFile file, int* method,
         pfile_in_zip_read_info->stream_initialised=Z_BZIP2ED;
       else
       {
-        free(pfile_in_zip_read_info->read_buffer);
-        free(pfile_in_zip_read_info);
+        unz64local_FreeReadInfo(pfile_in_zip_read_info);
         return err;
       }
 #else
       pfile_in_zip_read_info->raw=1;
 #endif
     }
-    else if ((s->cur_file_info.compression_method==Z_DEFLATED) && (!raw))
+    else if ((compression_method==Z_ZSTD) && (!raw))
+    {
+#ifdef HAVE_ZSTD
+      if (pfile_in_zip_read_info->zstream==NULL)
+        pfile_in_zip_read_info->zstream=ZSTD_createDCtx();
+      if ((pfile_in_zip_read_info->zstream==NULL) ||
+          ZSTD_isError(ZSTD_DCtx_reset(pfile_in_zip_read_info->zstream, ZSTD_reset_session_only)))
+      {
+        unz64local_FreeReadInfo(pfile_in_zip_read_info);
+        return UNZ_INTERNALERROR;
+      }
+#else
+      pfile_in_zip_read_info->raw=1;
+#endif
+    }
+    else if (((compression_method==Z_LZMA) || (compression_method==Z_XZ)) && (!raw))
+    {
+#ifdef HAVE_LZMA
+      /* the LZMA decoder is made from the properties before the data, when
+         unzReadCurrentFile has read them */
+      pfile_in_zip_read_info->lzma_header_read = 0;
+      if (compression_method==Z_XZ)
+      {
+        pfile_in_zip_read_info->lzma_header_read = SIZELZMAHEADER;
+        if (lzma_stream_decoder(&pfile_in_zip_read_info->lstream, UINT64_MAX, 0)!=LZMA_OK)
+        {
+          unz64local_FreeReadInfo(pfile_in_zip_read_info);
+          return UNZ_INTERNALERROR;
+        }
+      }
+#else
+      pfile_in_zip_read_info->raw=1;
+#endif
+    }
+    else if ((compression_method==Z_DEFLATED) && (!raw) &&
+             (pfile_in_zip_read_info->stream_initialised==Z_DEFLATED))
+    {
+      /* inflate state of a previous file, just reset it */
+      pfile_in_zip_read_info->stream.next_in = 0;
+      pfile_in_zip_read_info->stream.avail_in = 0;
+
+      err=inflateReset(&pfile_in_zip_read_info->stream);
+      if (err != Z_OK)
+      {
+        unz64local_FreeReadInfo(pfile_in_zip_read_info);
+        return err;
+      }
+    }
+    else if ((compression_method==Z_DEFLATED) && (!raw))
     {
       pfile_in_zip_read_info->stream.zalloc = (alloc_func)0;
       pfile_in_zip_read_info->stream.zfree = (free_func)0;
@@ -1457,8 +2122,7 @@ extern int ZEXPORT unzOpenCurrentFile3(unzFile file, int* method,
         pfile_in_zip_read_info->stream_initialised=Z_DEFLATED;
       else
       {
-        free(pfile_in_zip_read_info->read_buffer);
-        free(pfile_in_zip_read_info);
+        unz64local_FreeReadInfo(pfile_in_zip_read_info);
         return err;
       }
         /* windowBits is passed < 0 to tell that there is no zlib header.
@@ -1485,17 +2149,15 @@ extern int ZEXPORT unzOpenCurrentFile3(unzFile file, int* method,
                 s->encrypted = 0;
 
 #    ifndef NOUNCRYPT
-    if (password != NULL)
+    if ((password != NULL) && (aes_version == 0))
     {
         int i;
         s->pcrc_32_tab = get_crc_table();
         init_keys(password,s->keys,s->pcrc_32_tab);
-        if (ZSEEK64(s->z_filefunc, s->filestream,
-                  s->pfile_in_zip_read->pos_in_zipfile +
-                     s->pfile_in_zip_read->byte_before_the_zipfile,
-                  SEEK_SET)!=0)
-            return UNZ_INTERNALERROR;
-        if(ZREAD64(s->z_filefunc, s->filestream,source, 12)<12)
+        if(ZREADAT64(s->z_filefunc, s->filestream,
+                     s->pfile_in_zip_read->pos_in_zipfile +
+                        s->pfile_in_zip_read->byte_before_the_zipfile,
+                     source, 12)<12)
             return UNZ_INTERNALERROR;
 
         for (i = 0; i<12; i++)
@@ -1506,6 +2168,43 @@ extern int ZEXPORT unzOpenCurrentFile3(unzFile file, int* method,
     }
 #    endif
 
+#ifndef NOAES
+    if (aes_version != 0)
+    {
+        /* the salt and the password verification value are before the
+           data, the authentication code after it */
+        unsigned char head[ZAES_MAX_SALT_LEN + ZAES_PWVERIFY_LEN];
+        unsigned char pwverify[ZAES_PWVERIFY_LEN];
+        uInt size_head = ZAES_SALT_LEN(aes_strength) + ZAES_PWVERIFY_LEN;
+
+        err = UNZ_OK;
+        if (pfile_in_zip_read_info->rest_read_compressed < size_head + ZAES_AUTHCODE_LEN)
+            err = UNZ_BADZIPFILE;
+        else if (ZREADAT64(s->z_filefunc, s->filestream,
+                           pfile_in_zip_read_info->pos_in_zipfile +
+                              pfile_in_zip_read_info->byte_before_the_zipfile,
+                           head, size_head) != size_head)
+            err = UNZ_ERRNO;
+        else
+        {
+            zaes_init(&pfile_in_zip_read_info->aes_ctx, aes_strength, password, head, pwverify);
+            if (memcmp(pwverify, head + size_head - ZAES_PWVERIFY_LEN, ZAES_PWVERIFY_LEN) != 0)
+                err = UNZ_BADPASSWORD;
+        }
+        if (err != UNZ_OK)
+        {
+            unzCloseCurrentFile(file);
+            return err;
+        }
+
+        pfile_in_zip_read_info->aes = aes_version;
+        pfile_in_zip_read_info->pos_in_zipfile += size_head;
+        pfile_in_zip_read_info->rest_read_compressed -= size_head + ZAES_AUTHCODE_LEN;
+    }
+#endif
+
+    pfile_in_zip_read_info->pos_data = pfile_in_zip_read_info->pos_in_zipfile;
+    pfile_in_zip_read_info->size_data = pfile_in_zip_read_info->rest_read_compressed;
 
     return UNZ_OK;
 }
@@ -1539,6 +2238,97 @@ extern ZPOS64_T ZEXPORT unzGetCurrentFileZStreamPos64(unzFile file) {
 
 /** Addition for GDAL : END */
 
+#ifdef HAVE_LZMA
+/*
+  Make the LZMA decoder of the current file from the properties in its
+    header, once unzReadCurrentFile has read them
+*/
+local int unz64local_InitLzmaDecoder(file_in_zip64_read_info_s* pfile_in_zip_read_info) {
+    lzma_filter filters[2];
+    lzma_ret ret;
+
+    filters[0].id = LZMA_FILTER_LZMA1;
+    filters[0].options = NULL;
+    filters[1].id = LZMA_VLI_UNKNOWN;
+    filters[1].options = NULL;
+    if ((unz64local_readShort(pfile_in_zip_read_info->lzma_header + 2) != SIZELZMAHEADER - 4) ||
+        (lzma_properties_decode(&filters[0], NULL, pfile_in_zip_read_info->lzma_header + 4,
+                                SIZELZMAHEADER - 4) != LZMA_OK))
+        return UNZ_BADZIPFILE;
+
+    /* liblzma copies the options, and reuses the memory of the previous decoder */
+    ret = lzma_raw_decoder(&pfile_in_zip_read_info->lstream, filters);
+    free(filters[0].options);
+    return (ret == LZMA_OK) ? UNZ_OK : UNZ_INTERNALERROR;
+}
+#endif
+
+/*
+  Give to the stream of the current file its next compressed data, mapped
+    from the zipfile or read in read_buffer and decrypted.
+  return UNZ_OK, or UNZ_ERRNO for IO error
+*/
+local int unz64local_ReadCompressed(unz64_s* s, file_in_zip64_read_info_s* pfile_in_zip_read_info) {
+    uInt uReadThis = UNZ_BUFSIZE;
+    const void* mapped = NULL;
+
+    /* if the zipfile is mapped, we give the data to inflate in place
+       instead of copying it in read_buffer */
+    if ((!s->encrypted) && (!pfile_in_zip_read_info->aes))
+    {
+        uInt uMapThis = 0x40000000;
+        if (pfile_in_zip_read_info->rest_read_compressed<uMapThis)
+            uMapThis = (uInt)pfile_in_zip_read_info->rest_read_compressed;
+        mapped = ZMAP64(pfile_in_zip_read_info->z_filefunc,
+                        pfile_in_zip_read_info->filestream,
+                        pfile_in_zip_read_info->pos_in_zipfile +
+                           pfile_in_zip_read_info->byte_before_the_zipfile,
+                        uMapThis);
+        if (mapped!=NULL)
+            uReadThis = uMapThis;
+    }
+    if (pfile_in_zip_read_info->rest_read_compressed<uReadThis)
+        uReadThis = (uInt)pfile_in_zip_read_info->rest_read_compressed;
+    if (uReadThis == 0)
+        return UNZ_EOF;
+    if (mapped==NULL)
+    {
+        if (ZREADAT64(pfile_in_zip_read_info->z_filefunc,
+                      pfile_in_zip_read_info->filestream,
+                      pfile_in_zip_read_info->pos_in_zipfile +
+                         pfile_in_zip_read_info->byte_before_the_zipfile,
+                      pfile_in_zip_read_info->read_buffer,
+                      uReadThis)!=uReadThis)
+            return UNZ_ERRNO;
+        mapped = pfile_in_zip_read_info->read_buffer;
+    }
+
+#    ifndef NOUNCRYPT
+    if(s->encrypted)
+    {
+        uInt i;
+        for(i=0;i<uReadThis;i++)
+          pfile_in_zip_read_info->read_buffer[i] =
+              zdecode(s->keys,s->pcrc_32_tab,
+                      pfile_in_zip_read_info->read_buffer[i]);
+    }
+#    endif
+
+#ifndef NOAES
+    if (pfile_in_zip_read_info->aes)
+        zaes_decrypt(&pfile_in_zip_read_info->aes_ctx,
+                     (unsigned char*)pfile_in_zip_read_info->read_buffer, uReadThis);
+#endif
+
+    pfile_in_zip_read_info->pos_in_zipfile += uReadThis;
+    pfile_in_zip_read_info->rest_read_compressed-=uReadThis;
+
+    pfile_in_zip_read_info->stream.next_in = (Bytef*)mapped;
+    pfile_in_zip_read_info->stream.avail_in = (uInt)uReadThis;
+    return UNZ_OK;
+}
+
+
 /*
   Read bytes from the current file.
   buf contain buffer where data must be copied
@@ -1589,48 +2379,14 @@ extern int ZEXPORT unzReadCurrentFile(unzFile file, voidp buf, unsigned len) {
         if ((pfile_in_zip_read_info->stream.avail_in==0) &&
             (pfile_in_zip_read_info->rest_read_compressed>0))
         {
-            uInt uReadThis = UNZ_BUFSIZE;
-            if (pfile_in_zip_read_info->rest_read_compressed<uReadThis)
-                uReadThis = (uInt)pfile_in_zip_read_info->rest_read_compressed;
-            if (uReadThis == 0)
-                return UNZ_EOF;
-            if (ZSEEK64(pfile_in_zip_read_info->z_filefunc,
-                      pfile_in_zip_read_info->filestream,
-                      pfile_in_zip_read_info->pos_in_zipfile +
-                         pfile_in_zip_read_info->byte_before_the_zipfile,
-                         ZLIB_FILEFUNC_SEEK_SET)!=0)
-                return UNZ_ERRNO;
-            if (ZREAD64(pfile_in_zip_read_info->z_filefunc,
-                      pfile_in_zip_read_info->filestream,
-                      pfile_in_zip_read_info->read_buffer,
-                      uReadThis)!=uReadThis)
-                return UNZ_ERRNO;
+            err = unz64local_ReadCompressed(s, pfile_in_zip_read_info);
+            if (err!=UNZ_OK)
+                return err;
+        }
 
-
-#            ifndef NOUNCRYPT
-            if(s->encrypted)
-            {
-                uInt i;
-                for(i=0;i<uReadThis;i++)
-                  pfile_in_zip_read_info->read_buffer[i] =
-                      zdecode(s->keys,s->pcrc_32_tab,
-                              pfile_in_zip_read_info->read_buffer[i]);
-            }
-#            endif
-
-
-            pfile_in_zip_read_info->pos_in_zipfile += uReadThis;
-
-            pfile_in_zip_read_info->rest_read_compressed-=uReadThis;
-
-            pfile_in_zip_read_info->stream.next_in =
-                (Bytef*)pfile_in_zip_read_info->read_buffer;
-            pfile_in_zip_read_info->stream.avail_in = (uInt)uReadThis;
-        }
-
-        if ((pfile_in_zip_read_info->compression_method==0) || (pfile_in_zip_read_info->raw))
-        {
-            uInt uDoCopy,i ;
+        if ((pfile_in_zip_read_info->compression_method==0) || (pfile_in_zip_read_info->raw))
+        {
+            uInt uDoCopy;
 
             if ((pfile_in_zip_read_info->stream.avail_in == 0) &&
                 (pfile_in_zip_read_info->rest_read_compressed == 0))
@@ -1642,15 +2398,13 @@ extern int ZEXPORT unzReadCurrentFile(unzFile file, voidp buf, unsigned len) {
             else
                 uDoCopy = pfile_in_zip_read_info->stream.avail_in ;
 
-            for (i=0;i<uDoCopy;i++)
-                *(pfile_in_zip_read_info->stream.next_out+i) =
-                        *(pfile_in_zip_read_info->stream.next_in+i);
+            /* copy and check the data in the same pass */
+            pfile_in_zip_read_info->crc32 = zcrc32_copy(pfile_in_zip_read_info->crc32,
+                                pfile_in_zip_read_info->stream.next_out,
+                                pfile_in_zip_read_info->stream.next_in, uDoCopy);
 
             pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + uDoCopy;
 
-            pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,
-                                pfile_in_zip_read_info->stream.next_out,
-                                uDoCopy);
             pfile_in_zip_read_info->rest_read_uncompressed-=uDoCopy;
             pfile_in_zip_read_info->stream.avail_in -= uDoCopy;
             pfile_in_zip_read_info->stream.avail_out -= uDoCopy;
@@ -1685,7 +2439,7 @@ extern int ZEXPORT unzReadCurrentFile(unzFile file, voidp buf, unsigned len) {
 
             pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + uOutThis;
 
-            pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,bufBefore, (uInt)(uOutThis));
+            pfile_in_zip_read_info->crc32 = zcrc32(pfile_in_zip_read_info->crc32,bufBefore, (size_t)(uOutThis));
             pfile_in_zip_read_info->rest_read_uncompressed -= uOutThis;
             iRead += (uInt)(uTotalOutAfter - uTotalOutBefore);
 
@@ -1702,6 +2456,112 @@ extern int ZEXPORT unzReadCurrentFile(unzFile file, voidp buf, unsigned len) {
               break;
 #endif
         } // end Z_BZIP2ED
+        else if (pfile_in_zip_read_info->compression_method==Z_ZSTD)
+        {
+#ifdef HAVE_ZSTD
+            ZSTD_inBuffer input;
+            ZSTD_outBuffer output;
+            size_t ret;
+
+            input.src = pfile_in_zip_read_info->stream.next_in;
+            input.size = pfile_in_zip_read_info->stream.avail_in;
+            input.pos = 0;
+            output.dst = pfile_in_zip_read_info->stream.next_out;
+            output.size = pfile_in_zip_read_info->stream.avail_out;
+            output.pos = 0;
+
+            ret = ZSTD_decompressStream(pfile_in_zip_read_info->zstream, &output, &input);
+
+            pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + output.pos;
+            pfile_in_zip_read_info->crc32 = zcrc32(pfile_in_zip_read_info->crc32,
+                                                   output.dst, output.pos);
+            pfile_in_zip_read_info->rest_read_uncompressed -= output.pos;
+            iRead += (uInt)output.pos;
+
+            pfile_in_zip_read_info->stream.next_in += input.pos;
+            pfile_in_zip_read_info->stream.avail_in -= (uInt)input.pos;
+            pfile_in_zip_read_info->stream.total_in += input.pos;
+            pfile_in_zip_read_info->stream.next_out += output.pos;
+            pfile_in_zip_read_info->stream.avail_out -= (uInt)output.pos;
+            pfile_in_zip_read_info->stream.total_out += output.pos;
+
+            if (ZSTD_isError(ret))
+            {
+                err = Z_DATA_ERROR;
+                break;
+            }
+            if (ret==0)
+                return (iRead==0) ? UNZ_EOF : (int)iRead;
+            /* all the data was given but the frame is not complete */
+            if ((input.pos==0) && (output.pos==0) &&
+                (pfile_in_zip_read_info->stream.avail_in==0) &&
+                (pfile_in_zip_read_info->rest_read_compressed==0))
+            {
+                err = Z_DATA_ERROR;
+                break;
+            }
+#endif
+        } // end Z_ZSTD
+        else if ((pfile_in_zip_read_info->compression_method==Z_LZMA) ||
+                 (pfile_in_zip_read_info->compression_method==Z_XZ))
+        {
+#ifdef HAVE_LZMA
+            uInt uInThis, uOutThis;
+            lzma_ret ret;
+
+            if (pfile_in_zip_read_info->lzma_header_read < SIZELZMAHEADER)
+            {
+                uInt uCopy = SIZELZMAHEADER - pfile_in_zip_read_info->lzma_header_read;
+                if (uCopy > pfile_in_zip_read_info->stream.avail_in)
+                    uCopy = pfile_in_zip_read_info->stream.avail_in;
+                memcpy(pfile_in_zip_read_info->lzma_header + pfile_in_zip_read_info->lzma_header_read,
+                       pfile_in_zip_read_info->stream.next_in, uCopy);
+                pfile_in_zip_read_info->lzma_header_read += uCopy;
+                pfile_in_zip_read_info->stream.next_in += uCopy;
+                pfile_in_zip_read_info->stream.avail_in -= uCopy;
+                pfile_in_zip_read_info->stream.total_in += uCopy;
+                if (pfile_in_zip_read_info->lzma_header_read == SIZELZMAHEADER)
+                    err = unz64local_InitLzmaDecoder(pfile_in_zip_read_info);
+                else if (pfile_in_zip_read_info->rest_read_compressed == 0)
+                    err = Z_DATA_ERROR;
+                if (err!=UNZ_OK)
+                    break;
+                continue;
+            }
+
+            pfile_in_zip_read_info->lstream.next_in = pfile_in_zip_read_info->stream.next_in;
+            pfile_in_zip_read_info->lstream.avail_in = pfile_in_zip_read_info->stream.avail_in;
+            pfile_in_zip_read_info->lstream.next_out = pfile_in_zip_read_info->stream.next_out;
+            pfile_in_zip_read_info->lstream.avail_out = pfile_in_zip_read_info->stream.avail_out;
+
+            ret = lzma_code(&pfile_in_zip_read_info->lstream, LZMA_RUN);
+
+            uInThis = pfile_in_zip_read_info->stream.avail_in - (uInt)pfile_in_zip_read_info->lstream.avail_in;
+            uOutThis = pfile_in_zip_read_info->stream.avail_out - (uInt)pfile_in_zip_read_info->lstream.avail_out;
+
+            pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + uOutThis;
+            pfile_in_zip_read_info->crc32 = zcrc32(pfile_in_zip_read_info->crc32,
+                                                   pfile_in_zip_read_info->stream.next_out, uOutThis);
+            pfile_in_zip_read_info->rest_read_uncompressed -= uOutThis;
+            iRead += uOutThis;
+
+            pfile_in_zip_read_info->stream.next_in += uInThis;
+            pfile_in_zip_read_info->stream.avail_in -= uInThis;
+            pfile_in_zip_read_info->stream.total_in += uInThis;
+            pfile_in_zip_read_info->stream.next_out += uOutThis;
+            pfile_in_zip_read_info->stream.avail_out -= uOutThis;
+            pfile_in_zip_read_info->stream.total_out += uOutThis;
+
+            if (ret==LZMA_STREAM_END)
+                return (iRead==0) ? UNZ_EOF : (int)iRead;
+            if (ret!=LZMA_OK)
+            {
+                /* LZMA_BUF_ERROR: all the data was given but it is not complete */
+                err = (ret==LZMA_MEM_ERROR) ? UNZ_INTERNALERROR : Z_DATA_ERROR;
+                break;
+            }
+#endif
+        } // end Z_LZMA, Z_XZ
         else
         {
             ZPOS64_T uTotalOutBefore,uTotalOutAfter;
@@ -1732,8 +2592,8 @@ extern int ZEXPORT unzReadCurrentFile(unzFile file, voidp buf, unsigned len) {
             pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + uOutThis;
 
             pfile_in_zip_read_info->crc32 =
-                crc32(pfile_in_zip_read_info->crc32,bufBefore,
-                        (uInt)(uOutThis));
+                zcrc32(pfile_in_zip_read_info->crc32,bufBefore,
+                        (size_t)(uOutThis));
 
             pfile_in_zip_read_info->rest_read_uncompressed -=
                 uOutThis;
@@ -1753,6 +2613,148 @@ extern int ZEXPORT unzReadCurrentFile(unzFile file, voidp buf, unsigned len) {
 }
 
 
+/*
+  Inflate in one pass the size_in bytes of in to the size_out bytes of out,
+    by libdeflate or by the inflate state of the current file
+*/
+local int unz64local_InflateFully(file_in_zip64_read_info_s* pfile_in_zip_read_info,
+                                  const unsigned char* in, ZPOS64_T size_in,
+                                  unsigned char* out, ZPOS64_T size_out) {
+#ifdef HAVE_LIBDEFLATE
+    if (pfile_in_zip_read_info->ldecompressor == NULL)
+        pfile_in_zip_read_info->ldecompressor = libdeflate_alloc_decompressor();
+    if (pfile_in_zip_read_info->ldecompressor == NULL)
+        return UNZ_INTERNALERROR;
+    /* without actual_out_nbytes_ret, libdeflate checks that size_out is exact */
+    if (libdeflate_deflate_decompress(pfile_in_zip_read_info->ldecompressor, in, (size_t)size_in,
+                                      out, (size_t)size_out, NULL) != LIBDEFLATE_SUCCESS)
+        return Z_DATA_ERROR;
+    return UNZ_OK;
+#else
+    int err = Z_OK;
+
+    /* z_stream counts in uInt, give it at most 1 GB at a time */
+    while ((err == Z_OK) && (size_out > 0))
+    {
+        uInt in_this = (size_in < 0x40000000) ? (uInt)size_in : 0x40000000;
+        uInt out_this = (size_out < 0x40000000) ? (uInt)size_out : 0x40000000;
+
+        pfile_in_zip_read_info->stream.next_in = (Bytef*)(uintptr_t)in;
+        pfile_in_zip_read_info->stream.avail_in = in_this;
+        pfile_in_zip_read_info->stream.next_out = out;
+        pfile_in_zip_read_info->stream.avail_out = out_this;
+        err = inflate(&pfile_in_zip_read_info->stream, Z_SYNC_FLUSH);
+        if ((err == Z_BUF_ERROR) && (pfile_in_zip_read_info->stream.avail_in < in_this))
+            err = Z_OK;
+
+        in += in_this - pfile_in_zip_read_info->stream.avail_in;
+        size_in -= in_this - pfile_in_zip_read_info->stream.avail_in;
+        out += out_this - pfile_in_zip_read_info->stream.avail_out;
+        size_out -= out_this - pfile_in_zip_read_info->stream.avail_out;
+        if ((err == Z_OK) && (pfile_in_zip_read_info->stream.avail_out == out_this) &&
+            (pfile_in_zip_read_info->stream.avail_in == in_this))
+            err = Z_DATA_ERROR; /* no progress: the data is truncated */
+    }
+    pfile_in_zip_read_info->stream.avail_in = 0;
+    if ((err == Z_OK) || (err == Z_STREAM_END))
+        return (size_out == 0) ? UNZ_OK : Z_DATA_ERROR;
+    return (err == Z_BUF_ERROR) ? Z_DATA_ERROR : err;
+#endif
+}
+
+extern int ZEXPORT unzReadCurrentFileFully(unzFile file, voidp buf, ZPOS64_T len) {
+    unz64_s* s;
+    file_in_zip64_read_info_s* pfile_in_zip_read_info;
+    ZPOS64_T size_in;
+    ZPOS64_T size_out;
+    ZPOS64_T done = 0;
+    unsigned char* out = (unsigned char*)buf;
+    int err = UNZ_OK;
+
+    if ((file==NULL) || (buf==NULL))
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
+    if (pfile_in_zip_read_info==NULL)
+        return UNZ_PARAMERROR;
+
+    size_in = pfile_in_zip_read_info->rest_read_compressed;
+    size_out = pfile_in_zip_read_info->rest_read_uncompressed;
+    if (pfile_in_zip_read_info->raw)
+        size_out = size_in + pfile_in_zip_read_info->stream.avail_in;
+    if (len < size_out)
+        return UNZ_PARAMERROR;
+
+    if ((!pfile_in_zip_read_info->raw) && (!s->encrypted) && (!pfile_in_zip_read_info->aes) &&
+        (pfile_in_zip_read_info->total_out_64 == 0) &&
+        (pfile_in_zip_read_info->stream.avail_in == 0) &&
+        ((size_t)size_in == size_in) && ((size_t)size_out == size_out) &&
+        (((pfile_in_zip_read_info->compression_method == 0) && (size_in == size_out)) ||
+         (pfile_in_zip_read_info->compression_method == Z_DEFLATED)))
+    {
+        ZPOS64_T pos = pfile_in_zip_read_info->pos_in_zipfile +
+                       pfile_in_zip_read_info->byte_before_the_zipfile;
+        const unsigned char* in;
+        unsigned char* in_alloc = NULL;
+
+        in = (const unsigned char*)ZMAP64(pfile_in_zip_read_info->z_filefunc,
+                                          pfile_in_zip_read_info->filestream, pos, size_in);
+        if ((in == NULL) && (size_in > 0))
+        {
+            /* stored data is read right in buf */
+            ZPOS64_T read = 0;
+            if (pfile_in_zip_read_info->compression_method == 0)
+                in = out;
+            else
+                in = in_alloc = (unsigned char*)ALLOC((size_t)size_in);
+            if (in == NULL)
+                return UNZ_INTERNALERROR;
+            while ((err == UNZ_OK) && (read < size_in))
+            {
+                uLong read_this = (size_in - read < 0x40000000) ? (uLong)(size_in - read) : 0x40000000;
+                if (ZREADAT64(pfile_in_zip_read_info->z_filefunc, pfile_in_zip_read_info->filestream,
+                              pos + read, (void*)(in + read), read_this) != read_this)
+                    err = UNZ_ERRNO;
+                read += read_this;
+            }
+        }
+
+        if ((err == UNZ_OK) && (pfile_in_zip_read_info->compression_method == Z_DEFLATED))
+        {
+            err = unz64local_InflateFully(pfile_in_zip_read_info, in, size_in, out, size_out);
+            if (err == UNZ_OK)
+                pfile_in_zip_read_info->crc32 = zcrc32(pfile_in_zip_read_info->crc32, out, (size_t)size_out);
+        }
+        else if ((err == UNZ_OK) && (in != out))
+            pfile_in_zip_read_info->crc32 = zcrc32_copy(pfile_in_zip_read_info->crc32, out, in, (size_t)size_out);
+        else if (err == UNZ_OK)
+            pfile_in_zip_read_info->crc32 = zcrc32(pfile_in_zip_read_info->crc32, out, (size_t)size_out);
+        free(in_alloc);
+        if (err != UNZ_OK)
+            return err;
+
+        pfile_in_zip_read_info->pos_in_zipfile += size_in;
+        pfile_in_zip_read_info->rest_read_compressed = 0;
+        pfile_in_zip_read_info->rest_read_uncompressed = 0;
+        pfile_in_zip_read_info->total_out_64 = size_out;
+        pfile_in_zip_read_info->stream.total_out = (uLong)size_out;
+        return UNZ_OK;
+    }
+
+    while (done < size_out)
+    {
+        unsigned read_this = (size_out - done < 0x40000000) ? (unsigned)(size_out - done) : 0x40000000;
+        int read = unzReadCurrentFile(file, out + done, read_this);
+        if (read < 0)
+            return read;
+        if (read == 0)
+            return UNZ_BADZIPFILE;
+        done += (ZPOS64_T)read;
+    }
+    return UNZ_OK;
+}
+
+
 /*
   Give the current position in uncompressed data
 */
@@ -1806,72 +2808,380 @@ extern int ZEXPORT unzeof(unzFile file) {
         return 0;
 }
 
+/*
+  Free the checkpoints of all the files sought in
+*/
+local void unz64local_FreeSeekIndex(unz64_seek_index* index) {
+    while (index != NULL)
+    {
+        unz64_seek_index* next = index->next;
+        free(index->points);
+        free(index);
+        index = next;
+    }
+}
+
+/*
+  Find the checkpoints of the current file among those recorded
+*/
+local unz64_seek_index* unz64local_FindSeekIndex(const unz64_s* s) {
+    unz64_seek_index* index;
 
+    for (index = s->seek_index; index != NULL; index = index->next)
+        if (index->offset_curfile == s->cur_file_info_internal.offset_curfile)
+            return index;
+    return NULL;
+}
 
 /*
-Read extra field from the current file (opened by unzOpenCurrentFile)
-This is the local-header version of the extra field (sometimes, there is
-more info in the local-header version than in the central-header)
+  Add an empty list of checkpoints for the current file
+*/
+local unz64_seek_index* unz64local_NewSeekIndex(unz64_s* s) {
+    unz64_seek_index* index;
 
-  if buf==NULL, it return the size of the local extra field that can be read
+    index = (unz64_seek_index*)ALLOC(sizeof(unz64_seek_index));
+    if (index == NULL)
+        return NULL;
+    index->offset_curfile = s->cur_file_info_internal.offset_curfile;
+    index->compressed_size = s->cur_file_info.compressed_size;
+    index->uncompressed_size = s->cur_file_info.uncompressed_size;
+    index->crc = s->cur_file_info.crc;
+    index->points = NULL;
+    index->number_point = 0;
+    index->size_points = 0;
+    index->complete = 0;
+    index->next = s->seek_index;
+    s->seek_index = index;
+    return index;
+}
 
-  if buf!=NULL, len is the size of the buffer, the extra header is copied in
-    buf.
-  the return value is the number of bytes copied in buf, or (if <0)
-    the error code
+
+#define SEEKINDEXMAGIC (0x3149535a)  /* "ZSI1" */
+#define SIZESEEKINDEXHEADER (0x24)
+#define SIZESEEKPOINT (0x11 + UNZ_WINDOWSIZE)
+
+local void unz64local_putValue(unsigned char* p, ZPOS64_T x, int nbByte) {
+    int n;
+    for (n = 0; n < nbByte; n++)
+    {
+        p[n] = (unsigned char)(x & 0xff);
+        x >>= 8;
+    }
+}
+
+local ZPOS64_T unz64local_SizeSeekIndex(const unz64_seek_index* index) {
+    return SIZESEEKINDEXHEADER + (ZPOS64_T)index->number_point * SIZESEEKPOINT;
+}
+
+/*
+  Write the checkpoints in p, as given by unzExportSeekIndex
 */
-extern int ZEXPORT unzGetLocalExtrafield(unzFile file, voidp buf, unsigned len) {
-    unz64_s* s;
-    file_in_zip64_read_info_s* pfile_in_zip_read_info;
-    uInt read_now;
-    ZPOS64_T size_to_read;
+local void unz64local_WriteSeekIndex(const unz64_seek_index* index, unsigned char* p) {
+    uLong i;
+
+    unz64local_putValue(p, SEEKINDEXMAGIC, 4);
+    unz64local_putValue(p + 4, index->offset_curfile, 8);
+    unz64local_putValue(p + 12, index->compressed_size, 8);
+    unz64local_putValue(p + 20, index->uncompressed_size, 8);
+    unz64local_putValue(p + 28, index->crc, 4);
+    unz64local_putValue(p + 32, index->number_point, 4);
+    p += SIZESEEKINDEXHEADER;
+    for (i = 0; i < index->number_point; i++)
+    {
+        unz64local_putValue(p, index->points[i].out, 8);
+        unz64local_putValue(p + 8, index->points[i].in, 8);
+        p[16] = (unsigned char)index->points[i].bits;
+        memcpy(p + 17, index->points[i].window, UNZ_WINDOWSIZE);
+        p += SIZESEEKPOINT;
+    }
+}
 
-    if (file==NULL)
-        return UNZ_PARAMERROR;
-    s=(unz64_s*)file;
-    pfile_in_zip_read_info=s->pfile_in_zip_read;
+/*
+  Set the checkpoints of the current file from those written in buf by
+    unz64local_WriteSeekIndex
+  return UNZ_OK, or UNZ_BADZIPFILE if they are not the ones of this file
+*/
+local int unz64local_ReadSeekIndex(unz64_s* s, const unsigned char* buf, ZPOS64_T size) {
+    file_in_zip64_read_info_s* pfile_in_zip_read_info = s->pfile_in_zip_read;
+    unz64_seek_index* index;
+    unz64_seek_point* points = NULL;
+    const unsigned char* p = buf;
+    uLong number_point, i;
+
+    if ((size < SIZESEEKINDEXHEADER) ||
+        (unz64local_readLong(p) != SEEKINDEXMAGIC) ||
+        (unz64local_readLong64(p + 4) != s->cur_file_info_internal.offset_curfile) ||
+        (unz64local_readLong64(p + 12) != s->cur_file_info.compressed_size) ||
+        (unz64local_readLong64(p + 20) != s->cur_file_info.uncompressed_size) ||
+        (unz64local_readLong(p + 28) != s->cur_file_info.crc))
+        return UNZ_BADZIPFILE;
+    number_point = unz64local_readLong(p + 32);
+    if ((size - SIZESEEKINDEXHEADER) / SIZESEEKPOINT != number_point)
+        return UNZ_BADZIPFILE;
 
-    if (pfile_in_zip_read_info==NULL)
-        return UNZ_PARAMERROR;
+    if (number_point > 0)
+    {
+        points = (unz64_seek_point*)ALLOC(number_point * sizeof(unz64_seek_point));
+        if (points == NULL)
+            return UNZ_INTERNALERROR;
+    }
+    p += SIZESEEKINDEXHEADER;
+    for (i = 0; i < number_point; i++)
+    {
+        points[i].out = unz64local_readLong64(p);
+        points[i].in = unz64local_readLong64(p + 8);
+        points[i].bits = p[16];
+        memcpy(points[i].window, p + 17, UNZ_WINDOWSIZE);
+        p += SIZESEEKPOINT;
+
+        if ((points[i].bits > 7) || (points[i].in > pfile_in_zip_read_info->size_data) ||
+            ((points[i].bits != 0) && (points[i].in == 0)) ||
+            (points[i].out > s->cur_file_info.uncompressed_size) ||
+            ((i > 0) && ((points[i].out <= points[i - 1].out) || (points[i].in < points[i - 1].in))))
+        {
+            free(points);
+            return UNZ_BADZIPFILE;
+        }
+    }
 
-    size_to_read = (pfile_in_zip_read_info->size_local_extrafield -
-                pfile_in_zip_read_info->pos_local_extrafield);
+    index = unz64local_FindSeekIndex(s);
+    if (index == NULL)
+        index = unz64local_NewSeekIndex(s);
+    if (index == NULL)
+    {
+        free(points);
+        return UNZ_INTERNALERROR;
+    }
+    free(index->points);
+    index->points = points;
+    index->number_point = number_point;
+    index->size_points = number_point;
+    index->complete = 1;
+    return UNZ_OK;
+}
 
-    if (buf==NULL)
-        return (int)size_to_read;
+/*
+  Find the checkpoints of the current file, taking them from the index file
+    if they are there, or add an empty list of them
+*/
+local unz64_seek_index* unz64local_GetSeekIndex(unz64_s* s) {
+    unz64_seek_index* index;
+    const unsigned char* p = s->index_seek;
+    ZPOS64_T rest = s->size_index_seek;
 
-    if (len>size_to_read)
-        read_now = (uInt)size_to_read;
+    index = unz64local_FindSeekIndex(s);
+    if (index != NULL)
+        return index;
+
+    while (rest >= 8)
+    {
+        ZPOS64_T size = unz64local_readLong64(p);
+        if (size > rest - 8)
+            break;
+        if ((size >= SIZESEEKINDEXHEADER) &&
+            (unz64local_readLong64(p + 8 + 4) == s->cur_file_info_internal.offset_curfile))
+        {
+            if (unz64local_ReadSeekIndex(s, p + 8, size) == UNZ_OK)
+                return unz64local_FindSeekIndex(s);
+            break;
+        }
+        p += 8 + size;
+        rest -= 8 + size;
+    }
+    return unz64local_NewSeekIndex(s);
+}
+
+/*
+  Add a checkpoint after the last one. window is the circular buffer inflate
+    writes in, the oldest data being at window + have.
+*/
+local int unz64local_AddSeekPoint(unz64_seek_index* index, ZPOS64_T out, ZPOS64_T in,
+                                  int bits, const unsigned char* window, uInt have) {
+    unz64_seek_point* point;
+
+    if (index->number_point == index->size_points)
+    {
+        uLong size_points = (index->size_points == 0) ? 8 : 2 * index->size_points;
+        point = (unz64_seek_point*)realloc(index->points, size_points * sizeof(unz64_seek_point));
+        if (point == NULL)
+            return UNZ_INTERNALERROR;
+        index->points = point;
+        index->size_points = size_points;
+    }
+
+    point = &index->points[index->number_point++];
+    point->out = out;
+    point->in = in;
+    point->bits = bits;
+    memcpy(point->window, window + have, UNZ_WINDOWSIZE - have);
+    memcpy(point->window + UNZ_WINDOWSIZE - have, window, have);
+    return UNZ_OK;
+}
+
+/*
+  Move the current file (deflated, not encrypted) to position, by starting
+    inflate again at the last checkpoint before it. The checkpoints after the
+    last one are recorded on the way.
+*/
+local int unz64local_SeekDeflated(unz64_s* s, ZPOS64_T position) {
+    file_in_zip64_read_info_s* pfile_in_zip_read_info = s->pfile_in_zip_read;
+    unz64_seek_index* index;
+    const unz64_seek_point* point = NULL;
+    unsigned char* window;
+    uInt have = 0;
+    ZPOS64_T out = 0, in = 0;
+    uLong lo, hi;
+    int err;
+
+    index = unz64local_GetSeekIndex(s);
+    if (index == NULL)
+        return UNZ_INTERNALERROR;
+    window = (unsigned char*)ALLOC(UNZ_WINDOWSIZE);
+    if (window == NULL)
+        return UNZ_INTERNALERROR;
+
+    /* last checkpoint at or before position */
+    lo = 0;
+    hi = index->number_point;
+    while (lo < hi)
+    {
+        uLong mid = lo + (hi - lo) / 2;
+        if (index->points[mid].out <= position)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo > 0)
+        point = &index->points[lo - 1];
+
+    err = inflateReset(&pfile_in_zip_read_info->stream);
+    pfile_in_zip_read_info->stream.avail_in = 0;
+    if ((err == Z_OK) && (point != NULL))
+    {
+        out = point->out;
+        in = point->in;
+        if (point->bits)
+        {
+            unsigned char c;
+            if (ZREADAT64(pfile_in_zip_read_info->z_filefunc, pfile_in_zip_read_info->filestream,
+                          pfile_in_zip_read_info->pos_data + in - 1 +
+                             pfile_in_zip_read_info->byte_before_the_zipfile,
+                          &c, 1) != 1)
+                err = UNZ_ERRNO;
+            else
+                err = inflatePrime(&pfile_in_zip_read_info->stream, point->bits,
+                                   c >> (8 - point->bits));
+        }
+        memcpy(window, point->window, UNZ_WINDOWSIZE);
+        if (err == Z_OK)
+            err = inflateSetDictionary(&pfile_in_zip_read_info->stream, window, UNZ_WINDOWSIZE);
+    }
     else
-        read_now = (uInt)len ;
+        memset(window, 0, UNZ_WINDOWSIZE);
+    pfile_in_zip_read_info->pos_in_zipfile = pfile_in_zip_read_info->pos_data + in;
+    pfile_in_zip_read_info->rest_read_compressed = pfile_in_zip_read_info->size_data - in;
 
-    if (read_now==0)
-        return 0;
+    /* inflate up to position in window, stopping at the end of each block to
+       see if a checkpoint is due */
+    while ((err == Z_OK) && (out < position))
+    {
+        uInt before;
 
-    if (ZSEEK64(pfile_in_zip_read_info->z_filefunc,
-              pfile_in_zip_read_info->filestream,
-              pfile_in_zip_read_info->offset_local_extrafield +
-              pfile_in_zip_read_info->pos_local_extrafield,
-              ZLIB_FILEFUNC_SEEK_SET)!=0)
-        return UNZ_ERRNO;
+        if (pfile_in_zip_read_info->stream.avail_in == 0)
+        {
+            if (pfile_in_zip_read_info->rest_read_compressed == 0)
+            {
+                err = Z_DATA_ERROR;
+                break;
+            }
+            err = unz64local_ReadCompressed(s, pfile_in_zip_read_info);
+            if (err != UNZ_OK)
+                break;
+        }
 
-    if (ZREAD64(pfile_in_zip_read_info->z_filefunc,
-              pfile_in_zip_read_info->filestream,
-              buf,read_now)!=read_now)
-        return UNZ_ERRNO;
+        if (have == UNZ_WINDOWSIZE)
+            have = 0;
+        pfile_in_zip_read_info->stream.next_out = window + have;
+        pfile_in_zip_read_info->stream.avail_out = UNZ_WINDOWSIZE - have;
+        if (pfile_in_zip_read_info->stream.avail_out > position - out)
+            pfile_in_zip_read_info->stream.avail_out = (uInt)(position - out);
+        before = pfile_in_zip_read_info->stream.avail_out;
+
+        err = inflate(&pfile_in_zip_read_info->stream, Z_BLOCK);
+
+        have += before - pfile_in_zip_read_info->stream.avail_out;
+        out += before - pfile_in_zip_read_info->stream.avail_out;
+        if ((err == Z_BUF_ERROR) || ((err == Z_STREAM_END) && (out == position)))
+            err = Z_OK;
+        else if ((err == Z_NEED_DICT) || (err == Z_STREAM_END))
+            err = Z_DATA_ERROR;
+
+        /* the end of a block which is not the last one */
+        if ((err == Z_OK) && ((pfile_in_zip_read_info->stream.data_type & 192) == 128) &&
+            (out >= ((index->number_point == 0) ? 0 : index->points[index->number_point - 1].out) +
+                    UNZ_SEEKSPAN))
+        {
+            in = pfile_in_zip_read_info->pos_in_zipfile - pfile_in_zip_read_info->pos_data -
+                 pfile_in_zip_read_info->stream.avail_in;
+            err = unz64local_AddSeekPoint(index, out, in,
+                                          pfile_in_zip_read_info->stream.data_type & 7,
+                                          window, have);
+        }
+    }
+    free(window);
+    if (err != Z_OK)
+        return err;
 
-    return (int)read_now;
+    /* all the file after point was gone through */
+    if (position == s->cur_file_info.uncompressed_size)
+        index->complete = 1;
+
+    pfile_in_zip_read_info->total_out_64 = position;
+    pfile_in_zip_read_info->stream.total_out = (uLong)position;
+    pfile_in_zip_read_info->rest_read_uncompressed = s->cur_file_info.uncompressed_size - position;
+    /* from the start, inflate is as after unzOpenCurrentFile */
+    pfile_in_zip_read_info->crc32 = 0;
+    pfile_in_zip_read_info->crc_unknown = (position != 0);
+    return UNZ_OK;
 }
 
 /*
-  Close the file in zip opened with unzOpenCurrentFile
-  Return UNZ_CRCERROR if all the file was read but the CRC is not good
+  Read and drop len bytes of the current file
 */
-extern int ZEXPORT unzCloseCurrentFile(unzFile file) {
-    int err=UNZ_OK;
+local int unz64local_SkipCurrentFile(unzFile file, ZPOS64_T len) {
+    char* buf;
+    int err = UNZ_OK;
+
+    buf = (char*)ALLOC(UNZ_BUFSIZE);
+    if (buf == NULL)
+        return UNZ_INTERNALERROR;
+    while (len > 0)
+    {
+        uInt uReadThis = UNZ_BUFSIZE;
+        if (len < uReadThis)
+            uReadThis = (uInt)len;
+        err = unzReadCurrentFile(file, buf, uReadThis);
+        if (err < 0)
+            break;
+        if (err == 0)
+        {
+            err = UNZ_BADZIPFILE;
+            break;
+        }
+        len -= (uInt)err;
+        err = UNZ_OK;
+    }
+    free(buf);
+    return err;
+}
 
+/*
+  Set the position in the uncompressed data of the current file
+*/
+extern int ZEXPORT unzSeek64(unzFile file, ZPOS64_T offset, int origin) {
     unz64_s* s;
     file_in_zip64_read_info_s* pfile_in_zip_read_info;
+    ZPOS64_T size, position;
     if (file==NULL)
         return UNZ_PARAMERROR;
     s=(unz64_s*)file;
@@ -1880,106 +3190,1588 @@ extern int ZEXPORT unzCloseCurrentFile(unzFile file) {
     if (pfile_in_zip_read_info==NULL)
         return UNZ_PARAMERROR;
 
+    /* when opened raw, the file is its compressed data */
+    if (pfile_in_zip_read_info->raw)
+        size = pfile_in_zip_read_info->size_data;
+    else
+        size = s->cur_file_info.uncompressed_size;
 
-    if ((pfile_in_zip_read_info->rest_read_uncompressed == 0) &&
-        (!pfile_in_zip_read_info->raw))
+    switch (origin)
     {
-        if (pfile_in_zip_read_info->crc32 != pfile_in_zip_read_info->crc32_wait)
-            err=UNZ_CRCERROR;
+        case ZLIB_FILEFUNC_SEEK_SET :
+            position = offset;
+            break;
+        case ZLIB_FILEFUNC_SEEK_CUR :
+            position = pfile_in_zip_read_info->total_out_64 + offset;
+            break;
+        case ZLIB_FILEFUNC_SEEK_END :
+            position = size + offset;
+            break;
+        default: return UNZ_PARAMERROR;
     }
+    if (position > size)
+        return UNZ_PARAMERROR;
+    if (position == pfile_in_zip_read_info->total_out_64)
+        return UNZ_OK;
 
+    if (s->encrypted || pfile_in_zip_read_info->aes)
+    {
+        /* the data can only be decrypted in order */
+        if (position < pfile_in_zip_read_info->total_out_64)
+            return UNZ_PARAMERROR;
+        return unz64local_SkipCurrentFile(file, position - pfile_in_zip_read_info->total_out_64);
+    }
 
-    free(pfile_in_zip_read_info->read_buffer);
-    pfile_in_zip_read_info->read_buffer = NULL;
-    if (pfile_in_zip_read_info->stream_initialised == Z_DEFLATED)
-        inflateEnd(&pfile_in_zip_read_info->stream);
-#ifdef HAVE_BZIP2
-    else if (pfile_in_zip_read_info->stream_initialised == Z_BZIP2ED)
-        BZ2_bzDecompressEnd(&pfile_in_zip_read_info->bstream);
-#endif
-
-
-    pfile_in_zip_read_info->stream_initialised = 0;
-    free(pfile_in_zip_read_info);
+    if ((pfile_in_zip_read_info->compression_method==0) || (pfile_in_zip_read_info->raw))
+    {
+        pfile_in_zip_read_info->pos_in_zipfile = pfile_in_zip_read_info->pos_data + position;
+        pfile_in_zip_read_info->rest_read_compressed = 0;
+        if (position < pfile_in_zip_read_info->size_data)
+            pfile_in_zip_read_info->rest_read_compressed = pfile_in_zip_read_info->size_data - position;
+        pfile_in_zip_read_info->rest_read_uncompressed = s->cur_file_info.uncompressed_size - position;
+        pfile_in_zip_read_info->stream.avail_in = 0;
+        pfile_in_zip_read_info->total_out_64 = position;
+        pfile_in_zip_read_info->stream.total_out = (uLong)position;
+        pfile_in_zip_read_info->crc32 = 0;
+        pfile_in_zip_read_info->crc_unknown = (position != 0);
+        return UNZ_OK;
+    }
 
-    s->pfile_in_zip_read=NULL;
+    /* close ahead, inflating from here is faster than from a checkpoint,
+       and keeps the crc */
+    if ((position > pfile_in_zip_read_info->total_out_64) &&
+        ((position - pfile_in_zip_read_info->total_out_64 < UNZ_SEEKSPAN) ||
+         (pfile_in_zip_read_info->compression_method!=Z_DEFLATED)))
+        return unz64local_SkipCurrentFile(file, position - pfile_in_zip_read_info->total_out_64);
 
-    return err;
+    if (pfile_in_zip_read_info->compression_method!=Z_DEFLATED)
+        return UNZ_PARAMERROR;
+    return unz64local_SeekDeflated(s, position);
 }
 
 
 /*
-  Get the global comment string of the ZipFile, in the szComment buffer.
-  uSizeBuf is the size of the szComment buffer.
-  return the number of byte copied or an error code <0
+  Give the checkpoints of the current file, to save them
 */
-extern int ZEXPORT unzGetGlobalComment(unzFile file, char * szComment, uLong uSizeBuf) {
+extern int ZEXPORT unzExportSeekIndex(unzFile file, voidp buf, ZPOS64_T* size) {
     unz64_s* s;
-    uLong uReadThis ;
-    if (file==NULL)
-        return (int)UNZ_PARAMERROR;
+    file_in_zip64_read_info_s* pfile_in_zip_read_info;
+    unz64_seek_index* index;
+    if ((file==NULL) || (size==NULL))
+        return UNZ_PARAMERROR;
     s=(unz64_s*)file;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
 
-    uReadThis = uSizeBuf;
-    if (uReadThis>s->gi.size_comment)
-        uReadThis = s->gi.size_comment;
+    if ((pfile_in_zip_read_info==NULL) ||
+        (pfile_in_zip_read_info->compression_method!=Z_DEFLATED) ||
+        (pfile_in_zip_read_info->raw) || (s->encrypted) || (pfile_in_zip_read_info->aes))
+        return UNZ_PARAMERROR;
+
+    index = unz64local_GetSeekIndex(s);
+    if (index == NULL)
+        return UNZ_INTERNALERROR;
+
+    /* make the checkpoints up to the end, then go back where we were */
+    if (!index->complete)
+    {
+        ZPOS64_T position = pfile_in_zip_read_info->total_out_64;
+        int crc_unknown = pfile_in_zip_read_info->crc_unknown;
+        int err = unz64local_SeekDeflated(s, s->cur_file_info.uncompressed_size);
+        if (err == UNZ_OK)
+            err = unz64local_SeekDeflated(s, position);
+        if (err != UNZ_OK)
+            return err;
+        pfile_in_zip_read_info->crc_unknown |= crc_unknown;
+    }
+
+    if ((buf != NULL) && (*size < unz64local_SizeSeekIndex(index)))
+        return UNZ_PARAMERROR;
+    if (buf != NULL)
+        unz64local_WriteSeekIndex(index, (unsigned char*)buf);
+    *size = unz64local_SizeSeekIndex(index);
+    return UNZ_OK;
+}
+
+/*
+  Give back to the current file the checkpoints given by unzExportSeekIndex
+*/
+extern int ZEXPORT unzImportSeekIndex(unzFile file, const void* buf, ZPOS64_T size) {
+    unz64_s* s;
+    file_in_zip64_read_info_s* pfile_in_zip_read_info;
+    if ((file==NULL) || (buf==NULL))
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
+
+    if ((pfile_in_zip_read_info==NULL) ||
+        (pfile_in_zip_read_info->compression_method!=Z_DEFLATED) ||
+        (pfile_in_zip_read_info->raw) || (s->encrypted) || (pfile_in_zip_read_info->aes))
+        return UNZ_PARAMERROR;
+
+    return unz64local_ReadSeekIndex(s, (const unsigned char*)buf, size);
+}
+
+
+
+/*
+  Index file of the zipfile, see unzOpen4_64
+*/
+#define INDEXFILEMAGIC (0x58444955)  /* "UIDX" */
+#define SIZEENDMAX (0x20000) /* the end of central dir records and the comment */
+
+/*
+  Give what identify the zipfile in its index file: its size, its modification
+    time, and the crc of its end from central_pos
+*/
+local int unz64local_GetIndexFileKey(const unz64_s* s, ZPOS64_T central_pos, ZPOS64_T* psize,
+                                     ZPOS64_T* pmtime, ZPOS64_T* pcrc) {
+    unsigned char* buf;
+    uLong size_end;
 
-    if (ZSEEK64(s->z_filefunc,s->filestream,s->central_pos+22,ZLIB_FILEFUNC_SEEK_SET)!=0)
+    if (ZSEEK64(s->z_filefunc, s->filestream, 0, ZLIB_FILEFUNC_SEEK_END) != 0)
         return UNZ_ERRNO;
+    *psize = ZTELL64(s->z_filefunc, s->filestream);
+    if ((central_pos > *psize) || (*psize - central_pos > SIZEENDMAX))
+        return UNZ_BADZIPFILE;
+    size_end = (uLong)(*psize - central_pos);
 
-    if (uReadThis>0)
+    buf = (unsigned char*)ALLOC(size_end + 1);
+    if (buf == NULL)
+        return UNZ_INTERNALERROR;
+    if (ZREADAT64(s->z_filefunc, s->filestream, central_pos, buf, size_end) != size_end)
     {
-      *szComment='\0';
-      if (ZREAD64(s->z_filefunc,s->filestream,szComment,uReadThis)!=uReadThis)
+        free(buf);
         return UNZ_ERRNO;
     }
+    *pcrc = zcrc32(0, buf, size_end);
+    free(buf);
+    *pmtime = ZMTIME64(s->z_filefunc, s->filestream);
+    return UNZ_OK;
+}
 
-    if ((szComment != NULL) && (uSizeBuf > s->gi.size_comment))
-        *(szComment+s->gi.size_comment)='\0';
-    return (int)uReadThis;
+/*
+  Read or write size bytes at offset of stream, by pieces that fit in uLong
+*/
+local int unz64local_ReadAll(const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream,
+                             ZPOS64_T offset, unsigned char* buf, ZPOS64_T size) {
+    while (size > 0)
+    {
+        uLong uReadThis = 0x40000000;
+        if (size < uReadThis)
+            uReadThis = (uLong)size;
+        if (ZREADAT64(*pzlib_filefunc_def, filestream, offset, buf, uReadThis) != uReadThis)
+            return UNZ_ERRNO;
+        offset += uReadThis;
+        buf += uReadThis;
+        size -= uReadThis;
+    }
+    return UNZ_OK;
 }
 
-/* Additions by RX '2004 */
-extern ZPOS64_T ZEXPORT unzGetOffset64(unzFile file) {
+local int unz64local_WriteAll(const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream,
+                              const void* buf, ZPOS64_T size) {
+    const unsigned char* p = (const unsigned char*)buf;
+    while (size > 0)
+    {
+        uLong uWriteThis = 0x40000000;
+        if (size < uWriteThis)
+            uWriteThis = (uLong)size;
+        if (ZWRITE64(*pzlib_filefunc_def, filestream, p, uWriteThis) != uWriteThis)
+            return UNZ_ERRNO;
+        p += uWriteThis;
+        size -= uWriteThis;
+    }
+    return UNZ_OK;
+}
+
+/*
+  Set the central directory of s and its index from the index file, if it was
+    made for this zipfile. The index file is read in memory and closed at
+    once: it is never used in place, since another handle can write it again
+    while s is opened.
+*/
+local int unz64local_LoadIndexFile(unz64_s* s, const void* index_path) {
+    unz64_index_file_header header;
+    unz64_cd_index* index = NULL;
+    voidpf stream;
+    unsigned char* base = NULL;
+    ZPOS64_T size_zipfile = 0, mtime_zipfile = 0, crc_end = 0, size_index_file = 0;
+    ZPOS64_T offset_hash_table, offset_names;
+    int err;
+
+    stream = ZOPEN64(s->z_filefunc, index_path,
+                     ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_EXISTING);
+    if (stream == NULL)
+        return UNZ_ERRNO;
+
+    err = UNZ_OK;
+    if (ZSEEK64(s->z_filefunc, stream, 0, ZLIB_FILEFUNC_SEEK_END) == 0)
+        size_index_file = ZTELL64(s->z_filefunc, stream);
+    if ((size_index_file < sizeof(header)) || (size_index_file == (ZPOS64_T)-1) ||
+        (ZREADAT64(s->z_filefunc, stream, 0, &header, sizeof(header)) != sizeof(header)))
+        err = UNZ_ERRNO;
+    else if ((header.magic != INDEXFILEMAGIC) || (header.size_entry != sizeof(unz64_cd_entry)) ||
+             (header.size_index_file != size_index_file))
+        err = UNZ_BADZIPFILE;
+    else
+        err = unz64local_GetIndexFileKey(s, header.central_pos, &size_zipfile, &mtime_zipfile, &crc_end);
+    if ((err == UNZ_OK) &&
+        ((header.size_zipfile != size_zipfile) || (header.mtime_zipfile != mtime_zipfile) ||
+         (header.crc_end != crc_end)))
+        err = UNZ_BADZIPFILE;
+
+    /* the parts of the index file must be in it */
+    offset_hash_table = sizeof(header) + header.number_index_entry * sizeof(unz64_cd_entry);
+    offset_names = offset_hash_table + (header.hash_mask + 1) * sizeof(unsigned int);
+    if ((err == UNZ_OK) &&
+        ((header.number_index_entry >= 0xffffffff) || (header.hash_mask >= 0xffffffff) ||
+         ((header.hash_mask & (header.hash_mask + 1)) != 0) ||
+         (header.hash_mask < header.number_index_entry) ||
+         (header.size_names > header.size_index_file) ||
+         (offset_names + header.size_names > header.offset_seek) ||
+         (header.offset_seek > header.size_index_file) ||
+         ((size_t)header.size_index_file != header.size_index_file)))
+        err = UNZ_BADZIPFILE;
+
+    if (err == UNZ_OK)
+    {
+        base = (unsigned char*)ALLOC((size_t)header.size_index_file);
+        if (base == NULL)
+            err = UNZ_INTERNALERROR;
+        else
+            err = unz64local_ReadAll(&s->z_filefunc, stream, 0, base, header.size_index_file);
+    }
+    ZCLOSE64(s->z_filefunc, stream);
+    /* the file may have been written again since its header was read */
+    if ((err == UNZ_OK) && (memcmp(base, &header, sizeof(header)) != 0))
+        err = UNZ_BADZIPFILE;
+    if ((err == UNZ_OK) && (header.size_names > 0) && (base[offset_names + header.size_names - 1] != '\0'))
+        err = UNZ_BADZIPFILE;
+
+    /* a damaged index file must not make the lookups read out of it */
+    if (err == UNZ_OK)
+    {
+        const unz64_cd_entry* entries = (const unz64_cd_entry*)(base + sizeof(header));
+        const unsigned int* hash_table = (const unsigned int*)(base + offset_hash_table);
+        ZPOS64_T i, number_used = 0;
+
+        for (i = 0; (err == UNZ_OK) && (i < header.number_index_entry); i++)
+            if ((entries[i].name_offset >= header.size_names) ||
+                (header.size_names - entries[i].name_offset <= entries[i].size_filename))
+                err = UNZ_BADZIPFILE;
+        for (i = 0; (err == UNZ_OK) && (i <= header.hash_mask); i++)
+            if (hash_table[i] != 0)
+            {
+                if ((hash_table[i] > header.number_index_entry) ||
+                    (++number_used > header.number_index_entry))
+                    err = UNZ_BADZIPFILE;
+            }
+    }
+
+    if (err == UNZ_OK)
+    {
+        index = (unz64_cd_index*)ALLOC(sizeof(unz64_cd_index));
+        if (index == NULL)
+            err = UNZ_INTERNALERROR;
+    }
+    if (err != UNZ_OK)
+    {
+        free(base);
+        return err;
+    }
+
+    index->entries = (unz64_cd_entry*)(base + sizeof(header));
+    index->number_entry = header.number_index_entry;
+    index->hash_table = (unsigned int*)(base + offset_hash_table);
+    index->hash_mask = header.hash_mask;
+    index->names = (char*)(base + offset_names);
+    index->size_names = header.size_names;
+    index->in_index_file = 1;
+
+    s->index_alloc = base;
+    s->index_seek = base + header.offset_seek;
+    s->size_index_seek = header.size_index_file - header.offset_seek;
+    s->cd_index = index;
+
+    s->central_pos = header.central_pos;
+    s->size_central_dir = header.size_central_dir;
+    s->offset_central_dir = header.offset_central_dir;
+    s->gi.number_entry = header.number_entry;
+    s->gi.size_comment = (uLong)header.size_comment;
+    s->isZip64 = (int)header.isZip64;
+    return UNZ_OK;
+}
+
+/*
+  Find the complete checkpoints recorded for the file at offset_curfile
+*/
+local const unz64_seek_index* unz64local_FindCompleteSeekIndex(const unz64_s* s, ZPOS64_T offset_curfile) {
+    const unz64_seek_index* index;
+
+    for (index = s->seek_index; index != NULL; index = index->next)
+        if ((index->offset_curfile == offset_curfile) && (index->complete))
+            return index;
+    return NULL;
+}
+
+/*
+  Write the index file of s: its central directory index, the checkpoints it
+    made up to the end of files, and those of the previous index file
+*/
+local int unz64local_WriteIndexFile(unz64_s* s, const void* index_path) {
+    static const unsigned char zero[8] = { 0 };
+    zlib_filefunc64_32_def z_filefunc = s->z_filefunc;
+    unz64_index_file_header header;
+    const unz64_cd_index* index = s->cd_index;
+    const unz64_seek_index* seek_index;
+    const unsigned char* p;
+    ZPOS64_T rest, size_seek = 0;
+    voidpf stream;
+    int err;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = INDEXFILEMAGIC;
+    header.size_entry = sizeof(unz64_cd_entry);
+    err = unz64local_GetIndexFileKey(s, s->central_pos, &header.size_zipfile,
+                                     &header.mtime_zipfile, &header.crc_end);
+    if (err != UNZ_OK)
+        return err;
+    header.central_pos = s->central_pos;
+    header.size_central_dir = s->size_central_dir;
+    header.offset_central_dir = s->offset_central_dir;
+    header.number_entry = s->gi.number_entry;
+    header.size_comment = s->gi.size_comment;
+    header.isZip64 = (ZPOS64_T)s->isZip64;
+    header.number_index_entry = index->number_entry;
+    header.hash_mask = index->hash_mask;
+    header.size_names = index->size_names;
+    header.offset_seek = sizeof(header) + index->number_entry * sizeof(unz64_cd_entry) +
+                         (index->hash_mask + 1) * sizeof(unsigned int) + index->size_names;
+    header.offset_seek = (header.offset_seek + 7) & ~(ZPOS64_T)7;
+
+    for (seek_index = s->seek_index; seek_index != NULL; seek_index = seek_index->next)
+        if (seek_index->complete)
+            size_seek += 8 + unz64local_SizeSeekIndex(seek_index);
+    for (p = s->index_seek, rest = s->size_index_seek; rest >= 8; )
+    {
+        ZPOS64_T size = unz64local_readLong64(p);
+        if ((size > rest - 8) || (size < SIZESEEKINDEXHEADER))
+            break;
+        if (unz64local_FindCompleteSeekIndex(s, unz64local_readLong64(p + 8 + 4)) == NULL)
+            size_seek += 8 + size;
+        p += 8 + size;
+        rest -= 8 + size;
+    }
+    header.size_index_file = header.offset_seek + size_seek;
+
+    stream = ZOPEN64(z_filefunc, index_path, ZLIB_FILEFUNC_MODE_WRITE | ZLIB_FILEFUNC_MODE_CREATE);
+    if (stream == NULL)
+    {
+        /* the io functions of the zipfile may be read only */
+        fill_fopen64_filefunc(&z_filefunc.zfile_func64);
+        z_filefunc.ztell32_file = NULL;
+        z_filefunc.zseek32_file = NULL;
+        stream = ZOPEN64(z_filefunc, index_path, ZLIB_FILEFUNC_MODE_WRITE | ZLIB_FILEFUNC_MODE_CREATE);
+        if (stream == NULL)
+            return UNZ_ERRNO;
+    }
+
+    err = unz64local_WriteAll(&z_filefunc, stream, &header, sizeof(header));
+    if (err == UNZ_OK)
+        err = unz64local_WriteAll(&z_filefunc, stream, index->entries,
+                                  index->number_entry * sizeof(unz64_cd_entry));
+    if (err == UNZ_OK)
+        err = unz64local_WriteAll(&z_filefunc, stream, index->hash_table,
+                                  (index->hash_mask + 1) * sizeof(unsigned int));
+    if (err == UNZ_OK)
+        err = unz64local_WriteAll(&z_filefunc, stream, index->names, index->size_names);
+    if (err == UNZ_OK)
+        err = unz64local_WriteAll(&z_filefunc, stream, zero,
+                                  header.offset_seek - sizeof(header) -
+                                  index->number_entry * sizeof(unz64_cd_entry) -
+                                  (index->hash_mask + 1) * sizeof(unsigned int) - index->size_names);
+
+    for (seek_index = s->seek_index; (err == UNZ_OK) && (seek_index != NULL); seek_index = seek_index->next)
+    {
+        unsigned char* buf;
+        ZPOS64_T size;
+        if (!seek_index->complete)
+            continue;
+        size = unz64local_SizeSeekIndex(seek_index);
+        buf = (unsigned char*)ALLOC((size_t)size + 8);
+        if (buf == NULL)
+        {
+            err = UNZ_INTERNALERROR;
+            break;
+        }
+        unz64local_putValue(buf, size, 8);
+        unz64local_WriteSeekIndex(seek_index, buf + 8);
+        err = unz64local_WriteAll(&z_filefunc, stream, buf, size + 8);
+        free(buf);
+    }
+    for (p = s->index_seek, rest = s->size_index_seek; (err == UNZ_OK) && (rest >= 8); )
+    {
+        ZPOS64_T size = unz64local_readLong64(p);
+        if ((size > rest - 8) || (size < SIZESEEKINDEXHEADER))
+            break;
+        if (unz64local_FindCompleteSeekIndex(s, unz64local_readLong64(p + 8 + 4)) == NULL)
+            err = unz64local_WriteAll(&z_filefunc, stream, p, size + 8);
+        p += 8 + size;
+        rest -= 8 + size;
+    }
+
+    if (ZCLOSE64(z_filefunc, stream) != 0)
+        err = UNZ_ERRNO;
+    return err;
+}
+
+/*
+  Write the index file of the zipfile, with the checkpoints of the files
+*/
+extern int ZEXPORT unzWriteIndexFile(unzFile file, const void* index_path) {
+    unz64_s* s;
+    if ((file==NULL) || (index_path==NULL))
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    if (s->cd_index==NULL)
+        return UNZ_PARAMERROR;
+    return unz64local_WriteIndexFile(s, index_path);
+}
+
+
+
+/*
+Read extra field from the current file (opened by unzOpenCurrentFile)
+This is the local-header version of the extra field (sometimes, there is
+more info in the local-header version than in the central-header)
+
+  if buf==NULL, it return the size of the local extra field that can be read
+
+  if buf!=NULL, len is the size of the buffer, the extra header is copied in
+    buf.
+  the return value is the number of bytes copied in buf, or (if <0)
+    the error code
+*/
+extern int ZEXPORT unzGetLocalExtrafield(unzFile file, voidp buf, unsigned len) {
     unz64_s* s;
+    file_in_zip64_read_info_s* pfile_in_zip_read_info;
+    uInt read_now;
+    ZPOS64_T size_to_read;
 
     if (file==NULL)
-          return 0; //UNZ_PARAMERROR;
+        return UNZ_PARAMERROR;
     s=(unz64_s*)file;
-    if (!s->current_file_ok)
-      return 0;
-    if (s->gi.number_entry != 0 && s->gi.number_entry != 0xffff)
-      if (s->num_file==s->gi.number_entry)
-         return 0;
-    return s->pos_in_central_dir;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
+
+    if (pfile_in_zip_read_info==NULL)
+        return UNZ_PARAMERROR;
+
+    size_to_read = (pfile_in_zip_read_info->size_local_extrafield -
+                pfile_in_zip_read_info->pos_local_extrafield);
+
+    if (buf==NULL)
+        return (int)size_to_read;
+
+    if (len>size_to_read)
+        read_now = (uInt)size_to_read;
+    else
+        read_now = (uInt)len ;
+
+    if (read_now==0)
+        return 0;
+
+    if (ZREADAT64(pfile_in_zip_read_info->z_filefunc,
+                  pfile_in_zip_read_info->filestream,
+                  pfile_in_zip_read_info->offset_local_extrafield +
+                  pfile_in_zip_read_info->pos_local_extrafield,
+                  buf,read_now)!=read_now)
+        return UNZ_ERRNO;
+
+    return (int)read_now;
 }
 
-extern uLong ZEXPORT unzGetOffset(unzFile file) {
-    ZPOS64_T offset64;
+/*
+  Give the io functions, the stream, and the place of the data of the
+    current file opened in raw mode, to copy it without reading it here
+*/
+extern int ZEXPORT unzGetCurrentFileRawStream(unzFile file, zlib_filefunc64_32_def* pzlib_filefunc_def,
+                                              voidpf* pstream, ZPOS64_T* ppos, ZPOS64_T* psize) {
+    unz64_s* s;
+    file_in_zip64_read_info_s* pfile_in_zip_read_info;
 
     if (file==NULL)
-          return 0; //UNZ_PARAMERROR;
-    offset64 = unzGetOffset64(file);
-    return (uLong)offset64;
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
+
+    if ((pfile_in_zip_read_info==NULL) || (!pfile_in_zip_read_info->raw))
+        return UNZ_PARAMERROR;
+
+    if (pzlib_filefunc_def!=NULL)
+        *pzlib_filefunc_def = pfile_in_zip_read_info->z_filefunc;
+    if (pstream!=NULL)
+        *pstream = pfile_in_zip_read_info->filestream;
+    if (ppos!=NULL)
+        *ppos = pfile_in_zip_read_info->pos_data + pfile_in_zip_read_info->byte_before_the_zipfile;
+    if (psize!=NULL)
+        *psize = pfile_in_zip_read_info->size_data;
+    return UNZ_OK;
 }
 
-extern int ZEXPORT unzSetOffset64(unzFile file, ZPOS64_T pos) {
-    unz64_s* s;
-    int err;
+/*
+  Close the file in zip opened with unzOpenCurrentFile
+  Return UNZ_CRCERROR if all the file was read but the CRC is not good
+*/
+extern int ZEXPORT unzCloseCurrentFile(unzFile file) {
+    int err=UNZ_OK;
 
+    unz64_s* s;
+    file_in_zip64_read_info_s* pfile_in_zip_read_info;
     if (file==NULL)
         return UNZ_PARAMERROR;
     s=(unz64_s*)file;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
+
+    if (pfile_in_zip_read_info==NULL)
+        return UNZ_PARAMERROR;
+
+
+    if ((pfile_in_zip_read_info->rest_read_uncompressed == 0) &&
+        (!pfile_in_zip_read_info->raw) && (!pfile_in_zip_read_info->crc_unknown))
+    {
+        if (pfile_in_zip_read_info->crc32 != pfile_in_zip_read_info->crc32_wait)
+            err=UNZ_CRCERROR;
+#ifndef NOAES
+        /* AE-2 files have no crc, the authentication code checks them */
+        if (pfile_in_zip_read_info->aes == ZAES_VERSION_AE2)
+            err=UNZ_OK;
+#endif
+    }
+
+#ifndef NOAES
+    if ((pfile_in_zip_read_info->aes) && (pfile_in_zip_read_info->rest_read_compressed == 0) &&
+        (err==UNZ_OK))
+    {
+        unsigned char authcode[ZAES_AUTHCODE_LEN];
+        unsigned char expected[ZAES_AUTHCODE_LEN];
+        zaes_authcode(&pfile_in_zip_read_info->aes_ctx, expected);
+        if (ZREADAT64(pfile_in_zip_read_info->z_filefunc, pfile_in_zip_read_info->filestream,
+                      pfile_in_zip_read_info->pos_in_zipfile +
+                         pfile_in_zip_read_info->byte_before_the_zipfile,
+                      authcode, ZAES_AUTHCODE_LEN) != ZAES_AUTHCODE_LEN)
+            err=UNZ_ERRNO;
+        else if (memcmp(authcode, expected, ZAES_AUTHCODE_LEN) != 0)
+            err=UNZ_CRCERROR;
+    }
+#endif
+
+
+#ifdef HAVE_BZIP2
+    if (pfile_in_zip_read_info->stream_initialised == Z_BZIP2ED)
+    {
+        BZ2_bzDecompressEnd(&pfile_in_zip_read_info->bstream);
+        pfile_in_zip_read_info->stream_initialised = 0;
+    }
+#endif
+
+    /* keep the structure, buffer and inflate state for the next file */
+    if (s->pfile_in_zip_read_free == NULL)
+        s->pfile_in_zip_read_free = pfile_in_zip_read_info;
+    else
+        unz64local_FreeReadInfo(pfile_in_zip_read_info);
+
+    s->pfile_in_zip_read=NULL;
 
-    s->pos_in_central_dir = pos;
-    s->num_file = s->gi.number_entry;      /* hack */
-    err = unz64local_GetCurrentFileInfoInternal(file,&s->cur_file_info,
-                                              &s->cur_file_info_internal,
-                                              NULL,0,NULL,0,NULL,0);
-    s->current_file_ok = (err == UNZ_OK);
     return err;
 }
 
-extern int ZEXPORT unzSetOffset (unzFile file, uLong pos) {
-    return unzSetOffset64(file,pos);
+/*
+  Free the structure of a file in zip, with its buffer and decompression state
+*/
+local void unz64local_FreeReadInfo(file_in_zip64_read_info_s* pfile_in_zip_read_info) {
+    if (pfile_in_zip_read_info == NULL)
+        return;
+    free(pfile_in_zip_read_info->read_buffer);
+    if (pfile_in_zip_read_info->stream_initialised == Z_DEFLATED)
+        inflateEnd(&pfile_in_zip_read_info->stream);
+#ifdef HAVE_BZIP2
+    else if (pfile_in_zip_read_info->stream_initialised == Z_BZIP2ED)
+        BZ2_bzDecompressEnd(&pfile_in_zip_read_info->bstream);
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_freeDCtx(pfile_in_zip_read_info->zstream);
+#endif
+#ifdef HAVE_LZMA
+    lzma_end(&pfile_in_zip_read_info->lstream);
+#endif
+#ifdef HAVE_LIBDEFLATE
+    if (pfile_in_zip_read_info->ldecompressor != NULL)
+        libdeflate_free_decompressor(pfile_in_zip_read_info->ldecompressor);
+#endif
+    free(pfile_in_zip_read_info);
+}
+
+
+/*
+  Give direct access to the data of the current file, if it is stored
+    (not compressed), not encrypted and the io functions can map the zipfile.
+  The CRC is not checked, use unzCheckCurrentFileView for that.
+*/
+extern int ZEXPORT unzGetCurrentFileView(unzFile file, const void** pbuf, ZPOS64_T* plen) {
+    unz64_s* s;
+    uInt iSizeVar;
+    ZPOS64_T offset_local_extrafield;
+    uInt  size_local_extrafield;
+    const void* view;
+
+    if ((file==NULL) || (pbuf==NULL) || (plen==NULL))
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    *pbuf = NULL;
+    *plen = 0;
+    if (!s->current_file_ok)
+        return UNZ_PARAMERROR;
+    if ((s->cur_file_info.compression_method!=0) ||
+        ((s->cur_file_info.flag & 1)!=0) ||
+        (s->cur_file_info.compressed_size!=s->cur_file_info.uncompressed_size))
+        return UNZ_PARAMERROR;
+
+    if (unz64local_CheckCurrentFileCoherencyHeader(s,&iSizeVar, &offset_local_extrafield,&size_local_extrafield)!=UNZ_OK)
+        return UNZ_BADZIPFILE;
+
+    view = ZMAP64(s->z_filefunc, s->filestream,
+                  s->cur_file_info_internal.offset_curfile + SIZEZIPLOCALHEADER +
+                  iSizeVar + s->byte_before_the_zipfile,
+                  s->cur_file_info.compressed_size);
+    if (view==NULL)
+        return (s->cur_file_info.compressed_size==0) ? UNZ_OK : UNZ_PARAMERROR;
+
+    *pbuf = view;
+    *plen = s->cur_file_info.compressed_size;
+    return UNZ_OK;
+}
+
+/*
+  Check the data given by unzGetCurrentFileView against the CRC of the
+    current file.
+  Return UNZ_CRCERROR if it does not match
+*/
+extern int ZEXPORT unzCheckCurrentFileView(unzFile file, const void* buf, ZPOS64_T len) {
+    unz64_s* s;
+    const Bytef* p = (const Bytef*)buf;
+    uLong crc = crc32(0L, Z_NULL, 0);
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    if (!s->current_file_ok)
+        return UNZ_PARAMERROR;
+    if ((buf==NULL) && (len!=0))
+        return UNZ_PARAMERROR;
+    if (len!=s->cur_file_info.uncompressed_size)
+        return UNZ_CRCERROR;
+
+    while (len>0)
+    {
+        uInt uDoThis = 0x40000000;
+        if (len<uDoThis)
+            uDoThis = (uInt)len;
+        crc = zcrc32(crc, p, uDoThis);
+        p += uDoThis;
+        len -= uDoThis;
+    }
+    return (crc==s->cur_file_info.crc) ? UNZ_OK : UNZ_CRCERROR;
+}
+
+
+/*
+  Get the global comment string of the ZipFile, in the szComment buffer.
+  uSizeBuf is the size of the szComment buffer.
+  return the number of byte copied or an error code <0
+*/
+extern int ZEXPORT unzGetGlobalComment(unzFile file, char * szComment, uLong uSizeBuf) {
+    unz64_s* s;
+    uLong uReadThis ;
+    if (file==NULL)
+        return (int)UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+
+    uReadThis = uSizeBuf;
+    if (uReadThis>s->gi.size_comment)
+        uReadThis = s->gi.size_comment;
+
+    if (uReadThis>0)
+    {
+      *szComment='\0';
+      if (ZREADAT64(s->z_filefunc,s->filestream,s->central_pos+22,szComment,uReadThis)!=uReadThis)
+        return UNZ_ERRNO;
+    }
+
+    if ((szComment != NULL) && (uSizeBuf > s->gi.size_comment))
+        *(szComment+s->gi.size_comment)='\0';
+    return (int)uReadThis;
+}
+
+/* Additions by RX '2004 */
+extern ZPOS64_T ZEXPORT unzGetOffset64(unzFile file) {
+    unz64_s* s;
+
+    if (file==NULL)
+          return 0; //UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    if (!s->current_file_ok)
+      return 0;
+    if (s->gi.number_entry != 0 && s->gi.number_entry != 0xffff)
+      if (s->num_file==s->gi.number_entry)
+         return 0;
+    return s->pos_in_central_dir;
+}
+
+extern uLong ZEXPORT unzGetOffset(unzFile file) {
+    ZPOS64_T offset64;
+
+    if (file==NULL)
+          return 0; //UNZ_PARAMERROR;
+    offset64 = unzGetOffset64(file);
+    return (uLong)offset64;
+}
+
+extern int ZEXPORT unzSetOffset64(unzFile file, ZPOS64_T pos) {
+    unz64_s* s;
+    int err;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+
+    s->pos_in_central_dir = pos;
+    s->num_file = s->gi.number_entry;      /* hack */
+    err = unz64local_GetCurrentFileInfoInternal(file,&s->cur_file_info,
+                                              &s->cur_file_info_internal,
+                                              NULL,0,NULL,0,NULL,0);
+    s->current_file_ok = (err == UNZ_OK);
+    return err;
+}
+
+extern int ZEXPORT unzSetOffset (unzFile file, uLong pos) {
+    return unzSetOffset64(file,pos);
+}
+
+
+/*
+// Parallel extraction
+///////////////////////////////////////////
+*/
+
+typedef struct
+{
+    unz64_file_pos file_pos;
+    ZPOS64_T offset_curfile;       /* relative offset of the local header */
+    ZPOS64_T compressed_size;
+    ZPOS64_T uncompressed_size;
+    uLong crc;
+    uLong compression_method;
+} unz64_extract_entry;
+
+typedef struct
+{
+    unz64_s* s;
+    unz64_extract_entry* entries;
+    ZPOS64_T number_entry;
+    ZPOS64_T next_entry;           /* next entry to give to a thread */
+    int err;                       /* first error, stops all the threads */
+    zthread_mutex mutex;           /* protects next_entry, err and s->filestream */
+    unz_extract_func extract_func;
+    voidpf opaque;
+} unz64_extract_s;
+
+/*
+  Give size bytes at pos in the zipfile, mapped if possible, else read in buf.
+  Return NULL on error
+*/
+local const unsigned char* unz64local_ExtractRead(unz64_extract_s* p, ZPOS64_T pos,
+                                                  unsigned char* buf, uLong size) {
+    unz64_s* s = p->s;
+    const unsigned char* data;
+
+    data = (const unsigned char*)ZMAP64(s->z_filefunc, s->filestream,
+                                        pos + s->byte_before_the_zipfile, size);
+    if (data!=NULL)
+        return data;
+
+    /* a positional read doesn't move the filestream, threads can share it */
+    if (ZEXT64(s->z_filefunc, zread_at64_file) != NULL)
+        return (ZREADAT64(s->z_filefunc, s->filestream, pos + s->byte_before_the_zipfile,
+                          buf, size)==size) ? buf : NULL;
+
+    zthread_mutex_lock(&p->mutex);
+    if (ZREADAT64(s->z_filefunc, s->filestream, pos + s->byte_before_the_zipfile,
+                  buf, size)==size)
+        data = buf;
+    zthread_mutex_unlock(&p->mutex);
+    return data;
+}
+
+/*
+  Uncompress one entry, giving its data to extract_func
+*/
+local int unz64local_ExtractEntry(unz64_extract_s* p, const unz64_extract_entry* entry,
+                                  z_stream* stream, int* stream_initialised,
+                                  unsigned char* read_buffer, unsigned char* out_buffer) {
+    const unsigned char* header;
+    ZPOS64_T pos;
+    ZPOS64_T rest_read_compressed;
+    ZPOS64_T total_out = 0;
+    uLong crc = crc32(0L, Z_NULL, 0);
+    int err = UNZ_OK;
+
+    header = unz64local_ExtractRead(p, entry->offset_curfile, read_buffer, SIZEZIPLOCALHEADER);
+    if (header==NULL)
+        return UNZ_ERRNO;
+    if ((unz64local_readLong(header)!=0x04034b50) ||
+        (unz64local_readShort(header+8)!=entry->compression_method))
+        return UNZ_BADZIPFILE;
+    pos = entry->offset_curfile + SIZEZIPLOCALHEADER +
+          unz64local_readShort(header+26) + unz64local_readShort(header+28);
+    rest_read_compressed = entry->compressed_size;
+
+    if (entry->compression_method==Z_DEFLATED)
+    {
+        if (!*stream_initialised)
+        {
+            stream->zalloc = (alloc_func)0;
+            stream->zfree = (free_func)0;
+            stream->opaque = (voidpf)0;
+            stream->next_in = 0;
+            stream->avail_in = 0;
+            if (inflateInit2(stream, -MAX_WBITS)!=Z_OK)
+                return UNZ_INTERNALERROR;
+            *stream_initialised = 1;
+        }
+        else if (inflateReset(stream)!=Z_OK)
+            return UNZ_INTERNALERROR;
+        stream->avail_in = 0;
+    }
+
+    while (err==UNZ_OK)
+    {
+        const unsigned char* data = NULL;
+        uLong uReadThis = 0;
+
+        zthread_mutex_lock(&p->mutex);
+        err = p->err;
+        zthread_mutex_unlock(&p->mutex);
+        if (err!=UNZ_OK)
+            return UNZ_OK;
+
+        if ((rest_read_compressed>0) &&
+            ((entry->compression_method==0) || (stream->avail_in==0)))
+        {
+            uReadThis = 0x40000000;
+            if (rest_read_compressed<uReadThis)
+                uReadThis = (uLong)rest_read_compressed;
+            data = (const unsigned char*)ZMAP64(p->s->z_filefunc, p->s->filestream,
+                                                pos + p->s->byte_before_the_zipfile, uReadThis);
+            if (data==NULL)
+            {
+                if (uReadThis>UNZ_BUFSIZE)
+                    uReadThis = UNZ_BUFSIZE;
+                data = unz64local_ExtractRead(p, pos, read_buffer, uReadThis);
+                if (data==NULL)
+                    return UNZ_ERRNO;
+            }
+            pos += uReadThis;
+            rest_read_compressed -= uReadThis;
+        }
+
+        if (entry->compression_method==0)
+        {
+            if (uReadThis==0)
+                break;
+            crc = zcrc32(crc, data, (size_t)uReadThis);
+            err = (*p->extract_func)(p->opaque, &entry->file_pos, total_out, data, uReadThis);
+            total_out += uReadThis;
+        }
+        else
+        {
+            int zerr;
+            uLong uOutThis;
+
+            if (data!=NULL)
+            {
+                stream->next_in = (Bytef*)data;
+                stream->avail_in = (uInt)uReadThis;
+            }
+            stream->next_out = out_buffer;
+            stream->avail_out = UNZ_BUFSIZE;
+            zerr = inflate(stream, Z_SYNC_FLUSH);
+            uOutThis = UNZ_BUFSIZE - stream->avail_out;
+            if ((zerr<0) && (zerr!=Z_BUF_ERROR))
+                return UNZ_BADZIPFILE;
+            if (uOutThis>0)
+            {
+                crc = zcrc32(crc, out_buffer, (size_t)uOutThis);
+                err = (*p->extract_func)(p->opaque, &entry->file_pos, total_out, out_buffer, uOutThis);
+                total_out += uOutThis;
+            }
+            if (zerr==Z_STREAM_END)
+                break;
+            if ((uOutThis==0) && (stream->avail_in==0) && (rest_read_compressed==0))
+                return UNZ_BADZIPFILE;
+        }
+    }
+    if (err!=UNZ_OK)
+        return err;
+
+    if ((total_out!=entry->uncompressed_size) || (crc!=entry->crc))
+        return UNZ_CRCERROR;
+    return (*p->extract_func)(p->opaque, &entry->file_pos, total_out, NULL, 0);
+}
+
+local void unz64local_ExtractThread(void* arg) {
+    unz64_extract_s* p = (unz64_extract_s*)arg;
+    unsigned char* read_buffer;
+    unsigned char* out_buffer;
+    z_stream stream;
+    int stream_initialised = 0;
+
+    read_buffer = (unsigned char*)ALLOC(UNZ_BUFSIZE);
+    out_buffer = (unsigned char*)ALLOC(UNZ_BUFSIZE);
+    if ((read_buffer==NULL) || (out_buffer==NULL))
+    {
+        free(read_buffer);
+        free(out_buffer);
+        zthread_mutex_lock(&p->mutex);
+        if (p->err==UNZ_OK)
+            p->err = UNZ_INTERNALERROR;
+        zthread_mutex_unlock(&p->mutex);
+        return;
+    }
+
+    for (;;)
+    {
+        const unz64_extract_entry* entry = NULL;
+        int err;
+
+        zthread_mutex_lock(&p->mutex);
+        if ((p->err==UNZ_OK) && (p->next_entry<p->number_entry))
+            entry = &p->entries[p->next_entry++];
+        zthread_mutex_unlock(&p->mutex);
+        if (entry==NULL)
+            break;
+
+        err = unz64local_ExtractEntry(p, entry, &stream, &stream_initialised,
+                                      read_buffer, out_buffer);
+        if (err!=UNZ_OK)
+        {
+            zthread_mutex_lock(&p->mutex);
+            if (p->err==UNZ_OK)
+                p->err = err;
+            zthread_mutex_unlock(&p->mutex);
+        }
+    }
+
+    if (stream_initialised)
+        inflateEnd(&stream);
+    free(read_buffer);
+    free(out_buffer);
+}
+
+/* biggest files first, so the last ones to finish are the small ones */
+local int unz64local_CompareExtractEntry(const void* a, const void* b) {
+    const unz64_extract_entry* ea = (const unz64_extract_entry*)a;
+    const unz64_extract_entry* eb = (const unz64_extract_entry*)b;
+    if (ea->compressed_size!=eb->compressed_size)
+        return (ea->compressed_size<eb->compressed_size) ? 1 : -1;
+    return (ea->file_pos.num_of_file<eb->file_pos.num_of_file) ? -1 : 1;
+}
+
+extern int ZEXPORT unzExtractParallel(unzFile file, const unz64_file_pos* file_pos,
+                                      ZPOS64_T number_file, int threads,
+                                      unz_extract_func extract_func, voidpf opaque) {
+    unz64_s* s;
+    unz64_extract_s p;
+    ZPOS64_T num_file;
+    ZPOS64_T pos_in_central_dir;
+    ZPOS64_T current_file_ok;
+    unz_file_info64 cur_file_info;
+    unz_file_info64_internal cur_file_info_internal;
+    ZPOS64_T i;
+    int err = UNZ_OK;
+
+    if ((file==NULL) || (extract_func==NULL) || (threads<0))
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    if (file_pos==NULL)
+        number_file = s->gi.number_entry;
+    if (number_file==0)
+        return UNZ_OK;
+    if ((size_t)(number_file*sizeof(unz64_extract_entry)) / sizeof(unz64_extract_entry) != number_file)
+        return UNZ_INTERNALERROR;
+
+    p.entries = (unz64_extract_entry*)ALLOC((size_t)(number_file*sizeof(unz64_extract_entry)));
+    if (p.entries==NULL)
+        return UNZ_INTERNALERROR;
+
+    /* collect the files with the current file of the zipfile, then restore it */
+    num_file = s->num_file;
+    pos_in_central_dir = s->pos_in_central_dir;
+    current_file_ok = s->current_file_ok;
+    cur_file_info = s->cur_file_info;
+    cur_file_info_internal = s->cur_file_info_internal;
+
+    if (file_pos==NULL)
+        err = unzGoToFirstFile(file);
+    for (i=0; (i<number_file) && (err==UNZ_OK); i++)
+    {
+        unz64_extract_entry* entry = &p.entries[i];
+
+        if (file_pos!=NULL)
+            err = unzGoToFilePos64(file, &file_pos[i]);
+        else if (i>0)
+            err = unzGoToNextFile(file);
+        if (err!=UNZ_OK)
+            break;
+
+        if (((s->cur_file_info.compression_method!=0) &&
+             (s->cur_file_info.compression_method!=Z_DEFLATED)) ||
+            ((s->cur_file_info.flag & 1)!=0))
+        {
+            err = UNZ_PARAMERROR;
+            break;
+        }
+        entry->file_pos.pos_in_zip_directory = s->pos_in_central_dir;
+        entry->file_pos.num_of_file = s->num_file;
+        entry->offset_curfile = s->cur_file_info_internal.offset_curfile;
+        entry->compressed_size = s->cur_file_info.compressed_size;
+        entry->uncompressed_size = s->cur_file_info.uncompressed_size;
+        entry->crc = s->cur_file_info.crc;
+        entry->compression_method = s->cur_file_info.compression_method;
+    }
+    if ((file_pos==NULL) && (err==UNZ_END_OF_LIST_OF_FILE))
+    {
+        number_file = i;
+        err = UNZ_OK;
+    }
+
+    s->num_file = num_file;
+    s->pos_in_central_dir = pos_in_central_dir;
+    s->current_file_ok = current_file_ok;
+    s->cur_file_info = cur_file_info;
+    s->cur_file_info_internal = cur_file_info_internal;
+
+    if (err!=UNZ_OK)
+    {
+        free(p.entries);
+        return err;
+    }
+
+    qsort(p.entries, (size_t)number_file, sizeof(unz64_extract_entry),
+          unz64local_CompareExtractEntry);
+
+    if (threads==0)
+        threads = zthread_cpu_count();
+    if ((ZPOS64_T)threads>number_file)
+        threads = (int)number_file;
+
+    p.s = s;
+    p.number_entry = number_file;
+    p.next_entry = 0;
+    p.err = UNZ_OK;
+    p.extract_func = extract_func;
+    p.opaque = opaque;
+    zthread_mutex_init(&p.mutex);
+
+    zthread_run(threads, unz64local_ExtractThread, &p);
+
+    zthread_mutex_destroy(&p.mutex);
+    free(p.entries);
+    return p.err;
+}
+
+/***************************************************************************/
+/* Forward-only reading */
+
+#define LOCALHEADERMAGIC    (0x04034b50)
+#define CENTRALHEADERMAGIC  (0x02014b50)
+#define ENDHEADERMAGIC      (0x06054b50)
+#define ZIP64ENDHEADERMAGIC (0x06064b50)
+#define DATADESCRIPTORMAGIC (0x08074b50)
+
+typedef struct
+{
+    zlib_filefunc64_32_def z_filefunc;
+    voidpf filestream;          /* io structure of the zipfile */
+    unsigned char buffer[UNZ_BUFSIZE]; /* bytes read from the zipfile */
+    uInt pos_in_buffer;         /* first byte of buffer not used yet */
+    uInt avail_in_buffer;       /* number of bytes of buffer not used yet */
+    int eof;                    /* 1 when the zipfile has no more bytes */
+    ZPOS64_T num_file;          /* number of the current file */
+
+    int file_opened;            /* 1 if unzStreamNextFile found a file */
+    int file_ended;             /* 1 if all the data of this file was read */
+    unz_file_info64 cur_file_info; /* local header of the current file */
+    int zip64;                  /* 1 if the local header has a zip64 extra field */
+    z_stream stream;            /* zLib stream structure for inflate */
+    int stream_initialised;     /* 1 if stream has an inflate state, kept
+                                   from file to file */
+    uLong crc32;                /* crc32 of all data uncompressed */
+    ZPOS64_T total_in;          /* compressed bytes of the file used */
+    ZPOS64_T total_out;         /* uncompressed bytes of the file given */
+} unz64_stream_s;
+
+/*
+  Make sure at least need bytes (need <= UNZ_BUFSIZE) are in the buffer,
+    reading more from the zipfile if needed.
+*/
+local int unz64local_StreamFill(unz64_stream_s* s, uInt need) {
+    if (s->avail_in_buffer >= need)
+        return UNZ_OK;
+    if (s->pos_in_buffer > 0)
+    {
+        memmove(s->buffer, s->buffer + s->pos_in_buffer, s->avail_in_buffer);
+        s->pos_in_buffer = 0;
+    }
+    while ((s->avail_in_buffer < need) && (!s->eof))
+    {
+        uLong got = ZREAD64(s->z_filefunc, s->filestream,
+                            s->buffer + s->avail_in_buffer,
+                            UNZ_BUFSIZE - s->avail_in_buffer);
+        if (got == 0)
+        {
+            if (ZERROR64(s->z_filefunc, s->filestream))
+                return UNZ_ERRNO;
+            s->eof = 1;
+        }
+        s->avail_in_buffer += (uInt)got;
+    }
+    return (s->avail_in_buffer >= need) ? UNZ_OK : UNZ_BADZIPFILE;
+}
+
+local void unz64local_StreamUse(unz64_stream_s* s, uInt len) {
+    s->pos_in_buffer += len;
+    s->avail_in_buffer -= len;
+}
+
+/* Copy the next len bytes of the zipfile to buf, or skip them if buf==NULL */
+local int unz64local_StreamCopy(unz64_stream_s* s, void* buf, ZPOS64_T len) {
+    unsigned char* out = (unsigned char*)buf;
+    while (len > 0)
+    {
+        uInt copy;
+        int err = unz64local_StreamFill(s, 1);
+        if (err != UNZ_OK)
+            return err;
+        copy = s->avail_in_buffer;
+        if ((ZPOS64_T)copy > len)
+            copy = (uInt)len;
+        if (out != NULL)
+        {
+            memcpy(out, s->buffer + s->pos_in_buffer, copy);
+            out += copy;
+        }
+        unz64local_StreamUse(s, copy);
+        len -= copy;
+    }
+    return UNZ_OK;
+}
+
+local int unz64local_StreamCanRead(const unz64_stream_s* s) {
+    return ((s->cur_file_info.compression_method == 0) ||
+            (s->cur_file_info.compression_method == Z_DEFLATED)) &&
+           ((s->cur_file_info.flag & 1) == 0);
+}
+
+/*
+  p points to a data descriptor signature in the buffer, after the data of a
+    stored file: tell if it is the descriptor of all the bytes before it.
+*/
+local int unz64local_StreamIsDescriptor(const unz64_stream_s* s, const unsigned char* p) {
+    const unsigned char* data = s->buffer + s->pos_in_buffer;
+    ZPOS64_T size = s->total_in + (ZPOS64_T)(p - data);
+    ZPOS64_T compressed_size, uncompressed_size;
+
+    if (s->zip64)
+    {
+        compressed_size = unz64local_readLong64(p + 8);
+        uncompressed_size = unz64local_readLong64(p + 16);
+    }
+    else
+    {
+        compressed_size = unz64local_readLong(p + 8);
+        uncompressed_size = unz64local_readLong(p + 12);
+    }
+    if ((compressed_size != size) || (uncompressed_size != size))
+        return 0;
+    return zcrc32(s->crc32, data, (size_t)(p - data)) == unz64local_readLong(p + 4);
+}
+
+/* Read the data descriptor if any, then check the crc and the sizes */
+local int unz64local_StreamEndFile(unz64_stream_s* s) {
+    s->file_ended = 1;
+    if ((s->cur_file_info.flag & 8) != 0)
+    {
+        const unsigned char* p;
+        uInt size = s->zip64 ? 20 : 12;
+        int err = unz64local_StreamFill(s, 4);
+        if (err != UNZ_OK)
+            return err;
+        /* the signature is optional */
+        if (unz64local_readLong(s->buffer + s->pos_in_buffer) == DATADESCRIPTORMAGIC)
+            unz64local_StreamUse(s, 4);
+        err = unz64local_StreamFill(s, size);
+        if (err != UNZ_OK)
+            return err;
+        p = s->buffer + s->pos_in_buffer;
+        s->cur_file_info.crc = unz64local_readLong(p);
+        if (s->zip64)
+        {
+            s->cur_file_info.compressed_size = unz64local_readLong64(p + 4);
+            s->cur_file_info.uncompressed_size = unz64local_readLong64(p + 12);
+        }
+        else
+        {
+            s->cur_file_info.compressed_size = unz64local_readLong(p + 4);
+            s->cur_file_info.uncompressed_size = unz64local_readLong(p + 8);
+        }
+        unz64local_StreamUse(s, size);
+    }
+    if ((s->total_in != s->cur_file_info.compressed_size) ||
+        (s->total_out != s->cur_file_info.uncompressed_size))
+        return UNZ_BADZIPFILE;
+    if (s->crc32 != s->cur_file_info.crc)
+        return UNZ_CRCERROR;
+    return UNZ_OK;
+}
+
+extern unzStream ZEXPORT unzStreamOpen64(const void *path,
+                                         zlib_filefunc64_def* pzlib_filefunc_def) {
+    unz64_stream_s* s;
+
+    s = (unz64_stream_s*)ALLOC(sizeof(unz64_stream_s));
+    if (s == NULL)
+        return NULL;
+
+    s->z_filefunc.zseek32_file = NULL;
+    s->z_filefunc.ztell32_file = NULL;
+    if (pzlib_filefunc_def==NULL)
+        fill_fopen64_filefunc(&s->z_filefunc.zfile_func64);
+    else
+        s->z_filefunc.zfile_func64 = *pzlib_filefunc_def;
+
+    s->filestream = ZOPEN64(s->z_filefunc, path,
+                            ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_EXISTING);
+    if (s->filestream == NULL)
+    {
+        free(s);
+        return NULL;
+    }
+
+    s->pos_in_buffer = 0;
+    s->avail_in_buffer = 0;
+    s->eof = 0;
+    s->num_file = 0;
+    s->file_opened = 0;
+    s->file_ended = 0;
+    s->stream_initialised = 0;
+    return (unzStream)s;
+}
+
+extern int ZEXPORT unzStreamNextFile(unzStream file,
+                                     unz_file_info64 *pfile_info,
+                                     char *szFileName,
+                                     uLong fileNameBufferSize) {
+    unz64_stream_s* s;
+    unz_file_info64 file_info;
+    const unsigned char* p;
+    uLong magic;
+    int err;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_stream_s*)file;
+
+    /* skip what was not read of the previous file */
+    if ((s->file_opened) && (!s->file_ended))
+    {
+        if (unz64local_StreamCanRead(s))
+        {
+            unsigned char skip_buffer[1024];
+            do
+                err = unzStreamReadFile(file, skip_buffer, sizeof(skip_buffer));
+            while (err > 0);
+            if (err < 0)
+                return err;
+        }
+        else if ((s->cur_file_info.flag & 8) == 0)
+        {
+            err = unz64local_StreamCopy(s, NULL, s->cur_file_info.compressed_size);
+            if (err != UNZ_OK)
+                return err;
+        }
+        else
+            return UNZ_BADZIPFILE; /* no way to find the end of the data */
+    }
+    s->file_opened = 0;
+
+    err = unz64local_StreamFill(s, 4);
+    if (err != UNZ_OK)
+        return err;
+    magic = unz64local_readLong(s->buffer + s->pos_in_buffer);
+    if ((magic == DATADESCRIPTORMAGIC) && (s->num_file == 0))
+    {
+        /* marker of a spanned zipfile written in one part */
+        unz64local_StreamUse(s, 4);
+        err = unz64local_StreamFill(s, 4);
+        if (err != UNZ_OK)
+            return err;
+        magic = unz64local_readLong(s->buffer + s->pos_in_buffer);
+    }
+    if ((magic == CENTRALHEADERMAGIC) || (magic == ENDHEADERMAGIC) ||
+        (magic == ZIP64ENDHEADERMAGIC))
+        return UNZ_END_OF_LIST_OF_FILE;
+    if (magic != LOCALHEADERMAGIC)
+        return UNZ_BADZIPFILE;
+
+    err = unz64local_StreamFill(s, SIZEZIPLOCALHEADER);
+    if (err != UNZ_OK)
+        return err;
+    p = s->buffer + s->pos_in_buffer;
+
+    file_info.version = 0;
+    file_info.version_needed = unz64local_readShort(p + 4);
+    file_info.flag = unz64local_readShort(p + 6);
+    file_info.compression_method = unz64local_readShort(p + 8);
+    file_info.dosDate = unz64local_readLong(p + 10);
+    file_info.crc = unz64local_readLong(p + 14);
+    file_info.compressed_size = unz64local_readLong(p + 18);
+    file_info.uncompressed_size = unz64local_readLong(p + 22);
+    file_info.size_filename = unz64local_readShort(p + 26);
+    file_info.size_file_extra = unz64local_readShort(p + 28);
+    file_info.size_file_comment = 0;
+    file_info.disk_num_start = 0;
+    file_info.internal_fa = 0;
+    file_info.external_fa = 0;
+    unz64local_DosDateToTmuDate(file_info.dosDate, &file_info.tmu_date);
+    unz64local_StreamUse(s, SIZEZIPLOCALHEADER);
+
+    if (szFileName != NULL)
+    {
+        uLong uSizeRead;
+        if (file_info.size_filename < fileNameBufferSize)
+        {
+            *(szFileName + file_info.size_filename) = '\0';
+            uSizeRead = file_info.size_filename;
+        }
+        else
+            uSizeRead = fileNameBufferSize;
+        err = unz64local_StreamCopy(s, szFileName, uSizeRead);
+        if (err == UNZ_OK)
+            err = unz64local_StreamCopy(s, NULL, file_info.size_filename - uSizeRead);
+    }
+    else
+        err = unz64local_StreamCopy(s, NULL, file_info.size_filename);
+    if (err != UNZ_OK)
+        return err;
+
+    /* the zip64 extra field gives the sizes which don't fit in the header */
+    s->zip64 = 0;
+    if (file_info.size_file_extra > 0)
+    {
+        unsigned char* extra = (unsigned char*)ALLOC(file_info.size_file_extra);
+        uLong acc = 0;
+        if (extra == NULL)
+            return UNZ_INTERNALERROR;
+        err = unz64local_StreamCopy(s, extra, file_info.size_file_extra);
+        while ((err == UNZ_OK) && (acc + 4 <= file_info.size_file_extra))
+        {
+            uLong headerId = unz64local_readShort(extra + acc);
+            uLong dataSize = unz64local_readShort(extra + acc + 2);
+            const unsigned char* q = extra + acc + 4;
+            const unsigned char* end = q + dataSize;
+
+            if (acc + 4 + dataSize > file_info.size_file_extra)
+                break;
+            if (headerId == 0x0001)
+            {
+                s->zip64 = 1;
+                if ((file_info.uncompressed_size == 0xffffffff) && (q + 8 <= end))
+                {
+                    file_info.uncompressed_size = unz64local_readLong64(q);
+                    q += 8;
+                }
+                if ((file_info.compressed_size == 0xffffffff) && (q + 8 <= end))
+                    file_info.compressed_size = unz64local_readLong64(q);
+            }
+            acc += 4 + dataSize;
+        }
+        free(extra);
+        if (err != UNZ_OK)
+            return err;
+    }
+
+    if ((file_info.compression_method == Z_DEFLATED) && ((file_info.flag & 1) == 0))
+    {
+        if (s->stream_initialised)
+            err = inflateReset(&s->stream);
+        else
+        {
+            s->stream.zalloc = (alloc_func)0;
+            s->stream.zfree = (free_func)0;
+            s->stream.opaque = (voidpf)0;
+            s->stream.next_in = 0;
+            s->stream.avail_in = 0;
+            err = inflateInit2(&s->stream, -MAX_WBITS);
+            if (err == Z_OK)
+                s->stream_initialised = 1;
+        }
+        if (err != Z_OK)
+            return err;
+    }
+
+    s->cur_file_info = file_info;
+    s->file_opened = 1;
+    s->file_ended = 0;
+    s->crc32 = 0;
+    s->total_in = 0;
+    s->total_out = 0;
+    s->num_file++;
+
+    if (pfile_info != NULL)
+        *pfile_info = file_info;
+    return UNZ_OK;
+}
+
+extern int ZEXPORT unzStreamReadFile(unzStream file, voidp buf, unsigned len) {
+    unz64_stream_s* s;
+    unsigned char* out = (unsigned char*)buf;
+    uInt produced = 0;
+    int ended = 0;
+    int err;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_stream_s*)file;
+
+    if ((!s->file_opened) || (!unz64local_StreamCanRead(s)))
+        return UNZ_PARAMERROR;
+    if (s->file_ended)
+        return 0;
+    if (buf==NULL)
+        return UNZ_PARAMERROR;
+
+    if (s->cur_file_info.compression_method == Z_DEFLATED)
+    {
+        s->stream.next_out = (Bytef*)buf;
+        s->stream.avail_out = (uInt)len;
+        while ((s->stream.avail_out > 0) && (!ended))
+        {
+            uInt in = 0;
+            int zerr;
+
+            /* when all the input was given, inflate may still have output */
+            if (((s->cur_file_info.flag & 8) != 0) ||
+                (s->total_in < s->cur_file_info.compressed_size))
+            {
+                err = unz64local_StreamFill(s, 1);
+                if (err != UNZ_OK)
+                    return err;
+                in = s->avail_in_buffer;
+                if (((s->cur_file_info.flag & 8) == 0) &&
+                    ((ZPOS64_T)in > s->cur_file_info.compressed_size - s->total_in))
+                    in = (uInt)(s->cur_file_info.compressed_size - s->total_in);
+            }
+
+            s->stream.next_in = s->buffer + s->pos_in_buffer;
+            s->stream.avail_in = in;
+            zerr = inflate(&s->stream, Z_SYNC_FLUSH);
+            s->total_in += in - s->stream.avail_in;
+            unz64local_StreamUse(s, in - s->stream.avail_in);
+
+            if (zerr == Z_STREAM_END)
+                ended = 1;
+            else if ((zerr == Z_BUF_ERROR) && (in == 0))
+                return UNZ_BADZIPFILE; /* the deflate data is truncated */
+            else if (zerr != Z_OK)
+                return zerr;
+        }
+        produced = (uInt)len - s->stream.avail_out;
+    }
+    else if ((s->cur_file_info.flag & 8) == 0)
+    {
+        ZPOS64_T rest = s->cur_file_info.compressed_size - s->total_in;
+        produced = (uInt)len;
+        if ((ZPOS64_T)produced >= rest)
+        {
+            produced = (uInt)rest;
+            ended = 1;
+        }
+        err = unz64local_StreamCopy(s, out, produced);
+        if (err != UNZ_OK)
+            return err;
+        s->total_in += produced;
+    }
+    else
+    {
+        /* stored data of unknown size: they end at the data descriptor */
+        uInt size_descriptor = s->zip64 ? 24 : 16;
+        while ((produced < len) && (!ended))
+        {
+            const unsigned char* p;
+            uInt limit, copy, k;
+
+            err = unz64local_StreamFill(s, size_descriptor);
+            if (err != UNZ_OK)
+                return err;
+            p = s->buffer + s->pos_in_buffer;
+            limit = s->avail_in_buffer - size_descriptor + 1;
+            if (limit > len - produced)
+                limit = len - produced;
+
+            copy = limit;
+            for (k = 0; k < limit; k++)
+                if ((p[k] == 0x50) && (unz64local_readLong(p + k) == DATADESCRIPTORMAGIC) &&
+                    unz64local_StreamIsDescriptor(s, p + k))
+                {
+                    copy = k;
+                    ended = 1;
+                    break;
+                }
+
+            s->crc32 = zcrc32_copy(s->crc32, out + produced, p, copy);
+            s->total_in += copy;
+            s->total_out += copy;
+            unz64local_StreamUse(s, copy);
+            produced += copy;
+        }
+        /* crc32 and total_out are already updated */
+        out = NULL;
+    }
+
+    if (out != NULL)
+    {
+        s->crc32 = zcrc32(s->crc32, out, produced);
+        s->total_out += produced;
+    }
+
+    if (ended)
+    {
+        err = unz64local_StreamEndFile(s);
+        if (err != UNZ_OK)
+            return err;
+    }
+    return (int)produced;
+}
+
+extern int ZEXPORT unzStreamClose(unzStream file) {
+    unz64_stream_s* s;
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_stream_s*)file;
+
+    if (s->stream_initialised)
+        inflateEnd(&s->stream);
+    ZCLOSE64(s->z_filefunc, s->filestream);
+    free(s);
+    return UNZ_OK;
 }
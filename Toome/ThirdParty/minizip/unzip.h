@@ -59,7 +59,23 @@ extern "C" {
 #include "bzlib.h"
 #endif
 
+#ifdef HAVE_ZSTD
+#include "zstd.h"
+#endif
+
+#ifdef HAVE_LZMA
+#include "lzma.h"
+#endif
+
+#ifdef HAVE_LIBDEFLATE
+#include "libdeflate.h"
+#endif
+
 #define Z_BZIP2ED 12
+#define Z_LZMA 14
+#define Z_ZSTD 93
+#define Z_XZ 95
+#define Z_AES 99        /* WinZip AES, the real method is in the 0x9901 extra field */
 
 #if defined(STRICTUNZIP) || defined(STRICTZIPUNZIP)
 /* like the STRICT of WIN32, we define a pointer that cannot be converted
@@ -79,6 +95,7 @@ typedef voidp unzFile;
 #define UNZ_BADZIPFILE                  (-103)
 #define UNZ_INTERNALERROR               (-104)
 #define UNZ_CRCERROR                    (-105)
+#define UNZ_BADPASSWORD                 (-106)
 
 /* tm_unz contain date/time info */
 typedef struct tm_unz_s
@@ -195,6 +212,60 @@ extern unzFile ZEXPORT unzOpen2_64(const void *path,
       for read/write the zip file (see ioapi.h)
 */
 
+#define UNZ_OPEN_INDEXED                (1)
+#define UNZ_OPEN_BUFFERED               (2)
+
+extern unzFile ZEXPORT unzOpen3_64(const void *path,
+                                   zlib_filefunc64_def* pzlib_filefunc_def,
+                                   int open_flags);
+/*
+   Open a Zip file, like unzOpen2_64, with additional open_flags.
+   If open_flags contains UNZ_OPEN_INDEXED, the central directory is read
+     once at open time into an in-memory index (entry array + hash table of
+     the filenames). unzLocateFile, unzGoToFirstFile and unzGoToNextFile then
+     work without any file I/O, whatever the iCaseSensitivity passed.
+     If the index cannot be built (out of memory), the file is still opened
+     and works as if the flag was not given.
+   If open_flags contains UNZ_OPEN_BUFFERED, the whole central directory is
+     read with one I/O and kept in memory until unzClose, and the file infos
+     (unzGetCurrentFileInfo64, unzGoToNextFile...) are decoded from there.
+     UNZ_OPEN_INDEXED uses the same single read to build its index.
+*/
+
+extern unzFile ZEXPORT unzOpen4_64(const void *path,
+                                   zlib_filefunc64_def* pzlib_filefunc_def,
+                                   int open_flags,
+                                   const void *index_path);
+/*
+   Open a Zip file, like unzOpen3_64 with UNZ_OPEN_INDEXED, keeping the index
+     of the central directory in the file index_path, opened with the same
+     io functions.
+   If the index file was made for this zipfile (same size, same modification
+     time when the io functions give it, same end of central directory
+     records and comment), the central directory is not read at all: the
+     index file is read in memory with one I/O and closed, so that it can
+     be written again while the zipfile is opened (by another handle or
+     unzWriteIndexFile).
+   Else the central directory is read and the index file is written again,
+     with the io functions if they can write, or with fopen. Failing to
+     write it doesn't fail the open.
+   The index file also keeps the checkpoints of deflated files given to it by
+     unzWriteIndexFile, used by unzSeek64 without inflating the files again.
+   The index file is only valid on the machine type it was written on (byte
+     order, structure layout); another one is seen as out of date.
+*/
+
+extern int ZEXPORT unzWriteIndexFile(unzFile file,
+                                     const void *index_path);
+/*
+   Write the index file of a zipfile opened with unzOpen4_64 or with
+     UNZ_OPEN_INDEXED, adding the checkpoints of the deflated files that
+     unzSeek64 or unzExportSeekIndex made up to their end.
+   The index file may be the one the zipfile was opened with.
+   return UNZ_OK, UNZ_PARAMERROR if there is no index of the central
+     directory, or UNZ_ERRNO if the index file can't be written
+*/
+
 extern int ZEXPORT unzClose(unzFile file);
 /*
   Close a ZipFile opened with unzOpen.
@@ -340,6 +411,10 @@ extern int ZEXPORT unzOpenCurrentFilePassword(unzFile file,
   Open for reading data the current file in the zipfile.
   password is a crypting password
   If there is no error, the return value is UNZ_OK.
+  For a file encrypted with WinZip AES (compression method Z_AES), the
+    password is checked first and UNZ_BADPASSWORD is returned if it is
+    wrong; the authentication code of the data is checked by
+    unzCloseCurrentFile.
 */
 
 extern int ZEXPORT unzOpenCurrentFile2(unzFile file,
@@ -373,7 +448,8 @@ extern int ZEXPORT unzOpenCurrentFile3(unzFile file,
 extern int ZEXPORT unzCloseCurrentFile(unzFile file);
 /*
   Close the file in zip opened with unzOpenCurrentFile
-  Return UNZ_CRCERROR if all the file was read but the CRC is not good
+  Return UNZ_CRCERROR if all the file was read but the CRC is not good,
+    or the authentication code of a WinZip AES file is not good
 */
 
 extern int ZEXPORT unzReadCurrentFile(unzFile file,
@@ -390,6 +466,21 @@ extern int ZEXPORT unzReadCurrentFile(unzFile file,
     (UNZ_ERRNO for IO error, or zLib error for uncompress error)
 */
 
+extern int ZEXPORT unzReadCurrentFileFully(unzFile file,
+                                           voidp buf,
+                                           ZPOS64_T len);
+/*
+  Read all the current file (opened by unzOpenCurrentFile, nothing read yet)
+    in buf in one call. len must be at least the uncompressed size of the
+    file, or its compressed size if it was opened raw.
+  A stored or deflated file without encryption is read with a single read
+    (or mapped) and inflated in one pass, by libdeflate if minizip is built
+    with HAVE_LIBDEFLATE. Other files are read by unzReadCurrentFile.
+  The crc is checked by unzCloseCurrentFile, as after unzReadCurrentFile.
+  return UNZ_OK if all the file was read, UNZ_PARAMERROR if len is too small,
+    or an error code as unzReadCurrentFile
+*/
+
 extern z_off_t ZEXPORT unztell(unzFile file);
 
 extern ZPOS64_T ZEXPORT unztell64(unzFile file);
@@ -402,6 +493,55 @@ extern int ZEXPORT unzeof(unzFile file);
   return 1 if the end of file was reached, 0 elsewhere
 */
 
+extern int ZEXPORT unzSeek64(unzFile file,
+                             ZPOS64_T offset,
+                             int origin);
+/*
+  Set the position in the uncompressed data of the current file (opened by
+    unzOpenCurrentFile), or in its compressed data if it was opened raw.
+  origin is ZLIB_FILEFUNC_SEEK_SET, ZLIB_FILEFUNC_SEEK_CUR or
+    ZLIB_FILEFUNC_SEEK_END, as for fseek; offset is added modulo 2^64, so a
+    negative offset cast to ZPOS64_T goes backward.
+  A stored file is sought without reading anything. A deflated file is
+    inflated from the last checkpoint before the position: the checkpoints
+    (the last 32K of uncompressed data every UNZ_SEEKSPAN bytes, 1M by
+    default) are recorded the first time unzSeek64 goes through a part of
+    the file, or given by unzImportSeekIndex or by the index file of
+    unzOpen4_64, and kept until unzClose.
+  An encrypted file, or a file compressed by another method, can only be
+    sought forward, by reading the data up to the position.
+  The crc of the file is not checked by unzCloseCurrentFile once some data
+    was skipped, until the file is sought back to 0.
+  return UNZ_OK, UNZ_PARAMERROR if the position is out of the file or can't
+    be reached, or an error code as unzReadCurrentFile
+*/
+
+extern int ZEXPORT unzExportSeekIndex(unzFile file,
+                                      voidp buf,
+                                      ZPOS64_T* size);
+/*
+  Give the checkpoints of the current file (deflated, opened by
+    unzOpenCurrentFile not raw and without password), to keep them with the
+    zipfile and give them back later by unzImportSeekIndex.
+  The checkpoints up to the end of the file are made first if they are
+    missing, by inflating it once; the position in the file doesn't change.
+  if buf==NULL, *size is set to the size of the index.
+  if buf!=NULL, *size is the size of buf, the index is copied in buf and
+    *size is set to its size.
+  return UNZ_OK, UNZ_PARAMERROR if the file can't be sought with checkpoints
+    or buf is too small, or an error code as unzReadCurrentFile
+*/
+
+extern int ZEXPORT unzImportSeekIndex(unzFile file,
+                                      const void* buf,
+                                      ZPOS64_T size);
+/*
+  Give to the current file (opened as for unzExportSeekIndex) the checkpoints
+    given by unzExportSeekIndex for it, so that unzSeek64 doesn't inflate
+    the file to make them.
+  return UNZ_OK, or UNZ_BADZIPFILE if the index is not the one of this file
+*/
+
 extern int ZEXPORT unzGetLocalExtrafield(unzFile file,
                                          voidp buf,
                                          unsigned len);
@@ -418,6 +558,46 @@ extern int ZEXPORT unzGetLocalExtrafield(unzFile file,
     the error code
 */
 
+extern int ZEXPORT unzGetCurrentFileRawStream(unzFile file,
+                                              zlib_filefunc64_32_def* pzlib_filefunc_def,
+                                              voidpf* pstream,
+                                              ZPOS64_T* ppos,
+                                              ZPOS64_T* psize);
+/*
+  Give access to the data of the current file, opened by unzOpenCurrentFile2
+    with raw==1, without reading it with unzReadCurrentFile.
+  *pzlib_filefunc_def receive the io functions of the zipfile, *pstream its
+    stream, *ppos the position of the data in this stream and *psize its
+    size. Each of them can be NULL. The data can be read with ZREADAT64,
+    ZMAP64 or ZCOPY64 on this stream while the file is open.
+  return UNZ_OK if there is no problem, UNZ_PARAMERROR if no file is opened
+    in raw mode.
+*/
+
+extern int ZEXPORT unzGetCurrentFileView(unzFile file,
+                                         const void** pbuf,
+                                         ZPOS64_T* plen);
+/*
+  Give direct access to the data of the current file, without opening it
+    and without any copy.
+  This works only for stored (not compressed) and not encrypted files, when
+    the io functions can map the zipfile (see fill_mmap64_filefunc).
+  *pbuf receive a pointer on the data, valid until the zipfile is closed,
+    and *plen its size.
+  The CRC is not checked here, call unzCheckCurrentFileView if needed.
+
+  return UNZ_OK if there is no problem, UNZ_PARAMERROR if direct access is not
+    possible for this file (use unzOpenCurrentFile in this case)
+*/
+
+extern int ZEXPORT unzCheckCurrentFileView(unzFile file,
+                                           const void* buf,
+                                           ZPOS64_T len);
+/*
+  Check the CRC of the data given by unzGetCurrentFileView for the current file.
+  return UNZ_OK if the data is good, UNZ_CRCERROR if not
+*/
+
 /***************************************************************************/
 
 /* Get the current file offset */
@@ -428,6 +608,99 @@ extern uLong ZEXPORT unzGetOffset (unzFile file);
 extern int ZEXPORT unzSetOffset64 (unzFile file, ZPOS64_T pos);
 extern int ZEXPORT unzSetOffset (unzFile file, uLong pos);
 
+/***************************************************************************/
+/* Parallel extraction */
+
+typedef int (*unz_extract_func)(voidpf opaque,
+                                const unz64_file_pos* file_pos,
+                                ZPOS64_T offset,
+                                const void* buf,
+                                uLong len);
+/*
+  Receive len bytes of uncompressed data of the file at file_pos, starting at
+    offset in this file. The data of one file come in order, from a single
+    thread, and a last call with buf==NULL and len==0 tells the file is
+    complete (and its CRC checked).
+  Different files are given concurrently by different threads.
+  Return UNZ_OK to continue, any other value stops the extraction.
+*/
+
+extern int ZEXPORT unzExtractParallel(unzFile file,
+                                      const unz64_file_pos* file_pos,
+                                      ZPOS64_T number_file,
+                                      int threads,
+                                      unz_extract_func extract_func,
+                                      voidpf opaque);
+/*
+  Uncompress number_file files of the zipfile, given by their position (see
+    unzGetFilePos64), or all the files if file_pos==NULL, on threads threads
+    (0 to use one thread by processor).
+  Each thread reads the zipfile at its own positions and has its own
+    decompression state, the data are given to extract_func.
+  The zipfile is read with zmap64_file when the io functions can map it,
+    else with zread_at64_file by all the threads at once if it is given,
+    else reads of the threads are serialized on the filestream.
+  Only stored and deflated files without encryption can be extracted.
+  The current file of the zipfile is not changed.
+
+  return UNZ_OK if all the files were extracted, the error of the first file
+    which failed (UNZ_CRCERROR, UNZ_BADZIPFILE, UNZ_ERRNO...) or the value
+    returned by extract_func if it stopped the extraction
+*/
+
+/***************************************************************************/
+/* Forward-only reading */
+
+#if defined(STRICTUNZIP) || defined(STRICTZIPUNZIP)
+typedef struct TagunzStream__ { int unused; } unzStream__;
+typedef unzStream__ *unzStream;
+#else
+typedef voidp unzStream;
+#endif
+
+extern unzStream ZEXPORT unzStreamOpen64(const void *path,
+                                         zlib_filefunc64_def* pzlib_filefunc_def);
+/*
+  Open a zipfile to read its files in the order of their local headers,
+    without the central directory: the zipfile is only read forward, so it
+    can be read while it is downloaded or from a pipe. Only zread_file,
+    zerror_file and zclose_file of pzlib_filefunc_def are used.
+  If the zipfile cannot be opened, the return value is NULL.
+*/
+
+extern int ZEXPORT unzStreamNextFile(unzStream file,
+                                     unz_file_info64 *pfile_info,
+                                     char *szFileName,
+                                     uLong fileNameBufferSize);
+/*
+  Go to the next file of the zipfile, skipping what was not read of the
+    current one, and get the information of its local header (see
+    unzGetCurrentFileInfo64; version, comment, attributes are not in the
+    local header and are 0).
+  If bit 3 of the flag is set, the crc and sizes are only known when all the
+    data was read.
+  return UNZ_OK if there is no problem, UNZ_END_OF_LIST_OF_FILE when the
+    central directory is reached, UNZ_BADZIPFILE if the current file can't
+    be skipped (not stored or deflated, or encrypted, with a data descriptor).
+*/
+
+extern int ZEXPORT unzStreamReadFile(unzStream file, voidp buf, unsigned len);
+/*
+  Read bytes from the current file, like unzReadCurrentFile. Only stored and
+    deflated files without encryption can be read.
+  return the number of bytes copied if some bytes are copied
+  return 0 if the end of file was reached, after the crc and the sizes
+    (read in the data descriptor if any) were checked
+  return <0 with error code if there is an error
+    (UNZ_CRCERROR, UNZ_BADZIPFILE for a truncated zipfile, UNZ_ERRNO for IO
+    error, or zLib error for uncompress error)
+*/
+
+extern int ZEXPORT unzStreamClose(unzStream file);
+/*
+  Close a zipfile opened with unzStreamOpen64.
+*/
+
 
 
 #ifdef __cplusplus
@@ -0,0 +1,680 @@
+/* zaes.h -- WinZip AES encryption for minizip
+
+   This file is included in zip.c and unzip.c, after zthread.h. It gives
+   the WinZip AES encryption (AE-1 and AE-2, compression method 99 with
+   the 0x9901 extra field): the keys are derived from the password and a
+   random salt with PBKDF2-HMAC-SHA1, the data is encrypted with AES in
+   counter mode, and authenticated with an HMAC-SHA1 of the encrypted data.
+
+   The data of a file is stored as:
+     salt (8, 12 or 16 bytes), password verification value (2 bytes),
+     encrypted data, authentication code (10 bytes)
+
+   AES uses the AES-NI instructions and SHA-1 the SHA instructions on
+   x86-64 when the processor has them (checked once at run time), and
+   portable code otherwise.
+
+   As with crypt.h, the encrypting functions are only included with
+   INCLUDECRYPTINGCODE_IFCRYPTALLOWED (by zip.c), the decrypting ones
+   otherwise.
+
+   If you don't want WinZip AES, define the symbol NOAES. If you don't want
+   the x86-64 instructions, define the symbol NOZAES_X86.
+*/
+
+#ifndef _ZAES_H
+#define _ZAES_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#if !defined(NOZAES_X86) && (defined(__x86_64__) || defined(_M_X64)) && \
+    (defined(__GNUC__) || defined(_MSC_VER))
+#  define ZAES_HAVE_X86
+#  if defined(_MSC_VER) && !defined(__clang__)
+#    include <intrin.h>
+#    define ZAES_TARGET_AESNI
+#    define ZAES_TARGET_SHANI
+#  else
+#    include <cpuid.h>
+#    include <immintrin.h>
+#    define ZAES_TARGET_AESNI __attribute__((target("sse2,aes")))
+#    define ZAES_TARGET_SHANI __attribute__((target("sse4.1,sha")))
+#  endif
+#endif
+
+#ifdef _WIN32
+#  include <windows.h>
+#  include <wincrypt.h>
+#endif
+
+#define ZAES_EXTRA_ID           (0x9901) /* id of the AES extra field */
+#define ZAES_EXTRA_SIZE         (7)      /* size of its data */
+#define ZAES_VERSION_AE1        (1)      /* the crc is stored and checked */
+#define ZAES_VERSION_AE2        (2)      /* the crc is 0, only the authentication
+                                            code checks the data */
+#define ZAES_PWVERIFY_LEN       (2)
+#define ZAES_AUTHCODE_LEN       (10)
+#define ZAES_ITERATIONS         (1000)
+#define ZAES_MAX_SALT_LEN       (16)
+
+/* strength 1, 2, 3 for AES-128, AES-192, AES-256 */
+#define ZAES_KEY_LEN(strength)  (8 + 8 * (strength))
+#define ZAES_SALT_LEN(strength) (4 + 4 * (strength))
+
+/* the counter mode and the authentication are done by chunks of that size,
+   so that the encrypted data is still in the cache when it is hashed */
+#define ZAES_CHUNK              (4096)
+
+typedef struct
+{
+    uint32_t h[5];
+    ZPOS64_T length;            /* bytes hashed so far */
+    unsigned char block[64];    /* bytes waiting for a full block */
+    unsigned used;
+} zaes_sha1;
+
+typedef struct
+{
+    int rounds;
+    uint32_t rk[60];            /* round keys, as big endian words */
+    unsigned char rk_bytes[240];/* the same, as bytes for AES-NI */
+
+    ZPOS64_T counter;           /* counter of the next block of key stream */
+    unsigned char pad[16];      /* key stream of the last partial block */
+    unsigned pad_used;          /* bytes of pad already used, 16 if none */
+
+    zaes_sha1 hmac_inner;       /* HMAC of the encrypted data */
+    zaes_sha1 hmac_outer;       /* outer hash, with the key already in it */
+} zaes_ctx;
+
+static unsigned char zaes_sbox[256];
+static uint32_t zaes_te[4][256];
+static zthread_once_flag zaes_once = ZTHREAD_ONCE_INIT;
+#ifdef ZAES_HAVE_X86
+static int zaes_use_aesni = 0;
+static int zaes_use_shani = 0;
+#endif
+
+#define ZAES_ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define ZAES_GETU32(p) (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | \
+                        ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+#define ZAES_PUTU32(p, x) ((p)[0] = (unsigned char)((x) >> 24), (p)[1] = (unsigned char)((x) >> 16), \
+                           (p)[2] = (unsigned char)((x) >> 8), (p)[3] = (unsigned char)(x))
+
+static void zaes_init_tables(void) {
+    unsigned p = 1, q = 1;
+    int i;
+
+    /* the S-box is the inverse in GF(2^8) followed by an affine transform,
+       3 being a generator of the multiplicative group */
+    do
+    {
+        unsigned x;
+        p = (p ^ (p << 1) ^ ((p & 0x80) ? 0x1b : 0)) & 0xff;
+        q ^= q << 1;
+        q ^= q << 2;
+        q ^= q << 4;
+        q &= 0xff;
+        if (q & 0x80)
+            q ^= 0x09;
+        x = q ^ (q << 1) ^ (q << 2) ^ (q << 3) ^ (q << 4);
+        x = (x ^ (x >> 8)) & 0xff;
+        zaes_sbox[p] = (unsigned char)(x ^ 0x63);
+    } while (p != 1);
+    zaes_sbox[0] = 0x63;
+
+    for (i = 0; i < 256; i++)
+    {
+        uint32_t s = zaes_sbox[i];
+        uint32_t s2 = ((s << 1) ^ ((s & 0x80) ? 0x1b : 0)) & 0xff;
+        uint32_t t = (s2 << 24) | (s << 16) | (s << 8) | (s2 ^ s);
+        zaes_te[0][i] = t;
+        zaes_te[1][i] = ZAES_ROTL32(t, 24);
+        zaes_te[2][i] = ZAES_ROTL32(t, 16);
+        zaes_te[3][i] = ZAES_ROTL32(t, 8);
+    }
+
+#ifdef ZAES_HAVE_X86
+#  if defined(_MSC_VER) && !defined(__clang__)
+    {
+        int info[4];
+        int max_leaf;
+        __cpuid(info, 0);
+        max_leaf = info[0];
+        __cpuid(info, 1);
+        zaes_use_aesni = (info[2] & (1 << 25)) != 0;
+        if ((max_leaf >= 7) && ((info[2] & (1 << 19)) != 0)) /* SSE4.1 */
+        {
+            __cpuidex(info, 7, 0);
+            zaes_use_shani = (info[1] & (1 << 29)) != 0;
+        }
+    }
+#  else
+    {
+        unsigned a, b, c, d;
+        if (__get_cpuid(1, &a, &b, &c, &d))
+        {
+            zaes_use_aesni = (c & (1u << 25)) != 0;
+            if (((c & (1u << 19)) != 0) && __get_cpuid_count(7, 0, &a, &b, &c, &d))
+                zaes_use_shani = (b & (1u << 29)) != 0;
+        }
+    }
+#  endif
+#endif
+}
+
+/* ===========================================================================
+   SHA-1
+*/
+
+static void zaes_sha1_blocks_c(uint32_t* h, const unsigned char* p, size_t blocks) {
+    while (blocks-- > 0)
+    {
+        uint32_t w[16];
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], t;
+        int i;
+
+        for (i = 0; i < 16; i++)
+            w[i] = ZAES_GETU32(p + 4 * i);
+        for (i = 0; i < 80; i++)
+        {
+            if (i >= 16)
+            {
+                t = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15];
+                w[i & 15] = ZAES_ROTL32(t, 1);
+            }
+            if (i < 20)
+                t = ((b & c) | (~b & d)) + 0x5a827999;
+            else if (i < 40)
+                t = (b ^ c ^ d) + 0x6ed9eba1;
+            else if (i < 60)
+                t = ((b & c) | (b & d) | (c & d)) + 0x8f1bbcdc;
+            else
+                t = (b ^ c ^ d) + 0xca62c1d6;
+            t += ZAES_ROTL32(a, 5) + e + w[i & 15];
+            e = d;
+            d = c;
+            c = ZAES_ROTL32(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+        p += 64;
+    }
+}
+
+#ifdef ZAES_HAVE_X86
+/*
+  Four rounds g of SHA-1 with the SHA instructions: the message schedule of
+    the next rounds is computed while the rounds are done, as in Intel's
+    "Intel SHA Extensions" paper.
+*/
+#define ZAES_SHA1_ROUNDS4(g) \
+    if ((g) < 4) \
+        msg[(g)] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 16 * (g))), mask); \
+    if ((g) == 0) \
+        e[0] = _mm_add_epi32(e[0], msg[0]); \
+    else \
+        e[(g) & 1] = _mm_sha1nexte_epu32(e[(g) & 1], msg[(g) & 3]); \
+    e[((g) + 1) & 1] = abcd; \
+    if (((g) >= 3) && ((g) <= 18)) \
+        msg[((g) + 1) & 3] = _mm_sha1msg2_epu32(msg[((g) + 1) & 3], msg[(g) & 3]); \
+    abcd = _mm_sha1rnds4_epu32(abcd, e[(g) & 1], (g) / 5); \
+    if (((g) >= 1) && ((g) <= 16)) \
+        msg[((g) + 3) & 3] = _mm_sha1msg1_epu32(msg[((g) + 3) & 3], msg[(g) & 3]); \
+    if (((g) >= 2) && ((g) <= 17)) \
+        msg[((g) + 2) & 3] = _mm_xor_si128(msg[((g) + 2) & 3], msg[(g) & 3]);
+
+ZAES_TARGET_SHANI
+static void zaes_sha1_blocks_shani(uint32_t* h, const unsigned char* p, size_t blocks) {
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+    __m128i abcd, abcd_save, e0_save, e[2], msg[4];
+
+    abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)h), 0x1b);
+    e[0] = _mm_set_epi32((int)h[4], 0, 0, 0);
+
+    while (blocks-- > 0)
+    {
+        abcd_save = abcd;
+        e0_save = e[0];
+
+        ZAES_SHA1_ROUNDS4(0)  ZAES_SHA1_ROUNDS4(1)  ZAES_SHA1_ROUNDS4(2)  ZAES_SHA1_ROUNDS4(3)
+        ZAES_SHA1_ROUNDS4(4)  ZAES_SHA1_ROUNDS4(5)  ZAES_SHA1_ROUNDS4(6)  ZAES_SHA1_ROUNDS4(7)
+        ZAES_SHA1_ROUNDS4(8)  ZAES_SHA1_ROUNDS4(9)  ZAES_SHA1_ROUNDS4(10) ZAES_SHA1_ROUNDS4(11)
+        ZAES_SHA1_ROUNDS4(12) ZAES_SHA1_ROUNDS4(13) ZAES_SHA1_ROUNDS4(14) ZAES_SHA1_ROUNDS4(15)
+        ZAES_SHA1_ROUNDS4(16) ZAES_SHA1_ROUNDS4(17) ZAES_SHA1_ROUNDS4(18) ZAES_SHA1_ROUNDS4(19)
+
+        e[0] = _mm_sha1nexte_epu32(e[0], e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+        p += 64;
+    }
+
+    _mm_storeu_si128((__m128i*)h, _mm_shuffle_epi32(abcd, 0x1b));
+    h[4] = (uint32_t)_mm_extract_epi32(e[0], 3);
+}
+#endif
+
+static void zaes_sha1_blocks(uint32_t* h, const unsigned char* p, size_t blocks) {
+#ifdef ZAES_HAVE_X86
+    if (zaes_use_shani)
+    {
+        zaes_sha1_blocks_shani(h, p, blocks);
+        return;
+    }
+#endif
+    zaes_sha1_blocks_c(h, p, blocks);
+}
+
+static void zaes_sha1_init(zaes_sha1* ctx) {
+    ctx->h[0] = 0x67452301;
+    ctx->h[1] = 0xefcdab89;
+    ctx->h[2] = 0x98badcfe;
+    ctx->h[3] = 0x10325476;
+    ctx->h[4] = 0xc3d2e1f0;
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+static void zaes_sha1_update(zaes_sha1* ctx, const unsigned char* p, size_t len) {
+    ctx->length += len;
+    if (ctx->used > 0)
+    {
+        size_t copy = 64 - ctx->used;
+        if (len < copy)
+            copy = len;
+        memcpy(ctx->block + ctx->used, p, copy);
+        ctx->used += (unsigned)copy;
+        p += copy;
+        len -= copy;
+        if (ctx->used < 64)
+            return;
+        zaes_sha1_blocks(ctx->h, ctx->block, 1);
+        ctx->used = 0;
+    }
+    if (len >= 64)
+    {
+        zaes_sha1_blocks(ctx->h, p, len / 64);
+        p += len & ~(size_t)63;
+        len &= 63;
+    }
+    if (len > 0)
+    {
+        memcpy(ctx->block, p, len);
+        ctx->used = (unsigned)len;
+    }
+}
+
+static void zaes_sha1_final(zaes_sha1* ctx, unsigned char* digest) {
+    ZPOS64_T bits = ctx->length << 3;
+    int i;
+
+    ctx->block[ctx->used++] = 0x80;
+    if (ctx->used > 56)
+    {
+        memset(ctx->block + ctx->used, 0, 64 - ctx->used);
+        zaes_sha1_blocks(ctx->h, ctx->block, 1);
+        ctx->used = 0;
+    }
+    memset(ctx->block + ctx->used, 0, 56 - ctx->used);
+    for (i = 0; i < 8; i++)
+        ctx->block[63 - i] = (unsigned char)(bits >> (8 * i));
+    zaes_sha1_blocks(ctx->h, ctx->block, 1);
+    for (i = 0; i < 5; i++)
+        ZAES_PUTU32(digest + 4 * i, ctx->h[i]);
+}
+
+/*
+  Start an HMAC-SHA1 with the given key: inner and outer are the hashes
+    with the padded key already in them.
+*/
+static void zaes_hmac_init(zaes_sha1* inner, zaes_sha1* outer, const unsigned char* key, size_t key_len) {
+    unsigned char pad[64];
+    unsigned char digest[20];
+    size_t i;
+
+    if (key_len > 64)
+    {
+        zaes_sha1_init(inner);
+        zaes_sha1_update(inner, key, key_len);
+        zaes_sha1_final(inner, digest);
+        key = digest;
+        key_len = 20;
+    }
+    for (i = 0; i < 64; i++)
+        pad[i] = (unsigned char)(((i < key_len) ? key[i] : 0) ^ 0x36);
+    zaes_sha1_init(inner);
+    zaes_sha1_update(inner, pad, 64);
+    for (i = 0; i < 64; i++)
+        pad[i] ^= 0x36 ^ 0x5c;
+    zaes_sha1_init(outer);
+    zaes_sha1_update(outer, pad, 64);
+}
+
+static void zaes_hmac_final(zaes_sha1* inner, const zaes_sha1* outer, unsigned char* digest) {
+    zaes_sha1 ctx = *outer;
+    zaes_sha1_final(inner, digest);
+    zaes_sha1_update(&ctx, digest, 20);
+    zaes_sha1_final(&ctx, digest);
+}
+
+/*
+  PBKDF2 with HMAC-SHA1, as in RFC 2898
+*/
+static void zaes_pbkdf2(const char* password, const unsigned char* salt, unsigned salt_len,
+                        unsigned iterations, unsigned char* out, unsigned out_len) {
+    zaes_sha1 inner, outer, ctx;
+    unsigned char u[20], t[20], index[4];
+    unsigned block, i, j;
+
+    zaes_hmac_init(&inner, &outer, (const unsigned char*)password, strlen(password));
+    for (block = 1; out_len > 0; block++)
+    {
+        unsigned copy = (out_len < 20) ? out_len : 20;
+
+        ZAES_PUTU32(index, block);
+        ctx = inner;
+        zaes_sha1_update(&ctx, salt, salt_len);
+        zaes_sha1_update(&ctx, index, 4);
+        zaes_hmac_final(&ctx, &outer, u);
+        memcpy(t, u, 20);
+        for (i = 1; i < iterations; i++)
+        {
+            ctx = inner;
+            zaes_sha1_update(&ctx, u, 20);
+            zaes_hmac_final(&ctx, &outer, u);
+            for (j = 0; j < 20; j++)
+                t[j] ^= u[j];
+        }
+        memcpy(out, t, copy);
+        out += copy;
+        out_len -= copy;
+    }
+}
+
+/* ===========================================================================
+   AES in counter mode
+*/
+
+static void zaes_expand_key(zaes_ctx* ctx, const unsigned char* key, int key_len) {
+    static const uint32_t rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+    int nk = key_len / 4;
+    int total;
+    int i;
+
+    ctx->rounds = nk + 6;
+    total = 4 * (ctx->rounds + 1);
+    for (i = 0; i < nk; i++)
+        ctx->rk[i] = ZAES_GETU32(key + 4 * i);
+    for (i = nk; i < total; i++)
+    {
+        uint32_t t = ctx->rk[i - 1];
+        if (i % nk == 0)
+        {
+            t = ZAES_ROTL32(t, 8);
+            t = ((uint32_t)zaes_sbox[t >> 24] << 24) | ((uint32_t)zaes_sbox[(t >> 16) & 0xff] << 16) |
+                ((uint32_t)zaes_sbox[(t >> 8) & 0xff] << 8) | (uint32_t)zaes_sbox[t & 0xff];
+            t ^= rcon[i / nk - 1] << 24;
+        }
+        else if ((nk > 6) && (i % nk == 4))
+            t = ((uint32_t)zaes_sbox[t >> 24] << 24) | ((uint32_t)zaes_sbox[(t >> 16) & 0xff] << 16) |
+                ((uint32_t)zaes_sbox[(t >> 8) & 0xff] << 8) | (uint32_t)zaes_sbox[t & 0xff];
+        ctx->rk[i] = ctx->rk[i - nk] ^ t;
+    }
+    for (i = 0; i < total; i++)
+        ZAES_PUTU32(ctx->rk_bytes + 4 * i, ctx->rk[i]);
+}
+
+static void zaes_encrypt_block(const zaes_ctx* ctx, const unsigned char* in, unsigned char* out) {
+    const uint32_t* rk = ctx->rk;
+    uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+    int r;
+
+    s0 = ZAES_GETU32(in) ^ rk[0];
+    s1 = ZAES_GETU32(in + 4) ^ rk[1];
+    s2 = ZAES_GETU32(in + 8) ^ rk[2];
+    s3 = ZAES_GETU32(in + 12) ^ rk[3];
+    for (r = 1; r < ctx->rounds; r++)
+    {
+        rk += 4;
+        t0 = zaes_te[0][s0 >> 24] ^ zaes_te[1][(s1 >> 16) & 0xff] ^ zaes_te[2][(s2 >> 8) & 0xff] ^ zaes_te[3][s3 & 0xff] ^ rk[0];
+        t1 = zaes_te[0][s1 >> 24] ^ zaes_te[1][(s2 >> 16) & 0xff] ^ zaes_te[2][(s3 >> 8) & 0xff] ^ zaes_te[3][s0 & 0xff] ^ rk[1];
+        t2 = zaes_te[0][s2 >> 24] ^ zaes_te[1][(s3 >> 16) & 0xff] ^ zaes_te[2][(s0 >> 8) & 0xff] ^ zaes_te[3][s1 & 0xff] ^ rk[2];
+        t3 = zaes_te[0][s3 >> 24] ^ zaes_te[1][(s0 >> 16) & 0xff] ^ zaes_te[2][(s1 >> 8) & 0xff] ^ zaes_te[3][s2 & 0xff] ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+    rk += 4;
+#define ZAES_LAST(a, b, c, d, k) \
+    (((uint32_t)zaes_sbox[(a) >> 24] << 24) ^ ((uint32_t)zaes_sbox[((b) >> 16) & 0xff] << 16) ^ \
+     ((uint32_t)zaes_sbox[((c) >> 8) & 0xff] << 8) ^ (uint32_t)zaes_sbox[(d) & 0xff] ^ (k))
+    t0 = ZAES_LAST(s0, s1, s2, s3, rk[0]);
+    t1 = ZAES_LAST(s1, s2, s3, s0, rk[1]);
+    t2 = ZAES_LAST(s2, s3, s0, s1, rk[2]);
+    t3 = ZAES_LAST(s3, s0, s1, s2, rk[3]);
+#undef ZAES_LAST
+    ZAES_PUTU32(out, t0);
+    ZAES_PUTU32(out + 4, t1);
+    ZAES_PUTU32(out + 8, t2);
+    ZAES_PUTU32(out + 12, t3);
+}
+
+/* the counter block: a 128 bits little endian counter, starting at 1 */
+static void zaes_counter_block(ZPOS64_T counter, unsigned char* block) {
+    int i;
+    for (i = 0; i < 8; i++)
+        block[i] = (unsigned char)(counter >> (8 * i));
+    memset(block + 8, 0, 8);
+}
+
+static void zaes_ctr_blocks_c(zaes_ctx* ctx, unsigned char* buf, size_t blocks) {
+    unsigned char stream[16];
+    int i;
+
+    while (blocks-- > 0)
+    {
+        zaes_counter_block(ctx->counter++, stream);
+        zaes_encrypt_block(ctx, stream, stream);
+        for (i = 0; i < 16; i++)
+            buf[i] ^= stream[i];
+        buf += 16;
+    }
+}
+
+#ifdef ZAES_HAVE_X86
+/*
+  Counter mode with AES-NI, on 8 blocks at a time so that the aesenc of
+    different blocks overlap in the pipeline.
+*/
+ZAES_TARGET_AESNI
+static void zaes_ctr_blocks_aesni(zaes_ctx* ctx, unsigned char* buf, size_t blocks) {
+    __m128i rk[15];
+    __m128i b0, b1, b2, b3, b4, b5, b6, b7;
+    int rounds = ctx->rounds;
+    int r;
+
+    for (r = 0; r <= rounds; r++)
+        rk[r] = _mm_loadu_si128((const __m128i*)(ctx->rk_bytes + 16 * r));
+
+#define ZAES_COUNTER(i) _mm_xor_si128(_mm_set_epi64x(0, (long long)(ctx->counter + (i))), rk[0])
+#define ZAES_OUT(i, b) _mm_storeu_si128((__m128i*)(buf + 16 * (i)), \
+        _mm_xor_si128(_mm_aesenclast_si128((b), rk[rounds]), _mm_loadu_si128((const __m128i*)(buf + 16 * (i)))))
+    while (blocks >= 8)
+    {
+        b0 = ZAES_COUNTER(0);
+        b1 = ZAES_COUNTER(1);
+        b2 = ZAES_COUNTER(2);
+        b3 = ZAES_COUNTER(3);
+        b4 = ZAES_COUNTER(4);
+        b5 = ZAES_COUNTER(5);
+        b6 = ZAES_COUNTER(6);
+        b7 = ZAES_COUNTER(7);
+        for (r = 1; r < rounds; r++)
+        {
+            __m128i k = rk[r];
+            b0 = _mm_aesenc_si128(b0, k);
+            b1 = _mm_aesenc_si128(b1, k);
+            b2 = _mm_aesenc_si128(b2, k);
+            b3 = _mm_aesenc_si128(b3, k);
+            b4 = _mm_aesenc_si128(b4, k);
+            b5 = _mm_aesenc_si128(b5, k);
+            b6 = _mm_aesenc_si128(b6, k);
+            b7 = _mm_aesenc_si128(b7, k);
+        }
+        ZAES_OUT(0, b0);
+        ZAES_OUT(1, b1);
+        ZAES_OUT(2, b2);
+        ZAES_OUT(3, b3);
+        ZAES_OUT(4, b4);
+        ZAES_OUT(5, b5);
+        ZAES_OUT(6, b6);
+        ZAES_OUT(7, b7);
+        ctx->counter += 8;
+        buf += 128;
+        blocks -= 8;
+    }
+    while (blocks-- > 0)
+    {
+        b0 = ZAES_COUNTER(0);
+        for (r = 1; r < rounds; r++)
+            b0 = _mm_aesenc_si128(b0, rk[r]);
+        ZAES_OUT(0, b0);
+        ctx->counter++;
+        buf += 16;
+    }
+#undef ZAES_COUNTER
+#undef ZAES_OUT
+}
+#endif
+
+static void zaes_ctr(zaes_ctx* ctx, unsigned char* buf, size_t len) {
+    size_t blocks;
+
+    while ((len > 0) && (ctx->pad_used < 16))
+    {
+        *buf++ ^= ctx->pad[ctx->pad_used++];
+        len--;
+    }
+    blocks = len / 16;
+    if (blocks > 0)
+    {
+#ifdef ZAES_HAVE_X86
+        if (zaes_use_aesni)
+            zaes_ctr_blocks_aesni(ctx, buf, blocks);
+        else
+#endif
+            zaes_ctr_blocks_c(ctx, buf, blocks);
+        buf += blocks * 16;
+        len -= blocks * 16;
+    }
+    if (len > 0)
+    {
+        zaes_counter_block(ctx->counter++, ctx->pad);
+        zaes_encrypt_block(ctx, ctx->pad, ctx->pad);
+        ctx->pad_used = 0;
+        while (len-- > 0)
+            *buf++ ^= ctx->pad[ctx->pad_used++];
+    }
+}
+
+/* ===========================================================================
+   WinZip AES
+*/
+
+#ifdef INCLUDECRYPTINGCODE_IFCRYPTALLOWED
+
+/*
+  Fill buf with len random bytes, for the salt.
+  Return 0 if the random generator of the system can't be used.
+*/
+static int zaes_random(unsigned char* buf, unsigned len) {
+#ifdef _WIN32
+    HCRYPTPROV provider;
+    int ok = 0;
+    if (CryptAcquireContext(&provider, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT | CRYPT_SILENT))
+    {
+        ok = CryptGenRandom(provider, (DWORD)len, buf) ? 1 : 0;
+        CryptReleaseContext(provider, 0);
+    }
+    return ok;
+#else
+    FILE* f = fopen("/dev/urandom", "rb");
+    int ok;
+    if (f == NULL)
+        return 0;
+    ok = (fread(buf, 1, len, f) == len);
+    fclose(f);
+    return ok;
+#endif
+}
+
+#endif
+
+/*
+  Derive the keys of a file from the password and the salt, and give the
+    password verification value in pwverify.
+  strength is 1, 2 or 3, the salt is ZAES_SALT_LEN(strength) bytes long.
+*/
+static void zaes_init(zaes_ctx* ctx, int strength, const char* password,
+                      const unsigned char* salt, unsigned char* pwverify) {
+    unsigned char keys[2 * 32 + ZAES_PWVERIFY_LEN];
+    int key_len = ZAES_KEY_LEN(strength);
+
+    zthread_once(&zaes_once, zaes_init_tables);
+
+    zaes_pbkdf2(password, salt, (unsigned)ZAES_SALT_LEN(strength), ZAES_ITERATIONS,
+                keys, (unsigned)(2 * key_len + ZAES_PWVERIFY_LEN));
+    zaes_expand_key(ctx, keys, key_len);
+    zaes_hmac_init(&ctx->hmac_inner, &ctx->hmac_outer, keys + key_len, (size_t)key_len);
+    memcpy(pwverify, keys + 2 * key_len, ZAES_PWVERIFY_LEN);
+    memset(keys, 0, sizeof(keys));
+
+    ctx->counter = 1;
+    ctx->pad_used = 16;
+}
+
+#ifdef INCLUDECRYPTINGCODE_IFCRYPTALLOWED
+
+/* Encrypt len bytes of buf in place, and authenticate them */
+static void zaes_encrypt(zaes_ctx* ctx, unsigned char* buf, size_t len) {
+    while (len > 0)
+    {
+        size_t chunk = (len < ZAES_CHUNK) ? len : ZAES_CHUNK;
+        zaes_ctr(ctx, buf, chunk);
+        zaes_sha1_update(&ctx->hmac_inner, buf, chunk);
+        buf += chunk;
+        len -= chunk;
+    }
+}
+
+#else
+
+/* Authenticate len bytes of buf, and decrypt them in place */
+static void zaes_decrypt(zaes_ctx* ctx, unsigned char* buf, size_t len) {
+    while (len > 0)
+    {
+        size_t chunk = (len < ZAES_CHUNK) ? len : ZAES_CHUNK;
+        zaes_sha1_update(&ctx->hmac_inner, buf, chunk);
+        zaes_ctr(ctx, buf, chunk);
+        buf += chunk;
+        len -= chunk;
+    }
+}
+
+#endif
+
+/* The authentication code of all the encrypted data, to write or check after it */
+static void zaes_authcode(zaes_ctx* ctx, unsigned char* code) {
+    unsigned char digest[20];
+    zaes_hmac_final(&ctx->hmac_inner, &ctx->hmac_outer, digest);
+    memcpy(code, digest, ZAES_AUTHCODE_LEN);
+}
+
+#endif
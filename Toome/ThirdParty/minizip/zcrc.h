@@ -0,0 +1,266 @@
+/* zcrc.h -- CRC-32 of the zip data for minizip
+
+   This file is included in zip.c and unzip.c, after zthread.h. It computes
+   the same CRC-32 as zlib's crc32(), with the carry-less multiply
+   instruction (PCLMULQDQ) on x86-64 when the processor has it, and with
+   slicing-by-16 tables otherwise. zcrc32_copy also copies the data while
+   computing its CRC, so that stored data is only read once.
+
+   The folding constants and the Barrett reduction come from Intel's paper
+   "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+   Instruction", for the bit-reflected CRC-32 polynomial used by zip.
+
+   If you don't want the carry-less multiply code, define the symbol
+   NOZCRC_CLMUL: only the tables are used then.
+*/
+
+#ifndef _ZCRC_H
+#define _ZCRC_H
+
+#include <stddef.h>
+
+#if !defined(NOZCRC_CLMUL) && (defined(__x86_64__) || defined(_M_X64)) && \
+    (defined(__GNUC__) || defined(_MSC_VER))
+#  define ZCRC_HAVE_CLMUL
+#  if defined(_MSC_VER) && !defined(__clang__)
+#    include <intrin.h>
+#    define ZCRC_TARGET_CLMUL
+#  else
+#    include <immintrin.h>
+#    define ZCRC_TARGET_CLMUL __attribute__((target("sse2,pclmul")))
+#  endif
+#endif
+
+/* the carry-less multiply code is only used for buffers at least that long */
+#define ZCRC_CLMUL_MINIMUM (64)
+
+static z_crc_t zcrc_table[16][256];
+static zthread_once_flag zcrc_once = ZTHREAD_ONCE_INIT;
+#ifdef ZCRC_HAVE_CLMUL
+static int zcrc_use_clmul = 0;
+#endif
+
+static void zcrc_init(void) {
+    z_crc_t c;
+    int n, k;
+
+    for (n = 0; n < 256; n++)
+    {
+        c = (z_crc_t)n;
+        for (k = 0; k < 8; k++)
+            c = (c & 1) ? (c >> 1) ^ 0xedb88320 : (c >> 1);
+        zcrc_table[0][n] = c;
+    }
+    for (n = 0; n < 256; n++)
+        for (k = 1; k < 16; k++)
+            zcrc_table[k][n] = (zcrc_table[k - 1][n] >> 8) ^ zcrc_table[0][zcrc_table[k - 1][n] & 0xff];
+
+#ifdef ZCRC_HAVE_CLMUL
+#  if defined(_MSC_VER) && !defined(__clang__)
+    {
+        int info[4];
+        __cpuid(info, 1);
+        zcrc_use_clmul = (info[2] & 0x2) != 0;
+    }
+#  else
+    __builtin_cpu_init();
+    zcrc_use_clmul = __builtin_cpu_supports("pclmul");
+#  endif
+#endif
+}
+
+/*
+  Slicing-by-16 on the inverted crc c, copying the data to dst if it is
+    not NULL. The bytes are combined one by one, so that this does not
+    depend on the endianness of the machine.
+*/
+static z_crc_t zcrc32_tables(z_crc_t c, unsigned char* dst, const unsigned char* p, size_t len) {
+    while (len >= 16)
+    {
+        c ^= (z_crc_t)p[0] | ((z_crc_t)p[1] << 8) | ((z_crc_t)p[2] << 16) | ((z_crc_t)p[3] << 24);
+        c = zcrc_table[15][c & 0xff] ^ zcrc_table[14][(c >> 8) & 0xff] ^
+            zcrc_table[13][(c >> 16) & 0xff] ^ zcrc_table[12][c >> 24] ^
+            zcrc_table[11][p[4]] ^ zcrc_table[10][p[5]] ^ zcrc_table[9][p[6]] ^ zcrc_table[8][p[7]] ^
+            zcrc_table[7][p[8]] ^ zcrc_table[6][p[9]] ^ zcrc_table[5][p[10]] ^ zcrc_table[4][p[11]] ^
+            zcrc_table[3][p[12]] ^ zcrc_table[2][p[13]] ^ zcrc_table[1][p[14]] ^ zcrc_table[0][p[15]];
+        if (dst != NULL)
+        {
+            memcpy(dst, p, 16);
+            dst += 16;
+        }
+        p += 16;
+        len -= 16;
+    }
+    while (len > 0)
+    {
+        c = zcrc_table[0][(c ^ *p) & 0xff] ^ (c >> 8);
+        if (dst != NULL)
+            *dst++ = *p;
+        p++;
+        len--;
+    }
+    return c;
+}
+
+#ifdef ZCRC_HAVE_CLMUL
+/*
+  Carry-less multiply on the inverted crc c, for len a multiple of 16 and at
+    least ZCRC_CLMUL_MINIMUM. Four 128 bits lanes are folded forward by 64
+    bytes, then folded together, then reduced to 32 bits. The data is copied
+    to dst if it is not NULL, from the registers it is loaded in.
+*/
+ZCRC_TARGET_CLMUL
+static z_crc_t zcrc32_clmul(z_crc_t c, unsigned char* dst, const unsigned char* p, size_t len) {
+    static const ZPOS64_T k1k2[2] = { 0x0154442bd4, 0x01c6e41596 };
+    static const ZPOS64_T k3k4[2] = { 0x01751997d0, 0x00ccaa009e };
+    static const ZPOS64_T k5k0[2] = { 0x0163cd6124, 0x0000000000 };
+    static const ZPOS64_T poly[2] = { 0x01db710641, 0x01f7011641 };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(p + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(p + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(p + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(p + 0x30));
+    if (dst != NULL)
+    {
+        _mm_storeu_si128((__m128i*)(dst + 0x00), x1);
+        _mm_storeu_si128((__m128i*)(dst + 0x10), x2);
+        _mm_storeu_si128((__m128i*)(dst + 0x20), x3);
+        _mm_storeu_si128((__m128i*)(dst + 0x30), x4);
+        dst += 64;
+    }
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)c));
+    x0 = _mm_loadu_si128((const __m128i*)k1k2);
+    p += 64;
+    len -= 64;
+
+    /* fold 64 bytes at a time */
+    while (len >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128((const __m128i*)(p + 0x00));
+        y6 = _mm_loadu_si128((const __m128i*)(p + 0x10));
+        y7 = _mm_loadu_si128((const __m128i*)(p + 0x20));
+        y8 = _mm_loadu_si128((const __m128i*)(p + 0x30));
+        if (dst != NULL)
+        {
+            _mm_storeu_si128((__m128i*)(dst + 0x00), y5);
+            _mm_storeu_si128((__m128i*)(dst + 0x10), y6);
+            _mm_storeu_si128((__m128i*)(dst + 0x20), y7);
+            _mm_storeu_si128((__m128i*)(dst + 0x30), y8);
+            dst += 64;
+        }
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        p += 64;
+        len -= 64;
+    }
+
+    /* fold the four lanes into one */
+    x0 = _mm_loadu_si128((const __m128i*)k3k4);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* fold the rest 16 bytes at a time */
+    while (len >= 16)
+    {
+        x2 = _mm_loadu_si128((const __m128i*)p);
+        if (dst != NULL)
+        {
+            _mm_storeu_si128((__m128i*)dst, x2);
+            dst += 16;
+        }
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        p += 16;
+        len -= 16;
+    }
+
+    /* 128 bits to 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_loadu_si128((const __m128i*)poly);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (z_crc_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+#endif
+
+static uLong zcrc32_any(uLong crc, unsigned char* dst, const unsigned char* p, size_t len) {
+    z_crc_t c = (z_crc_t)crc ^ 0xffffffff;
+
+    zthread_once(&zcrc_once, zcrc_init);
+#ifdef ZCRC_HAVE_CLMUL
+    if (zcrc_use_clmul && (len >= ZCRC_CLMUL_MINIMUM))
+    {
+        size_t len_clmul = len & ~(size_t)15;
+        c = zcrc32_clmul(c, dst, p, len_clmul);
+        p += len_clmul;
+        if (dst != NULL)
+            dst += len_clmul;
+        len -= len_clmul;
+    }
+#endif
+    c = zcrc32_tables(c, dst, p, len);
+    return (uLong)(c ^ 0xffffffff);
+}
+
+/*
+  Update the running crc with len bytes of buf, like zlib's crc32(),
+    without the 4 GB limit on len.
+*/
+static uLong zcrc32(uLong crc, const void* buf, size_t len) {
+    return zcrc32_any(crc, NULL, (const unsigned char*)buf, len);
+}
+
+/*
+  Copy len bytes from src to dst, which must not overlap, and return the
+    running crc updated with these bytes.
+*/
+static uLong zcrc32_copy(uLong crc, void* dst, const void* src, size_t len) {
+    return zcrc32_any(crc, (unsigned char*)dst, (const unsigned char*)src, len);
+}
+
+#endif
@@ -53,6 +53,12 @@
 #define Z_BUFSIZE (64*1024) //(16384)
 #endif
 
+#ifndef Z_PARALLEL_BLOCKSIZE
+#define Z_PARALLEL_BLOCKSIZE (128*1024)
+#endif
+
+#define Z_PARALLEL_DICTSIZE (32*1024)
+
 #ifndef Z_MAXFILENAMEINZIP
 #define Z_MAXFILENAMEINZIP (256)
 #endif
@@ -63,8 +69,8 @@
 
 /*
 #define SIZECENTRALDIRITEM (0x2e)
-#define SIZEZIPLOCALHEADER (0x1e)
 */
+#define SIZEZIPLOCALHEADER (0x1e)
 
 /* I've found an old Unix (a SunOS 4.1.3_U1) without all SEEK_* defined.... */
 
@@ -94,33 +100,104 @@
 const char zip_copyright[] =" zip 1.01 Copyright 1998-2004 Gilles Vollant - http://www.winimage.com/zLibDll";
 
 
-#define SIZEDATA_INDATABLOCK (4096-(4*4))
+#define SIZEDATA_INDATABLOCK (0x10000) /* initial size of the central directory buffer */
+#define SIZEDATA_WRITEBLOCK (0x40000000) /* largest single read or write of that buffer */
 
 #define LOCALHEADERMAGIC    (0x04034b50)
 #define CENTRALHEADERMAGIC  (0x02014b50)
 #define ENDHEADERMAGIC      (0x06054b50)
 #define ZIP64ENDHEADERMAGIC      (0x6064b50)
 #define ZIP64ENDLOCHEADERMAGIC   (0x7064b50)
+#define DATADESCRIPTORMAGIC (0x08074b50)
 
 #define FLAG_LOCALHEADER_OFFSET (0x06)
 #define CRC_LOCALHEADER_OFFSET  (0x0e)
 
 #define SIZECENTRALHEADER (0x2e) /* 46 */
 
-typedef struct linkedlist_datablock_internal_s
+#ifndef NOCRYPT
+#define INCLUDECRYPTINGCODE_IFCRYPTALLOWED
+#include "crypt.h"
+#endif
+
+#include "zthread.h"
+
+#ifdef NOCRYPT
+#  ifndef NOAES
+#    define NOAES
+#  endif
+#endif
+#ifndef NOAES
+#include "zaes.h"
+#endif
+
+typedef struct datablock_s
 {
-  struct linkedlist_datablock_internal_s* next_datablock;
-  uLong  avail_in_this_block;
-  uLong  filled_in_this_block;
-  uLong  unused; /* for future use and alignment */
-  unsigned char data[SIZEDATA_INDATABLOCK];
-} linkedlist_datablock_internal;
-
-typedef struct linkedlist_data_s
+    unsigned char* data;  /* contiguous buffer, grown geometrically */
+    ZPOS64_T filled;      /* number of bytes used in data */
+    ZPOS64_T allocated;   /* size of data */
+} datablock;
+
+
+/* one pass deflate of the members in memory, by libdeflate when it is linked;
+   a libdeflate compressor has a fixed level, so it is made again when the
+   level changes */
+typedef struct
 {
-    linkedlist_datablock_internal* first_block;
-    linkedlist_datablock_internal* last_block;
-} linkedlist_data;
+#ifdef HAVE_LIBDEFLATE
+    struct libdeflate_compressor* compressor;
+#else
+    z_stream stream;
+#endif
+    int  initialised;
+    int  level;
+} zip64_member_deflater;
+
+local int zip64local_MemberDeflaterInit(zip64_member_deflater* deflater, int level) {
+    if (deflater->initialised && (deflater->level == level))
+        return ZIP_OK;
+#ifdef HAVE_LIBDEFLATE
+    if (deflater->initialised)
+        libdeflate_free_compressor(deflater->compressor);
+    deflater->initialised = 0;
+    deflater->compressor = libdeflate_alloc_compressor((level == Z_DEFAULT_COMPRESSION) ? 6 : level);
+    if (deflater->compressor == NULL)
+        return ZIP_INTERNALERROR;
+#else
+    if (deflater->initialised)
+    {
+        /* the deflate state changes level without being made again */
+        if ((deflateReset(&deflater->stream) == Z_OK) &&
+            (deflateParams(&deflater->stream, level, Z_DEFAULT_STRATEGY) == Z_OK))
+        {
+            deflater->level = level;
+            return ZIP_OK;
+        }
+        deflateEnd(&deflater->stream);
+    }
+    deflater->initialised = 0;
+    deflater->stream.zalloc = (alloc_func)0;
+    deflater->stream.zfree = (free_func)0;
+    deflater->stream.opaque = (voidpf)0;
+    if (deflateInit2(&deflater->stream, level, Z_DEFLATED, -MAX_WBITS,
+                     DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+        return ZIP_INTERNALERROR;
+#endif
+    deflater->initialised = 1;
+    deflater->level = level;
+    return ZIP_OK;
+}
+
+local void zip64local_MemberDeflaterEnd(zip64_member_deflater* deflater) {
+    if (!deflater->initialised)
+        return;
+#ifdef HAVE_LIBDEFLATE
+    libdeflate_free_compressor(deflater->compressor);
+#else
+    deflateEnd(&deflater->stream);
+#endif
+    deflater->initialised = 0;
+}
 
 
 typedef struct
@@ -131,11 +208,15 @@ typedef struct
 #endif
 
     int  stream_initialised;    /* 1 is stream is initialised */
+    int  deflate_initialised;   /* 1 if stream has a deflate state, kept from
+                                   file to file and ended by zipClose */
     uInt pos_in_buffered_data;  /* last written byte in buffered_data */
 
     ZPOS64_T pos_local_header;     /* offset of the local header of the file
                                      currently writing */
     char* central_header;       /* central header data for the current file */
+    datablock local_header;     /* local header of the current file, kept to
+                                   update crc and sizes when closing it */
     uLong size_centralExtra;
     uLong size_centralheader;   /* size of the central header for cur file */
     uLong size_centralExtraFree; /* Extra bytes allocated to the centralheader but that are not used */
@@ -155,6 +236,31 @@ typedef struct
     unsigned long keys[3];     /* keys defining the pseudo-random sequence */
     const z_crc_t* pcrc_32_tab;
     unsigned crypt_header_size;
+#endif
+    int  aes;                   /* WinZip AES strength of the file, 0 if not */
+#ifndef NOAES
+    zaes_ctx aes_ctx;
+#endif
+
+    int  parallel;              /* 1 if deflating by independent blocks on threads */
+    int  threads;
+    int  level;                 /* parameters of the deflate state */
+    int  windowBits;
+    int  memLevel;
+    int  strategy;
+    unsigned char* pz_in;       /* dictionary followed by the input of the next blocks */
+    uLong pz_dict;              /* size of the dictionary at the beginning of pz_in */
+    uLong pz_in_size;           /* size of the input after the dictionary */
+    unsigned char* pz_out;      /* compressed output of each block */
+    uLong pz_out_block;         /* room for each block in pz_out */
+
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx* zstream;         /* zstd context, kept from file to file and
+                                   freed by zipClose */
+#endif
+#ifdef HAVE_LZMA
+    lzma_stream lstream;        /* liblzma stream for LZMA and XZ, kept from
+                                   file to file and ended by zipClose */
 #endif
 } curfile64_info;
 
@@ -162,7 +268,7 @@ typedef struct
 {
     zlib_filefunc64_32_def z_filefunc;
     voidpf filestream;        /* io structure of the zipfile */
-    linkedlist_data central_dir;/* datablock with central dir in construction*/
+    datablock central_dir;/* datablock with central dir in construction*/
     int  in_opened_file_inzip;  /* 1 if a file in the zip is currently writ.*/
     curfile64_info ci;            /* info on the file currently writing */
 
@@ -170,6 +276,20 @@ typedef struct
     ZPOS64_T add_position_when_writing_offset;
     ZPOS64_T number_entry;
 
+    int  streaming;             /* 1 if opened with APPEND_STATUS_STREAM: no seek, no read */
+    ZPOS64_T pos_in_zip;        /* bytes written since the opening, the position when streaming */
+
+    int  parallel_threads;      /* threads for parallel deflate, 1 if disabled */
+    uLong parallel_block_size;  /* input size of each block of the parallel deflate */
+    int  zstd_workers;          /* threads of zstd for the Z_ZSTD files, 1 if disabled */
+    int  aes_strength;          /* WinZip AES strength of the next encrypted files,
+                                   0 for the traditional PKWARE encryption */
+    int  truncate_at_close;     /* 1 if files were deleted, the zipfile may end
+                                   before its old end */
+    zip64_member_deflater* member_deflaters; /* ZTHREAD_MAX deflaters of the members
+                                   added from buffers, one by thread, allocated
+                                   by the first of them and freed by zipClose */
+
 #ifndef NO_ADDFILEINEXISTINGZIP
     char *globalcomment;
 #endif
@@ -177,125 +297,61 @@ typedef struct
 } zip64_internal;
 
 
-#ifndef NOCRYPT
-#define INCLUDECRYPTINGCODE_IFCRYPTALLOWED
-#include "crypt.h"
-#endif
-
-local linkedlist_datablock_internal* allocate_new_datablock(void) {
-    linkedlist_datablock_internal* ldi;
-    ldi = (linkedlist_datablock_internal*)
-                 ALLOC(sizeof(linkedlist_datablock_internal));
-    if (ldi!=NULL)
-    {
-        ldi->next_datablock = NULL ;
-        ldi->filled_in_this_block = 0 ;
-        ldi->avail_in_this_block = SIZEDATA_INDATABLOCK ;
-    }
-    return ldi;
-}
-
-local void free_datablock(linkedlist_datablock_internal* ldi) {
-    while (ldi!=NULL)
-    {
-        linkedlist_datablock_internal* ldinext = ldi->next_datablock;
-        free(ldi);
-        ldi = ldinext;
-    }
-}
+#include "zcrc.h"
 
-local void init_linkedlist(linkedlist_data* ll) {
-    ll->first_block = ll->last_block = NULL;
+local void init_datablock(datablock* db) {
+    db->data = NULL;
+    db->filled = db->allocated = 0;
 }
 
-local void free_linkedlist(linkedlist_data* ll) {
-    free_datablock(ll->first_block);
-    ll->first_block = ll->last_block = NULL;
+local void free_datablock(datablock* db) {
+    free(db->data);
+    init_datablock(db);
 }
 
+/* make room for len more bytes, doubling the buffer so appending is amortized O(1) */
+local int grow_datablock(datablock* db, ZPOS64_T len) {
+    ZPOS64_T needed = db->filled + len;
+    ZPOS64_T allocated = db->allocated;
+    unsigned char* data;
 
-local int add_data_in_datablock(linkedlist_data* ll, const void* buf, uLong len) {
-    linkedlist_datablock_internal* ldi;
-    const unsigned char* from_copy;
-
-    if (ll==NULL)
+    if (needed <= allocated)
+        return ZIP_OK;
+    if (allocated < SIZEDATA_INDATABLOCK)
+        allocated = SIZEDATA_INDATABLOCK;
+    while (allocated < needed)
+        allocated *= 2;
+    if ((size_t)allocated != allocated)
         return ZIP_INTERNALERROR;
 
-    if (ll->last_block == NULL)
-    {
-        ll->first_block = ll->last_block = allocate_new_datablock();
-        if (ll->first_block == NULL)
-            return ZIP_INTERNALERROR;
-    }
-
-    ldi = ll->last_block;
-    from_copy = (const unsigned char*)buf;
-
-    while (len>0)
-    {
-        uInt copy_this;
-        uInt i;
-        unsigned char* to_copy;
-
-        if (ldi->avail_in_this_block==0)
-        {
-            ldi->next_datablock = allocate_new_datablock();
-            if (ldi->next_datablock == NULL)
-                return ZIP_INTERNALERROR;
-            ldi = ldi->next_datablock ;
-            ll->last_block = ldi;
-        }
-
-        if (ldi->avail_in_this_block < len)
-            copy_this = (uInt)ldi->avail_in_this_block;
-        else
-            copy_this = (uInt)len;
+    data = (unsigned char*)realloc(db->data, (size_t)allocated);
+    if (data == NULL)
+        return ZIP_INTERNALERROR;
+    db->data = data;
+    db->allocated = allocated;
+    return ZIP_OK;
+}
 
-        to_copy = &(ldi->data[ldi->filled_in_this_block]);
+local int add_data_in_datablock(datablock* db, const void* buf, uLong len) {
+    if (db==NULL)
+        return ZIP_INTERNALERROR;
 
-        for (i=0;i<copy_this;i++)
-            *(to_copy+i)=*(from_copy+i);
+    if (grow_datablock(db, len) != ZIP_OK)
+        return ZIP_INTERNALERROR;
 
-        ldi->filled_in_this_block += copy_this;
-        ldi->avail_in_this_block -= copy_this;
-        from_copy += copy_this ;
-        len -= copy_this;
-    }
+    memcpy(db->data + db->filled, buf, len);
+    db->filled += len;
     return ZIP_OK;
 }
 
-
-
 /****************************************************************************/
 
 #ifndef NO_ADDFILEINEXISTINGZIP
 /* ===========================================================================
-   Inputs a long in LSB order to the given file
+   Inputs a long in LSB order to the given buffer
    nbByte == 1, 2 ,4 or 8 (byte, short or long, ZPOS64_T)
 */
 
-local int zip64local_putValue(const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream, ZPOS64_T x, int nbByte) {
-    unsigned char buf[8];
-    int n;
-    for (n = 0; n < nbByte; n++)
-    {
-        buf[n] = (unsigned char)(x & 0xff);
-        x >>= 8;
-    }
-    if (x != 0)
-      {     /* data overflow - hack for ZIP64 (X Roche) */
-      for (n = 0; n < nbByte; n++)
-        {
-          buf[n] = 0xff;
-        }
-      }
-
-    if (ZWRITE64(*pzlib_filefunc_def,filestream,buf,(uLong)nbByte)!=(uLong)nbByte)
-        return ZIP_ERRNO;
-    else
-        return ZIP_OK;
-}
-
 local void zip64local_putValue_inmemory (void* dest, ZPOS64_T x, int nbByte) {
     unsigned char* buf=(unsigned char*)dest;
     int n;
@@ -330,519 +386,253 @@ local uLong zip64local_TmzDateToDosDate(const tm_zip* ptm) {
 
 /****************************************************************************/
 
-local int zip64local_getByte(const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream, int* pi) {
-    unsigned char c;
-    int err = (int)ZREAD64(*pzlib_filefunc_def,filestream,&c,1);
-    if (err==1)
-    {
-        *pi = (int)c;
-        return ZIP_OK;
-    }
-    else
-    {
-        if (ZERROR64(*pzlib_filefunc_def,filestream))
-            return ZIP_ERRNO;
-        else
-            return ZIP_EOF;
-    }
+local uLong zip64local_readShort(const unsigned char* p) {
+    return p[0] | ((uLong)p[1] << 8);
 }
 
-
-/* ===========================================================================
-   Reads a long in LSB order from the given gz_stream. Sets
-*/
-local int zip64local_getShort(const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream, uLong* pX) {
-    uLong x ;
-    int i = 0;
-    int err;
-
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x = (uLong)i;
-
-    if (err==ZIP_OK)
-        err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x += ((uLong)i)<<8;
-
-    if (err==ZIP_OK)
-        *pX = x;
-    else
-        *pX = 0;
-    return err;
+local uLong zip64local_readLong(const unsigned char* p) {
+    return p[0] | ((uLong)p[1] << 8) | ((uLong)p[2] << 16) | ((uLong)p[3] << 24);
 }
 
-local int zip64local_getLong(const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream, uLong* pX) {
-    uLong x ;
-    int i = 0;
-    int err;
-
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x = (uLong)i;
-
-    if (err==ZIP_OK)
-        err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x += ((uLong)i)<<8;
-
-    if (err==ZIP_OK)
-        err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x += ((uLong)i)<<16;
-
-    if (err==ZIP_OK)
-        err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-    x += ((uLong)i)<<24;
-
-    if (err==ZIP_OK)
-        *pX = x;
-    else
-        *pX = 0;
-    return err;
+local ZPOS64_T zip64local_readLong64(const unsigned char* p) {
+    return zip64local_readLong(p) | ((ZPOS64_T)zip64local_readLong(p+4) << 32);
 }
 
+#define SIZEENDOFCENTRALDIR (22)        /* end of central directory record, without the comment */
+#define SIZEZIP64ENDLOCATOR (20)        /* zip64 end of central directory locator */
+#define SIZEZIP64ENDOFCENTRALDIR (56)   /* zip64 end of central directory record */
 
-local int zip64local_getLong64(const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream, ZPOS64_T *pX) {
-  ZPOS64_T x;
-  int i = 0;
-  int err;
-
-  err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x = (ZPOS64_T)i;
-
-  if (err==ZIP_OK)
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x += ((ZPOS64_T)i)<<8;
-
-  if (err==ZIP_OK)
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x += ((ZPOS64_T)i)<<16;
-
-  if (err==ZIP_OK)
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x += ((ZPOS64_T)i)<<24;
-
-  if (err==ZIP_OK)
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x += ((ZPOS64_T)i)<<32;
-
-  if (err==ZIP_OK)
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x += ((ZPOS64_T)i)<<40;
-
-  if (err==ZIP_OK)
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x += ((ZPOS64_T)i)<<48;
-
-  if (err==ZIP_OK)
-    err = zip64local_getByte(pzlib_filefunc_def,filestream,&i);
-  x += ((ZPOS64_T)i)<<56;
-
-  if (err==ZIP_OK)
-    *pX = x;
-  else
-    *pX = 0;
-
-  return err;
-}
-
-#ifndef BUFREADCOMMENT
-#define BUFREADCOMMENT (0x400)
-#endif
 /*
-  Locate the Central directory of a zipfile (at the end, just before
-    the global comment)
+  Read the end of the zipfile (the end of central directory record, the
+    global comment and the zip64 end of central directory locator before
+    them) with one I/O, and the zip64 end of central directory record with
+    another one, then the old central directory straight into the buffer the
+    new one is built in, with room for the new files and the end records.
 */
-local ZPOS64_T zip64local_SearchCentralDir(const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream) {
-  unsigned char* buf;
-  ZPOS64_T uSizeFile;
-  ZPOS64_T uBackRead;
-  ZPOS64_T uMaxBack=0xffff; /* maximum size of global comment */
-  ZPOS64_T uPosFound=0;
-
-  if (ZSEEK64(*pzlib_filefunc_def,filestream,0,ZLIB_FILEFUNC_SEEK_END) != 0)
-    return 0;
-
-
-  uSizeFile = ZTELL64(*pzlib_filefunc_def,filestream);
-
-  if (uMaxBack>uSizeFile)
-    uMaxBack = uSizeFile;
-
-  buf = (unsigned char*)ALLOC(BUFREADCOMMENT+4);
-  if (buf==NULL)
-    return 0;
+local int LoadCentralDirectoryRecord(zip64_internal* pziinit) {
+  int err=ZIP_OK;
+  ZPOS64_T byte_before_the_zipfile;/* byte before the zipfile, (>0 for sfx)*/
 
-  uBackRead = 4;
-  while (uBackRead<uMaxBack)
+  ZPOS64_T size_central_dir = 0;     /* size of the central directory  */
+  ZPOS64_T offset_central_dir = 0;   /* offset of start of central directory */
+  ZPOS64_T central_pos = 0;
+
+  uLong number_disk = 0;          /* number of the current disk, used for
+                                  spanning ZIP, unsupported, always 0*/
+  uLong number_disk_with_CD = 0;  /* number of the disk with central dir, used
+                                  for spanning ZIP, unsupported, always 0*/
+  ZPOS64_T number_entry = 0;
+  ZPOS64_T number_entry_CD = 0;      /* total number of entries in
+                                    the central dir
+                                    (same than number_entry on nospan) */
+  uLong size_comment = 0;
+
+  unsigned char* buf = NULL;
+  uLong size_buf = 0;
+  uLong i = 0;
+  ZPOS64_T size_file = 0;
+  int found = 0;
+
+  /* the end of central directory record is at most 64K before the end,
+     with the zip64 locator just before it */
+  if (ZSEEK64(pziinit->z_filefunc, pziinit->filestream, 0, ZLIB_FILEFUNC_SEEK_END) != 0)
+    err=ZIP_ERRNO;
+  else
   {
-    uLong uReadSize;
-    ZPOS64_T uReadPos ;
-    int i;
-    if (uBackRead+BUFREADCOMMENT>uMaxBack)
-      uBackRead = uMaxBack;
-    else
-      uBackRead+=BUFREADCOMMENT;
-    uReadPos = uSizeFile-uBackRead ;
-
-    uReadSize = ((BUFREADCOMMENT+4) < (uSizeFile-uReadPos)) ?
-      (BUFREADCOMMENT+4) : (uLong)(uSizeFile-uReadPos);
-    if (ZSEEK64(*pzlib_filefunc_def,filestream,uReadPos,ZLIB_FILEFUNC_SEEK_SET)!=0)
-      break;
-
-    if (ZREAD64(*pzlib_filefunc_def,filestream,buf,uReadSize)!=uReadSize)
-      break;
+    size_file = ZTELL64(pziinit->z_filefunc, pziinit->filestream);
+    size_buf = SIZEZIP64ENDLOCATOR + SIZEENDOFCENTRALDIR + 0xffff;
+    if (size_buf > size_file)
+      size_buf = (uLong)size_file;
+    buf = (unsigned char*)ALLOC(size_buf);
+    if (buf==NULL)
+      err=ZIP_INTERNALERROR;
+    else if (ZREADAT64(pziinit->z_filefunc, pziinit->filestream, size_file - size_buf, buf, size_buf) != size_buf)
+      err=ZIP_ERRNO;
+  }
 
-    for (i=(int)uReadSize-3; (i--)>0;)
-      if (((*(buf+i))==0x50) && ((*(buf+i+1))==0x4b) &&
-        ((*(buf+i+2))==0x05) && ((*(buf+i+3))==0x06))
+  if ((err==ZIP_OK) && (size_buf >= SIZEENDOFCENTRALDIR))
+  {
+    for (i = size_buf - SIZEENDOFCENTRALDIR + 1; (i--) > 0;)
+      if ((buf[i]==0x50) && (buf[i+1]==0x4b) && (buf[i+2]==0x05) && (buf[i+3]==0x06))
       {
-        uPosFound = uReadPos+(unsigned)i;
+        found = 1;
         break;
       }
-
-    if (uPosFound!=0)
-      break;
   }
-  free(buf);
-  return uPosFound;
-}
-
-/*
-Locate the End of Zip64 Central directory locator and from there find the CD of a zipfile (at the end, just before
-the global comment)
-*/
-local ZPOS64_T zip64local_SearchCentralDir64(const zlib_filefunc64_32_def* pzlib_filefunc_def, voidpf filestream) {
-  unsigned char* buf;
-  ZPOS64_T uSizeFile;
-  ZPOS64_T uBackRead;
-  ZPOS64_T uMaxBack=0xffff; /* maximum size of global comment */
-  ZPOS64_T uPosFound=0;
-  uLong uL;
-  ZPOS64_T relativeOffset;
-
-  if (ZSEEK64(*pzlib_filefunc_def,filestream,0,ZLIB_FILEFUNC_SEEK_END) != 0)
-    return 0;
-
-  uSizeFile = ZTELL64(*pzlib_filefunc_def,filestream);
-
-  if (uMaxBack>uSizeFile)
-    uMaxBack = uSizeFile;
-
-  buf = (unsigned char*)ALLOC(BUFREADCOMMENT+4);
-  if (buf==NULL)
-    return 0;
+  if ((err==ZIP_OK) && !found)
+    err=ZIP_ERRNO;
 
-  uBackRead = 4;
-  while (uBackRead<uMaxBack)
+  if (err==ZIP_OK)
   {
-    uLong uReadSize;
-    ZPOS64_T uReadPos;
-    int i;
-    if (uBackRead+BUFREADCOMMENT>uMaxBack)
-      uBackRead = uMaxBack;
-    else
-      uBackRead+=BUFREADCOMMENT;
-    uReadPos = uSizeFile-uBackRead ;
-
-    uReadSize = ((BUFREADCOMMENT+4) < (uSizeFile-uReadPos)) ?
-      (BUFREADCOMMENT+4) : (uLong)(uSizeFile-uReadPos);
-    if (ZSEEK64(*pzlib_filefunc_def,filestream,uReadPos,ZLIB_FILEFUNC_SEEK_SET)!=0)
-      break;
-
-    if (ZREAD64(*pzlib_filefunc_def,filestream,buf,uReadSize)!=uReadSize)
-      break;
+    const unsigned char* p = buf + i;
+
+    central_pos = size_file - size_buf + i;
+    number_disk = zip64local_readShort(p + 4);
+    number_disk_with_CD = zip64local_readShort(p + 6);
+    number_entry = zip64local_readShort(p + 8);
+    number_entry_CD = zip64local_readShort(p + 10);
+    size_central_dir = zip64local_readLong(p + 12);
+    offset_central_dir = zip64local_readLong(p + 16);
+
+    /* zipfile global comment, cut if the zipfile ends before it */
+    size_comment = zip64local_readShort(p + 20);
+    if (size_comment > size_buf - i - SIZEENDOFCENTRALDIR)
+      size_comment = size_buf - i - SIZEENDOFCENTRALDIR;
+    if (size_comment>0)
+    {
+      pziinit->globalcomment = (char*)ALLOC(size_comment+1);
+      if (pziinit->globalcomment)
+      {
+        memcpy(pziinit->globalcomment, p + SIZEENDOFCENTRALDIR, size_comment);
+        pziinit->globalcomment[size_comment]=0;
+      }
+    }
 
-    for (i=(int)uReadSize-3; (i--)>0;)
+    /* the zip64 end of central directory record, found by its locator */
+    if ((i >= SIZEZIP64ENDLOCATOR) &&
+        (zip64local_readLong(p - SIZEZIP64ENDLOCATOR) == ZIP64ENDLOCHEADERMAGIC) &&
+        (zip64local_readLong(p - SIZEZIP64ENDLOCATOR + 4) == 0) &&
+        (zip64local_readLong(p - SIZEZIP64ENDLOCATOR + 16) == 1))
     {
-      // Signature "0x07064b50" Zip64 end of central directory locater
-      if (((*(buf+i))==0x50) && ((*(buf+i+1))==0x4b) && ((*(buf+i+2))==0x06) && ((*(buf+i+3))==0x07))
+      unsigned char rec[SIZEZIP64ENDOFCENTRALDIR];
+      ZPOS64_T zip64_pos = zip64local_readLong64(p - SIZEZIP64ENDLOCATOR + 8);
+
+      if ((ZREADAT64(pziinit->z_filefunc, pziinit->filestream, zip64_pos, rec, SIZEZIP64ENDOFCENTRALDIR) == SIZEZIP64ENDOFCENTRALDIR) &&
+          (zip64local_readLong(rec) == ZIP64ENDHEADERMAGIC))
       {
-        uPosFound = uReadPos+(unsigned)i;
-        break;
+        central_pos = zip64_pos;
+        number_disk = zip64local_readLong(rec + 16);
+        number_disk_with_CD = zip64local_readLong(rec + 20);
+        number_entry = zip64local_readLong64(rec + 24);
+        number_entry_CD = zip64local_readLong64(rec + 32);
+        size_central_dir = zip64local_readLong64(rec + 40);
+        offset_central_dir = zip64local_readLong64(rec + 48);
       }
     }
 
-      if (uPosFound!=0)
-        break;
+    if ((number_entry_CD!=number_entry) || (number_disk_with_CD!=0) || (number_disk!=0))
+      err=ZIP_BADZIPFILE;
+    else if (central_pos<offset_central_dir+size_central_dir)
+      err=ZIP_BADZIPFILE;
   }
-
   free(buf);
-  if (uPosFound == 0)
-    return 0;
 
-  /* Zip64 end of central directory locator */
-  if (ZSEEK64(*pzlib_filefunc_def,filestream, uPosFound,ZLIB_FILEFUNC_SEEK_SET)!=0)
-    return 0;
+  if (err!=ZIP_OK)
+  {
+    ZCLOSE64(pziinit->z_filefunc, pziinit->filestream);
+    return ZIP_ERRNO;
+  }
+
+  byte_before_the_zipfile = central_pos - (offset_central_dir+size_central_dir);
+  pziinit->add_position_when_writing_offset = byte_before_the_zipfile;
 
-  /* the signature, already checked */
-  if (zip64local_getLong(pzlib_filefunc_def,filestream,&uL)!=ZIP_OK)
-    return 0;
+  {
+    ZPOS64_T size_central_dir_to_read = size_central_dir;
 
-  /* number of the disk with the start of the zip64 end of  central directory */
-  if (zip64local_getLong(pzlib_filefunc_def,filestream,&uL)!=ZIP_OK)
-    return 0;
-  if (uL != 0)
-    return 0;
+    /* the room after the old central directory keeps zipClose from copying
+       it to a bigger buffer, unless many files are added */
+    err = grow_datablock(&pziinit->central_dir, size_central_dir + SIZEDATA_INDATABLOCK +
+                         SIZEZIP64ENDOFCENTRALDIR + SIZEZIP64ENDLOCATOR + SIZEENDOFCENTRALDIR + 0xffff);
 
-  /* relative offset of the zip64 end of central directory record */
-  if (zip64local_getLong64(pzlib_filefunc_def,filestream,&relativeOffset)!=ZIP_OK)
-    return 0;
+    while ((size_central_dir_to_read>0) && (err==ZIP_OK))
+    {
+      ZPOS64_T read_this = SIZEDATA_WRITEBLOCK;
+      if (read_this > size_central_dir_to_read)
+        read_this = size_central_dir_to_read;
 
-  /* total number of disks */
-  if (zip64local_getLong(pzlib_filefunc_def,filestream,&uL)!=ZIP_OK)
-    return 0;
-  if (uL != 1)
-    return 0;
+      if (ZREADAT64(pziinit->z_filefunc, pziinit->filestream,
+                    offset_central_dir + byte_before_the_zipfile + pziinit->central_dir.filled,
+                    pziinit->central_dir.data + pziinit->central_dir.filled,(uLong)read_this) != read_this)
+        err=ZIP_ERRNO;
 
-  /* Goto Zip64 end of central directory record */
-  if (ZSEEK64(*pzlib_filefunc_def,filestream, relativeOffset,ZLIB_FILEFUNC_SEEK_SET)!=0)
-    return 0;
+      if (err==ZIP_OK)
+        pziinit->central_dir.filled += read_this;
 
-  /* the signature */
-  if (zip64local_getLong(pzlib_filefunc_def,filestream,&uL)!=ZIP_OK)
-    return 0;
+      size_central_dir_to_read-=read_this;
+    }
+  }
+  pziinit->begin_pos = byte_before_the_zipfile;
+  pziinit->number_entry = number_entry_CD;
 
-  if (uL != 0x06064b50) // signature of 'Zip64 end of central directory'
-    return 0;
+  if (ZSEEK64(pziinit->z_filefunc, pziinit->filestream, offset_central_dir+byte_before_the_zipfile,ZLIB_FILEFUNC_SEEK_SET) != 0)
+    err=ZIP_ERRNO;
 
-  return relativeOffset;
+  return err;
 }
 
-local int LoadCentralDirectoryRecord(zip64_internal* pziinit) {
-  int err=ZIP_OK;
-  ZPOS64_T byte_before_the_zipfile;/* byte before the zipfile, (>0 for sfx)*/
 
-  ZPOS64_T size_central_dir;     /* size of the central directory  */
-  ZPOS64_T offset_central_dir;   /* offset of start of central directory */
-  ZPOS64_T central_pos;
-  uLong uL;
-
-  uLong number_disk;          /* number of the current disk, used for
-                              spanning ZIP, unsupported, always 0*/
-  uLong number_disk_with_CD;  /* number of the disk with central dir, used
-                              for spanning ZIP, unsupported, always 0*/
-  ZPOS64_T number_entry;
-  ZPOS64_T number_entry_CD;      /* total number of entries in
-                                the central dir
-                                (same than number_entry on nospan) */
-  uLong VersionMadeBy;
-  uLong VersionNeeded;
-  uLong size_comment;
-
-  int hasZIP64Record = 0;
-
-  // check first if we find a ZIP64 record
-  central_pos = zip64local_SearchCentralDir64(&pziinit->z_filefunc,pziinit->filestream);
-  if(central_pos > 0)
-  {
-    hasZIP64Record = 1;
-  }
-  else if(central_pos == 0)
-  {
-    central_pos = zip64local_SearchCentralDir(&pziinit->z_filefunc,pziinit->filestream);
-  }
+#endif /* !NO_ADDFILEINEXISTINGZIP*/
 
-/* disable to allow appending to empty ZIP archive
-        if (central_pos==0)
-            err=ZIP_ERRNO;
-*/
 
-  if(hasZIP64Record)
-  {
-    ZPOS64_T sizeEndOfCentralDirectory;
-    if (ZSEEK64(pziinit->z_filefunc, pziinit->filestream, central_pos, ZLIB_FILEFUNC_SEEK_SET) != 0)
-      err=ZIP_ERRNO;
+/* every write to the zipfile goes here, so the position is known without ZTELL64 */
+local int zip64local_Write(zip64_internal* zi, const void* buf, uLong size) {
+    uLong written = ZWRITE64(zi->z_filefunc,zi->filestream,buf,size);
+    zi->pos_in_zip += written;
+    return (written == size) ? ZIP_OK : ZIP_ERRNO;
+}
 
-    /* the signature, already checked */
-    if (zip64local_getLong(&pziinit->z_filefunc, pziinit->filestream,&uL)!=ZIP_OK)
-      err=ZIP_ERRNO;
+local ZPOS64_T zip64local_Tell(zip64_internal* zi) {
+    if (zi->streaming)
+        return zi->pos_in_zip;
+    return ZTELL64(zi->z_filefunc,zi->filestream);
+}
 
-    /* size of zip64 end of central directory record */
-    if (zip64local_getLong64(&pziinit->z_filefunc, pziinit->filestream, &sizeEndOfCentralDirectory)!=ZIP_OK)
-      err=ZIP_ERRNO;
+/************************************************************/
+extern zipFile ZEXPORT zipOpen3(const void *pathname, int append, zipcharpc* globalcomment, zlib_filefunc64_32_def* pzlib_filefunc64_32_def) {
+    zip64_internal ziinit;
+    zip64_internal* zi;
+    int err=ZIP_OK;
 
-    /* version made by */
-    if (zip64local_getShort(&pziinit->z_filefunc, pziinit->filestream, &VersionMadeBy)!=ZIP_OK)
-      err=ZIP_ERRNO;
+    ziinit.z_filefunc.zseek32_file = NULL;
+    ziinit.z_filefunc.ztell32_file = NULL;
+    if (pzlib_filefunc64_32_def==NULL)
+        fill_fopen64_filefunc(&ziinit.z_filefunc.zfile_func64);
+    else
+        ziinit.z_filefunc = *pzlib_filefunc64_32_def;
 
-    /* version needed to extract */
-    if (zip64local_getShort(&pziinit->z_filefunc, pziinit->filestream, &VersionNeeded)!=ZIP_OK)
-      err=ZIP_ERRNO;
+    ziinit.streaming = (append == APPEND_STATUS_STREAM);
+    ziinit.pos_in_zip = 0;
+    if (ziinit.streaming)
+        ziinit.filestream = ZOPEN64(ziinit.z_filefunc,
+                  pathname,
+                  (ZLIB_FILEFUNC_MODE_WRITE | ZLIB_FILEFUNC_MODE_CREATE));
+    else
+        ziinit.filestream = ZOPEN64(ziinit.z_filefunc,
+                  pathname,
+                  (append == APPEND_STATUS_CREATE) ?
+                  (ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_WRITE | ZLIB_FILEFUNC_MODE_CREATE) :
+                    (ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_WRITE | ZLIB_FILEFUNC_MODE_EXISTING));
 
-    /* number of this disk */
-    if (zip64local_getLong(&pziinit->z_filefunc, pziinit->filestream,&number_disk)!=ZIP_OK)
-      err=ZIP_ERRNO;
+    if (ziinit.filestream == NULL)
+        return NULL;
 
-    /* number of the disk with the start of the central directory */
-    if (zip64local_getLong(&pziinit->z_filefunc, pziinit->filestream,&number_disk_with_CD)!=ZIP_OK)
-      err=ZIP_ERRNO;
+    if (append == APPEND_STATUS_CREATEAFTER)
+        ZSEEK64(ziinit.z_filefunc,ziinit.filestream,0,SEEK_END);
 
-    /* total number of entries in the central directory on this disk */
-    if (zip64local_getLong64(&pziinit->z_filefunc, pziinit->filestream, &number_entry)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* total number of entries in the central directory */
-    if (zip64local_getLong64(&pziinit->z_filefunc, pziinit->filestream,&number_entry_CD)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    if ((number_entry_CD!=number_entry) || (number_disk_with_CD!=0) || (number_disk!=0))
-      err=ZIP_BADZIPFILE;
-
-    /* size of the central directory */
-    if (zip64local_getLong64(&pziinit->z_filefunc, pziinit->filestream,&size_central_dir)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* offset of start of central directory with respect to the
-    starting disk number */
-    if (zip64local_getLong64(&pziinit->z_filefunc, pziinit->filestream,&offset_central_dir)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    // TODO..
-    // read the comment from the standard central header.
-    size_comment = 0;
-  }
-  else
-  {
-    // Read End of central Directory info
-    if (ZSEEK64(pziinit->z_filefunc, pziinit->filestream, central_pos,ZLIB_FILEFUNC_SEEK_SET)!=0)
-      err=ZIP_ERRNO;
-
-    /* the signature, already checked */
-    if (zip64local_getLong(&pziinit->z_filefunc, pziinit->filestream,&uL)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* number of this disk */
-    if (zip64local_getShort(&pziinit->z_filefunc, pziinit->filestream,&number_disk)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* number of the disk with the start of the central directory */
-    if (zip64local_getShort(&pziinit->z_filefunc, pziinit->filestream,&number_disk_with_CD)!=ZIP_OK)
-      err=ZIP_ERRNO;
-
-    /* total number of entries in the central dir on this disk */
-    number_entry = 0;
-    if (zip64local_getShort(&pziinit->z_filefunc, pziinit->filestream, &uL)!=ZIP_OK)
-      err=ZIP_ERRNO;
-    else
-      number_entry = uL;
-
-    /* total number of entries in the central dir */
-    number_entry_CD = 0;
-    if (zip64local_getShort(&pziinit->z_filefunc, pziinit->filestream, &uL)!=ZIP_OK)
-      err=ZIP_ERRNO;
-    else
-      number_entry_CD = uL;
-
-    if ((number_entry_CD!=number_entry) || (number_disk_with_CD!=0) || (number_disk!=0))
-      err=ZIP_BADZIPFILE;
-
-    /* size of the central directory */
-    size_central_dir = 0;
-    if (zip64local_getLong(&pziinit->z_filefunc, pziinit->filestream, &uL)!=ZIP_OK)
-      err=ZIP_ERRNO;
-    else
-      size_central_dir = uL;
-
-    /* offset of start of central directory with respect to the starting disk number */
-    offset_central_dir = 0;
-    if (zip64local_getLong(&pziinit->z_filefunc, pziinit->filestream, &uL)!=ZIP_OK)
-      err=ZIP_ERRNO;
-    else
-      offset_central_dir = uL;
-
-
-    /* zipfile global comment length */
-    if (zip64local_getShort(&pziinit->z_filefunc, pziinit->filestream, &size_comment)!=ZIP_OK)
-      err=ZIP_ERRNO;
-  }
-
-  if ((central_pos<offset_central_dir+size_central_dir) &&
-    (err==ZIP_OK))
-    err=ZIP_BADZIPFILE;
-
-  if (err!=ZIP_OK)
-  {
-    ZCLOSE64(pziinit->z_filefunc, pziinit->filestream);
-    return ZIP_ERRNO;
-  }
-
-  if (size_comment>0)
-  {
-    pziinit->globalcomment = (char*)ALLOC(size_comment+1);
-    if (pziinit->globalcomment)
-    {
-      size_comment = ZREAD64(pziinit->z_filefunc, pziinit->filestream, pziinit->globalcomment,size_comment);
-      pziinit->globalcomment[size_comment]=0;
-    }
-  }
-
-  byte_before_the_zipfile = central_pos - (offset_central_dir+size_central_dir);
-  pziinit->add_position_when_writing_offset = byte_before_the_zipfile;
-
-  {
-    ZPOS64_T size_central_dir_to_read = size_central_dir;
-    size_t buf_size = SIZEDATA_INDATABLOCK;
-    void* buf_read = (void*)ALLOC(buf_size);
-    if (ZSEEK64(pziinit->z_filefunc, pziinit->filestream, offset_central_dir + byte_before_the_zipfile, ZLIB_FILEFUNC_SEEK_SET) != 0)
-      err=ZIP_ERRNO;
-
-    while ((size_central_dir_to_read>0) && (err==ZIP_OK))
-    {
-      ZPOS64_T read_this = SIZEDATA_INDATABLOCK;
-      if (read_this > size_central_dir_to_read)
-        read_this = size_central_dir_to_read;
-
-      if (ZREAD64(pziinit->z_filefunc, pziinit->filestream,buf_read,(uLong)read_this) != read_this)
-        err=ZIP_ERRNO;
-
-      if (err==ZIP_OK)
-        err = add_data_in_datablock(&pziinit->central_dir,buf_read, (uLong)read_this);
-
-      size_central_dir_to_read-=read_this;
-    }
-    free(buf_read);
-  }
-  pziinit->begin_pos = byte_before_the_zipfile;
-  pziinit->number_entry = number_entry_CD;
-
-  if (ZSEEK64(pziinit->z_filefunc, pziinit->filestream, offset_central_dir+byte_before_the_zipfile,ZLIB_FILEFUNC_SEEK_SET) != 0)
-    err=ZIP_ERRNO;
-
-  return err;
-}
-
-
-#endif /* !NO_ADDFILEINEXISTINGZIP*/
-
-
-/************************************************************/
-extern zipFile ZEXPORT zipOpen3(const void *pathname, int append, zipcharpc* globalcomment, zlib_filefunc64_32_def* pzlib_filefunc64_32_def) {
-    zip64_internal ziinit;
-    zip64_internal* zi;
-    int err=ZIP_OK;
-
-    ziinit.z_filefunc.zseek32_file = NULL;
-    ziinit.z_filefunc.ztell32_file = NULL;
-    if (pzlib_filefunc64_32_def==NULL)
-        fill_fopen64_filefunc(&ziinit.z_filefunc.zfile_func64);
-    else
-        ziinit.z_filefunc = *pzlib_filefunc64_32_def;
-
-    ziinit.filestream = ZOPEN64(ziinit.z_filefunc,
-                  pathname,
-                  (append == APPEND_STATUS_CREATE) ?
-                  (ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_WRITE | ZLIB_FILEFUNC_MODE_CREATE) :
-                    (ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_WRITE | ZLIB_FILEFUNC_MODE_EXISTING));
-
-    if (ziinit.filestream == NULL)
-        return NULL;
-
-    if (append == APPEND_STATUS_CREATEAFTER)
-        ZSEEK64(ziinit.z_filefunc,ziinit.filestream,0,SEEK_END);
-
-    ziinit.begin_pos = ZTELL64(ziinit.z_filefunc,ziinit.filestream);
+    ziinit.begin_pos = zip64local_Tell(&ziinit);
     ziinit.in_opened_file_inzip = 0;
     ziinit.ci.stream_initialised = 0;
+    ziinit.ci.deflate_initialised = 0;
+    init_datablock(&ziinit.ci.local_header);
+    ziinit.ci.parallel = 0;
     ziinit.number_entry = 0;
+    ziinit.parallel_threads = 1;
+    ziinit.parallel_block_size = Z_PARALLEL_BLOCKSIZE;
+    ziinit.zstd_workers = 1;
+#ifdef HAVE_ZSTD
+    ziinit.ci.zstream = NULL;
+#endif
+#ifdef HAVE_LZMA
+    {
+        lzma_stream lstream_init = LZMA_STREAM_INIT;
+        ziinit.ci.lstream = lstream_init;
+    }
+#endif
+    ziinit.aes_strength = 0;
+    ziinit.truncate_at_close = 0;
+    ziinit.member_deflaters = NULL;
     ziinit.add_position_when_writing_offset = 0;
-    init_linkedlist(&(ziinit.central_dir));
+    init_datablock(&(ziinit.central_dir));
 
 
 
@@ -873,6 +663,8 @@ extern zipFile ZEXPORT zipOpen3(const void *pathname, int append, zipcharpc* glo
 #    ifndef NO_ADDFILEINEXISTINGZIP
         free(ziinit.globalcomment);
 #    endif /* !NO_ADDFILEINEXISTINGZIP*/
+        free_datablock(&ziinit.central_dir);
+        free_datablock(&ziinit.ci.local_header);
         free(zi);
         return NULL;
     }
@@ -917,74 +709,94 @@ extern zipFile ZEXPORT zipOpen64(const void* pathname, int append) {
     return zipOpen3(pathname,append,NULL,NULL);
 }
 
+#ifndef NOAES
+/*
+  Put the WinZip AES extra field of the current file at p: AE-2, the crc
+    is not stored, and the real compression method.
+*/
+local void zip64local_WriteAESExtra(const zip64_internal* zi, unsigned char* p) {
+    zip64local_putValue_inmemory(p, (uLong)ZAES_EXTRA_ID, 2);
+    zip64local_putValue_inmemory(p+2, (uLong)ZAES_EXTRA_SIZE, 2);
+    zip64local_putValue_inmemory(p+4, (uLong)ZAES_VERSION_AE2, 2);
+    p[6] = 'A';
+    p[7] = 'E';
+    p[8] = (unsigned char)zi->ci.aes;
+    zip64local_putValue_inmemory(p+9, (uLong)zi->ci.method, 2);
+}
+#endif
+
+/* version needed to extract the current file, at least 4.5 for zip64 */
+local uLong zip64local_VersionNeeded(const zip64_internal* zi, int zip64) {
+    if ((zi->ci.method == Z_LZMA) || (zi->ci.method == Z_XZ) || (zi->ci.method == Z_ZSTD))
+        return 63;
+    if ((zi->ci.aes) || (zi->ci.method == Z_AES))
+        return 51;
+    return zip64 ? 45 : 20;
+}
+
 local int Write_LocalFileHeader(zip64_internal* zi, const char* filename, uInt size_extrafield_local, const void* extrafield_local) {
-  /* write the local header */
+  /* build the local header in memory and write it at once */
   int err;
+  datablock* db = &zi->ci.local_header;
   uInt size_filename = (uInt)strlen(filename);
   uInt size_extrafield = size_extrafield_local;
+  unsigned char* p;
 
-  err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)LOCALHEADERMAGIC, 4);
-
-  if (err==ZIP_OK)
+  if(zi->ci.zip64)
   {
-    if(zi->ci.zip64)
-      err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)45,2);/* version needed to extract */
-    else
-      err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)20,2);/* version needed to extract */
+    size_extrafield += 20;
   }
+#ifndef NOAES
+  if(zi->ci.aes)
+  {
+    size_extrafield += 4 + ZAES_EXTRA_SIZE;
+  }
+#endif
 
-  if (err==ZIP_OK)
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)zi->ci.flag,2);
+  db->filled = 0;
+  err = grow_datablock(db, SIZEZIPLOCALHEADER + size_filename + size_extrafield);
+  if (err!=ZIP_OK)
+    return err;
+  p = db->data;
 
-  if (err==ZIP_OK)
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)zi->ci.method,2);
+  zip64local_putValue_inmemory(p,(uLong)LOCALHEADERMAGIC,4);
 
-  if (err==ZIP_OK)
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)zi->ci.dosDate,4);
+  zip64local_putValue_inmemory(p+4,zip64local_VersionNeeded(zi, zi->ci.zip64),2);/* version needed to extract */
+
+  zip64local_putValue_inmemory(p+6,(uLong)zi->ci.flag,2);
+  zip64local_putValue_inmemory(p+8,(uLong)(zi->ci.aes ? Z_AES : zi->ci.method),2);
+  zip64local_putValue_inmemory(p+10,(uLong)zi->ci.dosDate,4);
 
   // CRC / Compressed size / Uncompressed size will be filled in later and rewritten later
-  if (err==ZIP_OK)
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)0,4); /* crc 32, unknown */
-  if (err==ZIP_OK)
-  {
-    if(zi->ci.zip64)
-      err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)0xFFFFFFFF,4); /* compressed size, unknown */
-    else
-      err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)0,4); /* compressed size, unknown */
-  }
-  if (err==ZIP_OK)
+  zip64local_putValue_inmemory(p+14,(uLong)0,4); /* crc 32, unknown */
+  if(zi->ci.zip64)
   {
-    if(zi->ci.zip64)
-      err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)0xFFFFFFFF,4); /* uncompressed size, unknown */
-    else
-      err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)0,4); /* uncompressed size, unknown */
+    zip64local_putValue_inmemory(p+18,(uLong)0xFFFFFFFF,4); /* compressed size, unknown */
+    zip64local_putValue_inmemory(p+22,(uLong)0xFFFFFFFF,4); /* uncompressed size, unknown */
   }
-
-  if (err==ZIP_OK)
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)size_filename,2);
-
-  if(zi->ci.zip64)
+  else
   {
-    size_extrafield += 20;
+    zip64local_putValue_inmemory(p+18,(uLong)0,4); /* compressed size, unknown */
+    zip64local_putValue_inmemory(p+22,(uLong)0,4); /* uncompressed size, unknown */
   }
 
-  if (err==ZIP_OK)
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)size_extrafield,2);
+  zip64local_putValue_inmemory(p+26,(uLong)size_filename,2);
+  zip64local_putValue_inmemory(p+28,(uLong)size_extrafield,2);
+  p += SIZEZIPLOCALHEADER;
 
-  if ((err==ZIP_OK) && (size_filename > 0))
+  if (size_filename > 0)
   {
-    if (ZWRITE64(zi->z_filefunc,zi->filestream,filename,size_filename)!=size_filename)
-      err = ZIP_ERRNO;
+    memcpy(p, filename, size_filename);
+    p += size_filename;
   }
 
-  if ((err==ZIP_OK) && (size_extrafield_local > 0))
+  if (size_extrafield_local > 0)
   {
-    if (ZWRITE64(zi->z_filefunc, zi->filestream, extrafield_local, size_extrafield_local) != size_extrafield_local)
-      err = ZIP_ERRNO;
+    memcpy(p, extrafield_local, size_extrafield_local);
+    p += size_extrafield_local;
   }
 
-
-  if ((err==ZIP_OK) && (zi->ci.zip64))
+  if (zi->ci.zip64)
   {
       // write the Zip64 extended info
       short HeaderID = 1;
@@ -993,16 +805,26 @@ local int Write_LocalFileHeader(zip64_internal* zi, const char* filename, uInt s
       ZPOS64_T UncompressedSize = 0;
 
       // Remember position of Zip64 extended info for the local file header. (needed when we update size after done with file)
-      zi->ci.pos_zip64extrainfo = ZTELL64(zi->z_filefunc,zi->filestream);
+      zi->ci.pos_zip64extrainfo = zi->ci.pos_local_header + (ZPOS64_T)(p - db->data);
 
-      err = zip64local_putValue(&zi->z_filefunc, zi->filestream, (ZPOS64_T)HeaderID,2);
-      err = zip64local_putValue(&zi->z_filefunc, zi->filestream, (ZPOS64_T)DataSize,2);
+      zip64local_putValue_inmemory(p, (ZPOS64_T)HeaderID,2);
+      zip64local_putValue_inmemory(p+2, (ZPOS64_T)DataSize,2);
 
-      err = zip64local_putValue(&zi->z_filefunc, zi->filestream, (ZPOS64_T)UncompressedSize,8);
-      err = zip64local_putValue(&zi->z_filefunc, zi->filestream, (ZPOS64_T)CompressedSize,8);
+      zip64local_putValue_inmemory(p+4, (ZPOS64_T)UncompressedSize,8);
+      zip64local_putValue_inmemory(p+12, (ZPOS64_T)CompressedSize,8);
+      p += 20;
   }
 
-  return err;
+#ifndef NOAES
+  if (zi->ci.aes)
+  {
+      zip64local_WriteAESExtra(zi, p);
+      p += 4 + ZAES_EXTRA_SIZE;
+  }
+#endif
+
+  db->filled = (ZPOS64_T)(p - db->data);
+  return zip64local_Write(zi, db->data, (uLong)db->filled);
 }
 
 /*
@@ -1023,7 +845,7 @@ extern int ZEXPORT zipOpenNewFileInZip4_64(zipFile file, const char* filename, c
     zip64_internal* zi;
     uInt size_filename;
     uInt size_comment;
-    uInt i;
+    uInt size_aesextra = 0;
     int err = ZIP_OK;
 
 #    ifdef NOCRYPT
@@ -1035,13 +857,19 @@ extern int ZEXPORT zipOpenNewFileInZip4_64(zipFile file, const char* filename, c
     if (file == NULL)
         return ZIP_PARAMERROR;
 
+    /* raw data is written as it is given, whatever its method */
+    if ((!raw) && (method!=0) && (method!=Z_DEFLATED)
 #ifdef HAVE_BZIP2
-    if ((method!=0) && (method!=Z_DEFLATED) && (method!=Z_BZIP2ED))
-      return ZIP_PARAMERROR;
-#else
-    if ((method!=0) && (method!=Z_DEFLATED))
-      return ZIP_PARAMERROR;
+        && (method!=Z_BZIP2ED)
+#endif
+#ifdef HAVE_ZSTD
+        && (method!=Z_ZSTD)
 #endif
+#ifdef HAVE_LZMA
+        && (method!=Z_LZMA) && (method!=Z_XZ)
+#endif
+       )
+      return ZIP_PARAMERROR;
 
     // The filename and comment length must fit in 16 bits.
     if ((filename!=NULL) && (strlen(filename)>0xffff))
@@ -1056,6 +884,16 @@ extern int ZEXPORT zipOpenNewFileInZip4_64(zipFile file, const char* filename, c
 
     zi = (zip64_internal*)file;
 
+#ifndef NOAES
+    // WinZip AES adds its own extra field in both headers.
+    if ((password != NULL) && (zi->aes_strength != 0))
+    {
+        size_aesextra = 4 + ZAES_EXTRA_SIZE;
+        if ((size_extrafield_local+size_aesextra>0xffff) || (size_extrafield_global+size_aesextra>0xffff))
+            return ZIP_PARAMERROR;
+    }
+#endif
+
     if (zi->in_opened_file_inzip == 1)
     {
         err = zipCloseFileInZip (file);
@@ -1084,41 +922,50 @@ extern int ZEXPORT zipOpenNewFileInZip4_64(zipFile file, const char* filename, c
     }
 
     zi->ci.flag = flagBase;
-    if ((level==8) || (level==9))
-      zi->ci.flag |= 2;
-    if (level==2)
-      zi->ci.flag |= 4;
-    if (level==1)
-      zi->ci.flag |= 6;
+    if (method == Z_DEFLATED)
+    {
+      if ((level==8) || (level==9))
+        zi->ci.flag |= 2;
+      if (level==2)
+        zi->ci.flag |= 4;
+      if (level==1)
+        zi->ci.flag |= 6;
+    }
+    if ((method == Z_LZMA) && (!raw))
+      zi->ci.flag |= 2; /* the LZMA data ends with an end of stream marker */
     if (password != NULL)
       zi->ci.flag |= 1;
+    if (zi->streaming)
+      zi->ci.flag |= 8; /* crc and sizes are in a data descriptor after the data */
 
     zi->ci.crc32 = 0;
     zi->ci.method = method;
     zi->ci.encrypt = 0;
+    zi->ci.aes = (size_aesextra > 0) ? zi->aes_strength : 0;
     zi->ci.stream_initialised = 0;
+    zi->ci.parallel = 0;
     zi->ci.pos_in_buffered_data = 0;
     zi->ci.raw = raw;
-    zi->ci.pos_local_header = ZTELL64(zi->z_filefunc,zi->filestream);
+    zi->ci.pos_local_header = zip64local_Tell(zi);
 
-    zi->ci.size_centralheader = SIZECENTRALHEADER + size_filename + size_extrafield_global + size_comment;
+    zi->ci.size_centralheader = SIZECENTRALHEADER + size_filename + size_extrafield_global + size_aesextra + size_comment;
     zi->ci.size_centralExtraFree = 32; // Extra space we have reserved in case we need to add ZIP64 extra info data
 
     zi->ci.central_header = (char*)ALLOC((uInt)zi->ci.size_centralheader + zi->ci.size_centralExtraFree);
 
-    zi->ci.size_centralExtra = size_extrafield_global;
+    zi->ci.size_centralExtra = size_extrafield_global + size_aesextra;
     zip64local_putValue_inmemory(zi->ci.central_header,(uLong)CENTRALHEADERMAGIC,4);
     /* version info */
     zip64local_putValue_inmemory(zi->ci.central_header+4,(uLong)versionMadeBy,2);
-    zip64local_putValue_inmemory(zi->ci.central_header+6,(uLong)20,2);
+    zip64local_putValue_inmemory(zi->ci.central_header+6,zip64local_VersionNeeded(zi, 0),2);
     zip64local_putValue_inmemory(zi->ci.central_header+8,(uLong)zi->ci.flag,2);
-    zip64local_putValue_inmemory(zi->ci.central_header+10,(uLong)zi->ci.method,2);
+    zip64local_putValue_inmemory(zi->ci.central_header+10,(uLong)(zi->ci.aes ? Z_AES : zi->ci.method),2);
     zip64local_putValue_inmemory(zi->ci.central_header+12,(uLong)zi->ci.dosDate,4);
     zip64local_putValue_inmemory(zi->ci.central_header+16,(uLong)0,4); /*crc*/
     zip64local_putValue_inmemory(zi->ci.central_header+20,(uLong)0,4); /*compr size*/
     zip64local_putValue_inmemory(zi->ci.central_header+24,(uLong)0,4); /*uncompr size*/
     zip64local_putValue_inmemory(zi->ci.central_header+28,(uLong)size_filename,2);
-    zip64local_putValue_inmemory(zi->ci.central_header+30,(uLong)size_extrafield_global,2);
+    zip64local_putValue_inmemory(zi->ci.central_header+30,(uLong)zi->ci.size_centralExtra,2);
     zip64local_putValue_inmemory(zi->ci.central_header+32,(uLong)size_comment,2);
     zip64local_putValue_inmemory(zi->ci.central_header+34,(uLong)0,2); /*disk nm start*/
 
@@ -1137,16 +984,21 @@ extern int ZEXPORT zipOpenNewFileInZip4_64(zipFile file, const char* filename, c
     else
       zip64local_putValue_inmemory(zi->ci.central_header+42,(uLong)zi->ci.pos_local_header - zi->add_position_when_writing_offset,4);
 
-    for (i=0;i<size_filename;i++)
-        *(zi->ci.central_header+SIZECENTRALHEADER+i) = *(filename+i);
+    memcpy(zi->ci.central_header+SIZECENTRALHEADER, filename, size_filename);
 
-    for (i=0;i<size_extrafield_global;i++)
-        *(zi->ci.central_header+SIZECENTRALHEADER+size_filename+i) =
-              *(((const char*)extrafield_global)+i);
+    if (size_extrafield_global > 0)
+        memcpy(zi->ci.central_header+SIZECENTRALHEADER+size_filename,
+               extrafield_global, size_extrafield_global);
+
+#ifndef NOAES
+    if (zi->ci.aes)
+        zip64local_WriteAESExtra(zi, (unsigned char*)zi->ci.central_header+SIZECENTRALHEADER+
+                                 size_filename+size_extrafield_global);
+#endif
 
-    for (i=0;i<size_comment;i++)
-        *(zi->ci.central_header+SIZECENTRALHEADER+size_filename+
-              size_extrafield_global+i) = *(comment+i);
+    if (size_comment > 0)
+        memcpy(zi->ci.central_header+SIZECENTRALHEADER+size_filename+
+               size_extrafield_global+size_aesextra, comment, size_comment);
     if (zi->ci.central_header == NULL)
         return ZIP_INTERNALERROR;
 
@@ -1182,17 +1034,71 @@ extern int ZEXPORT zipOpenNewFileInZip4_64(zipFile file, const char* filename, c
     {
         if(zi->ci.method == Z_DEFLATED)
         {
-          zi->ci.stream.zalloc = (alloc_func)0;
-          zi->ci.stream.zfree = (free_func)0;
-          zi->ci.stream.opaque = (voidpf)0;
-
           if (windowBits>0)
               windowBits = -windowBits;
 
-          err = deflateInit2(&zi->ci.stream, level, Z_DEFLATED, windowBits, memLevel, strategy);
+          if (zi->parallel_threads > 1)
+          {
+              /* deflate by blocks on threads, see zip64local_DeflateBlocks */
+              uLong block_size = zi->parallel_block_size;
+              zi->ci.pz_out_block = block_size + (block_size >> 3) + (block_size >> 7) +
+                                    (block_size >> 8) + 32;
+              zi->ci.pz_in = (unsigned char*)ALLOC(Z_PARALLEL_DICTSIZE + zi->parallel_threads * block_size);
+              zi->ci.pz_out = (unsigned char*)ALLOC(zi->parallel_threads * zi->ci.pz_out_block);
+              if ((zi->ci.pz_in != NULL) && (zi->ci.pz_out != NULL))
+              {
+                  if (zi->ci.deflate_initialised)
+                  {
+                      deflateEnd(&zi->ci.stream);
+                      zi->ci.deflate_initialised = 0;
+                  }
+                  zi->ci.parallel = 1;
+                  zi->ci.threads = zi->parallel_threads;
+                  zi->ci.level = level;
+                  zi->ci.windowBits = windowBits;
+                  zi->ci.memLevel = memLevel;
+                  zi->ci.strategy = strategy;
+                  zi->ci.pz_dict = 0;
+                  zi->ci.pz_in_size = 0;
+              }
+              else
+              {
+                  free(zi->ci.pz_in);
+                  free(zi->ci.pz_out);
+              }
+          }
+
+          if ((!zi->ci.parallel) && zi->ci.deflate_initialised &&
+              (zi->ci.windowBits == windowBits) && (zi->ci.memLevel == memLevel))
+          {
+              /* reuse the deflate state of the previous file */
+              err = deflateReset(&zi->ci.stream);
+              if ((err==Z_OK) && ((zi->ci.level != level) || (zi->ci.strategy != strategy)))
+                  err = deflateParams(&zi->ci.stream, level, strategy);
+          }
+          else if (!zi->ci.parallel)
+          {
+              if (zi->ci.deflate_initialised)
+                  deflateEnd(&zi->ci.stream);
+              zi->ci.deflate_initialised = 0;
+
+              zi->ci.stream.zalloc = (alloc_func)0;
+              zi->ci.stream.zfree = (free_func)0;
+              zi->ci.stream.opaque = (voidpf)0;
+
+              err = deflateInit2(&zi->ci.stream, level, Z_DEFLATED, windowBits, memLevel, strategy);
+              if (err==Z_OK)
+                  zi->ci.deflate_initialised = 1;
+          }
 
-          if (err==Z_OK)
+          if ((!zi->ci.parallel) && (err==Z_OK))
+          {
               zi->ci.stream_initialised = Z_DEFLATED;
+              zi->ci.level = level;
+              zi->ci.windowBits = windowBits;
+              zi->ci.memLevel = memLevel;
+              zi->ci.strategy = strategy;
+          }
         }
         else if(zi->ci.method == Z_BZIP2ED)
         {
@@ -1209,9 +1115,90 @@ extern int ZEXPORT zipOpenNewFileInZip4_64(zipFile file, const char* filename, c
         }
 
     }
+#ifdef HAVE_ZSTD
+    else if ((err==ZIP_OK) && (zi->ci.method == Z_ZSTD) && (!zi->ci.raw))
+    {
+        /* the context and its threads are kept for the next file */
+        if (zi->ci.zstream == NULL)
+            zi->ci.zstream = ZSTD_createCCtx();
+        if (zi->ci.zstream == NULL)
+            err = ZIP_INTERNALERROR;
+        else if (ZSTD_isError(ZSTD_CCtx_reset(zi->ci.zstream, ZSTD_reset_session_and_parameters)) ||
+                 ZSTD_isError(ZSTD_CCtx_setParameter(zi->ci.zstream, ZSTD_c_compressionLevel,
+                                 (level == Z_DEFAULT_COMPRESSION) ? ZSTD_CLEVEL_DEFAULT : level)))
+            err = ZIP_PARAMERROR;
+        else
+        {
+            /* fails if libzstd was built without threads: compress on this one */
+            if (zi->zstd_workers > 1)
+                ZSTD_CCtx_setParameter(zi->ci.zstream, ZSTD_c_nbWorkers, zi->zstd_workers);
+            zi->ci.stream_initialised = Z_ZSTD;
+        }
+    }
+#endif
+#ifdef HAVE_LZMA
+    else if ((err==ZIP_OK) && ((zi->ci.method == Z_LZMA) || (zi->ci.method == Z_XZ)) && (!zi->ci.raw))
+    {
+        lzma_options_lzma options;
+        uint32_t preset = (level == Z_DEFAULT_COMPRESSION) ? LZMA_PRESET_DEFAULT : (uint32_t)level;
+
+        /* liblzma reuses the memory of the previous file's encoder */
+        if ((level < Z_DEFAULT_COMPRESSION) || lzma_lzma_preset(&options, preset))
+            err = ZIP_PARAMERROR;
+        else if (zi->ci.method == Z_XZ)
+        {
+            if (lzma_easy_encoder(&zi->ci.lstream, preset, LZMA_CHECK_CRC64) != LZMA_OK)
+                err = ZIP_INTERNALERROR;
+        }
+        else
+        {
+            /* LZMA in zip: LZMA SDK version, size of the properties, properties,
+               then the raw LZMA data */
+            lzma_filter filters[2];
+            uint32_t size_props = 0;
+            filters[0].id = LZMA_FILTER_LZMA1;
+            filters[0].options = &options;
+            filters[1].id = LZMA_VLI_UNKNOWN;
+            filters[1].options = NULL;
+            if ((lzma_properties_size(&size_props, &filters[0]) != LZMA_OK) || (size_props != 5) ||
+                (lzma_properties_encode(&filters[0], zi->ci.buffered_data + 4) != LZMA_OK) ||
+                (lzma_raw_encoder(&zi->ci.lstream, filters) != LZMA_OK))
+                err = ZIP_INTERNALERROR;
+            else
+            {
+                zi->ci.buffered_data[0] = LZMA_VERSION_MAJOR;
+                zi->ci.buffered_data[1] = LZMA_VERSION_MINOR;
+                zip64local_putValue_inmemory(zi->ci.buffered_data + 2, (ZPOS64_T)size_props, 2);
+                zi->ci.pos_in_buffered_data = 4 + size_props;
+                zi->ci.stream.next_out = zi->ci.buffered_data + zi->ci.pos_in_buffered_data;
+                zi->ci.stream.avail_out -= zi->ci.pos_in_buffered_data;
+            }
+        }
+        if (err==ZIP_OK)
+            zi->ci.stream_initialised = zi->ci.method;
+    }
+#endif
 
 #    ifndef NOCRYPT
     zi->ci.crypt_header_size = 0;
+#      ifndef NOAES
+    if ((err==Z_OK) && (zi->ci.aes != 0))
+    {
+        /* the salt and the password verification value come before the data */
+        unsigned char bufHead[ZAES_MAX_SALT_LEN + ZAES_PWVERIFY_LEN];
+        unsigned int sizeSalt = ZAES_SALT_LEN(zi->ci.aes);
+        zi->ci.encrypt = 1;
+        if (!zaes_random(bufHead, sizeSalt))
+            err = ZIP_INTERNALERROR;
+        else
+        {
+            zaes_init(&zi->ci.aes_ctx, zi->ci.aes, password, bufHead, bufHead + sizeSalt);
+            zi->ci.crypt_header_size = sizeSalt + ZAES_PWVERIFY_LEN;
+            err = zip64local_Write(zi, bufHead, zi->ci.crypt_header_size);
+        }
+    }
+    else
+#      endif
     if ((err==Z_OK) && (password != NULL))
     {
         unsigned char bufHead[RAND_HEAD_LEN];
@@ -1220,16 +1207,31 @@ extern int ZEXPORT zipOpenNewFileInZip4_64(zipFile file, const char* filename, c
         zi->ci.pcrc_32_tab = get_crc_table();
         /*init_keys(password,zi->ci.keys,zi->ci.pcrc_32_tab);*/
 
+        /* with a data descriptor, the check byte of the header is the high
+           byte of the time, the crc being unknown when reading it */
+        if (zi->streaming)
+          crcForCrypting = (zi->ci.dosDate & 0xffff) << 16;
+
         sizeHead=crypthead(password,bufHead,RAND_HEAD_LEN,zi->ci.keys,zi->ci.pcrc_32_tab,crcForCrypting);
         zi->ci.crypt_header_size = sizeHead;
 
-        if (ZWRITE64(zi->z_filefunc,zi->filestream,bufHead,sizeHead) != sizeHead)
-                err = ZIP_ERRNO;
+        err = zip64local_Write(zi, bufHead, sizeHead);
     }
 #    endif
 
     if (err==Z_OK)
         zi->in_opened_file_inzip = 1;
+    else
+    {
+        free(zi->ci.central_header);
+        zi->ci.central_header = NULL;
+        if (zi->ci.parallel)
+        {
+            free(zi->ci.pz_in);
+            free(zi->ci.pz_out);
+            zi->ci.parallel = 0;
+        }
+    }
     return err;
 }
 
@@ -1329,16 +1331,22 @@ local int zip64FlushWriteBuffer(zip64_internal* zi) {
 
     if (zi->ci.encrypt != 0)
     {
+#ifndef NOAES
+        if (zi->ci.aes)
+            zaes_encrypt(&zi->ci.aes_ctx, zi->ci.buffered_data, zi->ci.pos_in_buffered_data);
+        else
+#endif
+        {
 #ifndef NOCRYPT
         uInt i;
         int t;
         for (i=0;i<zi->ci.pos_in_buffered_data;i++)
             zi->ci.buffered_data[i] = zencode(zi->ci.keys, zi->ci.pcrc_32_tab, zi->ci.buffered_data[i],t);
 #endif
+        }
     }
 
-    if (ZWRITE64(zi->z_filefunc,zi->filestream,zi->ci.buffered_data,zi->ci.pos_in_buffered_data) != zi->ci.pos_in_buffered_data)
-      err = ZIP_ERRNO;
+    err = zip64local_Write(zi, zi->ci.buffered_data, zi->ci.pos_in_buffered_data);
 
     zi->ci.totalCompressedData += zi->ci.pos_in_buffered_data;
 
@@ -1362,33 +1370,326 @@ local int zip64FlushWriteBuffer(zip64_internal* zi) {
     return err;
 }
 
-extern int ZEXPORT zipWriteInFileInZip(zipFile file, const void* buf, unsigned int len) {
-    zip64_internal* zi;
-    int err=ZIP_OK;
-
-    if (file == NULL)
-        return ZIP_PARAMERROR;
-    zi = (zip64_internal*)file;
-
-    if (zi->in_opened_file_inzip == 0)
-        return ZIP_PARAMERROR;
+/*
+  Add compressed data in buffered_data, writing it each time it is full
+*/
+local int zip64local_WriteInBuffer(zip64_internal* zi, const unsigned char* buf, uLong len) {
+    while (len > 0)
+    {
+        uInt copy_this = Z_BUFSIZE - zi->ci.pos_in_buffered_data;
+        if (len < copy_this)
+            copy_this = (uInt)len;
+        memcpy(zi->ci.buffered_data + zi->ci.pos_in_buffered_data, buf, copy_this);
+        zi->ci.pos_in_buffered_data += copy_this;
+        buf += copy_this;
+        len -= copy_this;
+        if ((zi->ci.pos_in_buffered_data == Z_BUFSIZE) && (zip64FlushWriteBuffer(zi) == ZIP_ERRNO))
+            return ZIP_ERRNO;
+    }
+    return ZIP_OK;
+}
 
-    zi->ci.crc32 = crc32(zi->ci.crc32,buf,(uInt)len);
+typedef struct
+{
+    const unsigned char* in;    /* input of the block, preceded by its dictionary */
+    uLong in_size;
+    uLong dict_size;
+    unsigned char* out;
+    uLong out_size;             /* room in out, then size of the compressed block */
+    uLong crc;                  /* crc32 of the input */
+    int err;
+} zip64_deflate_block;
 
-#ifdef HAVE_BZIP2
-    if(zi->ci.method == Z_BZIP2ED && (!zi->ci.raw))
+typedef struct
+{
+    zip64_deflate_block* blocks;
+    int number_block;
+    int next_block;             /* next block to give to a thread */
+    int finish;                 /* the last block ends the deflate stream */
+    int level;
+    int windowBits;
+    int memLevel;
+    int strategy;
+    zthread_mutex mutex;
+} zip64_deflate_batch;
+
+local void zip64local_DeflateThread(void* arg) {
+    zip64_deflate_batch* batch = (zip64_deflate_batch*)arg;
+    z_stream stream;
+    int stream_initialised = 0;
+
+    for (;;)
     {
-      zi->ci.bstream.next_in = (void*)buf;
-      zi->ci.bstream.avail_in = len;
-      err = BZ_RUN_OK;
+        zip64_deflate_block* block;
+        int last;
+        int err;
 
-      while ((err==BZ_RUN_OK) && (zi->ci.bstream.avail_in>0))
-      {
-        if (zi->ci.bstream.avail_out == 0)
+        zthread_mutex_lock(&batch->mutex);
+        if (batch->next_block == batch->number_block)
         {
-          if (zip64FlushWriteBuffer(zi) == ZIP_ERRNO)
-            err = ZIP_ERRNO;
-          zi->ci.bstream.avail_out = (uInt)Z_BUFSIZE;
+            zthread_mutex_unlock(&batch->mutex);
+            break;
+        }
+        last = (batch->next_block == batch->number_block - 1);
+        block = &batch->blocks[batch->next_block++];
+        zthread_mutex_unlock(&batch->mutex);
+
+        if (!stream_initialised)
+        {
+            stream.zalloc = (alloc_func)0;
+            stream.zfree = (free_func)0;
+            stream.opaque = (voidpf)0;
+            if (deflateInit2(&stream, batch->level, Z_DEFLATED, batch->windowBits,
+                             batch->memLevel, batch->strategy) != Z_OK)
+            {
+                block->err = ZIP_INTERNALERROR;
+                continue;
+            }
+            stream_initialised = 1;
+        }
+        else
+            deflateReset(&stream);
+
+        if (block->dict_size > 0)
+            deflateSetDictionary(&stream, block->in - block->dict_size, (uInt)block->dict_size);
+
+        stream.next_in = (Bytef*)(uintptr_t)block->in;
+        stream.avail_in = (uInt)block->in_size;
+        stream.next_out = block->out;
+        stream.avail_out = (uInt)block->out_size;
+        /* a sync flush ends each block on a byte boundary, without the last
+           block bit, so the blocks can be concatenated in one stream */
+        err = deflate(&stream, (last && batch->finish) ? Z_FINISH : Z_SYNC_FLUSH);
+        if ((err != ((last && batch->finish) ? Z_STREAM_END : Z_OK)) ||
+            (stream.avail_in != 0) || (stream.avail_out == 0))
+            block->err = ZIP_INTERNALERROR;
+        block->out_size -= stream.avail_out;
+        block->crc = zcrc32(0L, block->in, (size_t)block->in_size);
+    }
+
+    if (stream_initialised)
+        deflateEnd(&stream);
+}
+
+/*
+  Compress the input collected in pz_in by blocks of parallel_block_size on
+    threads, each block using the 32 KB of input before it as dictionary,
+    and write them in order. If finish is set, the last block (maybe empty)
+    ends the deflate stream.
+*/
+local int zip64local_DeflateBlocks(zip64_internal* zi, int finish) {
+    zip64_deflate_block blocks[ZTHREAD_MAX];
+    zip64_deflate_batch batch;
+    uLong block_size = zi->parallel_block_size;
+    uLong total;
+    uLong keep;
+    int i;
+    int err = ZIP_OK;
+
+    batch.number_block = (int)((zi->ci.pz_in_size + block_size - 1) / block_size);
+    if ((batch.number_block == 0) && finish)
+        batch.number_block = 1;
+    if (batch.number_block == 0)
+        return ZIP_OK;
+
+    for (i = 0; i < batch.number_block; i++)
+    {
+        uLong offset = i * block_size;
+        blocks[i].in = zi->ci.pz_in + zi->ci.pz_dict + offset;
+        blocks[i].in_size = zi->ci.pz_in_size - offset;
+        if (blocks[i].in_size > block_size)
+            blocks[i].in_size = block_size;
+        blocks[i].dict_size = zi->ci.pz_dict + offset;
+        if (blocks[i].dict_size > Z_PARALLEL_DICTSIZE)
+            blocks[i].dict_size = Z_PARALLEL_DICTSIZE;
+        blocks[i].out = zi->ci.pz_out + i * zi->ci.pz_out_block;
+        blocks[i].out_size = zi->ci.pz_out_block;
+        blocks[i].err = ZIP_OK;
+    }
+
+    batch.blocks = blocks;
+    batch.next_block = 0;
+    batch.finish = finish;
+    batch.level = zi->ci.level;
+    batch.windowBits = zi->ci.windowBits;
+    batch.memLevel = zi->ci.memLevel;
+    batch.strategy = zi->ci.strategy;
+    zthread_mutex_init(&batch.mutex);
+    zthread_run((batch.number_block < zi->ci.threads) ? batch.number_block : zi->ci.threads,
+                zip64local_DeflateThread, &batch);
+    zthread_mutex_destroy(&batch.mutex);
+
+    for (i = 0; (i < batch.number_block) && (err == ZIP_OK); i++)
+    {
+        err = blocks[i].err;
+        if (err == ZIP_OK)
+            err = zip64local_WriteInBuffer(zi, blocks[i].out, blocks[i].out_size);
+        zi->ci.crc32 = crc32_combine(zi->ci.crc32, blocks[i].crc, (z_off_t)blocks[i].in_size);
+        zi->ci.totalUncompressedData += blocks[i].in_size;
+    }
+
+    /* keep the end of the input as dictionary of the next blocks */
+    total = zi->ci.pz_dict + zi->ci.pz_in_size;
+    keep = (total < Z_PARALLEL_DICTSIZE) ? total : Z_PARALLEL_DICTSIZE;
+    memmove(zi->ci.pz_in, zi->ci.pz_in + total - keep, keep);
+    zi->ci.pz_dict = keep;
+    zi->ci.pz_in_size = 0;
+    return err;
+}
+
+#ifdef HAVE_ZSTD
+/*
+  Compress input with zstd in the free part of buffered_data, given by
+    stream.next_out and stream.avail_out as for deflate. *remaining gets
+    what zstd still has to output, 0 once the frame is ended by ZSTD_e_end.
+*/
+local int zip64local_ZstdCompress(zip64_internal* zi, ZSTD_inBuffer* input,
+                                  ZSTD_EndDirective mode, size_t* remaining) {
+    ZSTD_outBuffer output;
+    size_t pos_in = input->pos;
+    size_t ret;
+
+    output.dst = zi->ci.stream.next_out;
+    output.size = zi->ci.stream.avail_out;
+    output.pos = 0;
+    ret = ZSTD_compressStream2(zi->ci.zstream, &output, input, mode);
+
+    zi->ci.stream.next_out += output.pos;
+    zi->ci.stream.avail_out -= (uInt)output.pos;
+    zi->ci.stream.total_out += output.pos;
+    zi->ci.stream.total_in += input->pos - pos_in;
+    zi->ci.pos_in_buffered_data += (uInt)output.pos;
+    if (ZSTD_isError(ret))
+        return ZIP_INTERNALERROR;
+    if (remaining != NULL)
+        *remaining = ret;
+    return ZIP_OK;
+}
+#endif
+
+#ifdef HAVE_LZMA
+/*
+  Run liblzma on lstream.next_in, output in the free part of buffered_data as
+    for deflate. Return Z_STREAM_END once LZMA_FINISH has ended the data.
+*/
+local int zip64local_LzmaCode(zip64_internal* zi, lzma_action action) {
+    size_t avail_in = zi->ci.lstream.avail_in;
+    uInt produced;
+    lzma_ret ret;
+
+    zi->ci.lstream.next_out = zi->ci.stream.next_out;
+    zi->ci.lstream.avail_out = zi->ci.stream.avail_out;
+    ret = lzma_code(&zi->ci.lstream, action);
+    produced = zi->ci.stream.avail_out - (uInt)zi->ci.lstream.avail_out;
+
+    zi->ci.stream.next_out += produced;
+    zi->ci.stream.avail_out -= produced;
+    zi->ci.stream.total_out += produced;
+    zi->ci.stream.total_in += avail_in - zi->ci.lstream.avail_in;
+    zi->ci.pos_in_buffered_data += produced;
+    if (ret == LZMA_STREAM_END)
+        return Z_STREAM_END;
+    return (ret == LZMA_OK) ? ZIP_OK : ZIP_INTERNALERROR;
+}
+#endif
+
+extern int ZEXPORT zipWriteInFileInZip(zipFile file, const void* buf, unsigned int len) {
+    zip64_internal* zi;
+    int err=ZIP_OK;
+
+    if (file == NULL)
+        return ZIP_PARAMERROR;
+    zi = (zip64_internal*)file;
+
+    if (zi->in_opened_file_inzip == 0)
+        return ZIP_PARAMERROR;
+
+    if (zi->ci.parallel)
+    {
+        /* collect the input, and compress it when we have a block by thread */
+        const unsigned char* from_copy = (const unsigned char*)buf;
+        uLong batch_size = zi->ci.threads * zi->parallel_block_size;
+
+        while ((err==ZIP_OK) && (len>0))
+        {
+            uLong copy_this = batch_size - zi->ci.pz_in_size;
+            if (len < copy_this)
+                copy_this = len;
+            memcpy(zi->ci.pz_in + zi->ci.pz_dict + zi->ci.pz_in_size, from_copy, copy_this);
+            zi->ci.pz_in_size += copy_this;
+            from_copy += copy_this;
+            len -= (unsigned int)copy_this;
+            if (zi->ci.pz_in_size == batch_size)
+                err = zip64local_DeflateBlocks(zi, 0);
+        }
+        return err;
+    }
+
+    /* stored data is checked while it is written or copied, see below */
+    if ((zi->ci.method == Z_DEFLATED) && (!zi->ci.raw))
+        zi->ci.crc32 = zcrc32(zi->ci.crc32,buf,len);
+
+#ifdef HAVE_ZSTD
+    if ((zi->ci.method == Z_ZSTD) && (!zi->ci.raw))
+    {
+      ZSTD_inBuffer input;
+      zi->ci.crc32 = zcrc32(zi->ci.crc32,buf,len);
+      input.src = buf;
+      input.size = len;
+      input.pos = 0;
+
+      while ((err==ZIP_OK) && (input.pos < input.size))
+      {
+        if (zi->ci.stream.avail_out == 0)
+        {
+          if (zip64FlushWriteBuffer(zi) == ZIP_ERRNO)
+            err = ZIP_ERRNO;
+          zi->ci.stream.avail_out = (uInt)Z_BUFSIZE;
+          zi->ci.stream.next_out = zi->ci.buffered_data;
+        }
+        if (err==ZIP_OK)
+          err = zip64local_ZstdCompress(zi, &input, ZSTD_e_continue, NULL);
+      }
+    }
+    else
+#endif
+#ifdef HAVE_LZMA
+    if (((zi->ci.method == Z_LZMA) || (zi->ci.method == Z_XZ)) && (!zi->ci.raw))
+    {
+      zi->ci.crc32 = zcrc32(zi->ci.crc32,buf,len);
+      zi->ci.lstream.next_in = (const uint8_t*)buf;
+      zi->ci.lstream.avail_in = len;
+
+      while ((err==ZIP_OK) && (zi->ci.lstream.avail_in > 0))
+      {
+        if (zi->ci.stream.avail_out == 0)
+        {
+          if (zip64FlushWriteBuffer(zi) == ZIP_ERRNO)
+            err = ZIP_ERRNO;
+          zi->ci.stream.avail_out = (uInt)Z_BUFSIZE;
+          zi->ci.stream.next_out = zi->ci.buffered_data;
+        }
+        if (err==ZIP_OK)
+          err = zip64local_LzmaCode(zi, LZMA_RUN);
+      }
+    }
+    else
+#endif
+#ifdef HAVE_BZIP2
+    if(zi->ci.method == Z_BZIP2ED && (!zi->ci.raw))
+    {
+      zi->ci.crc32 = zcrc32(zi->ci.crc32,buf,len);
+      zi->ci.bstream.next_in = (void*)buf;
+      zi->ci.bstream.avail_in = len;
+      err = BZ_RUN_OK;
+
+      while ((err==BZ_RUN_OK) && (zi->ci.bstream.avail_in>0))
+      {
+        if (zi->ci.bstream.avail_out == 0)
+        {
+          if (zip64FlushWriteBuffer(zi) == ZIP_ERRNO)
+            err = ZIP_ERRNO;
+          zi->ci.bstream.avail_out = (uInt)Z_BUFSIZE;
           zi->ci.bstream.next_out = (char*)zi->ci.buffered_data;
         }
 
@@ -1436,17 +1737,33 @@ extern int ZEXPORT zipWriteInFileInZip(zipFile file, const void* buf, unsigned i
 
               zi->ci.pos_in_buffered_data += (uInt)(zi->ci.stream.total_out - uTotalOutBefore) ;
           }
+          else if ((zi->ci.pos_in_buffered_data == 0) && (zi->ci.encrypt == 0) &&
+                   (zi->ci.stream.avail_in >= Z_BUFSIZE))
+          {
+              /* the buffer is empty and we have at least a full buffer to
+                 store: write it directly instead of copying it in buffered_data */
+              uInt write_this = zi->ci.stream.avail_in - (zi->ci.stream.avail_in % Z_BUFSIZE);
+              if (!zi->ci.raw)
+                  zi->ci.crc32 = zcrc32(zi->ci.crc32, zi->ci.stream.next_in, write_this);
+              err = zip64local_Write(zi, zi->ci.stream.next_in, write_this);
+              zi->ci.totalCompressedData += write_this;
+              zi->ci.totalUncompressedData += write_this;
+              zi->ci.stream.avail_in -= write_this;
+              zi->ci.stream.next_in += write_this;
+          }
           else
           {
-              uInt copy_this,i;
+              uInt copy_this;
               if (zi->ci.stream.avail_in < zi->ci.stream.avail_out)
                   copy_this = zi->ci.stream.avail_in;
               else
                   copy_this = zi->ci.stream.avail_out;
 
-              for (i = 0; i < copy_this; i++)
-                  *(((char*)zi->ci.stream.next_out)+i) =
-                      *(((const char*)zi->ci.stream.next_in)+i);
+              /* raw data comes with its crc, given to zipCloseFileInZipRaw64 */
+              if (zi->ci.raw)
+                  memcpy(zi->ci.stream.next_out, zi->ci.stream.next_in, copy_this);
+              else
+                  zi->ci.crc32 = zcrc32_copy(zi->ci.crc32, zi->ci.stream.next_out, zi->ci.stream.next_in, copy_this);
               {
                   zi->ci.stream.avail_in -= copy_this;
                   zi->ci.stream.avail_out-= copy_this;
@@ -1467,6 +1784,35 @@ extern int ZEXPORT zipCloseFileInZipRaw(zipFile file, uLong uncompressed_size, u
     return zipCloseFileInZipRaw64 (file, uncompressed_size, crc32);
 }
 
+/*
+  In streaming mode the local header can't be updated: the crc and the sizes
+    follow the data, 8 bytes sizes if the local header has a zip64 extra field.
+*/
+local int Write_DataDescriptor(zip64_internal* zi, uLong crc32, ZPOS64_T compressed_size, ZPOS64_T uncompressed_size) {
+    unsigned char buf[24];
+    uLong size;
+
+    if ((zi->ci.pos_zip64extrainfo == 0) &&
+        (uncompressed_size >= 0xffffffff || compressed_size >= 0xffffffff))
+        return ZIP_BADZIPFILE; // Caller passed zip64 = 0, so no room for zip64 info -> fatal
+
+    zip64local_putValue_inmemory(buf,(uLong)DATADESCRIPTORMAGIC,4);
+    zip64local_putValue_inmemory(buf+4,crc32,4);
+    if (zi->ci.pos_zip64extrainfo > 0)
+    {
+        zip64local_putValue_inmemory(buf+8,compressed_size,8);
+        zip64local_putValue_inmemory(buf+16,uncompressed_size,8);
+        size = 24;
+    }
+    else
+    {
+        zip64local_putValue_inmemory(buf+8,compressed_size,4);
+        zip64local_putValue_inmemory(buf+12,uncompressed_size,4);
+        size = 16;
+    }
+    return zip64local_Write(zi, buf, size);
+}
+
 extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, ZPOS64_T uncompressed_size, uLong crc32) {
     zip64_internal* zi;
     ZPOS64_T compressed_size;
@@ -1482,7 +1828,9 @@ extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, ZPOS64_T uncompressed_si
         return ZIP_PARAMERROR;
     zi->ci.stream.avail_in = 0;
 
-    if ((zi->ci.method == Z_DEFLATED) && (!zi->ci.raw))
+    if (zi->ci.parallel)
+        err = zip64local_DeflateBlocks(zi, 1);
+    else if ((zi->ci.method == Z_DEFLATED) && (!zi->ci.raw))
                 {
                         while (err==ZIP_OK)
                         {
@@ -1525,6 +1873,48 @@ extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, ZPOS64_T uncompressed_si
         err = ZIP_OK;
 #endif
     }
+#ifdef HAVE_ZSTD
+    else if ((zi->ci.method == Z_ZSTD) && (!zi->ci.raw))
+    {
+      ZSTD_inBuffer input;
+      size_t remaining = 1;
+      input.src = NULL;
+      input.size = 0;
+      input.pos = 0;
+
+      while ((err==ZIP_OK) && (remaining != 0))
+      {
+        if (zi->ci.stream.avail_out == 0)
+        {
+          if (zip64FlushWriteBuffer(zi) == ZIP_ERRNO)
+            err = ZIP_ERRNO;
+          zi->ci.stream.avail_out = (uInt)Z_BUFSIZE;
+          zi->ci.stream.next_out = zi->ci.buffered_data;
+        }
+        if (err==ZIP_OK)
+          err = zip64local_ZstdCompress(zi, &input, ZSTD_e_end, &remaining);
+      }
+    }
+#endif
+#ifdef HAVE_LZMA
+    else if (((zi->ci.method == Z_LZMA) || (zi->ci.method == Z_XZ)) && (!zi->ci.raw))
+    {
+      zi->ci.lstream.next_in = NULL;
+      zi->ci.lstream.avail_in = 0;
+      while (err==ZIP_OK)
+      {
+        if (zi->ci.stream.avail_out == 0)
+        {
+          if (zip64FlushWriteBuffer(zi) == ZIP_ERRNO)
+            err = ZIP_ERRNO;
+          zi->ci.stream.avail_out = (uInt)Z_BUFSIZE;
+          zi->ci.stream.next_out = zi->ci.buffered_data;
+        }
+        if (err==ZIP_OK)
+          err = zip64local_LzmaCode(zi, LZMA_FINISH);
+      }
+    }
+#endif
 
     if (err==Z_STREAM_END)
         err=ZIP_OK; /* this is normal */
@@ -1535,11 +1925,29 @@ extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, ZPOS64_T uncompressed_si
             err = ZIP_ERRNO;
                 }
 
-    if ((zi->ci.method == Z_DEFLATED) && (!zi->ci.raw))
+#ifndef NOAES
+    if ((zi->ci.aes) && (err==ZIP_OK))
     {
-        int tmp_err = deflateEnd(&zi->ci.stream);
-        if (err == ZIP_OK)
-            err = tmp_err;
+        /* the authentication code ends the data of the file */
+        unsigned char authcode[ZAES_AUTHCODE_LEN];
+        zaes_authcode(&zi->ci.aes_ctx, authcode);
+        err = zip64local_Write(zi, authcode, ZAES_AUTHCODE_LEN);
+        zi->ci.totalCompressedData += ZAES_AUTHCODE_LEN;
+    }
+#endif
+
+    if (zi->ci.parallel)
+    {
+        free(zi->ci.pz_in);
+        free(zi->ci.pz_out);
+        zi->ci.pz_in = NULL;
+        zi->ci.pz_out = NULL;
+        zi->ci.parallel = 0;
+    }
+    else if (((zi->ci.method == Z_DEFLATED) || (zi->ci.method == Z_ZSTD) ||
+              (zi->ci.method == Z_LZMA) || (zi->ci.method == Z_XZ)) && (!zi->ci.raw))
+    {
+        /* the deflate state, zstd and lzma contexts are kept for the next file */
         zi->ci.stream_initialised = 0;
     }
 #ifdef HAVE_BZIP2
@@ -1557,6 +1965,8 @@ extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, ZPOS64_T uncompressed_si
         crc32 = (uLong)zi->ci.crc32;
         uncompressed_size = zi->ci.totalUncompressedData;
     }
+    if (zi->ci.aes)
+        crc32 = 0; /* AE-2: the authentication code replaces the crc */
     compressed_size = zi->ci.totalCompressedData;
 
 #    ifndef NOCRYPT
@@ -1569,7 +1979,7 @@ extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, ZPOS64_T uncompressed_si
       /*version Made by*/
       zip64local_putValue_inmemory(zi->ci.central_header+4,(uLong)45,2);
       /*version needed*/
-      zip64local_putValue_inmemory(zi->ci.central_header+6,(uLong)45,2);
+      zip64local_putValue_inmemory(zi->ci.central_header+6,zip64local_VersionNeeded(zi, 1),2);
 
     }
 
@@ -1654,42 +2064,46 @@ extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, ZPOS64_T uncompressed_si
 
     free(zi->ci.central_header);
 
-    if (err==ZIP_OK)
+    if ((err==ZIP_OK) && (zi->streaming))
+        err = Write_DataDescriptor(zi, crc32, compressed_size, uncompressed_size);
+    else if (err==ZIP_OK)
     {
         // Update the LocalFileHeader with the new values.
 
         ZPOS64_T cur_pos_inzip = ZTELL64(zi->z_filefunc,zi->filestream);
 
-        if (ZSEEK64(zi->z_filefunc,zi->filestream, zi->ci.pos_local_header + 14,ZLIB_FILEFUNC_SEEK_SET)!=0)
-            err = ZIP_ERRNO;
+        // The copy of the header kept by Write_LocalFileHeader is patched, and
+        // the part from the crc to the last updated byte is written at once.
+        unsigned char* header = zi->ci.local_header.data;
+        uLong size_update = 12;
 
-        if (err==ZIP_OK)
-            err = zip64local_putValue(&zi->z_filefunc,zi->filestream,crc32,4); /* crc 32, unknown */
+        zip64local_putValue_inmemory(header+14,crc32,4); /* crc 32 */
 
         if(uncompressed_size >= 0xffffffff || compressed_size >= 0xffffffff )
         {
           if(zi->ci.pos_zip64extrainfo > 0)
           {
             // Update the size in the ZIP64 extended field.
-            if (ZSEEK64(zi->z_filefunc,zi->filestream, zi->ci.pos_zip64extrainfo + 4,ZLIB_FILEFUNC_SEEK_SET)!=0)
-              err = ZIP_ERRNO;
-
-            if (err==ZIP_OK) /* compressed size, unknown */
-              err = zip64local_putValue(&zi->z_filefunc, zi->filestream, uncompressed_size, 8);
-
-            if (err==ZIP_OK) /* uncompressed size, unknown */
-              err = zip64local_putValue(&zi->z_filefunc, zi->filestream, compressed_size, 8);
+            uLong pos_extra = (uLong)(zi->ci.pos_zip64extrainfo - zi->ci.pos_local_header);
+            zip64local_putValue_inmemory(header+pos_extra+4, uncompressed_size, 8);
+            zip64local_putValue_inmemory(header+pos_extra+12, compressed_size, 8);
+            size_update = pos_extra + 20 - 14;
           }
           else
               err = ZIP_BADZIPFILE; // Caller passed zip64 = 0, so no room for zip64 info -> fatal
         }
         else
         {
-          if (err==ZIP_OK) /* compressed size, unknown */
-              err = zip64local_putValue(&zi->z_filefunc,zi->filestream,compressed_size,4);
+          zip64local_putValue_inmemory(header+18,compressed_size,4);
+          zip64local_putValue_inmemory(header+22,uncompressed_size,4);
+        }
 
-          if (err==ZIP_OK) /* uncompressed size, unknown */
-              err = zip64local_putValue(&zi->z_filefunc,zi->filestream,uncompressed_size,4);
+        if (err==ZIP_OK)
+        {
+          if (ZSEEK64(zi->z_filefunc,zi->filestream, zi->ci.pos_local_header + 14,ZLIB_FILEFUNC_SEEK_SET)!=0)
+              err = ZIP_ERRNO;
+          else if (ZWRITE64(zi->z_filefunc,zi->filestream, header+14, size_update) != size_update)
+              err = ZIP_ERRNO;
         }
 
         if (ZSEEK64(zi->z_filefunc,zi->filestream, cur_pos_inzip,ZLIB_FILEFUNC_SEEK_SET)!=0)
@@ -1706,108 +2120,126 @@ extern int ZEXPORT zipCloseFileInZip(zipFile file) {
     return zipCloseFileInZipRaw (file,0,0);
 }
 
+local int add_value_in_datablock(datablock* db, ZPOS64_T x, int nbByte) {
+    unsigned char buf[8];
+    zip64local_putValue_inmemory(buf, x, nbByte);
+    return add_data_in_datablock(db, buf, (uLong)nbByte);
+}
+
+/*
+  The records closing the archive are appended to the central directory
+    buffer, so zipClose writes everything with a single write.
+*/
 local int Write_Zip64EndOfCentralDirectoryLocator(zip64_internal* zi, ZPOS64_T zip64eocd_pos_inzip) {
   int err = ZIP_OK;
+  datablock* db = &zi->central_dir;
   ZPOS64_T pos = zip64eocd_pos_inzip - zi->add_position_when_writing_offset;
 
-  err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)ZIP64ENDLOCHEADERMAGIC,4);
+  err = add_value_in_datablock(db,(uLong)ZIP64ENDLOCHEADERMAGIC,4);
 
   /*num disks*/
     if (err==ZIP_OK) /* number of the disk with the start of the central directory */
-      err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)0,4);
+      err = add_value_in_datablock(db,(uLong)0,4);
 
   /*relative offset*/
     if (err==ZIP_OK) /* Relative offset to the Zip64EndOfCentralDirectory */
-      err = zip64local_putValue(&zi->z_filefunc,zi->filestream, pos,8);
+      err = add_value_in_datablock(db, pos,8);
 
   /*total disks*/ /* Do not support spawning of disk so always say 1 here*/
     if (err==ZIP_OK) /* number of the disk with the start of the central directory */
-      err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)1,4);
+      err = add_value_in_datablock(db,(uLong)1,4);
 
     return err;
 }
 
-local int Write_Zip64EndOfCentralDirectoryRecord(zip64_internal* zi, uLong size_centraldir, ZPOS64_T centraldir_pos_inzip) {
+local int Write_Zip64EndOfCentralDirectoryRecord(zip64_internal* zi, ZPOS64_T size_centraldir, ZPOS64_T centraldir_pos_inzip) {
   int err = ZIP_OK;
+  datablock* db = &zi->central_dir;
 
   uLong Zip64DataSize = 44;
 
-  err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)ZIP64ENDHEADERMAGIC,4);
+  err = add_value_in_datablock(db,(uLong)ZIP64ENDHEADERMAGIC,4);
 
   if (err==ZIP_OK) /* size of this 'zip64 end of central directory' */
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(ZPOS64_T)Zip64DataSize,8); // why ZPOS64_T of this ?
+    err = add_value_in_datablock(db,(ZPOS64_T)Zip64DataSize,8); // why ZPOS64_T of this ?
 
   if (err==ZIP_OK) /* version made by */
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)45,2);
+    err = add_value_in_datablock(db,(uLong)45,2);
 
   if (err==ZIP_OK) /* version needed */
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)45,2);
+    err = add_value_in_datablock(db,(uLong)45,2);
 
   if (err==ZIP_OK) /* number of this disk */
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)0,4);
+    err = add_value_in_datablock(db,(uLong)0,4);
 
   if (err==ZIP_OK) /* number of the disk with the start of the central directory */
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)0,4);
+    err = add_value_in_datablock(db,(uLong)0,4);
 
   if (err==ZIP_OK) /* total number of entries in the central dir on this disk */
-    err = zip64local_putValue(&zi->z_filefunc, zi->filestream, zi->number_entry, 8);
+    err = add_value_in_datablock(db, zi->number_entry, 8);
 
   if (err==ZIP_OK) /* total number of entries in the central dir */
-    err = zip64local_putValue(&zi->z_filefunc, zi->filestream, zi->number_entry, 8);
+    err = add_value_in_datablock(db, zi->number_entry, 8);
 
   if (err==ZIP_OK) /* size of the central directory */
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(ZPOS64_T)size_centraldir,8);
+    err = add_value_in_datablock(db,(ZPOS64_T)size_centraldir,8);
 
   if (err==ZIP_OK) /* offset of start of central directory with respect to the starting disk number */
   {
     ZPOS64_T pos = centraldir_pos_inzip - zi->add_position_when_writing_offset;
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream, (ZPOS64_T)pos,8);
+    err = add_value_in_datablock(db, (ZPOS64_T)pos,8);
   }
   return err;
 }
 
-local int Write_EndOfCentralDirectoryRecord(zip64_internal* zi, uLong size_centraldir, ZPOS64_T centraldir_pos_inzip) {
+local int Write_EndOfCentralDirectoryRecord(zip64_internal* zi, ZPOS64_T size_centraldir, ZPOS64_T centraldir_pos_inzip) {
   int err = ZIP_OK;
+  datablock* db = &zi->central_dir;
 
   /*signature*/
-  err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)ENDHEADERMAGIC,4);
+  err = add_value_in_datablock(db,(uLong)ENDHEADERMAGIC,4);
 
   if (err==ZIP_OK) /* number of this disk */
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)0,2);
+    err = add_value_in_datablock(db,(uLong)0,2);
 
   if (err==ZIP_OK) /* number of the disk with the start of the central directory */
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)0,2);
+    err = add_value_in_datablock(db,(uLong)0,2);
 
   if (err==ZIP_OK) /* total number of entries in the central dir on this disk */
   {
     {
       if(zi->number_entry >= 0xFFFF)
-        err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)0xffff,2); // use value in ZIP64 record
+        err = add_value_in_datablock(db,(uLong)0xffff,2); // use value in ZIP64 record
       else
-        err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)zi->number_entry,2);
+        err = add_value_in_datablock(db,(uLong)zi->number_entry,2);
     }
   }
 
   if (err==ZIP_OK) /* total number of entries in the central dir */
   {
     if(zi->number_entry >= 0xFFFF)
-      err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)0xffff,2); // use value in ZIP64 record
+      err = add_value_in_datablock(db,(uLong)0xffff,2); // use value in ZIP64 record
     else
-      err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)zi->number_entry,2);
+      err = add_value_in_datablock(db,(uLong)zi->number_entry,2);
   }
 
   if (err==ZIP_OK) /* size of the central directory */
-    err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)size_centraldir,4);
+  {
+    if(size_centraldir >= 0xffffffff)
+      err = add_value_in_datablock(db,(uLong)0xffffffff,4); // use value in ZIP64 record
+    else
+      err = add_value_in_datablock(db,(uLong)size_centraldir,4);
+  }
 
   if (err==ZIP_OK) /* offset of start of central directory with respect to the starting disk number */
   {
     ZPOS64_T pos = centraldir_pos_inzip - zi->add_position_when_writing_offset;
     if(pos >= 0xffffffff)
     {
-      err = zip64local_putValue(&zi->z_filefunc,zi->filestream, (uLong)0xffffffff,4);
+      err = add_value_in_datablock(db, (uLong)0xffffffff,4);
     }
     else
-      err = zip64local_putValue(&zi->z_filefunc,zi->filestream, (uLong)(centraldir_pos_inzip - zi->add_position_when_writing_offset),4);
+      err = add_value_in_datablock(db, (uLong)(centraldir_pos_inzip - zi->add_position_when_writing_offset),4);
   }
 
    return err;
@@ -1820,20 +2252,17 @@ local int Write_GlobalComment(zip64_internal* zi, const char* global_comment) {
   if(global_comment != NULL)
     size_global_comment = (uInt)strlen(global_comment);
 
-  err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)size_global_comment,2);
+  err = add_value_in_datablock(&zi->central_dir,(uLong)size_global_comment,2);
 
   if (err == ZIP_OK && size_global_comment > 0)
-  {
-    if (ZWRITE64(zi->z_filefunc,zi->filestream, global_comment, size_global_comment) != size_global_comment)
-      err = ZIP_ERRNO;
-  }
+    err = add_data_in_datablock(&zi->central_dir, global_comment, size_global_comment);
   return err;
 }
 
 extern int ZEXPORT zipClose(zipFile file, const char* global_comment) {
     zip64_internal* zi;
     int err = 0;
-    uLong size_centraldir = 0;
+    ZPOS64_T size_centraldir = 0;
     ZPOS64_T centraldir_pos_inzip;
     ZPOS64_T pos;
 
@@ -1847,37 +2276,45 @@ extern int ZEXPORT zipClose(zipFile file, const char* global_comment) {
         err = zipCloseFileInZip (file);
     }
 
+    if (zi->ci.deflate_initialised)
+    {
+        deflateEnd(&zi->ci.stream);
+        zi->ci.deflate_initialised = 0;
+    }
+#ifdef HAVE_ZSTD
+    ZSTD_freeCCtx(zi->ci.zstream);
+    zi->ci.zstream = NULL;
+#endif
+#ifdef HAVE_LZMA
+    lzma_end(&zi->ci.lstream);
+#endif
+    if (zi->member_deflaters != NULL)
+    {
+        int i;
+        for (i = 0; i < ZTHREAD_MAX; i++)
+            zip64local_MemberDeflaterEnd(&zi->member_deflaters[i]);
+        free(zi->member_deflaters);
+        zi->member_deflaters = NULL;
+    }
+
 #ifndef NO_ADDFILEINEXISTINGZIP
     if (global_comment==NULL)
         global_comment = zi->globalcomment;
 #endif
 
-    centraldir_pos_inzip = ZTELL64(zi->z_filefunc,zi->filestream);
-
-    if (err==ZIP_OK)
-    {
-        linkedlist_datablock_internal* ldi = zi->central_dir.first_block;
-        while (ldi!=NULL)
-        {
-            if ((err==ZIP_OK) && (ldi->filled_in_this_block>0))
-            {
-                if (ZWRITE64(zi->z_filefunc,zi->filestream, ldi->data, ldi->filled_in_this_block) != ldi->filled_in_this_block)
-                    err = ZIP_ERRNO;
-            }
+    centraldir_pos_inzip = zip64local_Tell(zi);
 
-            size_centraldir += ldi->filled_in_this_block;
-            ldi = ldi->next_datablock;
-        }
-    }
-    free_linkedlist(&(zi->central_dir));
+    size_centraldir = zi->central_dir.filled;
 
     pos = centraldir_pos_inzip - zi->add_position_when_writing_offset;
-    if(pos >= 0xffffffff || zi->number_entry >= 0xFFFF)
+    if(pos >= 0xffffffff || zi->number_entry >= 0xFFFF || size_centraldir >= 0xffffffff)
     {
-      ZPOS64_T Zip64EOCDpos = ZTELL64(zi->z_filefunc,zi->filestream);
-      Write_Zip64EndOfCentralDirectoryRecord(zi, size_centraldir, centraldir_pos_inzip);
+      ZPOS64_T Zip64EOCDpos = centraldir_pos_inzip + size_centraldir;
+      if (err==ZIP_OK)
+        err = Write_Zip64EndOfCentralDirectoryRecord(zi, size_centraldir, centraldir_pos_inzip);
 
-      Write_Zip64EndOfCentralDirectoryLocator(zi, Zip64EOCDpos);
+      if (err==ZIP_OK)
+        err = Write_Zip64EndOfCentralDirectoryLocator(zi, Zip64EOCDpos);
     }
 
     if (err==ZIP_OK)
@@ -1886,6 +2323,24 @@ extern int ZEXPORT zipClose(zipFile file, const char* global_comment) {
     if(err == ZIP_OK)
       err = Write_GlobalComment(zi, global_comment);
 
+    if (err==ZIP_OK)
+    {
+        const unsigned char* data = zi->central_dir.data;
+        ZPOS64_T left = zi->central_dir.filled;
+        while ((left>0) && (err==ZIP_OK))
+        {
+            uLong write_this = (left > SIZEDATA_WRITEBLOCK) ? SIZEDATA_WRITEBLOCK : (uLong)left;
+            err = zip64local_Write(zi, data, write_this);
+            data += write_this;
+            left -= write_this;
+        }
+    }
+    if ((err==ZIP_OK) && zi->truncate_at_close)
+        if (ZTRUNCATE64(zi->z_filefunc, zi->filestream, zip64local_Tell(zi)) != 0)
+            err = ZIP_ERRNO;
+    free_datablock(&(zi->central_dir));
+    free_datablock(&(zi->ci.local_header));
+
     if (ZCLOSE64(zi->z_filefunc,zi->filestream) != 0)
         if (err == ZIP_OK)
             err = ZIP_ERRNO;
@@ -1954,3 +2409,786 @@ extern int ZEXPORT zipRemoveExtraInfoBlock(char* pData, int* dataLen, short sHea
 
   return retVal;
 }
+
+extern int ZEXPORT zipSetParallelDeflate(zipFile file, int threads, uLong block_size) {
+    zip64_internal* zi;
+
+    if ((file == NULL) || (threads < 0))
+        return ZIP_PARAMERROR;
+    zi = (zip64_internal*)file;
+
+    if (threads == 0)
+        threads = zthread_cpu_count();
+    if (threads > ZTHREAD_MAX)
+        threads = ZTHREAD_MAX;
+    if (block_size == 0)
+        block_size = Z_PARALLEL_BLOCKSIZE;
+    if (block_size < Z_PARALLEL_DICTSIZE)
+        block_size = Z_PARALLEL_DICTSIZE;
+    /* keep the input of all the threads below 1 GB */
+    if (block_size > 0x40000000 / (uLong)threads)
+        block_size = 0x40000000 / (uLong)threads;
+
+    zi->parallel_threads = threads;
+    zi->parallel_block_size = block_size;
+    return ZIP_OK;
+}
+
+extern int ZEXPORT zipSetZstdWorkers(zipFile file, int workers) {
+    zip64_internal* zi;
+
+    if ((file == NULL) || (workers < 0))
+        return ZIP_PARAMERROR;
+#ifndef HAVE_ZSTD
+    if (workers != 1)
+        return ZIP_PARAMERROR;
+#endif
+    zi = (zip64_internal*)file;
+
+    if (workers == 0)
+        workers = zthread_cpu_count();
+    if (workers > ZTHREAD_MAX)
+        workers = ZTHREAD_MAX;
+    zi->zstd_workers = workers;
+    return ZIP_OK;
+}
+
+extern int ZEXPORT zipSetAESEncryption(zipFile file, int strength) {
+    zip64_internal* zi;
+
+    if ((file == NULL) || (strength < 0) || (strength > 3))
+        return ZIP_PARAMERROR;
+#ifdef NOAES
+    if (strength != 0)
+        return ZIP_PARAMERROR;
+#endif
+    zi = (zip64_internal*)file;
+
+    zi->aes_strength = strength;
+    return ZIP_OK;
+}
+
+/*
+  Compress members by batches of Z_MEMBERS_BATCH files by thread, or less if
+    their size reach Z_MEMBERS_BATCHSIZE
+*/
+#ifndef Z_MEMBERS_BATCH
+#define Z_MEMBERS_BATCH (4)
+#endif
+
+#ifndef Z_MEMBERS_BATCHSIZE
+#define Z_MEMBERS_BATCHSIZE (256*1024*1024)
+#endif
+
+typedef struct
+{
+    const zip_member* member;
+    unsigned char* out;         /* compressed data, NULL if stored */
+    ZPOS64_T out_size;
+    uLong crc;
+    int method;                 /* method used for the file */
+    int err;
+} zip64_member_job;
+
+typedef struct
+{
+    zip64_member_job* jobs;
+    uLong number_job;
+    uLong next_job;             /* next job to give to a thread */
+    zip64_member_deflater* deflaters; /* the deflaters of the zipfile */
+    int next_deflater;          /* next deflater to give to a thread */
+    zthread_mutex mutex;
+} zip64_member_batch;
+
+/* the deflaters of the members, allocated once for the life of the zipfile */
+local int zip64local_AllocMemberDeflaters(zip64_internal* zi) {
+    int i;
+
+    if (zi->member_deflaters != NULL)
+        return ZIP_OK;
+    zi->member_deflaters = (zip64_member_deflater*)ALLOC(ZTHREAD_MAX * sizeof(zip64_member_deflater));
+    if (zi->member_deflaters == NULL)
+        return ZIP_INTERNALERROR;
+    for (i = 0; i < ZTHREAD_MAX; i++)
+        zi->member_deflaters[i].initialised = 0;
+    return ZIP_OK;
+}
+
+local int zip64local_DeflateMember(zip64_member_job* job, zip64_member_deflater* deflater) {
+    const zip_member* member = job->member;
+#ifdef HAVE_LIBDEFLATE
+    size_t bound;
+
+    if ((size_t)member->size != member->size)
+        return ZIP_INTERNALERROR;
+    bound = libdeflate_deflate_compress_bound(deflater->compressor, (size_t)member->size);
+    job->out = (unsigned char*)ALLOC(bound);
+    if (job->out == NULL)
+        return ZIP_INTERNALERROR;
+
+    job->out_size = libdeflate_deflate_compress(deflater->compressor, member->buf,
+                                                (size_t)member->size, job->out, bound);
+    if (job->out_size == 0)
+        return ZIP_INTERNALERROR;
+#else
+    z_stream* stream = &deflater->stream;
+    const unsigned char* in = (const unsigned char*)member->buf;
+    ZPOS64_T rest_in = member->size;
+    ZPOS64_T bound = member->size + (member->size >> 3) + (member->size >> 7) +
+                     (member->size >> 8) + 32;
+    ZPOS64_T rest_out;
+    int err = Z_OK;
+
+    if ((size_t)bound != bound)
+        return ZIP_INTERNALERROR;
+    job->out = (unsigned char*)ALLOC((size_t)bound);
+    if (job->out == NULL)
+        return ZIP_INTERNALERROR;
+
+    if (deflateReset(stream) != Z_OK)
+        return ZIP_INTERNALERROR;
+    stream->next_out = job->out;
+    rest_out = bound;
+    while (err == Z_OK)
+    {
+        uInt in_this = (rest_in < 0x40000000) ? (uInt)rest_in : 0x40000000;
+        uInt out_this = (rest_out < 0x40000000) ? (uInt)rest_out : 0x40000000;
+
+        stream->next_in = (Bytef*)(uintptr_t)in;
+        stream->avail_in = in_this;
+        stream->avail_out = out_this;
+        err = deflate(stream, (in_this == rest_in) ? Z_FINISH : Z_NO_FLUSH);
+        in += in_this - stream->avail_in;
+        rest_in -= in_this - stream->avail_in;
+        rest_out -= out_this - stream->avail_out;
+        if ((err == Z_BUF_ERROR) && (rest_out > 0))
+            err = Z_OK;
+    }
+    if (err != Z_STREAM_END)
+        return ZIP_INTERNALERROR;
+
+    job->out_size = bound - rest_out;
+#endif
+    job->method = Z_DEFLATED;
+    if (job->out_size >= member->size)
+    {
+        /* not worth it, we store the file */
+        free(job->out);
+        job->out = NULL;
+        job->method = 0;
+    }
+    return ZIP_OK;
+}
+
+/* crc and compression of a member, the deflater is kept from member to member */
+local void zip64local_CompressMember(zip64_member_job* job, zip64_member_deflater* deflater) {
+    const unsigned char* in = (const unsigned char*)job->member->buf;
+    ZPOS64_T rest = job->member->size;
+
+    job->crc = crc32(0L, Z_NULL, 0);
+    while (rest > 0)
+    {
+        uInt this_crc = (rest < 0x40000000) ? (uInt)rest : 0x40000000;
+        job->crc = zcrc32(job->crc, in, this_crc);
+        in += this_crc;
+        rest -= this_crc;
+    }
+
+    job->err = ZIP_OK;
+    job->out = NULL;
+    job->method = 0;
+    if ((job->member->method != Z_DEFLATED) || (job->member->size == 0))
+        return;
+
+    job->err = zip64local_MemberDeflaterInit(deflater, job->member->level);
+    if (job->err == ZIP_OK)
+        job->err = zip64local_DeflateMember(job, deflater);
+}
+
+/* each thread of a batch takes a deflater of its own, kept for the next batches */
+local void zip64local_MemberThread(void* arg) {
+    zip64_member_batch* batch = (zip64_member_batch*)arg;
+    zip64_member_deflater* deflater;
+
+    zthread_mutex_lock(&batch->mutex);
+    deflater = &batch->deflaters[batch->next_deflater++];
+    zthread_mutex_unlock(&batch->mutex);
+    for (;;)
+    {
+        zip64_member_job* job;
+
+        zthread_mutex_lock(&batch->mutex);
+        job = (batch->next_job < batch->number_job) ? &batch->jobs[batch->next_job++] : NULL;
+        zthread_mutex_unlock(&batch->mutex);
+        if (job == NULL)
+            break;
+
+        zip64local_CompressMember(job, deflater);
+    }
+}
+
+local int zip64local_WriteMember(zipFile file, const zip64_member_job* job) {
+    const zip_member* member = job->member;
+    const unsigned char* data = (job->method == 0) ? (const unsigned char*)member->buf : job->out;
+    ZPOS64_T rest = (job->method == 0) ? member->size : job->out_size;
+    int err;
+
+    err = zipOpenNewFileInZip4_64(file, member->filename, member->zipfi,
+                                  NULL, 0, NULL, 0, member->comment,
+                                  job->method, member->level, 1,
+                                  -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY,
+                                  NULL, 0, VERSIONMADEBY, 0,
+                                  (member->size >= 0xffffffff) || (rest >= 0xffffffff));
+    while ((err == ZIP_OK) && (rest > 0))
+    {
+        unsigned write_this = (rest < 0x40000000) ? (unsigned)rest : 0x40000000;
+        err = zipWriteInFileInZip(file, data, write_this);
+        data += write_this;
+        rest -= write_this;
+    }
+    if (err == ZIP_OK)
+        err = zipCloseFileInZipRaw64(file, member->size, job->crc);
+    return err;
+}
+
+extern int ZEXPORT zipAddMemberFromBuffer(zipFile file, const zip_member* member) {
+    zip64_internal* zi;
+    zip64_member_job job;
+    int err;
+
+    if ((file == NULL) || (member == NULL) ||
+        ((member->method != 0) && (member->method != Z_DEFLATED)) ||
+        ((member->buf == NULL) && (member->size > 0)))
+        return ZIP_PARAMERROR;
+    zi = (zip64_internal*)file;
+    if (zip64local_AllocMemberDeflaters(zi) != ZIP_OK)
+        return ZIP_INTERNALERROR;
+
+    /* the first deflater of the zipfile, kept for the next member */
+    job.member = member;
+    zip64local_CompressMember(&job, &zi->member_deflaters[0]);
+
+    err = job.err;
+    if (err == ZIP_OK)
+        err = zip64local_WriteMember(file, &job);
+    free(job.out);
+    return err;
+}
+
+extern int ZEXPORT zipAddMembersParallel(zipFile file, const zip_member* members,
+                                         uLong number_member, int threads) {
+    zip64_internal* zi;
+    zip64_member_job* jobs;
+    zip64_member_batch batch;
+    uLong max_job;
+    uLong first;
+    uLong i;
+    int err = ZIP_OK;
+
+    if ((file == NULL) || ((members == NULL) && (number_member > 0)) || (threads < 0))
+        return ZIP_PARAMERROR;
+    for (i = 0; i < number_member; i++)
+        if (((members[i].method != 0) && (members[i].method != Z_DEFLATED)) ||
+            ((members[i].buf == NULL) && (members[i].size > 0)))
+            return ZIP_PARAMERROR;
+    if (number_member == 0)
+        return ZIP_OK;
+    zi = (zip64_internal*)file;
+
+    if (threads == 0)
+        threads = zthread_cpu_count();
+    if (threads > ZTHREAD_MAX)
+        threads = ZTHREAD_MAX;
+    if (zip64local_AllocMemberDeflaters(zi) != ZIP_OK)
+        return ZIP_INTERNALERROR;
+    max_job = (uLong)threads * Z_MEMBERS_BATCH;
+    jobs = (zip64_member_job*)ALLOC(max_job * sizeof(zip64_member_job));
+    if (jobs == NULL)
+        return ZIP_INTERNALERROR;
+
+    zthread_mutex_init(&batch.mutex);
+    for (first = 0; (first < number_member) && (err == ZIP_OK); first += batch.number_job)
+    {
+        ZPOS64_T batch_size = 0;
+
+        batch.number_job = 0;
+        while ((first + batch.number_job < number_member) && (batch.number_job < max_job) &&
+               ((batch.number_job == 0) || (batch_size < Z_MEMBERS_BATCHSIZE)))
+        {
+            jobs[batch.number_job].member = &members[first + batch.number_job];
+            batch_size += members[first + batch.number_job].size;
+            batch.number_job++;
+        }
+        batch.jobs = jobs;
+        batch.next_job = 0;
+        batch.deflaters = zi->member_deflaters;
+        batch.next_deflater = 0;
+        zthread_run(((uLong)threads < batch.number_job) ? threads : (int)batch.number_job,
+                    zip64local_MemberThread, &batch);
+
+        for (i = 0; i < batch.number_job; i++)
+        {
+            if (err == ZIP_OK)
+                err = jobs[i].err;
+            if (err == ZIP_OK)
+                err = zip64local_WriteMember(file, &jobs[i]);
+            free(jobs[i].out);
+        }
+    }
+    zthread_mutex_destroy(&batch.mutex);
+    free(jobs);
+    return err;
+}
+
+/* ===========================================================================
+   Deleting files
+*/
+
+#define SIZEDATA_MOVEBLOCK (0x400000) /* buffer moving the data after the deleted files */
+
+/* a file of the central directory in construction */
+typedef struct
+{
+    ZPOS64_T offset;            /* relative offset of its local header */
+    ZPOS64_T pos_in_central_dir;
+    uLong size_record;          /* size of its record in the central directory */
+    uLong pos_offset;           /* position of its offset in the record, 4 or 8 bytes */
+    int size_offset;
+    int deleted;
+} zip64_cd_file;
+
+local int zip64local_CompareFileOffset(const void* a, const void* b) {
+    ZPOS64_T offset_a = (*(const zip64_cd_file* const*)a)->offset;
+    ZPOS64_T offset_b = (*(const zip64_cd_file* const*)b)->offset;
+    return (offset_a < offset_b) ? -1 : (offset_a > offset_b) ? 1 : 0;
+}
+
+local int zip64local_CompareName(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+/*
+  Decode the record of the central directory at pos_in_central_dir, with its
+    offset in the zip64 extra field if it doesn't fit in 32 bits
+*/
+local int zip64local_ReadCentralDirFile(const datablock* db, ZPOS64_T pos_in_central_dir, zip64_cd_file* file) {
+    const unsigned char* rec = db->data + pos_in_central_dir;
+    uLong size_filename, size_extra, size_comment;
+
+    if ((db->filled - pos_in_central_dir < SIZECENTRALHEADER) ||
+        (zip64local_readLong(rec) != CENTRALHEADERMAGIC))
+        return ZIP_BADZIPFILE;
+    size_filename = zip64local_readShort(rec + 28);
+    size_extra = zip64local_readShort(rec + 30);
+    size_comment = zip64local_readShort(rec + 32);
+    file->pos_in_central_dir = pos_in_central_dir;
+    file->size_record = SIZECENTRALHEADER + size_filename + size_extra + size_comment;
+    if (db->filled - pos_in_central_dir < file->size_record)
+        return ZIP_BADZIPFILE;
+    file->offset = zip64local_readLong(rec + 42);
+    file->pos_offset = 42;
+    file->size_offset = 4;
+    file->deleted = 0;
+
+    if (file->offset == MAXU32)
+    {
+        uLong pos = SIZECENTRALHEADER + size_filename;
+        uLong end = pos + size_extra;
+        while (pos + 4 <= end)
+        {
+            uLong header_id = zip64local_readShort(rec + pos);
+            uLong size_data = zip64local_readShort(rec + pos + 2);
+            if (pos + 4 + size_data > end)
+                break;
+            if (header_id == 0x0001)
+            {
+                /* the sizes are before the offset, if they are in the extra field */
+                uLong skip = 0;
+                if (zip64local_readLong(rec + 24) == MAXU32)
+                    skip += 8;
+                if (zip64local_readLong(rec + 20) == MAXU32)
+                    skip += 8;
+                if (skip + 8 > size_data)
+                    return ZIP_BADZIPFILE;
+                file->pos_offset = pos + 4 + skip;
+                file->size_offset = 8;
+                file->offset = zip64local_readLong64(rec + file->pos_offset);
+                return ZIP_OK;
+            }
+            pos += 4 + size_data;
+        }
+        return ZIP_BADZIPFILE;
+    }
+    return ZIP_OK;
+}
+
+/*
+  Move size bytes of the zipfile down from from to to, front to back so that
+    the two ranges may overlap: with the io functions copying without user
+    memory when they can and the ranges are far enough apart, else through
+    a buffer
+*/
+local int zip64local_MoveData(zip64_internal* zi, ZPOS64_T to, ZPOS64_T from, ZPOS64_T size) {
+    unsigned char* buf = NULL;
+    int copy = (from - to >= SIZEDATA_MOVEBLOCK);
+    int err = ZIP_OK;
+
+    while ((size > 0) && (err == ZIP_OK))
+    {
+        ZPOS64_T move_this;
+        if (copy)
+        {
+            move_this = (size < from - to) ? size : from - to;
+            move_this = ZCOPY64(zi->z_filefunc, zi->filestream, to, zi->filestream, from, move_this);
+            if (move_this == 0)
+                copy = 0;
+        }
+        else
+        {
+            move_this = (size < SIZEDATA_MOVEBLOCK) ? size : SIZEDATA_MOVEBLOCK;
+            if (buf == NULL)
+                buf = (unsigned char*)ALLOC((size_t)move_this);
+            if (buf == NULL)
+                err = ZIP_INTERNALERROR;
+            else if ((ZREADAT64(zi->z_filefunc, zi->filestream, from, buf, (uLong)move_this) != move_this) ||
+                     (ZSEEK64(zi->z_filefunc, zi->filestream, to, ZLIB_FILEFUNC_SEEK_SET) != 0) ||
+                     (ZWRITE64(zi->z_filefunc, zi->filestream, buf, (uLong)move_this) != move_this))
+                err = ZIP_ERRNO;
+        }
+        to += move_this;
+        from += move_this;
+        size -= move_this;
+    }
+    free(buf);
+    return err;
+}
+
+extern int ZEXPORT zipDeleteMembers(zipFile file, const char* const* filenames, uLong number_filename) {
+    zip64_internal* zi;
+    zip64_cd_file* files = NULL;
+    zip64_cd_file** sorted = NULL;
+    const char** names = NULL;
+    char* name = NULL;
+    ZPOS64_T number_file = 0, number_deleted = 0;
+    ZPOS64_T end_data, dst, pos, i;
+    ZPOS64_T run_from = 0, run_to = 0, run_size = 0;
+    int err = ZIP_OK;
+
+    if ((file == NULL) || ((filenames == NULL) && (number_filename > 0)))
+        return ZIP_PARAMERROR;
+    zi = (zip64_internal*)file;
+    if (zi->streaming || (zi->in_opened_file_inzip != 0) ||
+        (ZEXT64(zi->z_filefunc, ztruncate64_file) == NULL))
+        return ZIP_PARAMERROR;
+    if ((number_filename == 0) || (zi->number_entry == 0))
+        return ZIP_OK;
+
+    /* the names to delete, sorted to be searched */
+    names = (const char**)ALLOC(number_filename * sizeof(const char*));
+    name = (char*)ALLOC(0x10000);
+    if ((zi->number_entry > (size_t)-1 / sizeof(zip64_cd_file)) || (names == NULL) || (name == NULL))
+        err = ZIP_INTERNALERROR;
+    else
+    {
+        files = (zip64_cd_file*)ALLOC((size_t)zi->number_entry * sizeof(zip64_cd_file));
+        sorted = (zip64_cd_file**)ALLOC((size_t)zi->number_entry * sizeof(zip64_cd_file*));
+        if ((files == NULL) || (sorted == NULL))
+            err = ZIP_INTERNALERROR;
+    }
+    if (err == ZIP_OK)
+    {
+        for (i = 0; i < number_filename; i++)
+            names[i] = filenames[i];
+        qsort(names, (size_t)number_filename, sizeof(const char*), zip64local_CompareName);
+    }
+
+    /* the files of the central directory, and those to delete */
+    for (pos = 0; (err == ZIP_OK) && (pos < zi->central_dir.filled); pos += files[number_file++].size_record)
+    {
+        uLong size_filename;
+        const char* key = name;
+
+        if (number_file >= zi->number_entry)
+            err = ZIP_BADZIPFILE;
+        else
+            err = zip64local_ReadCentralDirFile(&zi->central_dir, pos, &files[number_file]);
+        if (err != ZIP_OK)
+            break;
+        size_filename = zip64local_readShort(zi->central_dir.data + pos + 28);
+        memcpy(name, zi->central_dir.data + pos + SIZECENTRALHEADER, size_filename);
+        name[size_filename] = '\0';
+        if (bsearch(&key, names, (size_t)number_filename, sizeof(const char*), zip64local_CompareName) != NULL)
+        {
+            files[number_file].deleted = 1;
+            number_deleted++;
+        }
+        sorted[number_file] = &files[number_file];
+    }
+    if ((err == ZIP_OK) && (number_file != zi->number_entry))
+        err = ZIP_BADZIPFILE;
+    free(names);
+    free(name);
+    if ((err != ZIP_OK) || (number_deleted == 0))
+    {
+        free(files);
+        free(sorted);
+        return err;
+    }
+
+    /* move the data of the files kept over the data of the deleted ones, in
+       the order of the zipfile, as few large moves */
+    qsort(sorted, (size_t)number_file, sizeof(zip64_cd_file*), zip64local_CompareFileOffset);
+    end_data = zip64local_Tell(zi) - zi->add_position_when_writing_offset;
+    if (sorted[number_file - 1]->offset > end_data)
+        err = ZIP_BADZIPFILE;
+    dst = sorted[0]->offset;
+    for (i = 0; (i < number_file) && (err == ZIP_OK); i++)
+    {
+        zip64_cd_file* f = sorted[i];
+        ZPOS64_T size = ((i + 1 < number_file) ? sorted[i + 1]->offset : end_data) - f->offset;
+        if (f->deleted)
+            continue;
+        if ((run_size > 0) && (f->offset != run_from + run_size))
+        {
+            if (run_from != run_to)
+                err = zip64local_MoveData(zi, run_to + zi->add_position_when_writing_offset,
+                                          run_from + zi->add_position_when_writing_offset, run_size);
+            run_size = 0;
+        }
+        if (run_size == 0)
+        {
+            run_from = f->offset;
+            run_to = dst;
+        }
+        run_size += size;
+        f->offset = dst;
+        dst += size;
+    }
+    if ((err == ZIP_OK) && (run_size > 0) && (run_from != run_to))
+        err = zip64local_MoveData(zi, run_to + zi->add_position_when_writing_offset,
+                                  run_from + zi->add_position_when_writing_offset, run_size);
+    if ((err == ZIP_OK) &&
+        (ZSEEK64(zi->z_filefunc, zi->filestream, dst + zi->add_position_when_writing_offset, ZLIB_FILEFUNC_SEEK_SET) != 0))
+        err = ZIP_ERRNO;
+
+    /* the new offsets of the files moved, then the central directory without
+       the deleted files */
+    if (err == ZIP_OK)
+    {
+        ZPOS64_T filled = 0;
+        for (i = 0; i < number_file; i++)
+        {
+            zip64_cd_file* f = &files[i];
+            if (f->deleted)
+                continue;
+            zip64local_putValue_inmemory(zi->central_dir.data + f->pos_in_central_dir + f->pos_offset,
+                                         f->offset, f->size_offset);
+            if (f->pos_in_central_dir != filled)
+                memmove(zi->central_dir.data + filled, zi->central_dir.data + f->pos_in_central_dir, f->size_record);
+            filled += f->size_record;
+        }
+        zi->central_dir.filled = filled;
+        zi->number_entry -= number_deleted;
+    }
+    zi->truncate_at_close = 1;
+    free(files);
+    free(sorted);
+    return err;
+}
+
+extern int ZEXPORT zipReplaceMember(zipFile file, const zip_member* member) {
+    int err;
+
+    if ((member == NULL) || (member->filename == NULL))
+        return ZIP_PARAMERROR;
+    err = zipDeleteMembers(file, &member->filename, 1);
+    if (err == ZIP_OK)
+        err = zipAddMemberFromBuffer(file, member);
+    return err;
+}
+
+/************************************************************/
+/* Copying files from another zipfile */
+
+/*
+  Copy size bytes from the stream of the io functions unz_filefunc at pos to
+    the end of the zipfile: by the system when both use the same io functions
+    with zcopy64_file, else from its mapping or through a buffer
+*/
+local int zip64local_CopyRawData(zip64_internal* zi, const zlib_filefunc64_32_def* unz_filefunc,
+                                  voidpf unz_stream, ZPOS64_T pos, ZPOS64_T size) {
+    unsigned char* buf = NULL;
+    const void* view = NULL;
+    int err = ZIP_OK;
+
+    if ((!zi->streaming) && (ZEXT64(zi->z_filefunc, zcopy64_file) != NULL) &&
+        (ZEXT64(zi->z_filefunc, zcopy64_file) == ZEXT64(*unz_filefunc, zcopy64_file)) &&
+        (zi->z_filefunc.zfile_func64.opaque == unz_filefunc->zfile_func64.opaque))
+    {
+        ZPOS64_T pos_to = zip64local_Tell(zi);
+        ZPOS64_T copied = ZCOPY64(zi->z_filefunc, zi->filestream, pos_to, unz_stream, pos, size);
+        if ((copied > 0) &&
+            (ZSEEK64(zi->z_filefunc, zi->filestream, pos_to + copied, ZLIB_FILEFUNC_SEEK_SET) != 0))
+            return ZIP_ERRNO;
+        zi->pos_in_zip += copied;
+        pos += copied;
+        size -= copied;
+    }
+
+    if (size > 0)
+        view = ZMAP64(*unz_filefunc, unz_stream, pos, size);
+    while ((size > 0) && (err == ZIP_OK))
+    {
+        uLong copy_this = (size < SIZEDATA_MOVEBLOCK) ? (uLong)size : SIZEDATA_MOVEBLOCK;
+        if (view != NULL)
+        {
+            err = zip64local_Write(zi, view, copy_this);
+            view = (const unsigned char*)view + copy_this;
+        }
+        else
+        {
+            if (buf == NULL)
+                buf = (unsigned char*)ALLOC(copy_this);
+            if (buf == NULL)
+                err = ZIP_INTERNALERROR;
+            else if (ZREADAT64(*unz_filefunc, unz_stream, pos, buf, copy_this) != copy_this)
+                err = ZIP_ERRNO;
+            else
+                err = zip64local_Write(zi, buf, copy_this);
+        }
+        pos += copy_this;
+        size -= copy_this;
+    }
+    free(buf);
+    return err;
+}
+
+/*
+  Remove the Zip64 extra blocks (0x0001) of the extra field data of *size
+    bytes, in place: the field comes from another zipfile, so a block whose
+    size is beyond the end, or the few bytes left after the last block, are
+    kept as they are instead of being read as a block
+*/
+local void zip64local_RemoveZip64Extra(char* data, int* size) {
+    const unsigned char* p = (const unsigned char*)data;
+    int from = 0;
+    int to = 0;
+
+    while (*size - from >= 4)
+    {
+        int header = (int)zip64local_readShort(p + from);
+        int block = 4 + (int)zip64local_readShort(p + from + 2);
+        if (block > *size - from)
+            break;
+        if (header != 0x0001)
+        {
+            memmove(data + to, data + from, (size_t)block);
+            to += block;
+        }
+        from += block;
+    }
+    if (from < *size)
+        memmove(data + to, data + from, (size_t)(*size - from));
+    *size = to + *size - from;
+}
+
+extern int ZEXPORT zipCopyMemberFromUnz(zipFile file, unzFile uf) {
+    zip64_internal* zi;
+    unz_file_info64 info;
+    zip_fileinfo zfi;
+    zlib_filefunc64_32_def unz_filefunc;
+    voidpf unz_stream;
+    ZPOS64_T pos_data;
+    ZPOS64_T size_data;
+    char* filename = NULL;
+    char* comment;
+    char* extra_global;
+    char* extra_local;
+    int size_extra_global;
+    int size_extra_local;
+    uLong flag;
+    int method;
+    int err;
+
+    if ((file == NULL) || (uf == NULL))
+        return ZIP_PARAMERROR;
+    zi = (zip64_internal*)file;
+
+    /* the error codes of unzip are the same as the ones of zip */
+    err = unzOpenCurrentFile2(uf, &method, NULL, 1);
+    if (err != UNZ_OK)
+        return err;
+    err = unzGetCurrentFileInfo64(uf, &info, NULL, 0, NULL, 0, NULL, 0);
+
+    /* the traditional encryption header is checked with the crc, unless the
+       file has a data descriptor: then with the time, kept by this flag */
+    flag = info.flag;
+    if (((flag & 1) == 0) || (info.compression_method == Z_AES))
+        flag &= ~(uLong)8;
+    else if (((flag & 8) == 0) && (zi->streaming) && (err == ZIP_OK))
+        err = ZIP_PARAMERROR;
+
+    size_extra_local = unzGetLocalExtrafield(uf, NULL, 0);
+    if (err == ZIP_OK)
+        err = unzGetCurrentFileRawStream(uf, &unz_filefunc, &unz_stream, &pos_data, &size_data);
+    if (err == ZIP_OK)
+    {
+        filename = (char*)ALLOC(info.size_filename + 1 + info.size_file_comment + 1 +
+                                info.size_file_extra + (uLong)size_extra_local + 1);
+        if (filename == NULL)
+            err = ZIP_INTERNALERROR;
+    }
+    if (err == ZIP_OK)
+    {
+        comment = filename + info.size_filename + 1;
+        extra_global = comment + info.size_file_comment + 1;
+        extra_local = extra_global + info.size_file_extra;
+        err = unzGetCurrentFileInfo64(uf, NULL, filename, info.size_filename + 1,
+                                      extra_global, info.size_file_extra,
+                                      comment, info.size_file_comment + 1);
+    }
+    if ((err == ZIP_OK) && (unzGetLocalExtrafield(uf, extra_local, (unsigned)size_extra_local) != size_extra_local))
+        err = ZIP_ERRNO;
+
+    if (err == ZIP_OK)
+    {
+        /* the Zip64 extra fields are made again for this zipfile */
+        size_extra_global = (int)info.size_file_extra;
+        zip64local_RemoveZip64Extra(extra_global, &size_extra_global);
+        zip64local_RemoveZip64Extra(extra_local, &size_extra_local);
+
+        zfi.tmz_date.tm_sec = info.tmu_date.tm_sec;
+        zfi.tmz_date.tm_min = info.tmu_date.tm_min;
+        zfi.tmz_date.tm_hour = info.tmu_date.tm_hour;
+        zfi.tmz_date.tm_mday = info.tmu_date.tm_mday;
+        zfi.tmz_date.tm_mon = info.tmu_date.tm_mon;
+        zfi.tmz_date.tm_year = info.tmu_date.tm_year;
+        zfi.dosDate = info.dosDate;
+        zfi.internal_fa = info.internal_fa;
+        zfi.external_fa = info.external_fa;
+
+        err = zipOpenNewFileInZip4_64(file, filename, &zfi,
+                                      extra_local, (uInt)size_extra_local,
+                                      extra_global, (uInt)size_extra_global,
+                                      (info.size_file_comment > 0) ? comment : NULL,
+                                      (int)info.compression_method, Z_DEFAULT_COMPRESSION, 1,
+                                      -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY,
+                                      NULL, 0, info.version, flag,
+                                      (info.compressed_size >= 0xffffffff) ||
+                                      (info.uncompressed_size >= 0xffffffff));
+    }
+    free(filename);
+
+    if (err == ZIP_OK)
+    {
+        err = zip64local_CopyRawData(zi, &unz_filefunc, unz_stream, pos_data, size_data);
+        zi->ci.totalCompressedData += size_data;
+    }
+    if ((err == ZIP_OK) && ((flag & 8) != 0) && (!zi->streaming))
+        err = Write_DataDescriptor(zi, info.crc, size_data, info.uncompressed_size);
+    if (err == ZIP_OK)
+        err = zipCloseFileInZipRaw64(file, info.uncompressed_size, info.crc);
+
+    unzCloseCurrentFile(uf);
+    return err;
+}
@@ -45,6 +45,9 @@ extern "C" {
 #endif
 
 //#define HAVE_BZIP2
+//#define HAVE_ZSTD
+//#define HAVE_LZMA
+//#define HAVE_LIBDEFLATE
 
 #ifndef _ZLIB_H
 #include "zlib.h"
@@ -54,11 +57,31 @@ extern "C" {
 #include "ioapi.h"
 #endif
 
+#ifndef _unz64_H
+#include "unzip.h"
+#endif
+
 #ifdef HAVE_BZIP2
 #include "bzlib.h"
 #endif
 
+#ifdef HAVE_ZSTD
+#include "zstd.h"
+#endif
+
+#ifdef HAVE_LZMA
+#include "lzma.h"
+#endif
+
+#ifdef HAVE_LIBDEFLATE
+#include "libdeflate.h"
+#endif
+
 #define Z_BZIP2ED 12
+#define Z_LZMA 14
+#define Z_ZSTD 93
+#define Z_XZ 95
+#define Z_AES 99        /* WinZip AES, the real method is in the 0x9901 extra field */
 
 #if defined(STRICTZIP) || defined(STRICTZIPUNZIP)
 /* like the STRICT of WIN32, we define a pointer that cannot be converted
@@ -106,12 +129,25 @@ typedef struct
     uLong       external_fa;    /* external file attributes        4 bytes */
 } zip_fileinfo;
 
+/* a file to add with zipAddMemberFromBuffer or zipAddMembersParallel */
+typedef struct
+{
+    const char*         filename;
+    const zip_fileinfo* zipfi;      /* can be NULL */
+    const void*         buf;        /* content of the file */
+    ZPOS64_T            size;
+    int                 method;     /* 0 (store) or Z_DEFLATED */
+    int                 level;
+    const char*         comment;    /* can be NULL */
+} zip_member;
+
 typedef const char* zipcharpc;
 
 
 #define APPEND_STATUS_CREATE        (0)
 #define APPEND_STATUS_CREATEAFTER   (1)
 #define APPEND_STATUS_ADDINZIP      (2)
+#define APPEND_STATUS_STREAM        (3)
 
 extern zipFile ZEXPORT zipOpen(const char *pathname, int append);
 extern zipFile ZEXPORT zipOpen64(const void *pathname, int append);
@@ -124,6 +160,10 @@ extern zipFile ZEXPORT zipOpen64(const void *pathname, int append);
          (useful if the file contain a self extractor code)
      if the file pathname exist and append==APPEND_STATUS_ADDINZIP, we will
        add files in existing zip (be sure you don't add file that doesn't exist)
+     if append==APPEND_STATUS_STREAM, the zip is written from the start without
+       ever seeking or reading, so the io functions of zipOpen2_64 can write to a
+       pipe or a socket. The crc and sizes of each file are then written in a
+       data descriptor after its data (bit 3 of the flag).
      If the zipfile cannot be opened, the return value is NULL.
      Else, the return value is a zipFile Handle, usable with other function
        of this zip package.
@@ -216,6 +256,7 @@ extern int ZEXPORT zipOpenNewFileInZip2_64(zipFile file,
                                            int zip64);
 /*
   Same than zipOpenNewFileInZip, except if raw=1, we write raw file
+  With raw=1, method is only written in the headers: it can be any method.
  */
 
 extern int ZEXPORT zipOpenNewFileInZip3(zipFile file,
@@ -339,6 +380,109 @@ extern int ZEXPORT zipClose(zipFile file,
 */
 
 
+extern int ZEXPORT zipSetParallelDeflate(zipFile file,
+                                         int threads,
+                                         uLong block_size);
+/*
+  Compress the deflated files opened after this call (not raw) on threads
+    threads, 0 for one thread by processor, 1 to go back to normal deflate.
+  The input is split in blocks of block_size bytes (0 for the default of
+    128 KB), each compressed independently with the 32 KB of input before
+    it as dictionary and ended by a sync flush. The result is a single
+    standard deflate stream, a little bigger than with one thread.
+*/
+
+extern int ZEXPORT zipSetZstdWorkers(zipFile file,
+                                     int workers);
+/*
+  Compress the Z_ZSTD files opened after this call (not raw) with workers
+    threads of zstd, 0 for one thread by processor, 1 to go back to
+    compressing on the calling thread. zstd cuts the input in jobs of a few
+    MB, so only large files are compressed in parallel.
+  The level given when opening a Z_ZSTD file is the zstd level (1 to 22),
+    Z_DEFAULT_COMPRESSION for the default of zstd.
+  Return ZIP_PARAMERROR for workers other than 1 if minizip was built without
+    HAVE_ZSTD.
+*/
+
+extern int ZEXPORT zipSetAESEncryption(zipFile file,
+                                       int strength);
+/*
+  Encrypt the files opened after this call with a password with WinZip AES
+    (compression method Z_AES with the 0x9901 extra field, AE-2) instead of
+    the traditional PKWARE encryption: strength is 1 for AES-128, 2 for
+    AES-192, 3 for AES-256, or 0 to go back to the traditional encryption.
+  The data is encrypted in counter mode and authenticated by an HMAC-SHA1,
+    using the AES-NI and SHA instructions when the processor has them.
+  Return ZIP_PARAMERROR if minizip was built with NOCRYPT or NOAES.
+*/
+
+extern int ZEXPORT zipAddMemberFromBuffer(zipFile file,
+                                          const zip_member* member);
+/*
+  Add a file from memory in the zipfile in one call, as with
+    zipOpenNewFileInZip / zipWriteInFileInZip / zipCloseFileInZip.
+  A deflated file is compressed in one pass, by libdeflate if minizip is
+    built with HAVE_LIBDEFLATE, and is stored if it does not get smaller.
+    The compressor is kept for the next files until zipClose.
+*/
+
+extern int ZEXPORT zipAddMembersParallel(zipFile file,
+                                         const zip_member* members,
+                                         uLong number_member,
+                                         int threads);
+/*
+  Add number_member files from memory in the zipfile, compressing them
+    concurrently on threads threads (0 for one thread by processor).
+  Each file is compressed in its own buffer, then the files are written in
+    order, as with zipOpenNewFileInZip / zipWriteInFileInZip /
+    zipCloseFileInZip. A deflated file which does not get smaller is stored.
+  The members are compressed by batches, so the memory used stays bounded.
+*/
+
+extern int ZEXPORT zipDeleteMembers(zipFile file,
+                                    const char* const* filenames,
+                                    uLong number_filename);
+/*
+  Delete the files named filenames (compared case sensitively) from the
+    zipfile, opened with APPEND_STATUS_ADDINZIP, while no file is being
+    written in it. Names not in the zipfile are ignored.
+  The data of the files after the deleted ones is moved down over them with
+    large moves (by the zcopy64_file io function if it is given), only the
+    records of the central directory of the moved files change, and zipClose
+    cuts the zipfile at its new end. The cost depends on the size of the
+    data moved, not on the size of the zipfile.
+  The zipfile is changed in place: if an error is returned, it may be lost.
+  Return ZIP_PARAMERROR if the zipfile was opened with APPEND_STATUS_STREAM,
+    if a file is being written, or if the io functions can't truncate it
+    (no ztruncate64_file).
+*/
+
+extern int ZEXPORT zipReplaceMember(zipFile file,
+                                    const zip_member* member);
+/*
+  Replace the file named member->filename by member, with zipDeleteMembers
+    then zipAddMemberFromBuffer: the new file is at the end of the zipfile.
+  The file is added if it was not in the zipfile.
+*/
+
+extern int ZEXPORT zipCopyMemberFromUnz(zipFile file,
+                                        unzFile uf);
+/*
+  Add the current file of the zipfile uf in the zipfile, as it is: its
+    compressed (and encrypted) data is copied without being decompressed,
+    with its name, comment, date, attributes, flags, crc, sizes and extra
+    fields (the Zip64 extra field is made again if needed).
+  When both zipfiles use the same io functions with zcopy64_file (the
+    default ones on Linux), the data is copied by the system without going
+    through user memory, else it is read from uf by blocks and written.
+  uf stays on this file, which is not left opened.
+  Return ZIP_PARAMERROR if uf has no current file, or if the file is
+    encrypted with the traditional PKWARE encryption, without data descriptor,
+    and the zipfile was opened with APPEND_STATUS_STREAM (its data can't be
+    copied as it is then).
+*/
+
 extern int ZEXPORT zipRemoveExtraInfoBlock(char* pData, int* dataLen, short sHeader);
 /*
   zipRemoveExtraInfoBlock -  Added by Mathias Svensson
@@ -0,0 +1,190 @@
+/* zthread.h -- minimal threading support for the parallel parts of minizip
+
+   This file is included in zip.c and unzip.c, it gives a mutex and a way
+   to run the same function on several threads, with pthread or Win32,
+   and a way to run an initialization only once.
+
+   If you don't want threads in your application, just define the symbol
+   NOZTHREAD: the parallel functions then do all the work in the calling
+   thread.
+*/
+
+#ifndef _ZTHREAD_H
+#define _ZTHREAD_H
+
+#ifndef ZTHREAD_MAX
+#  define ZTHREAD_MAX (64)
+#endif
+
+typedef void (*zthread_func)(void* arg);
+
+#if defined(NOZTHREAD)
+
+typedef int zthread_mutex;
+
+static void zthread_mutex_init(zthread_mutex* m) { *m = 0; }
+static void zthread_mutex_destroy(zthread_mutex* m) { (void)m; }
+static void zthread_mutex_lock(zthread_mutex* m) { (void)m; }
+static void zthread_mutex_unlock(zthread_mutex* m) { (void)m; }
+
+typedef int zthread_once_flag;
+#define ZTHREAD_ONCE_INIT (0)
+
+static void zthread_once(zthread_once_flag* once, void (*func)(void)) {
+    if (*once == 0)
+    {
+        (*func)();
+        *once = 1;
+    }
+}
+
+static int zthread_cpu_count(void) {
+    return 1;
+}
+
+static void zthread_run(int threads, zthread_func func, void* arg) {
+    (void)threads;
+    (*func)(arg);
+}
+
+#elif defined(_WIN32)
+
+#include <windows.h>
+
+typedef CRITICAL_SECTION zthread_mutex;
+
+static void zthread_mutex_init(zthread_mutex* m) { InitializeCriticalSection(m); }
+static void zthread_mutex_destroy(zthread_mutex* m) { DeleteCriticalSection(m); }
+static void zthread_mutex_lock(zthread_mutex* m) { EnterCriticalSection(m); }
+static void zthread_mutex_unlock(zthread_mutex* m) { LeaveCriticalSection(m); }
+
+typedef LONG volatile zthread_once_flag;
+#define ZTHREAD_ONCE_INIT (0)
+
+/* 0: not started, 1: func is running in another thread, 2: done */
+static void zthread_once(zthread_once_flag* once, void (*func)(void)) {
+    if (InterlockedCompareExchange(once, 1, 0) == 0)
+    {
+        (*func)();
+        InterlockedExchange(once, 2);
+    }
+    else
+        while (InterlockedCompareExchange(once, 2, 2) != 2)
+            Sleep(0);
+}
+
+static int zthread_cpu_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0) ? (int)info.dwNumberOfProcessors : 1;
+}
+
+typedef struct {
+    zthread_func func;
+    void* arg;
+} zthread_start_s;
+
+static DWORD WINAPI zthread_start(LPVOID param) {
+    zthread_start_s* start = (zthread_start_s*)param;
+    (*start->func)(start->arg);
+    return 0;
+}
+
+/*
+  Run func(arg) on threads threads (the calling thread being one of them),
+    and wait for all of them. If a thread can't be created, the work is done
+    by less threads, so func must share the work dynamically.
+*/
+static void zthread_run(int threads, zthread_func func, void* arg) {
+    HANDLE handles[ZTHREAD_MAX];
+    zthread_start_s start;
+    int created = 0;
+    int i;
+
+    start.func = func;
+    start.arg = arg;
+    if (threads > ZTHREAD_MAX)
+        threads = ZTHREAD_MAX;
+    for (i = 1; i < threads; i++)
+    {
+        handles[created] = CreateThread(NULL, 0, zthread_start, &start, 0, NULL);
+        if (handles[created] == NULL)
+            break;
+        created++;
+    }
+    (*func)(arg);
+    for (i = 0; i < created; i++)
+    {
+        WaitForSingleObject(handles[i], INFINITE);
+        CloseHandle(handles[i]);
+    }
+}
+
+#else
+
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_mutex_t zthread_mutex;
+
+static void zthread_mutex_init(zthread_mutex* m) { pthread_mutex_init(m, NULL); }
+static void zthread_mutex_destroy(zthread_mutex* m) { pthread_mutex_destroy(m); }
+static void zthread_mutex_lock(zthread_mutex* m) { pthread_mutex_lock(m); }
+static void zthread_mutex_unlock(zthread_mutex* m) { pthread_mutex_unlock(m); }
+
+typedef pthread_once_t zthread_once_flag;
+#define ZTHREAD_ONCE_INIT PTHREAD_ONCE_INIT
+
+static void zthread_once(zthread_once_flag* once, void (*func)(void)) {
+    pthread_once(once, func);
+}
+
+static int zthread_cpu_count(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count > 0)
+        return (count > ZTHREAD_MAX) ? ZTHREAD_MAX : (int)count;
+#endif
+    return 1;
+}
+
+typedef struct {
+    zthread_func func;
+    void* arg;
+} zthread_start_s;
+
+static void* zthread_start(void* param) {
+    zthread_start_s* start = (zthread_start_s*)param;
+    (*start->func)(start->arg);
+    return NULL;
+}
+
+/*
+  Run func(arg) on threads threads (the calling thread being one of them),
+    and wait for all of them. If a thread can't be created, the work is done
+    by less threads, so func must share the work dynamically.
+*/
+static void zthread_run(int threads, zthread_func func, void* arg) {
+    pthread_t handles[ZTHREAD_MAX];
+    zthread_start_s start;
+    int created = 0;
+    int i;
+
+    start.func = func;
+    start.arg = arg;
+    if (threads > ZTHREAD_MAX)
+        threads = ZTHREAD_MAX;
+    for (i = 1; i < threads; i++)
+    {
+        if (pthread_create(&handles[created], NULL, zthread_start, &start) != 0)
+            break;
+        created++;
+    }
+    (*func)(arg);
+    for (i = 0; i < created; i++)
+        pthread_join(handles[i], NULL);
+}
+
+#endif
+
+#endif